@@ -113,6 +113,15 @@ struct apr_client_data {
 
 typedef int32_t (*apr_fn)(struct apr_client_data *data, void *priv);
 
+/* transmit statistics, updated by apr_tal under the channel write lock */
+struct apr_tx_stats {
+	uint32_t sent;		/* packets written to the channel */
+	uint32_t queued;	/* packets that waited for FIFO space */
+	uint32_t dropped;	/* packets refused or lost from the queue */
+	uint64_t total_us;	/* apr_send_pkt to SMD write, summed */
+	uint32_t max_us;
+};
+
 struct apr_svc {
 	uint16_t id;
 	uint16_t dest_id;
@@ -126,7 +135,7 @@ struct apr_svc {
 	apr_fn fn;
 	void *priv;
 	struct mutex m_lock;
-	spinlock_t w_lock;
+	struct apr_tx_stats tx_stats;
 };
 
 struct apr_client {
@@ -16,6 +16,9 @@
 #include <linux/kernel.h>
 #include <linux/kthread.h>
 #include <linux/uaccess.h>
+#include <linux/list.h>
+#include <linux/ktime.h>
+#include <linux/workqueue.h>
 
 /* APR Client IDs */
 #define APR_CLIENT_AUDIO	0x0
@@ -33,10 +36,30 @@
 
 #define APR_OPEN_TIMEOUT_MS 5000
 
+/* packets allowed to wait for SMD FIFO space per channel */
+#define APR_TX_QUEUE_MAX 64
+
+/* sleep between retries of a full FIFO, doubling from min to max */
+#define APR_TX_RETRY_MIN_US 50
+#define APR_TX_RETRY_MAX_US 10000
+/* retrying this long gets reported once */
+#define APR_TX_STALL_US 1000000
+
+struct apr_tx_stats;
+
+struct apr_tx_pkt {
+	struct list_head list;
+	struct apr_tx_stats *stats;
+	ktime_t queued;
+	int len;
+	char data[0];
+};
+
 typedef void (*apr_svc_cb_fn)(void *buf, int len, void *priv);
 struct apr_svc_ch_dev *apr_tal_open(uint32_t svc, uint32_t dest,
 			uint32_t dl, apr_svc_cb_fn func, void *priv);
-int apr_tal_write(struct apr_svc_ch_dev *apr_ch, void *data, int len);
+int apr_tal_write(struct apr_svc_ch_dev *apr_ch, void *data, int len,
+			struct apr_tx_stats *stats);
 int apr_tal_close(struct apr_svc_ch_dev *apr_ch);
 struct apr_svc_ch_dev {
 	struct smd_channel *ch;
@@ -50,6 +73,11 @@ struct apr_svc_ch_dev {
 	uint32_t           smd_state;
 	wait_queue_head_t  dest;
 	uint32_t           dest_state;
+	/* packets waiting for FIFO space, protected by w_lock */
+	struct list_head   tx_q;
+	uint32_t           tx_depth;
+	uint32_t           tx_max_depth;
+	struct work_struct tx_work;
 };
 
 #endif
@@ -229,6 +229,7 @@ enum sps_timer_op {
 /*   SPS_TIMER_OP_START,   Not supported by hardware yet */
 /*   SPS_TIMER_OP_STOP,    Not supported by hardware yet */
 	SPS_TIMER_OP_READ,
+	SPS_TIMER_OP_MODERATE,	/* Descriptor interrupt moderation */
 };
 
 /*
@@ -638,6 +639,7 @@ struct sps_transfer {
  *
  * @op - Timer control operation.
  * @timeout_msec - Inactivity timeout (msec).
+ * @desc_count - Descriptors per interrupt for SPS_TIMER_OP_MODERATE.
  *
  */
 struct sps_timer_ctrl {
@@ -649,6 +651,15 @@ struct sps_timer_ctrl {
 	 */
 	enum sps_timer_mode mode;
 	u32 timeout_msec;
+
+	/**
+	 * The following parameter must be set when the timer control
+	 * operation is SPS_TIMER_OP_MODERATE. Only every desc_count'th
+	 * descriptor submitted to the pipe requests an interrupt; the
+	 * inactivity timer (timeout_msec) retires the remaining ones.
+	 * A desc_count of 0 or 1 disables moderation.
+	 */
+	u32 desc_count;
 };
 
 /**
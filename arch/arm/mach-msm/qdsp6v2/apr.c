@@ -27,6 +27,7 @@
 #include <linux/sysfs.h>
 #include <linux/device.h>
 #include <linux/slab.h>
+#include <linux/seq_file.h>
 #include <asm/mach-types.h>
 #include <mach/peripheral-loader.h>
 #include <mach/msm_smd.h>
@@ -59,8 +60,7 @@ int apr_send_pkt(void *handle, uint32_t *buf)
 	struct apr_hdr *hdr;
 	uint16_t dest_id;
 	uint16_t client_id;
-	uint16_t w_len;
-	unsigned long flags;
+	int w_len;
 
 	if (!handle || !buf) {
 		pr_err("APR: Wrong parameters\n");
@@ -82,14 +82,12 @@ int apr_send_pkt(void *handle, uint32_t *buf)
 	}
 
 
-	spin_lock_irqsave(&svc->w_lock, flags);
 	dest_id = svc->dest_id;
 	client_id = svc->client_id;
 	clnt = &client[dest_id][client_id];
 
 	if (!client[dest_id][client_id].handle) {
 		pr_err("APR: Still service is not yet opened\n");
-		spin_unlock_irqrestore(&svc->w_lock, flags);
 		return -EINVAL;
 	}
 	hdr = (struct apr_hdr *)buf;
@@ -103,10 +101,11 @@ int apr_send_pkt(void *handle, uint32_t *buf)
 
 	hdr->dest_svc = svc->id;
 
-	w_len = apr_tal_write(clnt->handle, buf, hdr->pkt_size);
+	/* apr_tal serializes writers and queues when the FIFO is full */
+	w_len = apr_tal_write(clnt->handle, buf, hdr->pkt_size,
+				&svc->tx_stats);
 	if (w_len != hdr->pkt_size)
 		pr_err("Unable to write APR pkt successfully: %d\n", w_len);
-	spin_unlock_irqrestore(&svc->w_lock, flags);
 
 	return w_len;
 }
@@ -651,6 +650,51 @@ static struct notifier_block lnb = {
 	.notifier_call = lpass_notifier_cb,
 };
 
+static int apr_stats_show(struct seq_file *m, void *unused)
+{
+	struct apr_svc_ch_dev *ch;
+	struct apr_tx_stats *st;
+	unsigned long flags;
+	uint64_t avg;
+	int i, j, k;
+
+	for (i = 0; i < APR_DEST_MAX; i++)
+		for (j = 0; j < APR_CLIENT_MAX; j++) {
+			ch = client[i][j].handle;
+			if (!ch)
+				continue;
+			spin_lock_irqsave(&ch->w_lock, flags);
+			seq_printf(m, "dest %d client %d: depth %u max_depth %u\n",
+				i, j, ch->tx_depth, ch->tx_max_depth);
+			for (k = 0; k < APR_SVC_MAX; k++) {
+				st = &client[i][j].svc[k].tx_stats;
+				if (!st->sent && !st->dropped)
+					continue;
+				avg = st->total_us;
+				if (st->sent)
+					do_div(avg, st->sent);
+				seq_printf(m,
+					"  svc 0x%x: sent %u queued %u dropped %u avg_us %llu max_us %u\n",
+					client[i][j].svc[k].id, st->sent,
+					st->queued, st->dropped, avg,
+					st->max_us);
+			}
+			spin_unlock_irqrestore(&ch->w_lock, flags);
+		}
+	return 0;
+}
+
+static int apr_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, apr_stats_show, NULL);
+}
+
+static const struct file_operations apr_stats_fops = {
+	.open = apr_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
 
 static int __init apr_init(void)
 {
@@ -661,7 +705,6 @@ static int __init apr_init(void)
 			mutex_init(&client[i][j].m_lock);
 			for (k = 0; k < APR_SVC_MAX; k++) {
 				mutex_init(&client[i][j].svc[k].m_lock);
-				spin_lock_init(&client[i][j].svc[k].w_lock);
 			}
 		}
 	mutex_init(&q6.lock);
@@ -670,6 +713,7 @@ static int __init apr_init(void)
 		create_singlethread_workqueue("apr_driver");
 	if (!apr_reset_workqueue)
 		return -ENOMEM;
+	debugfs_create_file("apr_stats", S_IRUGO, NULL, NULL, &apr_stats_fops);
 	return 0;
 }
 device_initcall(apr_init);
@@ -25,7 +25,9 @@
 #include <linux/platform_device.h>
 #include <linux/delay.h>
 #include <linux/clk.h>
+#include <linux/slab.h>
 #include <mach/msm_smd.h>
+#include <mach/qdsp6v2/apr.h>
 #include <mach/qdsp6v2/apr_tal.h>
 
 static char *svc_names[APR_DEST_MAX][APR_CLIENT_MAX] = {
@@ -41,20 +43,19 @@ static char *svc_names[APR_DEST_MAX][APR_CLIENT_MAX] = {
 
 struct apr_svc_ch_dev apr_svc_ch[APR_DL_MAX][APR_DEST_MAX][APR_CLIENT_MAX];
 
-int __apr_tal_write(struct apr_svc_ch_dev *apr_ch, void *data, int len)
+static struct workqueue_struct *apr_tal_wq;
+
+/* w_lock held */
+static int __apr_tal_write(struct apr_svc_ch_dev *apr_ch, void *data, int len)
 {
 	int w_len;
-	unsigned long flags;
-
 
-	spin_lock_irqsave(&apr_ch->w_lock, flags);
-	if (smd_write_avail(apr_ch->ch) < len) {
-		spin_unlock_irqrestore(&apr_ch->w_lock, flags);
+	if (!apr_ch->ch)
+		return -EINVAL;
+	if (smd_write_avail(apr_ch->ch) < len)
 		return -EAGAIN;
-	}
 
 	w_len = smd_write(apr_ch->ch, data, len);
-	spin_unlock_irqrestore(&apr_ch->w_lock, flags);
 	pr_debug("apr_tal:w_len = %d\n", w_len);
 
 	if (w_len != len) {
@@ -64,23 +65,136 @@ int __apr_tal_write(struct apr_svc_ch_dev *apr_ch, void *data, int len)
 	return w_len;
 }
 
-int apr_tal_write(struct apr_svc_ch_dev *apr_ch, void *data, int len)
+/* w_lock held */
+static void apr_tal_tx_account(struct apr_tx_stats *stats, ktime_t start)
+{
+	s64 us;
+
+	if (!stats)
+		return;
+	us = ktime_us_delta(ktime_get(), start);
+	stats->sent++;
+	stats->total_us += us;
+	if (us > stats->max_us)
+		stats->max_us = us;
+}
+
+/* w_lock held */
+static void apr_tal_tx_drop(struct apr_svc_ch_dev *apr_ch,
+			struct apr_tx_pkt *pkt)
 {
-	int rc = 0, retries = 0;
+	if (pkt->stats)
+		pkt->stats->dropped++;
+	list_del(&pkt->list);
+	apr_ch->tx_depth--;
+	kfree(pkt);
+}
+
+/*
+ * Drain packets that found the FIFO full. Runs in process context so
+ * waiting for the DSP to make room sleeps instead of spinning with
+ * interrupts off, and the whole backlog goes out under one pass.
+ * A full FIFO is retried with growing sleeps for as long as the
+ * channel is open; apr_tal_close() takes ch away to stop it.
+ */
+static void apr_tal_tx_work(struct work_struct *work)
+{
+	struct apr_svc_ch_dev *apr_ch = container_of(work,
+					struct apr_svc_ch_dev, tx_work);
+	struct apr_tx_pkt *pkt;
+	unsigned long flags;
+	unsigned int delay_us = APR_TX_RETRY_MIN_US;
+	unsigned int waited_us = 0;
+	int rc;
+
+	spin_lock_irqsave(&apr_ch->w_lock, flags);
+	while (!list_empty(&apr_ch->tx_q) && apr_ch->ch) {
+		pkt = list_first_entry(&apr_ch->tx_q, struct apr_tx_pkt, list);
+		rc = __apr_tal_write(apr_ch, pkt->data, pkt->len);
+		if (rc == -EAGAIN) {
+			spin_unlock_irqrestore(&apr_ch->w_lock, flags);
+			if (waited_us < APR_TX_STALL_US &&
+			    waited_us + delay_us >= APR_TX_STALL_US)
+				pr_err("apr_tal: write stalled, FIFO full\n");
+			waited_us += delay_us;
+			usleep_range(delay_us, 2 * delay_us);
+			delay_us = min_t(unsigned int, 2 * delay_us,
+					 APR_TX_RETRY_MAX_US);
+			spin_lock_irqsave(&apr_ch->w_lock, flags);
+			continue;
+		}
+		delay_us = APR_TX_RETRY_MIN_US;
+		waited_us = 0;
+		if (rc != pkt->len) {
+			pr_err("apr_tal: queued write failed %d, packet dropped\n",
+				rc);
+			apr_tal_tx_drop(apr_ch, pkt);
+			continue;
+		}
+		apr_tal_tx_account(pkt->stats, pkt->queued);
+		list_del(&pkt->list);
+		apr_ch->tx_depth--;
+		kfree(pkt);
+	}
+	spin_unlock_irqrestore(&apr_ch->w_lock, flags);
+}
+
+/*
+ * Write straight into the SMD FIFO when it has room and nothing is
+ * queued ahead; otherwise copy the packet to the channel's transmit
+ * queue and let apr_tal_tx_work send it. Never busy-waits, so it is
+ * safe from the APR receive callback and other atomic contexts.
+ */
+int apr_tal_write(struct apr_svc_ch_dev *apr_ch, void *data, int len,
+			struct apr_tx_stats *stats)
+{
+	struct apr_tx_pkt *pkt;
+	unsigned long flags;
+	ktime_t start = ktime_get();
+	int rc;
 
 	if (!apr_ch->ch)
 		return -EINVAL;
 
-	do {
-		if (rc == -EAGAIN)
-			udelay(50);
-
+	spin_lock_irqsave(&apr_ch->w_lock, flags);
+	if (list_empty(&apr_ch->tx_q)) {
 		rc = __apr_tal_write(apr_ch, data, len);
-	} while (rc == -EAGAIN && retries++ < 300);
+		if (rc != -EAGAIN) {
+			if (rc == len)
+				apr_tal_tx_account(stats, start);
+			spin_unlock_irqrestore(&apr_ch->w_lock, flags);
+			return rc;
+		}
+	}
+
+	if (apr_ch->tx_depth >= APR_TX_QUEUE_MAX) {
+		rc = -EAGAIN;
+		goto drop;
+	}
+	pkt = kmalloc(sizeof(*pkt) + len, GFP_ATOMIC);
+	if (!pkt) {
+		rc = -ENOMEM;
+		goto drop;
+	}
+	memcpy(pkt->data, data, len);
+	pkt->len = len;
+	pkt->stats = stats;
+	pkt->queued = start;
+	list_add_tail(&pkt->list, &apr_ch->tx_q);
+	if (++apr_ch->tx_depth > apr_ch->tx_max_depth)
+		apr_ch->tx_max_depth = apr_ch->tx_depth;
+	if (stats)
+		stats->queued++;
+	spin_unlock_irqrestore(&apr_ch->w_lock, flags);
 
-	if (rc == -EAGAIN)
-		pr_err("apr_tal: TIMEOUT for write\n");
+	queue_work(apr_tal_wq, &apr_ch->tx_work);
+	return len;
 
+drop:
+	if (stats)
+		stats->dropped++;
+	spin_unlock_irqrestore(&apr_ch->w_lock, flags);
+	pr_err("apr_tal: tx queue full, packet dropped\n");
 	return rc;
 }
 
@@ -128,8 +242,11 @@ check_pending:
 			apr_ch->func(apr_ch->data, r_len, apr_ch->priv);
 		goto check_pending;
 check_write_avail:
-		if (smd_write_avail(apr_ch->ch))
+		if (smd_write_avail(apr_ch->ch)) {
 			wake_up(&apr_ch->wait);
+			if (!list_empty(&apr_ch->tx_q))
+				queue_work(apr_tal_wq, &apr_ch->tx_work);
+		}
 		spin_unlock_irqrestore(&apr_ch->lock, flags);
 		break;
 	case SMD_EVENT_OPEN:
@@ -207,14 +324,29 @@ struct apr_svc_ch_dev *apr_tal_open(uint32_t svc, uint32_t dest,
 
 int apr_tal_close(struct apr_svc_ch_dev *apr_ch)
 {
+	struct apr_tx_pkt *pkt, *tmp;
+	smd_channel_t *ch;
+	unsigned long flags;
 	int r;
 
 	if (!apr_ch->ch)
 		return -EINVAL;
 
 	mutex_lock(&apr_ch->m_lock);
-	r = smd_close(apr_ch->ch);
+	/* stops apr_tal_tx_work() retrying a full FIFO */
+	spin_lock_irqsave(&apr_ch->w_lock, flags);
+	ch = apr_ch->ch;
 	apr_ch->ch = NULL;
+	spin_unlock_irqrestore(&apr_ch->w_lock, flags);
+	cancel_work_sync(&apr_ch->tx_work);
+	spin_lock_irqsave(&apr_ch->w_lock, flags);
+	if (!list_empty(&apr_ch->tx_q))
+		pr_err("apr_tal: close drops %u queued packets\n",
+			apr_ch->tx_depth);
+	list_for_each_entry_safe(pkt, tmp, &apr_ch->tx_q, list)
+		apr_tal_tx_drop(apr_ch, pkt);
+	spin_unlock_irqrestore(&apr_ch->w_lock, flags);
+	r = smd_close(ch);
 	apr_ch->func = NULL;
 	apr_ch->priv = NULL;
 	mutex_unlock(&apr_ch->m_lock);
@@ -264,6 +396,10 @@ static int __init apr_tal_init(void)
 {
 	int i, j, k;
 
+	apr_tal_wq = alloc_workqueue("apr_tal_tx", WQ_HIGHPRI, 0);
+	if (!apr_tal_wq)
+		return -ENOMEM;
+
 	for (i = 0; i < APR_DL_MAX; i++)
 		for (j = 0; j < APR_DEST_MAX; j++)
 			for (k = 0; k < APR_CLIENT_MAX; k++) {
@@ -272,6 +408,9 @@ static int __init apr_tal_init(void)
 				spin_lock_init(&apr_svc_ch[i][j][k].lock);
 				spin_lock_init(&apr_svc_ch[i][j][k].w_lock);
 				mutex_init(&apr_svc_ch[i][j][k].m_lock);
+				INIT_LIST_HEAD(&apr_svc_ch[i][j][k].tx_q);
+				INIT_WORK(&apr_svc_ch[i][j][k].tx_work,
+					apr_tal_tx_work);
 			}
 	platform_driver_register(&apr_q6_driver);
 	platform_driver_register(&apr_modem_driver);
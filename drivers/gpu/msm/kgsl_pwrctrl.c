@@ -18,6 +18,7 @@
 #include <mach/msm_iomap.h>
 #include <mach/msm_bus.h>
 #include <linux/ktime.h>
+#include <linux/msm_thermal.h>
 
 #include "kgsl.h"
 #include "kgsl_pwrscale.h"
@@ -173,47 +174,85 @@ void kgsl_pwrctrl_pwrlevel_change(struct kgsl_device *device,
 
 EXPORT_SYMBOL(kgsl_pwrctrl_pwrlevel_change);
 
+/*
+ * The thermal level in force is the lower clock of the one user space
+ * asked for and the one the msm_thermal power budget allows, so that
+ * neither lifts the other's limit. Called with device->mutex held.
+ */
+static void kgsl_pwrctrl_apply_thermal_pwrlevel(struct kgsl_device *device)
+{
+	struct kgsl_pwrctrl *pwr = &device->pwrctrl;
+
+	pwr->thermal_pwrlevel = max(pwr->user_thermal_pwrlevel,
+				    pwr->budget_pwrlevel);
+
+	/*
+	 * If there is no power policy set the clock to the requested thermal
+	 * level - if thermal now happens to be higher than max, then that will
+	 * be limited by the pwrlevel change function.  Otherwise if there is
+	 * a policy only change the active clock if it is higher then the new
+	 * thermal level
+	 */
+
+	if (device->pwrscale.policy == NULL ||
+		pwr->thermal_pwrlevel > pwr->active_pwrlevel)
+		kgsl_pwrctrl_pwrlevel_change(device, pwr->thermal_pwrlevel);
+}
+
+static void kgsl_pwrctrl_set_thermal_pwrlevel(struct kgsl_device *device,
+					unsigned int level)
+{
+	struct kgsl_pwrctrl *pwr = &device->pwrctrl;
+
+	mutex_lock(&device->mutex);
+
+	if (level > pwr->num_pwrlevels - 2)
+		level = pwr->num_pwrlevels - 2;
+
+	pwr->user_thermal_pwrlevel = level;
+	kgsl_pwrctrl_apply_thermal_pwrlevel(device);
+
+	mutex_unlock(&device->mutex);
+}
+
 static int kgsl_pwrctrl_thermal_pwrlevel_store(struct device *dev,
 					 struct device_attribute *attr,
 					 const char *buf, size_t count)
 {
 	struct kgsl_device *device = kgsl_device_from_dev(dev);
-	struct kgsl_pwrctrl *pwr;
 	int ret;
 	unsigned int level = 0;
 
 	if (device == NULL)
 		return 0;
 
-	pwr = &device->pwrctrl;
-
 	ret = kgsl_sysfs_store(buf, &level);
 
 	if (ret)
 		return ret;
 
-	mutex_lock(&device->mutex);
+	kgsl_pwrctrl_set_thermal_pwrlevel(device, level);
 
-	if (level > pwr->num_pwrlevels - 2)
-		level = pwr->num_pwrlevels - 2;
-
-	pwr->thermal_pwrlevel = level;
+	return count;
+}
 
-	/*
-	 * If there is no power policy set the clock to the requested thermal
-	 * level - if thermal now happens to be higher than max, then that will
-	 * be limited by the pwrlevel change function.  Otherwise if there is
-	 * a policy only change the active clock if it is higher then the new
-	 * thermal level
-	 */
+/*
+ * Called by msm_thermal with the share of full GPU performance the
+ * current power budget allows; spread it over the usable power levels.
+ * A full budget lifts only this limit, not the one set from user space.
+ */
+static void kgsl_pwrctrl_thermal_limit(unsigned int pct, void *data)
+{
+	struct kgsl_device *device = data;
+	struct kgsl_pwrctrl *pwr = &device->pwrctrl;
 
-	if (device->pwrscale.policy == NULL ||
-		pwr->thermal_pwrlevel > pwr->active_pwrlevel)
-		kgsl_pwrctrl_pwrlevel_change(device, pwr->thermal_pwrlevel);
+	if (pct > 100)
+		pct = 100;
 
+	mutex_lock(&device->mutex);
+	pwr->budget_pwrlevel = (100 - pct) * (pwr->num_pwrlevels - 2) / 100;
+	kgsl_pwrctrl_apply_thermal_pwrlevel(device);
 	mutex_unlock(&device->mutex);
-
-	return count;
 }
 
 static int kgsl_pwrctrl_thermal_pwrlevel_show(struct device *dev,
@@ -388,7 +427,8 @@ static int kgsl_pwrctrl_max_gpuclk_store(struct device *dev,
 	if (level < 0)
 		goto done;
 
-	pwr->thermal_pwrlevel = level;
+	pwr->user_thermal_pwrlevel = level;
+	pwr->thermal_pwrlevel = max(level, pwr->budget_pwrlevel);
 
 	/*
 	 * if the thermal limit is lower than the current setting,
@@ -901,6 +941,8 @@ int kgsl_pwrctrl_init(struct kgsl_device *device)
 	pwr->max_pwrlevel = 0;
 	pwr->min_pwrlevel = pdata->num_levels - 2;
 	pwr->thermal_pwrlevel = 0;
+	pwr->user_thermal_pwrlevel = 0;
+	pwr->budget_pwrlevel = 0;
 
 	pwr->active_pwrlevel = pdata->init_level;
 	pwr->default_pwrlevel = pdata->init_level;
@@ -960,6 +1002,9 @@ int kgsl_pwrctrl_init(struct kgsl_device *device)
 
 	pm_runtime_enable(device->parentdev);
 	register_early_suspend(&device->display_off);
+	if (device->id == KGSL_DEVICE_3D0)
+		msm_thermal_register_gpu_limit(kgsl_pwrctrl_thermal_limit,
+					device);
 	return result;
 
 clk_err:
@@ -978,6 +1023,9 @@ void kgsl_pwrctrl_close(struct kgsl_device *device)
 
 	KGSL_PWR_INFO(device, "close device %d\n", device->id);
 
+	if (device->id == KGSL_DEVICE_3D0)
+		msm_thermal_unregister_gpu_limit(device);
+
 	pm_runtime_disable(device->parentdev);
 	unregister_early_suspend(&device->display_off);
 
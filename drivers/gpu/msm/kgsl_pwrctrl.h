@@ -45,6 +45,8 @@ struct kgsl_pwrctrl {
 	struct kgsl_pwrlevel pwrlevels[KGSL_MAX_PWRLEVELS];
 	unsigned int active_pwrlevel;
 	int thermal_pwrlevel;
+	int user_thermal_pwrlevel;
+	int budget_pwrlevel;
 	unsigned int default_pwrlevel;
 	unsigned int num_pwrlevels;
 	unsigned int interval_timeout;
@@ -20,6 +20,10 @@
 #include <linux/backing-dev.h>
 #include <linux/atomic.h>
 #include <linux/scatterlist.h>
+#include <linux/kthread.h>
+#include <linux/rbtree.h>
+#include <linux/ktime.h>
+#include <linux/cpumask.h>
 #include <asm/page.h>
 #include <asm/unaligned.h>
 #include <crypto/hash.h>
@@ -30,6 +34,17 @@
 
 #define DM_MSG_PREFIX "crypt"
 
+#define DM_CRYPT_DEFAULT_SPLIT_KB	64
+#define DM_CRYPT_DEFAULT_HW_MIN_KB	64
+
+static unsigned dm_crypt_split_kb = DM_CRYPT_DEFAULT_SPLIT_KB;
+static unsigned dm_crypt_hw_min_kb = DM_CRYPT_DEFAULT_HW_MIN_KB;
+
+module_param_named(split_kb, dm_crypt_split_kb, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(split_kb, "Spread bios of at least twice this size over the cpus, 0 to disable");
+module_param_named(hw_min_kb, dm_crypt_hw_min_kb, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(hw_min_kb, "Smallest bio handed to the crypto engine on hw_offload targets");
+
 /*
  * context holding the current state of a multi-part conversion
  */
@@ -42,6 +57,7 @@ struct convert_context {
 	unsigned int idx_in;
 	unsigned int idx_out;
 	sector_t sector;
+	sector_t sector_end;
 	atomic_t cc_pending;
 	struct ablkcipher_request *req;
 };
@@ -60,6 +76,14 @@ struct dm_crypt_io {
 	int error;
 	sector_t sector;
 	struct dm_crypt_io *base_io;
+
+	/* byte range of base_bio handled by this io */
+	unsigned int offset;
+	unsigned int size;
+
+	int hw;
+	ktime_t crypt_start;
+	struct rb_node rb_node;
 };
 
 struct dm_crypt_request {
@@ -102,7 +126,18 @@ struct iv_lmk_private {
  * Crypt: maps a linear range of a block device
  * and encrypts / decrypts at the same time.
  */
-enum flags { DM_CRYPT_SUSPENDED, DM_CRYPT_KEY_VALID };
+enum flags { DM_CRYPT_SUSPENDED, DM_CRYPT_KEY_VALID, DM_CRYPT_HW_OFFLOAD };
+
+/*
+ * Per path (cpu, hw) conversion counters, reported by "dmsetup status".
+ * usecs is the sum of the time spent converting each io, so bytes/usecs
+ * is the throughput of a single worker on that path.
+ */
+struct crypt_path_stats {
+	atomic64_t requests;
+	atomic64_t bytes;
+	atomic64_t usecs;
+};
 
 /*
  * The fields in here must be read only after initialization,
@@ -122,6 +157,14 @@ struct crypt_config {
 
 	struct workqueue_struct *io_queue;
 	struct workqueue_struct *crypt_queue;
+	atomic_t cpu_rotor;
+
+	/* encrypted writes are submitted in sector order from here */
+	struct task_struct *write_thread;
+	wait_queue_head_t write_thread_wait;
+	struct rb_root write_tree;
+
+	struct crypt_path_stats stats[2];
 
 	char *cipher;
 	char *cipher_string;
@@ -138,6 +181,8 @@ struct crypt_config {
 	/* ESSIV: struct crypto_cipher *essiv_tfm */
 	void *iv_private;
 	struct crypto_ablkcipher **tfms;
+	/* async engine used for large bios when hw_offload is set */
+	struct crypto_ablkcipher **hw_tfms;
 	unsigned tfms_count;
 
 	/*
@@ -641,6 +686,34 @@ static void crypt_convert_init(struct crypt_config *cc,
 	init_completion(&ctx->restart);
 }
 
+/*
+ * Restrict a context to bytes [offset, offset + size) of bio_in.
+ * An in-place context moves its output position along with the input.
+ */
+static void crypt_convert_range(struct convert_context *ctx,
+				unsigned int offset, unsigned int size)
+{
+	struct bio_vec *bv;
+
+	ctx->sector_end = ctx->sector + (size >> SECTOR_SHIFT);
+
+	while (offset) {
+		bv = bio_iovec_idx(ctx->bio_in, ctx->idx_in);
+		if (offset < bv->bv_len - ctx->offset_in) {
+			ctx->offset_in += offset;
+			break;
+		}
+		offset -= bv->bv_len - ctx->offset_in;
+		ctx->offset_in = 0;
+		ctx->idx_in++;
+	}
+
+	if (ctx->bio_out == ctx->bio_in) {
+		ctx->idx_out = ctx->idx_in;
+		ctx->offset_out = ctx->offset_in;
+	}
+}
+
 static struct dm_crypt_request *dmreq_of_req(struct crypt_config *cc,
 					     struct ablkcipher_request *req)
 {
@@ -721,12 +794,14 @@ static void kcryptd_async_done(struct crypto_async_request *async_req,
 static void crypt_alloc_req(struct crypt_config *cc,
 			    struct convert_context *ctx)
 {
+	struct dm_crypt_io *io = container_of(ctx, struct dm_crypt_io, ctx);
+	struct crypto_ablkcipher **tfms = io->hw ? cc->hw_tfms : cc->tfms;
 	unsigned key_index = ctx->sector & (cc->tfms_count - 1);
 
 	if (!ctx->req)
 		ctx->req = mempool_alloc(cc->req_pool, GFP_NOIO);
 
-	ablkcipher_request_set_tfm(ctx->req, cc->tfms[key_index]);
+	ablkcipher_request_set_tfm(ctx->req, tfms[key_index]);
 	ablkcipher_request_set_callback(ctx->req,
 	    CRYPTO_TFM_REQ_MAY_BACKLOG | CRYPTO_TFM_REQ_MAY_SLEEP,
 	    kcryptd_async_done, dmreq_of_req(cc, ctx->req));
@@ -743,7 +818,8 @@ static int crypt_convert(struct crypt_config *cc,
 	atomic_set(&ctx->cc_pending, 1);
 
 	while(ctx->idx_in < ctx->bio_in->bi_vcnt &&
-	      ctx->idx_out < ctx->bio_out->bi_vcnt) {
+	      ctx->idx_out < ctx->bio_out->bi_vcnt &&
+	      ctx->sector < ctx->sector_end) {
 
 		crypt_alloc_req(cc, ctx);
 
@@ -856,17 +932,23 @@ static void crypt_free_buffer_pages(struct crypt_config *cc, struct bio *clone)
 }
 
 static struct dm_crypt_io *crypt_io_alloc(struct dm_target *ti,
-					  struct bio *bio, sector_t sector)
+					  struct bio *bio, sector_t sector,
+					  gfp_t gfp_mask)
 {
 	struct crypt_config *cc = ti->private;
 	struct dm_crypt_io *io;
 
-	io = mempool_alloc(cc->io_pool, GFP_NOIO);
+	io = mempool_alloc(cc->io_pool, gfp_mask);
+	if (!io)
+		return NULL;
 	io->target = ti;
 	io->base_bio = bio;
 	io->sector = sector;
 	io->error = 0;
 	io->base_io = NULL;
+	io->offset = 0;
+	io->size = bio->bi_size;
+	io->hw = 0;
 	io->ctx.req = NULL;
 	atomic_set(&io->io_pending, 0);
 
@@ -914,14 +996,21 @@ static void crypt_dec_pending(struct dm_crypt_io *io)
  *
  * kcryptd performs the actual encryption or decryption.
  *
- * kcryptd_io performs the IO submission.
+ * kcryptd_io performs the read IO submission when it could not be
+ * done directly from crypt_map.
  *
  * They must be separated as otherwise the final stages could be
  * starved by new requests which can block in the first stages due
  * to memory allocation.
  *
  * The work is done per CPU global for all dm-crypt instances.
- * They should not depend on each other and do not block.
+ * They should not depend on each other and do not block. Reads and
+ * the pieces of split bios are spread over the online cpus, writes
+ * stay on the submitting cpu where the data is cache hot.
+ *
+ * dmcrypt_write submits encrypted write clones in sector order, so
+ * that writes finished out of order by different cpus still reach
+ * the device sequentially.
  */
 static void crypt_endio(struct bio *clone, int error)
 {
@@ -1001,13 +1090,10 @@ static void kcryptd_io(struct work_struct *work)
 {
 	struct dm_crypt_io *io = container_of(work, struct dm_crypt_io, work);
 
-	if (bio_data_dir(io->base_bio) == READ) {
-		crypt_inc_pending(io);
-		if (kcryptd_io_read(io, GFP_NOIO))
-			io->error = -ENOMEM;
-		crypt_dec_pending(io);
-	} else
-		kcryptd_io_write(io);
+	crypt_inc_pending(io);
+	if (kcryptd_io_read(io, GFP_NOIO))
+		io->error = -ENOMEM;
+	crypt_dec_pending(io);
 }
 
 static void kcryptd_queue_io(struct dm_crypt_io *io)
@@ -1018,10 +1104,70 @@ static void kcryptd_queue_io(struct dm_crypt_io *io)
 	queue_work(cc->io_queue, &io->work);
 }
 
-static void kcryptd_crypt_write_io_submit(struct dm_crypt_io *io, int async)
+#define crypt_io_from_node(node) rb_entry((node), struct dm_crypt_io, rb_node)
+
+static int dmcrypt_write(void *data)
+{
+	struct crypt_config *cc = data;
+	struct dm_crypt_io *io;
+	struct rb_root write_tree;
+	struct blk_plug plug;
+	DECLARE_WAITQUEUE(wait, current);
+
+	while (1) {
+		spin_lock_irq(&cc->write_thread_wait.lock);
+		while (RB_EMPTY_ROOT(&cc->write_tree)) {
+			__set_current_state(TASK_INTERRUPTIBLE);
+			__add_wait_queue(&cc->write_thread_wait, &wait);
+			spin_unlock_irq(&cc->write_thread_wait.lock);
+
+			if (unlikely(kthread_should_stop())) {
+				set_current_state(TASK_RUNNING);
+				remove_wait_queue(&cc->write_thread_wait, &wait);
+				return 0;
+			}
+
+			schedule();
+
+			set_current_state(TASK_RUNNING);
+			spin_lock_irq(&cc->write_thread_wait.lock);
+			__remove_wait_queue(&cc->write_thread_wait, &wait);
+		}
+
+		write_tree = cc->write_tree;
+		cc->write_tree = RB_ROOT;
+		spin_unlock_irq(&cc->write_thread_wait.lock);
+
+		/*
+		 * The io may be freed as soon as its clone is submitted,
+		 * so take it off the tree first rather than walk it.
+		 */
+		blk_start_plug(&plug);
+		do {
+			io = crypt_io_from_node(rb_first(&write_tree));
+			rb_erase(&io->rb_node, &write_tree);
+			kcryptd_io_write(io);
+		} while (!RB_EMPTY_ROOT(&write_tree));
+		blk_finish_plug(&plug);
+	}
+}
+
+static void crypt_account(struct dm_crypt_io *io, unsigned int bytes)
+{
+	struct crypt_config *cc = io->target->private;
+	struct crypt_path_stats *st = &cc->stats[io->hw];
+
+	atomic64_inc(&st->requests);
+	atomic64_add(bytes, &st->bytes);
+	atomic64_add(ktime_us_delta(ktime_get(), io->crypt_start), &st->usecs);
+}
+
+static void kcryptd_crypt_write_io_submit(struct dm_crypt_io *io)
 {
 	struct bio *clone = io->ctx.bio_out;
 	struct crypt_config *cc = io->target->private;
+	struct rb_node **rbp, *parent;
+	unsigned long flags;
 
 	if (unlikely(io->error < 0)) {
 		crypt_free_buffer_pages(cc, clone);
@@ -1034,11 +1180,22 @@ static void kcryptd_crypt_write_io_submit(struct dm_crypt_io *io, int async)
 	BUG_ON(io->ctx.idx_out < clone->bi_vcnt);
 
 	clone->bi_sector = cc->start + io->sector;
-
-	if (async)
-		kcryptd_queue_io(io);
-	else
-		generic_make_request(clone);
+	crypt_account(io, clone->bi_size);
+
+	spin_lock_irqsave(&cc->write_thread_wait.lock, flags);
+	rbp = &cc->write_tree.rb_node;
+	parent = NULL;
+	while (*rbp) {
+		parent = *rbp;
+		if (io->sector < crypt_io_from_node(parent)->sector)
+			rbp = &parent->rb_left;
+		else
+			rbp = &parent->rb_right;
+	}
+	rb_link_node(&io->rb_node, parent, rbp);
+	rb_insert_color(&io->rb_node, &cc->write_tree);
+	wake_up_locked(&cc->write_thread_wait);
+	spin_unlock_irqrestore(&cc->write_thread_wait.lock, flags);
 }
 
 static void kcryptd_crypt_write_convert(struct dm_crypt_io *io)
@@ -1048,7 +1205,7 @@ static void kcryptd_crypt_write_convert(struct dm_crypt_io *io)
 	struct dm_crypt_io *new_io;
 	int crypt_finished;
 	unsigned out_of_pages = 0;
-	unsigned remaining = io->base_bio->bi_size;
+	unsigned remaining = io->size;
 	sector_t sector = io->sector;
 	int r;
 
@@ -1057,6 +1214,7 @@ static void kcryptd_crypt_write_convert(struct dm_crypt_io *io)
 	 */
 	crypt_inc_pending(io);
 	crypt_convert_init(cc, &io->ctx, NULL, io->base_bio, sector);
+	crypt_convert_range(&io->ctx, io->offset, io->size);
 
 	/*
 	 * The allocated buffers can be smaller than the whole bio,
@@ -1077,6 +1235,7 @@ static void kcryptd_crypt_write_convert(struct dm_crypt_io *io)
 
 		crypt_inc_pending(io);
 
+		io->crypt_start = ktime_get();
 		r = crypt_convert(cc, &io->ctx);
 		if (r < 0)
 			io->error = -EIO;
@@ -1084,7 +1243,7 @@ static void kcryptd_crypt_write_convert(struct dm_crypt_io *io)
 
 		/* Encryption was already finished, submit io now */
 		if (crypt_finished) {
-			kcryptd_crypt_write_io_submit(io, 0);
+			kcryptd_crypt_write_io_submit(io);
 
 			/*
 			 * If there was an error, do not try next fragments.
@@ -1092,8 +1251,6 @@ static void kcryptd_crypt_write_convert(struct dm_crypt_io *io)
 			 */
 			if (unlikely(r < 0))
 				break;
-
-			io->sector = sector;
 		}
 
 		/*
@@ -1105,16 +1262,19 @@ static void kcryptd_crypt_write_convert(struct dm_crypt_io *io)
 
 		/*
 		 * With async crypto it is unsafe to share the crypto context
-		 * between fragments, so switch to a new dm_crypt_io structure.
+		 * between fragments, and a submitted fragment belongs to the
+		 * write thread, so switch to a new dm_crypt_io structure.
 		 */
-		if (unlikely(!crypt_finished && remaining)) {
+		if (unlikely(remaining)) {
 			new_io = crypt_io_alloc(io->target, io->base_bio,
-						sector);
+						sector, GFP_NOIO);
+			new_io->hw = io->hw;
 			crypt_inc_pending(new_io);
 			crypt_convert_init(cc, &new_io->ctx, NULL,
 					   io->base_bio, sector);
 			new_io->ctx.idx_in = io->ctx.idx_in;
 			new_io->ctx.offset_in = io->ctx.offset_in;
+			new_io->ctx.sector_end = io->ctx.sector_end;
 
 			/*
 			 * Fragments after the first use the base_io
@@ -1137,6 +1297,8 @@ static void kcryptd_crypt_write_convert(struct dm_crypt_io *io)
 
 static void kcryptd_crypt_read_done(struct dm_crypt_io *io)
 {
+	if (likely(!io->error))
+		crypt_account(io, io->size);
 	crypt_dec_pending(io);
 }
 
@@ -1149,7 +1311,9 @@ static void kcryptd_crypt_read_convert(struct dm_crypt_io *io)
 
 	crypt_convert_init(cc, &io->ctx, io->base_bio, io->base_bio,
 			   io->sector);
+	crypt_convert_range(&io->ctx, io->offset, io->size);
 
+	io->crypt_start = ktime_get();
 	r = crypt_convert(cc, &io->ctx);
 
 	if (r < 0)
@@ -1188,25 +1352,108 @@ static void kcryptd_async_done(struct crypto_async_request *async_req,
 	if (bio_data_dir(io->base_bio) == READ)
 		kcryptd_crypt_read_done(io);
 	else
-		kcryptd_crypt_write_io_submit(io, 1);
+		kcryptd_crypt_write_io_submit(io);
+}
+
+/*
+ * Split a large bio into one piece per online cpu. Each piece is a
+ * dm_crypt_io covering a byte range of the base bio and completes
+ * through the base_io pending count, like the write fragments do.
+ *
+ * This runs in a kcryptd worker, and the pieces can only be freed by
+ * workers queued behind it, so it must not wait on the io pool: when
+ * a piece can not be had right away the rest is converted here.
+ */
+static int kcryptd_crypt_split(struct dm_crypt_io *io)
+{
+	unsigned split = ACCESS_ONCE(dm_crypt_split_kb) << 10;
+	unsigned n, chunk, offset, len;
+	struct dm_crypt_io *piece;
+	int read = bio_data_dir(io->base_bio) == READ;
+
+	if (io->hw || !split || io->size < 2 * split)
+		return 0;
+
+	n = min(num_online_cpus(), io->size / split);
+	chunk = ALIGN(DIV_ROUND_UP(io->size, n), PAGE_SIZE);
+	if (n < 2 || chunk >= io->size)
+		return 0;
+
+	/* hold io until every piece is queued */
+	crypt_inc_pending(io);
+
+	for (offset = 0; offset < io->size; offset += len) {
+		len = min(chunk, io->size - offset);
+		piece = crypt_io_alloc(io->target, io->base_bio,
+				       io->sector + (offset >> SECTOR_SHIFT),
+				       GFP_NOWAIT);
+		if (!piece) {
+			io->sector += offset >> SECTOR_SHIFT;
+			io->offset += offset;
+			io->size -= offset;
+			/* the read convert drops the completed clone's ref */
+			if (read) {
+				kcryptd_crypt_read_convert(io);
+				read = 0;
+			} else
+				kcryptd_crypt_write_convert(io);
+			break;
+		}
+		piece->base_io = io;
+		piece->offset = io->offset + offset;
+		piece->size = len;
+		crypt_inc_pending(io);
+		/*
+		 * A read piece stands in for the completed clone, whose
+		 * reference kcryptd_crypt_read_done() drops.
+		 */
+		if (read)
+			crypt_inc_pending(piece);
+		kcryptd_queue_crypt(piece);
+	}
+
+	/* reads also carry the reference of the completed clone */
+	if (read)
+		crypt_dec_pending(io);
+	crypt_dec_pending(io);
+
+	return 1;
 }
 
 static void kcryptd_crypt(struct work_struct *work)
 {
 	struct dm_crypt_io *io = container_of(work, struct dm_crypt_io, work);
 
+	if (!io->base_io && kcryptd_crypt_split(io))
+		return;
+
 	if (bio_data_dir(io->base_bio) == READ)
 		kcryptd_crypt_read_convert(io);
 	else
 		kcryptd_crypt_write_convert(io);
 }
 
+static int crypt_next_cpu(struct crypt_config *cc)
+{
+	unsigned n = atomic_inc_return(&cc->cpu_rotor) % num_online_cpus();
+	int cpu;
+
+	for_each_online_cpu(cpu)
+		if (!n--)
+			return cpu;
+
+	return raw_smp_processor_id();
+}
+
 static void kcryptd_queue_crypt(struct dm_crypt_io *io)
 {
 	struct crypt_config *cc = io->target->private;
 
 	INIT_WORK(&io->work, kcryptd_crypt);
-	queue_work(cc->crypt_queue, &io->work);
+	if (bio_data_dir(io->base_bio) == READ || io->base_io)
+		queue_work_on(crypt_next_cpu(cc), cc->crypt_queue, &io->work);
+	else
+		queue_work(cc->crypt_queue, &io->work);
 }
 
 /*
@@ -1254,6 +1501,14 @@ static void crypt_free_tfms(struct crypt_config *cc)
 {
 	unsigned i;
 
+	if (cc->hw_tfms) {
+		for (i = 0; i < cc->tfms_count; i++)
+			if (cc->hw_tfms[i] && !IS_ERR(cc->hw_tfms[i]))
+				crypto_free_ablkcipher(cc->hw_tfms[i]);
+		kfree(cc->hw_tfms);
+		cc->hw_tfms = NULL;
+	}
+
 	if (!cc->tfms)
 		return;
 
@@ -1264,23 +1519,58 @@ static void crypt_free_tfms(struct crypt_config *cc)
 		}
 }
 
+/*
+ * With hw_offload the cpu path must not pick up the (async) engine,
+ * which has a higher priority than the software ciphers, and the
+ * engine set must be async.
+ */
 static int crypt_alloc_tfms(struct crypt_config *cc, char *ciphermode)
 {
+	int hw = test_bit(DM_CRYPT_HW_OFFLOAD, &cc->flags);
 	unsigned i;
 	int err;
 
-	cc->tfms = kmalloc(cc->tfms_count * sizeof(struct crypto_ablkcipher *),
+	cc->tfms = kzalloc(cc->tfms_count * sizeof(struct crypto_ablkcipher *),
 			   GFP_KERNEL);
 	if (!cc->tfms)
 		return -ENOMEM;
 
+	if (hw) {
+		cc->hw_tfms = kzalloc(cc->tfms_count *
+				      sizeof(struct crypto_ablkcipher *),
+				      GFP_KERNEL);
+		if (!cc->hw_tfms) {
+			crypt_free_tfms(cc);
+			return -ENOMEM;
+		}
+	}
+
 	for (i = 0; i < cc->tfms_count; i++) {
-		cc->tfms[i] = crypto_alloc_ablkcipher(ciphermode, 0, 0);
+		cc->tfms[i] = crypto_alloc_ablkcipher(ciphermode, 0,
+					hw ? CRYPTO_ALG_ASYNC : 0);
 		if (IS_ERR(cc->tfms[i])) {
 			err = PTR_ERR(cc->tfms[i]);
 			crypt_free_tfms(cc);
 			return err;
 		}
+
+		if (!hw)
+			continue;
+
+		cc->hw_tfms[i] = crypto_alloc_ablkcipher(ciphermode,
+					CRYPTO_ALG_ASYNC, CRYPTO_ALG_ASYNC);
+		if (IS_ERR(cc->hw_tfms[i])) {
+			err = PTR_ERR(cc->hw_tfms[i]);
+			crypt_free_tfms(cc);
+			return err;
+		}
+
+		/* requests are laid out with the cpu cipher's alignment */
+		if (crypto_ablkcipher_alignmask(cc->hw_tfms[i]) >
+		    crypto_ablkcipher_alignmask(cc->tfms[i])) {
+			crypt_free_tfms(cc);
+			return -EINVAL;
+		}
 	}
 
 	return 0;
@@ -1297,6 +1587,15 @@ static int crypt_setkey_allcpus(struct crypt_config *cc)
 					     subkey_size);
 		if (r)
 			err = r;
+
+		if (!cc->hw_tfms)
+			continue;
+
+		r = crypto_ablkcipher_setkey(cc->hw_tfms[i],
+					     cc->key + (i * subkey_size),
+					     subkey_size);
+		if (r)
+			err = r;
 	}
 
 	return err;
@@ -1346,6 +1645,9 @@ static void crypt_dtr(struct dm_target *ti)
 	if (!cc)
 		return;
 
+	if (cc->write_thread)
+		kthread_stop(cc->write_thread);
+
 	if (cc->io_queue)
 		destroy_workqueue(cc->io_queue);
 	if (cc->crypt_queue)
@@ -1530,12 +1832,17 @@ bad_mem:
 
 /*
  * Construct an encryption mapping:
- * <cipher> <key> <iv_offset> <dev_path> <start>
+ * <cipher> <key> <iv_offset> <dev_path> <start> [<#opt_params> <opt_params>]
+ *
+ * Optional parameters:
+ *   allow_discards: pass discards down to the device
+ *   hw_offload: bios of at least hw_min_kb go to the async crypto
+ *		 engine, smaller ones stay on the cpu ciphers
  */
 static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 {
 	struct crypt_config *cc;
-	unsigned int key_size, opt_params;
+	unsigned int key_size, opt_params, reqsize;
 	unsigned long long tmpll;
 	int ret;
 	size_t iv_size_padding;
@@ -1544,7 +1851,7 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 	char dummy;
 
 	static struct dm_arg _args[] = {
-		{0, 1, "Invalid number of feature args"},
+		{0, 2, "Invalid number of feature args"},
 	};
 
 	if (argc < 5) {
@@ -1562,6 +1869,36 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 	cc->key_size = key_size;
 
 	ti->private = cc;
+
+	/* Optional parameters, needed before the ciphers are allocated */
+	if (argc > 5) {
+		as.argc = argc - 5;
+		as.argv = argv + 5;
+
+		ret = dm_read_arg_group(_args, &as, &opt_params, &ti->error);
+		if (ret)
+			goto bad;
+
+		while (opt_params--) {
+			opt_string = dm_shift_arg(&as);
+			if (!opt_string) {
+				ret = -EINVAL;
+				ti->error = "Not enough feature arguments";
+				goto bad;
+			}
+
+			if (!strcasecmp(opt_string, "allow_discards"))
+				ti->num_discard_requests = 1;
+			else if (!strcasecmp(opt_string, "hw_offload"))
+				set_bit(DM_CRYPT_HW_OFFLOAD, &cc->flags);
+			else {
+				ret = -EINVAL;
+				ti->error = "Invalid feature arguments";
+				goto bad;
+			}
+		}
+	}
+
 	ret = crypt_ctr_cipher(ti, argv[0], argv[1]);
 	if (ret < 0)
 		goto bad;
@@ -1573,8 +1910,12 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 		goto bad;
 	}
 
+	reqsize = crypto_ablkcipher_reqsize(any_tfm(cc));
+	if (cc->hw_tfms)
+		reqsize = max(reqsize, crypto_ablkcipher_reqsize(cc->hw_tfms[0]));
+
 	cc->dmreq_start = sizeof(struct ablkcipher_request);
-	cc->dmreq_start += crypto_ablkcipher_reqsize(any_tfm(cc));
+	cc->dmreq_start += reqsize;
 	cc->dmreq_start = ALIGN(cc->dmreq_start, __alignof__(struct dm_crypt_request));
 
 	if (crypto_ablkcipher_alignmask(any_tfm(cc)) < CRYPTO_MINALIGN) {
@@ -1627,30 +1968,6 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 	}
 	cc->start = tmpll;
 
-	argv += 5;
-	argc -= 5;
-
-	/* Optional parameters */
-	if (argc) {
-		as.argc = argc;
-		as.argv = argv;
-
-		ret = dm_read_arg_group(_args, &as, &opt_params, &ti->error);
-		if (ret)
-			goto bad;
-
-		opt_string = dm_shift_arg(&as);
-
-		if (opt_params == 1 && opt_string &&
-		    !strcasecmp(opt_string, "allow_discards"))
-			ti->num_discard_requests = 1;
-		else if (opt_params) {
-			ret = -EINVAL;
-			ti->error = "Invalid feature arguments";
-			goto bad;
-		}
-	}
-
 	ret = -ENOMEM;
 	cc->io_queue = alloc_workqueue("kcryptd_io",
 				       WQ_NON_REENTRANT|
@@ -1671,6 +1988,18 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 		goto bad;
 	}
 
+	init_waitqueue_head(&cc->write_thread_wait);
+	cc->write_tree = RB_ROOT;
+
+	cc->write_thread = kthread_create(dmcrypt_write, cc, "dmcrypt_write");
+	if (IS_ERR(cc->write_thread)) {
+		ret = PTR_ERR(cc->write_thread);
+		cc->write_thread = NULL;
+		ti->error = "Couldn't spawn write thread";
+		goto bad;
+	}
+	wake_up_process(cc->write_thread);
+
 	ti->num_flush_requests = 1;
 	ti->discard_zeroes_data_unsupported = 1;
 
@@ -1700,7 +2029,11 @@ static int crypt_map(struct dm_target *ti, struct bio *bio,
 		return DM_MAPIO_REMAPPED;
 	}
 
-	io = crypt_io_alloc(ti, bio, dm_target_offset(ti, bio->bi_sector));
+	io = crypt_io_alloc(ti, bio, dm_target_offset(ti, bio->bi_sector),
+			    GFP_NOIO);
+	cc = ti->private;
+	io->hw = cc->hw_tfms &&
+		 bio->bi_size >= (ACCESS_ONCE(dm_crypt_hw_min_kb) << 10);
 
 	if (bio_data_dir(io->base_bio) == READ) {
 		if (kcryptd_io_read(io, GFP_NOWAIT))
@@ -1715,11 +2048,21 @@ static void crypt_status(struct dm_target *ti, status_type_t type,
 			 char *result, unsigned int maxlen)
 {
 	struct crypt_config *cc = ti->private;
+	struct crypt_path_stats *st;
 	unsigned i, sz = 0;
+	int num_feature_args = 0;
 
 	switch (type) {
 	case STATUSTYPE_INFO:
-		result[0] = '\0';
+		/* <path> <requests> <bytes> <usecs> for the cpu and hw paths */
+		for (i = 0; i < ARRAY_SIZE(cc->stats); i++) {
+			st = &cc->stats[i];
+			DMEMIT("%s%s %llu %llu %llu", i ? " " : "",
+			       i ? "hw" : "cpu",
+			       (unsigned long long)atomic64_read(&st->requests),
+			       (unsigned long long)atomic64_read(&st->bytes),
+			       (unsigned long long)atomic64_read(&st->usecs));
+		}
 		break;
 
 	case STATUSTYPE_TABLE:
@@ -1734,8 +2077,15 @@ static void crypt_status(struct dm_target *ti, status_type_t type,
 		DMEMIT(" %llu %s %llu", (unsigned long long)cc->iv_offset,
 				cc->dev->name, (unsigned long long)cc->start);
 
-		if (ti->num_discard_requests)
-			DMEMIT(" 1 allow_discards");
+		num_feature_args += !!ti->num_discard_requests;
+		num_feature_args += test_bit(DM_CRYPT_HW_OFFLOAD, &cc->flags);
+		if (num_feature_args) {
+			DMEMIT(" %d", num_feature_args);
+			if (ti->num_discard_requests)
+				DMEMIT(" allow_discards");
+			if (test_bit(DM_CRYPT_HW_OFFLOAD, &cc->flags))
+				DMEMIT(" hw_offload");
+		}
 
 		break;
 	}
@@ -1832,7 +2182,7 @@ static int crypt_iterate_devices(struct dm_target *ti,
 
 static struct target_type crypt_target = {
 	.name   = "crypt",
-	.version = {1, 11, 0},
+	.version = {1, 12, 0},
 	.module = THIS_MODULE,
 	.ctr    = crypt_ctr,
 	.dtr    = crypt_dtr,
@@ -12,6 +12,10 @@
  * hash device. Setting this greatly improves performance when data and hash
  * are on the same disk on different partitions on devices with poor random
  * access behavior.
+ *
+ * Reads of at least twice "parallel_blocks" data blocks are verified in
+ * pieces on several cpus at once. Set it to 0 to verify each bio on a
+ * single cpu.
  */
 
 #include "dm-bufio.h"
@@ -25,6 +29,7 @@
 #define DM_VERITY_IO_VEC_INLINE		16
 #define DM_VERITY_MEMPOOL_SIZE		4
 #define DM_VERITY_DEFAULT_PREFETCH_SIZE	262144
+#define DM_VERITY_DEFAULT_PARALLEL_BLOCKS	32
 
 #define DM_VERITY_MAX_LEVELS		63
 
@@ -32,6 +37,10 @@ static unsigned dm_verity_prefetch_cluster = DM_VERITY_DEFAULT_PREFETCH_SIZE;
 
 module_param_named(prefetch_cluster, dm_verity_prefetch_cluster, uint, S_IRUGO | S_IWUSR);
 
+static unsigned dm_verity_parallel_blocks = DM_VERITY_DEFAULT_PARALLEL_BLOCKS;
+
+module_param_named(parallel_blocks, dm_verity_parallel_blocks, uint, S_IRUGO | S_IWUSR);
+
 struct dm_verity {
 	struct dm_dev *data_dev;
 	struct dm_dev *hash_dev;
@@ -60,6 +69,11 @@ struct dm_verity {
 
 	struct workqueue_struct *verify_wq;
 
+	/* counters reported by "dmsetup status" */
+	atomic64_t levels_skipped;	/* hash levels not walked */
+	atomic64_t hash_blocks_hashed;	/* hash blocks checked */
+	atomic64_t parallel_ios;	/* bios verified on several cpus */
+
 	/* starting blocks for each tree level. 0 is the lowest level. */
 	sector_t hash_level_block[DM_VERITY_MAX_LEVELS];
 };
@@ -81,6 +95,17 @@ struct dm_verity_io {
 
 	struct work_struct work;
 
+	/*
+	 * A large io is verified in pieces. Each piece is a dm_verity_io
+	 * (for its hash scratch space) pointing at the parent's vector;
+	 * the last one to finish ends the parent bio.
+	 */
+	struct dm_verity_io *parent;
+	atomic_t pieces;
+	int piece_error;
+	unsigned vec_start;
+	unsigned vec_offset;
+
 	/* A space for short vectors; longer vectors are allocated separately. */
 	struct bio_vec io_vec_inline[DM_VERITY_IO_VEC_INLINE];
 
@@ -235,6 +260,7 @@ static int verity_verify_level(struct dm_verity_io *io, sector_t block,
 			DMERR("crypto_shash_update failed: %d", r);
 			goto release_ret_r;
 		}
+		atomic64_inc(&v->hash_blocks_hashed);
 
 		if (!v->version) {
 			r = crypto_shash_update(desc, v->salt, v->salt_size);
@@ -274,45 +300,50 @@ release_ret_r:
 }
 
 /*
- * Verify one "dm_verity_io" structure.
+ * Verify "n_blocks" data blocks starting at "block", whose data starts at
+ * io->io_vec[*vector] + *offset. The position is advanced as blocks are
+ * hashed. "io" provides the hash scratch space.
  */
-static int verity_verify_io(struct dm_verity_io *io)
+static int verity_verify_blocks(struct dm_verity_io *io, sector_t block,
+				unsigned n_blocks, unsigned *vector_p,
+				unsigned *offset_p)
 {
 	struct dm_verity *v = io->v;
 	unsigned b;
 	int i;
-	unsigned vector = 0, offset = 0;
+	unsigned vector = *vector_p, offset = *offset_p;
 
-	for (b = 0; b < io->n_blocks; b++) {
+	for (b = 0; b < n_blocks; b++) {
 		struct shash_desc *desc;
 		u8 *result;
 		int r;
 		unsigned todo;
 
-		if (likely(v->levels)) {
-			/*
-			 * First, we try to get the requested hash for
-			 * the current block. If the hash block itself is
-			 * verified, zero is returned. If it isn't, this
-			 * function returns 0 and we fall back to whole
-			 * chain verification.
-			 */
-			int r = verity_verify_level(io, io->block + b, 0, true);
+		/*
+		 * Walk up from the leaf to the lowest hash block that is
+		 * already verified. Its contents give the wanted digest for
+		 * the level below, so only the unverified blocks under it are
+		 * hashed and the levels above it are not read at all.
+		 */
+		for (i = 0; i < v->levels; i++) {
+			r = verity_verify_level(io, block + b, i, true);
 			if (likely(!r))
-				goto test_block_hash;
+				break;
 			if (r < 0)
 				return r;
 		}
 
-		memcpy(io_want_digest(v, io), v->root_digest, v->digest_size);
+		if (i == v->levels)
+			memcpy(io_want_digest(v, io), v->root_digest, v->digest_size);
+		else
+			atomic64_add(v->levels - 1 - i, &v->levels_skipped);
 
-		for (i = v->levels - 1; i >= 0; i--) {
-			int r = verity_verify_level(io, io->block + b, i, false);
+		while (--i >= 0) {
+			r = verity_verify_level(io, block + b, i, false);
 			if (unlikely(r))
 				return r;
 		}
 
-test_block_hash:
 		desc = io_hash_desc(v, io);
 		desc->tfm = v->tfm;
 		desc->flags = CRYPTO_TFM_REQ_MAY_SLEEP;
@@ -373,17 +404,58 @@ test_block_hash:
 		}
 		if (unlikely(memcmp(result, io_want_digest(v, io), v->digest_size))) {
 			DMERR_LIMIT("data block %llu is corrupted",
-				(unsigned long long)(io->block + b));
+				(unsigned long long)(block + b));
 			v->hash_failed = 1;
 			return -EIO;
 		}
 	}
+
+	*vector_p = vector;
+	*offset_p = offset;
+
+	return 0;
+}
+
+/*
+ * Verify one "dm_verity_io" structure.
+ */
+static int verity_verify_io(struct dm_verity_io *io)
+{
+	unsigned vector = 0, offset = 0;
+	int r;
+
+	r = verity_verify_blocks(io, io->block, io->n_blocks, &vector, &offset);
+	if (unlikely(r))
+		return r;
+
 	BUG_ON(vector != io->io_vec_size);
 	BUG_ON(offset);
 
 	return 0;
 }
 
+/*
+ * Advance a position in the io vector by "bytes".
+ */
+static void verity_advance_vec(struct dm_verity_io *io, unsigned bytes,
+			       unsigned *vector, unsigned *offset)
+{
+	struct bio_vec *bv;
+	unsigned len;
+
+	while (bytes) {
+		BUG_ON(*vector >= io->io_vec_size);
+		bv = &io->io_vec[*vector];
+		len = min(bytes, bv->bv_len - *offset);
+		*offset += len;
+		bytes -= len;
+		if (*offset == bv->bv_len) {
+			*offset = 0;
+			(*vector)++;
+		}
+	}
+}
+
 /*
  * End one "io" structure with a given error.
  */
@@ -403,10 +475,104 @@ static void verity_finish_io(struct dm_verity_io *io, int error)
 	bio_endio(bio, error);
 }
 
+static void verity_piece_done(struct dm_verity_io *io, int error)
+{
+	if (unlikely(error))
+		io->piece_error = error;
+
+	if (atomic_dec_and_test(&io->pieces))
+		verity_finish_io(io, io->piece_error);
+}
+
+static void verity_piece_work(struct work_struct *w)
+{
+	struct dm_verity_io *piece = container_of(w, struct dm_verity_io, work);
+	struct dm_verity_io *io = piece->parent;
+	unsigned vector = piece->vec_start, offset = piece->vec_offset;
+	int r;
+
+	r = verity_verify_blocks(piece, piece->block, piece->n_blocks,
+				 &vector, &offset);
+	mempool_free(piece, piece->v->io_mempool);
+
+	verity_piece_done(io, r);
+}
+
+/*
+ * Hand all but the first piece of a large io to other workers and verify
+ * the first one here. A piece that cannot be allocated without waiting
+ * is verified here as well. Returns 0 if the io was not split.
+ */
+static int verity_split_io(struct dm_verity_io *io)
+{
+	struct dm_verity *v = io->v;
+	unsigned min_blocks = ACCESS_ONCE(dm_verity_parallel_blocks);
+	unsigned n, per, b, len, vec, off, vector = 0, offset = 0;
+	struct dm_verity_io *piece;
+	int r;
+
+	if (!min_blocks || io->n_blocks < 2 * min_blocks)
+		return 0;
+
+	n = min(num_online_cpus(), io->n_blocks / min_blocks);
+	if (n < 2)
+		return 0;
+	per = DIV_ROUND_UP(io->n_blocks, n);
+
+	atomic64_inc(&v->parallel_ios);
+	atomic_set(&io->pieces, 1);
+	io->piece_error = 0;
+
+	verity_advance_vec(io, per << v->data_dev_block_bits, &vector, &offset);
+
+	for (b = per; b < io->n_blocks; b += len) {
+		len = min(per, io->n_blocks - b);
+		vec = vector;
+		off = offset;
+		verity_advance_vec(io, len << v->data_dev_block_bits,
+				   &vector, &offset);
+
+		piece = mempool_alloc(v->io_mempool, GFP_NOWAIT);
+		if (unlikely(!piece)) {
+			r = verity_verify_blocks(io, io->block + b, len,
+						 &vec, &off);
+			if (unlikely(r))
+				io->piece_error = r;
+			continue;
+		}
+
+		piece->v = v;
+		piece->parent = io;
+		piece->block = io->block + b;
+		piece->n_blocks = len;
+		piece->io_vec = io->io_vec;
+		piece->io_vec_size = io->io_vec_size;
+		piece->vec_start = vec;
+		piece->vec_offset = off;
+
+		atomic_inc(&io->pieces);
+		INIT_WORK(&piece->work, verity_piece_work);
+		queue_work(v->verify_wq, &piece->work);
+	}
+
+	BUG_ON(vector != io->io_vec_size);
+	BUG_ON(offset);
+
+	vec = 0;
+	off = 0;
+	r = verity_verify_blocks(io, io->block, per, &vec, &off);
+	verity_piece_done(io, r);
+
+	return 1;
+}
+
 static void verity_work(struct work_struct *w)
 {
 	struct dm_verity_io *io = container_of(w, struct dm_verity_io, work);
 
+	if (verity_split_io(io))
+		return;
+
 	verity_finish_io(io, verity_verify_io(io));
 }
 
@@ -512,7 +678,9 @@ static int verity_map(struct dm_target *ti, struct bio *bio,
 }
 
 /*
- * Status: V (valid) or C (corruption found)
+ * Status: V (valid) or C (corruption found), followed by the number of
+ * hash levels skipped thanks to already verified blocks, the number of
+ * hash blocks hashed and the number of bios verified in parallel.
  */
 static void verity_status(struct dm_target *ti, status_type_t type,
 			  char *result, unsigned maxlen)
@@ -523,7 +691,10 @@ static void verity_status(struct dm_target *ti, status_type_t type,
 
 	switch (type) {
 	case STATUSTYPE_INFO:
-		DMEMIT("%c", v->hash_failed ? 'C' : 'V');
+		DMEMIT("%c %llu %llu %llu", v->hash_failed ? 'C' : 'V',
+		       (unsigned long long)atomic64_read(&v->levels_skipped),
+		       (unsigned long long)atomic64_read(&v->hash_blocks_hashed),
+		       (unsigned long long)atomic64_read(&v->parallel_ios));
 		break;
 	case STATUSTYPE_TABLE:
 		DMEMIT("%u %s %s %u %u %llu %llu %s ",
@@ -10,6 +10,7 @@
  * GNU General Public License for more details.
  */
 
+#include <linux/ktime.h>
 #include "msm_camera_i2c.h"
 
 int32_t msm_camera_i2c_rxdata(struct msm_camera_i2c_client *dev_client,
@@ -277,14 +278,91 @@ int32_t msm_camera_i2c_poll(struct msm_camera_i2c_client *client,
 	return rc;
 }
 
+/*
+ * Count the table entries starting at reg_conf_tbl that are plain writes
+ * of the same data type to consecutive register addresses and fit in
+ * one burst of max_burst bytes.
+ */
+static uint16_t msm_camera_i2c_burst_len(struct msm_camera_i2c_client *client,
+	struct msm_camera_i2c_reg_conf *reg_conf_tbl, uint16_t size,
+	enum msm_camera_i2c_data_type data_type)
+{
+	enum msm_camera_i2c_data_type dt, first_dt = 0;
+	uint16_t max_burst, addr = 0;
+	uint16_t i;
+
+	max_burst = min_t(uint16_t, client->max_burst,
+		MSM_CAMERA_I2C_BURST_MAX);
+
+	for (i = 0; i < size; i++, reg_conf_tbl++) {
+		if (reg_conf_tbl->cmd_type != MSM_CAMERA_I2C_CMD_WRITE)
+			break;
+		dt = reg_conf_tbl->dt ? reg_conf_tbl->dt : data_type;
+		if (dt != MSM_CAMERA_I2C_BYTE_DATA &&
+			dt != MSM_CAMERA_I2C_WORD_DATA)
+			break;
+		/* 0xFFFF is a delay entry for word address sensors */
+		if (client->addr_type == MSM_CAMERA_I2C_WORD_ADDR &&
+			reg_conf_tbl->reg_addr == 0xFFFF)
+			break;
+		if (i == 0) {
+			first_dt = dt;
+		} else if (dt != first_dt || reg_conf_tbl->reg_addr != addr ||
+			(i + 1) * dt > max_burst) {
+			break;
+		}
+		addr = reg_conf_tbl->reg_addr + dt;
+	}
+	return i;
+}
+
+static int32_t msm_camera_i2c_write_burst(struct msm_camera_i2c_client *client,
+	struct msm_camera_i2c_reg_conf *reg_conf_tbl, uint16_t num,
+	enum msm_camera_i2c_data_type dt)
+{
+	uint8_t data[MSM_CAMERA_I2C_BURST_MAX];
+	uint16_t addr = reg_conf_tbl->reg_addr;
+	uint16_t i, len = 0;
+
+	for (i = 0; i < num; i++, reg_conf_tbl++) {
+		if (dt == MSM_CAMERA_I2C_WORD_DATA)
+			data[len++] = reg_conf_tbl->reg_data >> BITS_PER_BYTE;
+		data[len++] = reg_conf_tbl->reg_data;
+	}
+	return msm_camera_i2c_write_seq(client, addr, data, len);
+}
+
 int32_t msm_camera_i2c_write_tbl(struct msm_camera_i2c_client *client,
 	struct msm_camera_i2c_reg_conf *reg_conf_tbl, uint16_t size,
 	enum msm_camera_i2c_data_type data_type)
 {
 	int i;
 	int32_t rc = -EFAULT;
+	struct msm_camera_i2c_tbl_stats *stats = &client->tbl_stats;
+	ktime_t start = ktime_get();
+	uint32_t us;
+
 	for (i = 0; i < size; i++) {
 		enum msm_camera_i2c_data_type dt;
+		uint16_t num = 0;
+
+		if (client->max_burst)
+			num = msm_camera_i2c_burst_len(client, reg_conf_tbl,
+				size - i, data_type);
+		if (num > 1) {
+			dt = reg_conf_tbl->dt ? reg_conf_tbl->dt : data_type;
+			rc = msm_camera_i2c_write_burst(client, reg_conf_tbl,
+				num, dt);
+			stats->bursts++;
+			stats->xfers++;
+			stats->regs += num;
+			if (rc < 0)
+				break;
+			i += num - 1;
+			reg_conf_tbl += num;
+			continue;
+		}
+
 		if (reg_conf_tbl->cmd_type == MSM_CAMERA_I2C_CMD_POLL) {
 			rc = msm_camera_i2c_poll(client, reg_conf_tbl->reg_addr,
 				reg_conf_tbl->reg_data, reg_conf_tbl->dt);
@@ -339,10 +417,18 @@ int32_t msm_camera_i2c_write_tbl(struct msm_camera_i2c_client *client,
 				break;
 			}
 		}
+		stats->xfers++;
+		stats->regs++;
 		if (rc < 0)
 			break;
 		reg_conf_tbl++;
 	}
+
+	us = ktime_to_us(ktime_sub(ktime_get(), start));
+	stats->tbl_writes++;
+	stats->total_us += us;
+	if (us > stats->max_us)
+		stats->max_us = us;
 	return rc;
 }
 
@@ -30,9 +30,27 @@ enum msm_camera_i2c_reg_addr_type {
 	MSM_CAMERA_I2C_WORD_ADDR,
 };
 
+/* upper bound of data bytes coalesced into one burst write */
+#define MSM_CAMERA_I2C_BURST_MAX 128
+
+struct msm_camera_i2c_tbl_stats {
+	uint32_t tbl_writes;	/* msm_camera_i2c_write_tbl calls */
+	uint32_t regs;		/* table entries written */
+	uint32_t xfers;		/* i2c transactions issued for them */
+	uint32_t bursts;	/* transactions carrying more than one entry */
+	uint64_t total_us;
+	uint32_t max_us;
+};
+
 struct msm_camera_i2c_client {
 	struct i2c_client *client;
 	enum msm_camera_i2c_reg_addr_type addr_type;
+	/*
+	 * max data bytes per auto-increment burst in table writes,
+	 * 0 writes every register separately
+	 */
+	uint16_t max_burst;
+	struct msm_camera_i2c_tbl_stats tbl_stats;
 };
 
 enum msm_camera_i2c_data_type {
@@ -28,6 +28,11 @@
 #include "msm_vfe32.h"
 #include "msm_camera_eeprom.h"
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/msm_cam.h>
+
+EXPORT_TRACEPOINT_SYMBOL(msm_cam_launch_step);
+
 #undef CONFIG_LOAD_FILE
 //#define CONFIG_LOAD_FILE
 
@@ -2211,6 +2216,7 @@ void msm_release_ion_client(struct kref *ref)
 	struct msm_cam_media_controller *mctl = container_of(ref,
 		struct msm_cam_media_controller, refcount);
 	pr_err("%s Calling ion_client_destroy\n", __func__);
+	videobuf2_msm_map_cache_flush(&mctl->buf_map_cache, mctl->client);
 	ion_client_destroy(mctl->client);
 }
 
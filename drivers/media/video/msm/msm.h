@@ -258,6 +258,9 @@ struct msm_cam_media_controller {
 	uint8_t opencnt; /*mctl ref count*/
 	const char *apps_id; /*ID for app that open this session*/
 	struct mutex lock;
+	/* sensor/actuator power up, overlapped with CSI and VFE init */
+	struct work_struct sensor_power_work;
+	int sensor_power_rc;
 	struct pm_qos_request idle_pm_qos; /*avoid low power mode when active*/
 	struct pm_qos_request pm_qos_req_list;
 	struct msm_mctl_pp_info pp_info;
@@ -265,6 +268,8 @@ struct msm_cam_media_controller {
 	uint32_t vfe_output_mode; /* VFE output mode */
 	struct ion_client *client;
 	struct kref refcount;
+	/* IOMMU mappings of imported buffers, live until client release */
+	struct videobuf2_msm_map_cache buf_map_cache;
 
 	/*pcam ptr*/
 	struct msm_cam_v4l2_device *pcam_ptr;
@@ -41,6 +41,8 @@
 #include "msm_camera_eeprom.h"
 #include "msm_csi_register.h"
 
+#include <trace/events/msm_cam.h>
+
 #ifdef CONFIG_MSM_CAMERA_DEBUG
 #define D(fmt, args...) pr_debug("msm_mctl: " fmt, ##args)
 #else
@@ -509,6 +511,42 @@ out:
 	return rc;
 }
 
+/*
+ * Sensor power up (regulators, MCLK, reset sequencing, chip id probe and
+ * init settings) is the slowest step of open and only touches the sensor
+ * and actuator, so it runs in a worker while the CSI and VFE blocks are
+ * brought up. On failure the worker unwinds its own power up.
+ */
+static void msm_mctl_sensor_power_work(struct work_struct *work)
+{
+	struct msm_cam_media_controller *p_mctl = container_of(work,
+		struct msm_cam_media_controller, sensor_power_work);
+	int rc;
+
+	trace_msm_cam_launch_step("sensor_power", 1);
+	rc = v4l2_subdev_call(p_mctl->sensor_sdev, core, s_power, 1);
+	trace_msm_cam_launch_step("sensor_power", 0);
+	if (rc < 0) {
+		pr_err("%s: sensor powerup failed: %d\n", __func__, rc);
+		goto out;
+	}
+
+	if (p_mctl->act_sdev) {
+		trace_msm_cam_launch_step("act_power", 1);
+		rc = v4l2_subdev_call(p_mctl->act_sdev, core, s_power, 1);
+		trace_msm_cam_launch_step("act_power", 0);
+		if (rc < 0) {
+			pr_err("%s: act power failed:%d\n", __func__, rc);
+			if (v4l2_subdev_call(p_mctl->sensor_sdev, core,
+				s_power, 0) < 0)
+				pr_err("%s: sensor powerdown failed\n",
+					__func__);
+		}
+	}
+out:
+	p_mctl->sensor_power_rc = rc;
+}
+
 static int msm_mctl_open(struct msm_cam_media_controller *p_mctl,
 				 const char *const apps_id)
 {
@@ -532,6 +570,7 @@ static int msm_mctl_open(struct msm_cam_media_controller *p_mctl,
 		pm_qos_update_request(&p_mctl->idle_pm_qos,
 			msm_cpuidle_get_deep_idle_latency());
 
+		trace_msm_cam_launch_step("mctl_open", 1);
 		csid_core = camdev->csid_core;
 		rc = msm_mctl_register_subdevs(p_mctl, csid_core);
 		if (rc < 0) {
@@ -540,24 +579,15 @@ static int msm_mctl_open(struct msm_cam_media_controller *p_mctl,
 			goto register_sdev_failed;
 		}
 
-		/* then sensor - move sub dev later */
-		rc = v4l2_subdev_call(p_mctl->sensor_sdev, core, s_power, 1);
-		if (rc < 0) {
-			pr_err("%s: sensor powerup failed: %d\n", __func__, rc);
-			goto sensor_sdev_failed;
-		}
-
-		if (p_mctl->act_sdev)
-			rc = v4l2_subdev_call(p_mctl->act_sdev,
-				core, s_power, 1);
-		if (rc < 0) {
-			pr_err("%s: act power failed:%d\n", __func__, rc);
-			goto act_power_up_failed;
-		}
+		/* sensor and actuator power up in parallel with the rest */
+		p_mctl->sensor_power_rc = 0;
+		queue_work(system_unbound_wq, &p_mctl->sensor_power_work);
 
 		if (p_mctl->csiphy_sdev) {
+			trace_msm_cam_launch_step("csiphy_init", 1);
 			rc = v4l2_subdev_call(p_mctl->csiphy_sdev, core, ioctl,
 				VIDIOC_MSM_CSIPHY_INIT, NULL);
+			trace_msm_cam_launch_step("csiphy_init", 0);
 			if (rc < 0) {
 				pr_err("%s: csiphy initialization failed %d\n",
 					__func__, rc);
@@ -566,8 +596,10 @@ static int msm_mctl_open(struct msm_cam_media_controller *p_mctl,
 		}
 
 		if (p_mctl->csid_sdev) {
+			trace_msm_cam_launch_step("csid_init", 1);
 			rc = v4l2_subdev_call(p_mctl->csid_sdev, core, ioctl,
 				VIDIOC_MSM_CSID_INIT, &csid_version);
+			trace_msm_cam_launch_step("csid_init", 0);
 			if (rc < 0) {
 				pr_err("%s: csid initialization failed %d\n",
 					__func__, rc);
@@ -577,8 +609,10 @@ static int msm_mctl_open(struct msm_cam_media_controller *p_mctl,
 		}
 
 		if (p_mctl->csic_sdev) {
+			trace_msm_cam_launch_step("csic_init", 1);
 			rc = v4l2_subdev_call(p_mctl->csic_sdev, core, ioctl,
 				VIDIOC_MSM_CSIC_INIT, &csid_version);
+			trace_msm_cam_launch_step("csic_init", 0);
 			if (rc < 0) {
 				pr_err("%s: csic initialization failed %d\n",
 					__func__, rc);
@@ -587,19 +621,12 @@ static int msm_mctl_open(struct msm_cam_media_controller *p_mctl,
 			csi_info.is_csic = 1;
 		}
 
-		csi_info.csid_version = csid_version;
-		rc = v4l2_subdev_call(p_mctl->sensor_sdev, core, ioctl,
-				VIDIOC_MSM_SENSOR_CSID_INFO, &csi_info);
-		if (rc < 0) {
-			pr_err("%s: sensor csi version failed %d\n",
-			__func__, rc);
-			goto msm_csi_version;
-		}
-
 		/* ISP first*/
 		if (p_mctl->isp_sdev && p_mctl->isp_sdev->isp_open) {
+			trace_msm_cam_launch_step("isp_open", 1);
 			rc = p_mctl->isp_sdev->isp_open(
 				p_mctl->isp_sdev->sd, p_mctl);
+			trace_msm_cam_launch_step("isp_open", 0);
 			if (rc < 0) {
 				pr_err("%s: isp init failed: %d\n",
 					__func__, rc);
@@ -608,8 +635,10 @@ static int msm_mctl_open(struct msm_cam_media_controller *p_mctl,
 		}
 
 		if (p_mctl->axi_sdev) {
+			trace_msm_cam_launch_step("axi_init", 1);
 			rc = v4l2_subdev_call(p_mctl->axi_sdev, core, ioctl,
 				VIDIOC_MSM_AXI_INIT, p_mctl);
+			trace_msm_cam_launch_step("axi_init", 0);
 			if (rc < 0) {
 				pr_err("%s: axi initialization failed %d\n",
 					__func__, rc);
@@ -618,8 +647,10 @@ static int msm_mctl_open(struct msm_cam_media_controller *p_mctl,
 		}
 
 		if (camdev->is_vpe) {
+			trace_msm_cam_launch_step("vpe_init", 1);
 			rc = v4l2_subdev_call(p_mctl->vpe_sdev, core, ioctl,
 				VIDIOC_MSM_VPE_INIT, p_mctl);
+			trace_msm_cam_launch_step("vpe_init", 0);
 			if (rc < 0) {
 				pr_err("%s: vpe initialization failed %d\n",
 				__func__, rc);
@@ -627,6 +658,21 @@ static int msm_mctl_open(struct msm_cam_media_controller *p_mctl,
 			}
 		}
 
+		trace_msm_cam_launch_step("sensor_power_wait", 1);
+		flush_work(&p_mctl->sensor_power_work);
+		trace_msm_cam_launch_step("sensor_power_wait", 0);
+		rc = p_mctl->sensor_power_rc;
+		if (rc < 0)
+			goto sensor_power_failed;
+
+		csi_info.csid_version = csid_version;
+		rc = v4l2_subdev_call(p_mctl->sensor_sdev, core, ioctl,
+				VIDIOC_MSM_SENSOR_CSID_INFO, &csi_info);
+		if (rc < 0) {
+			pr_err("%s: sensor csi version failed %d\n",
+			__func__, rc);
+			goto msm_csi_version;
+		}
 
 		pm_qos_add_request(&p_mctl->pm_qos_req_list,
 			PM_QOS_CPU_DMA_LATENCY, PM_QOS_DEFAULT_VALUE);
@@ -634,6 +680,7 @@ static int msm_mctl_open(struct msm_cam_media_controller *p_mctl,
 			MSM_V4L2_SWFI_LATENCY);
 		p_mctl->apps_id = apps_id;
 		p_mctl->opencnt++;
+		trace_msm_cam_launch_step("mctl_open", 0);
 	} else {
 		D("%s: camera is already open", __func__);
 	}
@@ -641,6 +688,12 @@ static int msm_mctl_open(struct msm_cam_media_controller *p_mctl,
 
 	return rc;
 
+msm_csi_version:
+sensor_power_failed:
+	if (camdev->is_vpe)
+		if (v4l2_subdev_call(p_mctl->vpe_sdev, core, ioctl,
+			VIDIOC_MSM_VPE_RELEASE, NULL) < 0)
+			pr_err("%s: vpe release failed %d\n", __func__, rc);
 vpe_init_failed:
 	if (p_mctl->axi_sdev)
 		if (v4l2_subdev_call(p_mctl->axi_sdev, core, ioctl,
@@ -649,7 +702,6 @@ vpe_init_failed:
 axi_init_failed:
 	if (p_mctl->isp_sdev && p_mctl->isp_sdev->isp_release)
 		p_mctl->isp_sdev->isp_release(p_mctl, p_mctl->isp_sdev->sd);
-msm_csi_version:
 isp_open_failed:
 	if (p_mctl->csic_sdev)
 		if (v4l2_subdev_call(p_mctl->csic_sdev, core, ioctl,
@@ -666,14 +718,19 @@ csid_init_failed:
 			VIDIOC_MSM_CSIPHY_RELEASE, NULL) < 0)
 			pr_err("%s: csiphy release failed %d\n", __func__, rc);
 csiphy_init_failed:
-	if (p_mctl->act_sdev)
-		if (v4l2_subdev_call(p_mctl->act_sdev, core,
+	/* the power up worker may still be running, and unwinds itself */
+	flush_work(&p_mctl->sensor_power_work);
+	if (p_mctl->sensor_power_rc >= 0) {
+		if (p_mctl->act_sdev)
+			if (v4l2_subdev_call(p_mctl->act_sdev, core,
+				s_power, 0) < 0)
+				pr_err("%s: act power down failed:%d\n",
+					__func__, rc);
+		if (v4l2_subdev_call(p_mctl->sensor_sdev, core,
 			s_power, 0) < 0)
-			pr_err("%s: act power down failed:%d\n", __func__, rc);
-act_power_up_failed:
-	if (v4l2_subdev_call(p_mctl->sensor_sdev, core, s_power, 0) < 0)
-		pr_err("%s: sensor powerdown failed: %d\n", __func__, rc);
-sensor_sdev_failed:
+			pr_err("%s: sensor powerdown failed: %d\n",
+				__func__, rc);
+	}
 register_sdev_failed:
 	pm_qos_update_request(&p_mctl->idle_pm_qos, PM_QOS_DEFAULT_VALUE);
 	mutex_unlock(&p_mctl->lock);
@@ -818,6 +875,7 @@ int msm_mctl_init(struct msm_cam_v4l2_device *pcam)
 	pm_qos_add_request(&pmctl->idle_pm_qos, PM_QOS_CPU_DMA_LATENCY,
 		PM_QOS_DEFAULT_VALUE);
 	mutex_init(&pmctl->lock);
+	INIT_WORK(&pmctl->sensor_power_work, msm_mctl_sensor_power_work);
 	pmctl->opencnt = 0;
 
 	/* init module operations*/
@@ -839,6 +897,7 @@ int msm_mctl_init(struct msm_cam_v4l2_device *pcam)
 	pmctl->client = msm_ion_client_create(-1, "camera");
 	kref_init(&pmctl->refcount);
 #endif
+	videobuf2_msm_map_cache_init(&pmctl->buf_map_cache);
 
 	return 0;
 }
@@ -28,6 +28,8 @@
 #include "msm.h"
 #include "msm_ispif.h"
 
+#include <trace/events/msm_cam.h>
+
 #ifdef CONFIG_MSM_CAMERA_DEBUG
 #define D(fmt, args...) pr_debug("msm_mctl_buf: " fmt, ##args)
 #else
@@ -125,7 +127,8 @@ static int msm_vb2_ops_buf_init(struct vb2_buffer *vb)
 			rc = videobuf2_pmem_contig_user_get(mem, &offset,
 				buf_type,
 				pcam_inst->buf_offset[buf_idx][i].addr_offset,
-				pcam_inst->path, pmctl->client);
+				pcam_inst->path, pmctl->client,
+				&pmctl->buf_map_cache);
 		else
 			rc = videobuf2_pmem_contig_mmap_get(mem, &offset,
 				buf_type, pcam_inst->path);
@@ -134,6 +137,8 @@ static int msm_vb2_ops_buf_init(struct vb2_buffer *vb)
 				__func__);
 			return rc;
 		}
+		trace_msm_cam_buf_map(pcam_inst->my_index, buf_idx, i,
+			mem->mapped_phyaddr, mem->size, mem->map_cached);
 	}
 	buf->state = MSM_BUFFER_STATE_INITIALIZED;
 	return rc;
@@ -253,7 +258,11 @@ static void msm_vb2_ops_buf_cleanup(struct vb2_buffer *vb)
 	pmctl = msm_camera_get_mctl(pcam->mctl_handle);
 	for (i = 0; i < vb->num_planes; i++) {
 		mem = vb2_plane_cookie(vb, i);
-		videobuf2_pmem_contig_user_put(mem, pmctl->client);
+		trace_msm_cam_buf_unmap(pcam_inst->my_index,
+			vb->v4l2_buf.index, i, mem->mapped_phyaddr, mem->size,
+			mem->map != NULL);
+		videobuf2_pmem_contig_user_put(mem, pmctl->client,
+			&pmctl->buf_map_cache);
 	}
 	buf->state = MSM_BUFFER_STATE_UNUSED;
 }
@@ -293,6 +302,8 @@ static void msm_vb2_ops_buf_queue(struct vb2_buffer *vb)
 	list_add_tail(&buf->list, &pcam_inst->free_vq);
 	spin_unlock_irqrestore(&pcam_inst->vq_irqlock, flags);
 	buf->state = MSM_BUFFER_STATE_QUEUED;
+	trace_msm_cam_buf_queue(pcam_inst->my_index, vb->v4l2_buf.index,
+		videobuf2_to_pmem_contig(vb, 0));
 }
 
 static struct vb2_ops msm_vb2_ops = {
@@ -416,6 +427,8 @@ int msm_mctl_buf_done_proc(
 		msm_mctl_gettimeofday(
 			&buf->vidbuf.v4l2_buf.timestamp);
 	}
+	trace_msm_cam_buf_done(pcam_inst->my_index,
+		buf->vidbuf.v4l2_buf.index, fbuf->ch_paddr[0]);
 	vb2_buffer_done(&buf->vidbuf, VB2_BUF_STATE_DONE);
 	return 0;
 }
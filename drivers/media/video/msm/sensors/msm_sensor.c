@@ -16,13 +16,17 @@
 #include "msm_camera_i2c_mux.h"
 #include "sec_cam_pmic.h"
 
+#include <trace/events/msm_cam.h>
+
 
 #include <linux/vmalloc.h>
 #include <linux/fs.h>
 #include <linux/mm.h>
 #include <linux/slab.h>
+#include <linux/seq_file.h>
 
 #include <asm/uaccess.h>
+#include <asm/div64.h>
 
 #ifdef CONFIG_S5K5CCGX
 #define S5K5CCGX_MODE_PREVIEW 0
@@ -369,6 +373,15 @@ int32_t msm_sensor_setting(struct msm_sensor_ctrl_t *s_ctrl,
 {
 	int32_t rc = 0;
 
+	if (update_type == MSM_SENSOR_REG_INIT &&
+		s_ctrl->init_settings_loaded) {
+		/* written by msm_sensor_power, sensor has not streamed since */
+		s_ctrl->init_settings_loaded = 0;
+		s_ctrl->curr_csi_params = NULL;
+		msm_sensor_enable_debugfs(s_ctrl);
+		return rc;
+	}
+
 	s_ctrl->func_tbl->sensor_stop_stream(s_ctrl);
 	msleep(30);
 	if (update_type == MSM_SENSOR_REG_INIT) {
@@ -977,9 +990,23 @@ int32_t msm_sensor_power(struct v4l2_subdev *sd, int on)
 					pr_err("%s: %s power_down failed\n",
 					__func__,
 					s_ctrl->sensordata->sensor_name);
+			} else if (s_ctrl->func_tbl->sensor_setting ==
+				msm_sensor_setting) {
+				/*
+				 * Write the init table now, while the open path
+				 * is still bringing up CSI and VFE, instead of
+				 * at the first REG_INIT config call.
+				 */
+				trace_msm_cam_launch_step("sensor_init_settings",
+					1);
+				if (msm_sensor_write_init_settings(s_ctrl) >= 0)
+					s_ctrl->init_settings_loaded = 1;
+				trace_msm_cam_launch_step("sensor_init_settings",
+					0);
 			}
 		}
 	} else {
+		s_ctrl->init_settings_loaded = 0;
 		rc = s_ctrl->func_tbl->sensor_power_down(s_ctrl);
 	}
 	mutex_unlock(s_ctrl->msm_sensor_mutex);
@@ -1098,6 +1125,40 @@ static int msm_sensor_debugfs_test_s(void *data, u64 val)
 DEFINE_SIMPLE_ATTRIBUTE(sensor_debugfs_test, NULL,
 			msm_sensor_debugfs_test_s, "%llu\n");
 
+static int msm_sensor_debugfs_i2c_stats_show(struct seq_file *m, void *unused)
+{
+	struct msm_sensor_ctrl_t *s_ctrl = m->private;
+	struct msm_camera_i2c_tbl_stats *stats =
+		&s_ctrl->sensor_i2c_client->tbl_stats;
+	uint64_t avg_us = stats->total_us;
+
+	if (stats->tbl_writes)
+		do_div(avg_us, stats->tbl_writes);
+
+	seq_printf(m, "tbl_writes: %u\n", stats->tbl_writes);
+	seq_printf(m, "regs: %u\n", stats->regs);
+	seq_printf(m, "xfers: %u\n", stats->xfers);
+	seq_printf(m, "bursts: %u\n", stats->bursts);
+	seq_printf(m, "total_us: %llu\n", stats->total_us);
+	seq_printf(m, "avg_us: %llu\n", avg_us);
+	seq_printf(m, "max_us: %u\n", stats->max_us);
+	return 0;
+}
+
+static int msm_sensor_debugfs_i2c_stats_open(struct inode *inode,
+	struct file *file)
+{
+	return single_open(file, msm_sensor_debugfs_i2c_stats_show,
+		inode->i_private);
+}
+
+static const struct file_operations sensor_debugfs_i2c_stats = {
+	.open = msm_sensor_debugfs_i2c_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 int msm_sensor_enable_debugfs(struct msm_sensor_ctrl_t *s_ctrl)
 {
 	struct dentry *debugfs_base, *sensor_dir;
@@ -1118,5 +1179,13 @@ int msm_sensor_enable_debugfs(struct msm_sensor_ctrl_t *s_ctrl)
 			(void *) s_ctrl, &sensor_debugfs_test))
 		return -ENOMEM;
 
+	if (!debugfs_create_file("i2c_tbl_stats", S_IRUGO, sensor_dir,
+			(void *) s_ctrl, &sensor_debugfs_i2c_stats))
+		return -ENOMEM;
+
+	if (!debugfs_create_u16("i2c_max_burst", S_IRUGO | S_IWUSR,
+			sensor_dir, &s_ctrl->sensor_i2c_client->max_burst))
+		return -ENOMEM;
+
 	return 0;
 }
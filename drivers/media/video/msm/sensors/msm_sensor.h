@@ -197,6 +197,8 @@ struct msm_sensor_ctrl_t {
 	uint8_t is_HD_preview;
 	uint32_t need_configuration;
 	uint8_t is_initialized;
+	/* init settings already written during power up */
+	uint8_t init_settings_loaded;
 };
 
 void msm_sensor_start_stream(struct msm_sensor_ctrl_t *s_ctrl);
@@ -841,6 +841,7 @@ static struct i2c_driver ov8825_i2c_driver = {
 
 static struct msm_camera_i2c_client ov8825_sensor_i2c_client = {
 	.addr_type = MSM_CAMERA_I2C_WORD_ADDR,
+	.max_burst = 64,
 };
 
 
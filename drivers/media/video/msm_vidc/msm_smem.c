@@ -23,7 +23,6 @@ static int ion_user_to_kernel(struct smem_client *client,
 			int fd, u32 offset, struct msm_smem *mem)
 {
 	struct ion_handle *hndl;
-	unsigned long ionflag;
 	size_t len;
 	int rc = 0;
 	hndl = ion_import_dma_buf(client->clnt, fd);
@@ -33,24 +32,16 @@ static int ion_user_to_kernel(struct smem_client *client,
 		rc = -ENOMEM;
 		goto fail_import_fd;
 	}
-	rc = ion_handle_get_flags(client->clnt, hndl, &ionflag);
-	if (rc) {
-		pr_err("Failed to get ion flags: %d", rc);
-		goto fail_map;
-	}
 	rc = ion_phys(client->clnt, hndl, &mem->paddr, &len);
 	if (rc) {
 		pr_err("Failed to get physical address\n");
 		goto fail_map;
 	}
-	mem->kvaddr = ion_map_kernel(client->clnt, hndl, ionflag);
-	if (!mem->kvaddr) {
-		pr_err("Failed to map shared mem in kernel\n");
-		rc = -EIO;
-		goto fail_map;
-	}
 
-	mem->kvaddr += offset;
+	/*
+	 * Client buffers are only ever touched by the core, so they are not
+	 * mapped into the kernel; kvaddr stays NULL.
+	 */
 	mem->paddr += offset;
 	mem->mem_type = client->mem_type;
 	mem->smem_priv = hndl;
@@ -104,7 +95,8 @@ skip_mem_alloc:
 
 static void free_ion_mem(struct smem_client *client, struct msm_smem *mem)
 {
-	ion_unmap_kernel(client->clnt, mem->smem_priv);
+	if (mem->kvaddr)
+		ion_unmap_kernel(client->clnt, mem->smem_priv);
 	ion_free(client->clnt, mem->smem_priv);
 }
 
@@ -153,6 +145,28 @@ struct msm_smem *msm_smem_user_to_kernel(void *clt, int fd, u32 offset)
 	return mem;
 }
 
+/*
+ * The client's handle for the buffer behind @fd. ION hands a client the
+ * same handle for every import of a buffer, however often it was
+ * exported, so it identifies the buffer independently of fd and dma_buf.
+ */
+void *msm_smem_get_buf_id(void *clt, int fd)
+{
+	struct smem_client *client = clt;
+	struct ion_handle *hndl;
+	if (!client || client->mem_type != SMEM_ION || fd < 0)
+		return NULL;
+	hndl = ion_import_dma_buf(client->clnt, fd);
+	return IS_ERR_OR_NULL(hndl) ? NULL : hndl;
+}
+
+void msm_smem_put_buf_id(void *clt, void *id)
+{
+	struct smem_client *client = clt;
+	if (id)
+		ion_free(client->clnt, id);
+}
+
 void *msm_smem_new_client(enum smem_type mtype)
 {
 	struct smem_client *client = NULL;
@@ -35,4 +35,6 @@ struct msm_smem *msm_smem_alloc(void *clt, size_t size, u32 align, u32 flags);
 void msm_smem_free(void *clt, struct msm_smem *mem);
 void msm_smem_delete_client(void *clt);
 struct msm_smem *msm_smem_user_to_kernel(void *clt, int fd, u32 offset);
+void *msm_smem_get_buf_id(void *clt, int fd);
+void msm_smem_put_buf_id(void *clt, void *id);
 #endif
@@ -21,12 +21,16 @@
 #include <linux/debugfs.h>
 #include <linux/version.h>
 #include <linux/slab.h>
+#include <linux/seq_file.h>
 
 #include <media/msm_vidc.h>
 #include "msm_vidc_internal.h"
 #include "vidc_hal_api.h"
 #include "msm_smem.h"
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/msm_vidc.h>
+
 #define BASE_DEVICE_NUMBER 32
 #define MAX_EVENTS 30
 
@@ -40,6 +44,10 @@ struct buffer_info {
 	int size;
 	u32 uvaddr;
 	struct msm_smem *handle;
+	/* firmware session the buffer is registered with, 0 if none */
+	u32 session_gen;
+	/* released by the client but kept mapped for reuse */
+	bool parked;
 };
 
 struct msm_v4l2_vid_inst {
@@ -78,8 +86,77 @@ static int msm_vidc_v4l2_setup_event_queue(void *inst,
 	return rc;
 }
 
+/*
+ * Identity of the buffer behind @fd, independent of the fd and of the
+ * dma_buf it came in on: the ion handle a registered buffer keeps in
+ * handle->smem_priv.
+ */
+static void *get_buf_id(struct msm_v4l2_vid_inst *v4l2_inst, int fd)
+{
+	return msm_smem_get_buf_id(v4l2_inst->mem_client, fd);
+}
+
+static void put_buf_id(struct msm_v4l2_vid_inst *v4l2_inst, void *id)
+{
+	msm_smem_put_buf_id(v4l2_inst->mem_client, id);
+}
+
+static void unregister_buf(struct msm_v4l2_vid_inst *v4l2_inst,
+				struct buffer_info *binfo)
+{
+	trace_msm_vidc_buf_unregister(binfo->fd, binfo->handle->device_addr);
+	list_del(&binfo->list);
+	msm_smem_free(v4l2_inst->mem_client, binfo->handle);
+	kfree(binfo);
+}
+
+/* Take the buffer back from firmware, if it still has it, and unmap it */
+static void release_buf(struct msm_v4l2_vid_inst *v4l2_inst,
+				struct buffer_info *bi)
+{
+	struct v4l2_buffer buffer_info;
+	struct v4l2_plane plane;
+	int rc;
+	if (v4l2_inst->vidc_inst.session_type == MSM_VIDC_DECODER &&
+		bi->session_gen &&
+		bi->session_gen == v4l2_inst->vidc_inst.session_gen) {
+		buffer_info.type = bi->type;
+		plane.reserved[0] = bi->fd;
+		plane.reserved[1] = bi->buff_off;
+		plane.length = bi->size;
+		plane.m.userptr = bi->handle->device_addr;
+		buffer_info.m.planes = &plane;
+		buffer_info.length = 1;
+		pr_debug("Releasing buffer: %d, %d, %d\n",
+			buffer_info.m.planes[0].reserved[0],
+			buffer_info.m.planes[0].reserved[1],
+			buffer_info.m.planes[0].length);
+		rc = msm_vidc_release_buf(&v4l2_inst->vidc_inst,
+			&buffer_info);
+		if (rc)
+			pr_err("Failed to release buffer: %d\n", rc);
+	}
+	v4l2_inst->vidc_inst.pool_stats.released++;
+	unregister_buf(v4l2_inst, bi);
+}
+
+/* Drop parked buffers the client did not bring back */
+static void release_parked_bufs(struct msm_v4l2_vid_inst *v4l2_inst)
+{
+	struct buffer_info *bi, *tmp;
+	list_for_each_entry_safe(bi, tmp, &v4l2_inst->registered_bufs, list)
+		if (bi->parked)
+			release_buf(v4l2_inst, bi);
+}
+
+/*
+ * Match on fd first; when @id is given also match the underlying
+ * buffer, so a buffer shared by another driver (e.g. camera) and passed
+ * in under a different fd number still finds its existing mapping.
+ */
 struct buffer_info *get_registered_buf(struct list_head *list,
-				int fd, u32 buff_off, u32 size)
+				int fd, u32 buff_off, u32 size,
+				void *id)
 {
 	struct buffer_info *temp;
 	struct buffer_info *ret = NULL;
@@ -89,7 +166,8 @@ struct buffer_info *get_registered_buf(struct list_head *list,
 	}
 	if (!list_empty(list)) {
 		list_for_each_entry(temp, list, list) {
-			if (temp && temp->fd == fd &&
+			if (temp && (temp->fd == fd ||
+				(id && temp->handle->smem_priv == id)) &&
 			(CONTAINS(temp->buff_off, temp->size, buff_off)
 			|| CONTAINS(buff_off, size, temp->buff_off)
 			|| OVERLAPS(buff_off, size,
@@ -156,9 +234,7 @@ static int msm_v4l2_close(struct file *filp)
 	rc = msm_vidc_close(vidc_inst);
 	list_for_each_safe(ptr, next, &v4l2_inst->registered_bufs) {
 		binfo = list_entry(ptr, struct buffer_info, list);
-		list_del(&binfo->list);
-		msm_smem_free(v4l2_inst->mem_client, binfo->handle);
-		kfree(binfo);
+		unregister_buf(v4l2_inst, binfo);
 	}
 	msm_smem_delete_client(v4l2_inst->mem_client);
 	kfree(v4l2_inst);
@@ -213,33 +289,23 @@ int msm_v4l2_reqbufs(struct file *file, void *fh,
 	struct msm_vidc_inst *vidc_inst = get_vidc_inst(file, fh);
 	struct msm_v4l2_vid_inst *v4l2_inst;
 	struct list_head *ptr, *next;
-	int rc;
 	struct buffer_info *bi;
-	struct v4l2_buffer buffer_info;
-	struct v4l2_plane plane;
 	v4l2_inst = get_v4l2_inst(file, NULL);
 	if (b->count == 0) {
 		list_for_each_safe(ptr, next, &v4l2_inst->registered_bufs) {
 			bi = list_entry(ptr, struct buffer_info, list);
-			if (bi->type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE) {
-				buffer_info.type = bi->type;
-				plane.reserved[0] = bi->fd;
-				plane.reserved[1] = bi->buff_off;
-				plane.length = bi->size;
-				plane.m.userptr = bi->uvaddr;
-				buffer_info.m.planes = &plane;
-				buffer_info.length = 1;
-				pr_info("Releasing buffer: %d, %d, %d\n",
-				buffer_info.m.planes[0].reserved[0],
-				buffer_info.m.planes[0].reserved[1],
-				buffer_info.m.planes[0].length);
-				rc = msm_vidc_release_buf(&v4l2_inst->vidc_inst,
-					&buffer_info);
-				list_del(&bi->list);
-				msm_smem_free(v4l2_inst->mem_client,
-					bi->handle);
-				kfree(bi);
-			}
+			if (bi->type != V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE)
+				continue;
+			/*
+			 * Decoder output buffers usually come straight back
+			 * after a flush, seek or reconfiguration; keep them
+			 * mapped and registered until prepare or streamon
+			 * shows they are not wanted.
+			 */
+			if (vidc_inst->session_type == MSM_VIDC_DECODER)
+				bi->parked = true;
+			else
+				release_buf(v4l2_inst, bi);
 		}
 	}
 	return msm_vidc_reqbufs((void *)vidc_inst, b);
@@ -250,9 +316,14 @@ int msm_v4l2_prepare_buf(struct file *file, void *fh,
 {
 	struct msm_smem *handle;
 	struct buffer_info *binfo;
+	struct buffer_info *planes[VIDEO_MAX_PLANES];
+	struct v4l2_plane fw_planes[VIDEO_MAX_PLANES];
+	struct v4l2_buffer fw_buf;
 	struct msm_vidc_inst *vidc_inst;
 	struct msm_v4l2_vid_inst *v4l2_inst;
-	int i, rc = 0;
+	unsigned long fw_held = 0;
+	void *id;
+	int i, kept = 0, reused = 0, rc = 0;
 	vidc_inst = get_vidc_inst(file, fh);
 	v4l2_inst = get_v4l2_inst(file, fh);
 	if (!v4l2_inst->mem_client) {
@@ -260,21 +331,56 @@ int msm_v4l2_prepare_buf(struct file *file, void *fh,
 		rc = -ENOMEM;
 		goto exit;
 	}
+	if (b->length > VIDEO_MAX_PLANES) {
+		pr_err("Too many planes: %d\n", b->length);
+		rc = -EINVAL;
+		goto exit;
+	}
 	for (i = 0; i < b->length; ++i) {
+		id = get_buf_id(v4l2_inst, b->m.planes[i].reserved[0]);
 		binfo = get_registered_buf(&v4l2_inst->registered_bufs,
 				b->m.planes[i].reserved[0],
 				b->m.planes[i].reserved[1],
-				b->m.planes[i].length);
+				b->m.planes[i].length, id);
+		if (binfo && id && binfo->handle->smem_priv == id &&
+			binfo->buff_off == b->m.planes[i].reserved[1] &&
+			binfo->size >= b->m.planes[i].length) {
+			/*
+			 * Same buffer again, and large enough for the
+			 * current format: keep the existing mapping, and
+			 * the firmware registration if the session is
+			 * the one it was made in.
+			 */
+			put_buf_id(v4l2_inst, id);
+			binfo->fd = b->m.planes[i].reserved[0];
+			binfo->uvaddr = b->m.planes[i].m.userptr;
+			binfo->parked = false;
+			b->m.planes[i].m.userptr = binfo->handle->device_addr;
+			trace_msm_vidc_buf_register(binfo->fd, binfo->buff_off,
+				binfo->handle->device_addr, binfo->size, 1);
+			planes[i] = binfo;
+			kept++;
+			if (binfo->session_gen == vidc_inst->session_gen) {
+				__set_bit(i, &fw_held);
+				reused++;
+			}
+			continue;
+		}
+		if (binfo && binfo->parked) {
+			/* grown by a reconfiguration, or a different buffer */
+			release_buf(v4l2_inst, binfo);
+			binfo = NULL;
+		}
 		if (binfo) {
 			pr_err("This memory region has already been prepared\n");
 			rc = -EINVAL;
-			goto exit;
+			goto put_id;
 		}
 		binfo = kzalloc(sizeof(*binfo), GFP_KERNEL);
 		if (!binfo) {
 			pr_err("Out of memory\n");
 			rc = -ENOMEM;
-			goto exit;
+			goto put_id;
 		}
 		handle = msm_smem_user_to_kernel(v4l2_inst->mem_client,
 				b->m.planes[i].reserved[0],
@@ -282,7 +388,7 @@ int msm_v4l2_prepare_buf(struct file *file, void *fh,
 		if (!handle) {
 			pr_err("Failed to get device buffer address\n");
 			kfree(binfo);
-			goto exit;
+			goto put_id;
 		}
 		binfo->type = b->type;
 		binfo->fd = b->m.planes[i].reserved[0];
@@ -290,14 +396,44 @@ int msm_v4l2_prepare_buf(struct file *file, void *fh,
 		binfo->size = b->m.planes[i].length;
 		binfo->uvaddr = b->m.planes[i].m.userptr;
 		binfo->handle = handle;
+		put_buf_id(v4l2_inst, id);
 		pr_debug("Registering buffer: %d, %d, %d\n",
 				b->m.planes[i].reserved[0],
 				b->m.planes[i].reserved[1],
 				b->m.planes[i].length);
+		trace_msm_vidc_buf_register(binfo->fd, binfo->buff_off,
+			handle->device_addr, binfo->size, 0);
 		list_add_tail(&binfo->list, &v4l2_inst->registered_bufs);
 		b->m.planes[i].m.userptr = handle->device_addr;
+		planes[i] = binfo;
+	}
+	/* the firmware already holds fully reused buffers */
+	if (reused == b->length) {
+		vidc_inst->pool_stats.reused++;
+		return 0;
 	}
-	rc = msm_vidc_prepare_buf(&v4l2_inst->vidc_inst, b);
+	/*
+	 * Only hand the firmware the planes it does not hold yet,
+	 * setting a held plane again would make it track it twice.
+	 */
+	fw_buf = *b;
+	fw_buf.m.planes = fw_planes;
+	fw_buf.length = 0;
+	for (i = 0; i < b->length; ++i)
+		if (!test_bit(i, &fw_held))
+			fw_planes[fw_buf.length++] = b->m.planes[i];
+	rc = msm_vidc_prepare_buf(&v4l2_inst->vidc_inst, &fw_buf);
+	if (rc)
+		return rc;
+	for (i = 0; i < b->length; ++i)
+		planes[i]->session_gen = vidc_inst->session_gen;
+	if (kept == b->length)
+		vidc_inst->pool_stats.fw_reregistered++;
+	else
+		vidc_inst->pool_stats.registered++;
+	return rc;
+put_id:
+	put_buf_id(v4l2_inst, id);
 exit:
 	return rc;
 }
@@ -308,6 +444,7 @@ int msm_v4l2_qbuf(struct file *file, void *fh,
 	struct msm_vidc_inst *vidc_inst;
 	struct msm_v4l2_vid_inst *v4l2_inst;
 	struct buffer_info *binfo;
+	void *id;
 	int rc = 0;
 	int i;
 	vidc_inst = get_vidc_inst(file, fh);
@@ -316,7 +453,19 @@ int msm_v4l2_qbuf(struct file *file, void *fh,
 		binfo = get_registered_buf(&v4l2_inst->registered_bufs,
 				b->m.planes[i].reserved[0],
 				b->m.planes[i].reserved[1],
-				b->m.planes[i].length);
+				b->m.planes[i].length, NULL);
+		if (!binfo) {
+			id = get_buf_id(v4l2_inst,
+					b->m.planes[i].reserved[0]);
+			if (id) {
+				binfo = get_registered_buf(
+					&v4l2_inst->registered_bufs,
+					b->m.planes[i].reserved[0],
+					b->m.planes[i].reserved[1],
+					b->m.planes[i].length, id);
+				put_buf_id(v4l2_inst, id);
+			}
+		}
 		if (!binfo) {
 			pr_err("This buffer is not registered: %d, %d, %d\n",
 				b->m.planes[i].reserved[0],
@@ -325,9 +474,12 @@ int msm_v4l2_qbuf(struct file *file, void *fh,
 			rc = -EINVAL;
 			goto err_invalid_buff;
 		}
+		binfo->parked = false;
 		b->m.planes[i].m.userptr = binfo->handle->device_addr;
 		pr_debug("Queueing device address = %ld\n",
 				binfo->handle->device_addr);
+		trace_msm_vidc_buf_queue(b->m.planes[i].reserved[0],
+				binfo->handle->device_addr);
 	}
 	rc = msm_vidc_qbuf(&v4l2_inst->vidc_inst, b);
 err_invalid_buff:
@@ -345,6 +497,8 @@ int msm_v4l2_streamon(struct file *file, void *fh,
 				enum v4l2_buf_type i)
 {
 	struct msm_vidc_inst *vidc_inst = get_vidc_inst(file, fh);
+	if (i == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE)
+		release_parked_bufs(get_v4l2_inst(file, fh));
 	return msm_vidc_streamon((void *)vidc_inst, i);
 }
 
@@ -452,6 +606,36 @@ static int msm_vidc_initialize_core(struct platform_device *pdev,
 	return 0;
 }
 
+static int buf_pool_show(struct seq_file *m, void *unused)
+{
+	struct msm_vidc_core *core = m->private;
+	struct msm_vidc_inst *inst;
+	struct msm_vidc_buf_pool_stats *st;
+	mutex_lock(&core->sync_lock);
+	list_for_each_entry(inst, &core->instances, list) {
+		st = &inst->pool_stats;
+		seq_printf(m,
+			"inst %p %s: registered %u reused %u fw_reregistered %u released %u scratch_reused %u\n",
+			inst, inst->session_type == MSM_VIDC_DECODER ?
+			"dec" : "enc", st->registered, st->reused,
+			st->fw_reregistered, st->released, st->scratch_reused);
+	}
+	mutex_unlock(&core->sync_lock);
+	return 0;
+}
+
+static int buf_pool_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, buf_pool_show, inode->i_private);
+}
+
+static const struct file_operations buf_pool_fops = {
+	.open = buf_pool_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 static int __devinit msm_vidc_probe(struct platform_device *pdev)
 {
 	int rc = 0;
@@ -522,6 +706,8 @@ static int __devinit msm_vidc_probe(struct platform_device *pdev)
 	snprintf(debugfs_name, MAX_DEBUGFS_NAME, "core%d", core->id);
 	core->debugfs_root = debugfs_create_dir(debugfs_name,
 						vidc_driver->debugfs_root);
+	debugfs_create_file("buf_pool", S_IRUGO, core->debugfs_root, core,
+			&buf_pool_fops);
 	pdev->dev.platform_data = core;
 	return rc;
 
@@ -633,6 +633,7 @@ static int msm_comm_session_init(int flipped_state,
 				inst->session_type, fourcc);
 		goto exit;
 	}
+	inst->session_gen++;
 	change_inst_state(inst, MSM_VIDC_OPEN);
 exit:
 	return rc;
@@ -946,18 +947,78 @@ exit:
 	return rc;
 }
 
+static int set_scratch_buffer(struct msm_vidc_inst *inst,
+		struct internal_buf *binfo)
+{
+	struct vidc_buffer_addr_info buffer_info;
+	int rc;
+	buffer_info.buffer_size = binfo->size;
+	buffer_info.buffer_type = HAL_BUFFER_INTERNAL_SCRATCH;
+	buffer_info.num_buffers = 1;
+	buffer_info.align_device_addr = binfo->handle->device_addr;
+	rc = vidc_hal_session_set_buffers((void *) inst->session,
+			&buffer_info);
+	if (rc)
+		pr_err("vidc_hal_session_set_buffers failed");
+	else
+		binfo->session_gen = inst->session_gen;
+	return rc;
+}
+
+/*
+ * Keep the current scratch set when it still satisfies the firmware's
+ * requirement; only hand it to firmware again if the session changed.
+ * Returns 1 when the set was kept.
+ */
+static int reuse_scratch_buffers(struct msm_vidc_inst *inst,
+		int count, u32 size)
+{
+	struct internal_buf *binfo;
+	unsigned long flags;
+	int n = 0, stale = 0, rc = 0;
+	/* The HAL command queue write only takes spinlocks. */
+	spin_lock_irqsave(&inst->lock, flags);
+	list_for_each_entry(binfo, &inst->internalbufs, list) {
+		if (binfo->size < size)
+			goto out;
+		if (binfo->session_gen != inst->session_gen)
+			stale++;
+		n++;
+	}
+	if (!n || n != count)
+		goto out;
+	if (stale) {
+		list_for_each_entry(binfo, &inst->internalbufs, list) {
+			if (binfo->session_gen == inst->session_gen)
+				continue;
+			rc = set_scratch_buffer(inst, binfo);
+			if (rc)
+				goto out;
+		}
+	}
+	inst->pool_stats.scratch_reused++;
+	rc = 1;
+out:
+	spin_unlock_irqrestore(&inst->lock, flags);
+	return rc;
+}
+
 int msm_comm_set_scratch_buffers(struct msm_vidc_inst *inst)
 {
 	int rc = 0;
 	struct msm_smem *handle;
 	struct internal_buf *binfo;
 	struct list_head *ptr, *next;
-	struct vidc_buffer_addr_info buffer_info;
 	unsigned long flags;
 	int i;
 	pr_debug("scratch: num = %d, size = %d\n",
 			inst->buff_req.buffer[6].buffer_count_actual,
 			inst->buff_req.buffer[6].buffer_size);
+	rc = reuse_scratch_buffers(inst,
+			inst->buff_req.buffer[6].buffer_count_actual,
+			inst->buff_req.buffer[6].buffer_size);
+	if (rc)
+		return rc < 0 ? rc : 0;
 	spin_lock_irqsave(&inst->lock, flags);
 	if (!list_empty(&inst->internalbufs)) {
 		list_for_each_safe(ptr, next, &inst->internalbufs) {
@@ -987,20 +1048,13 @@ int msm_comm_set_scratch_buffers(struct msm_vidc_inst *inst)
 			goto err_no_mem;
 		}
 		binfo->handle = handle;
+		binfo->size = inst->buff_req.buffer[6].buffer_size;
 		spin_lock_irqsave(&inst->lock, flags);
 		list_add_tail(&binfo->list, &inst->internalbufs);
 		spin_unlock_irqrestore(&inst->lock, flags);
-		buffer_info.buffer_size =
-				inst->buff_req.buffer[6].buffer_size;
-		buffer_info.buffer_type = HAL_BUFFER_INTERNAL_SCRATCH;
-		buffer_info.num_buffers = 1;
-		buffer_info.align_device_addr = handle->device_addr;
-		rc = vidc_hal_session_set_buffers((void *) inst->session,
-				&buffer_info);
-		if (rc) {
-			pr_err("vidc_hal_session_set_buffers failed");
+		rc = set_scratch_buffer(inst, binfo);
+		if (rc)
 			break;
-		}
 	}
 err_no_mem:
 	return rc;
@@ -83,6 +83,22 @@ struct buf_info {
 struct internal_buf {
 	struct list_head list;
 	struct msm_smem *handle;
+	u32 size;
+	/* session the buffer was last handed to firmware in */
+	u32 session_gen;
+};
+
+/*
+ * Output buffers (and scratch buffers) keep their IOMMU mapping and
+ * firmware registration across flush, seek and reconfigurations that
+ * do not grow them; these count how often that saved work.
+ */
+struct msm_vidc_buf_pool_stats {
+	u32 registered;		/* mapped and sent to firmware */
+	u32 reused;		/* mapping and registration kept */
+	u32 fw_reregistered;	/* mapping kept, new session needed it */
+	u32 released;		/* dropped as incompatible or unused */
+	u32 scratch_reused;	/* scratch set kept on start */
 };
 
 struct msm_vidc_format {
@@ -146,6 +162,9 @@ struct msm_vidc_inst {
 	bool in_reconfig;
 	u32 reconfig_width;
 	u32 reconfig_height;
+	/* bumped for every firmware session, 0 means never opened */
+	u32 session_gen;
+	struct msm_vidc_buf_pool_stats pool_stats;
 };
 
 extern struct msm_vidc_drv *vidc_driver;
@@ -20,12 +20,14 @@
 #include <linux/init.h>
 #include <linux/module.h>
 #include <linux/mm.h>
+#include <linux/fs.h>
 #include <linux/slab.h>
 #include <linux/pagemap.h>
 #include <linux/sched.h>
 #include <linux/io.h>
 #include <linux/android_pmem.h>
 #include <linux/memory_alloc.h>
+#include <linux/dma-buf.h>
 #include <media/videobuf2-msm-mem.h>
 #include <media/msm_camera.h>
 #include <mach/memory.h>
@@ -160,13 +162,188 @@ int videobuf2_pmem_contig_mmap_get(struct videobuf2_contig_pmem *mem,
 }
 EXPORT_SYMBOL_GPL(videobuf2_pmem_contig_mmap_get);
 
+void videobuf2_msm_map_cache_init(struct videobuf2_msm_map_cache *cache)
+{
+	mutex_init(&cache->lock);
+	INIT_LIST_HEAD(&cache->maps);
+	cache->count = 0;
+	cache->hits = 0;
+	cache->misses = 0;
+}
+EXPORT_SYMBOL_GPL(videobuf2_msm_map_cache_init);
+
+#ifdef CONFIG_MSM_MULTIMEDIA_USE_ION
+static void msm_mem_map_release(struct videobuf2_msm_map_cache *cache,
+				struct ion_client *client,
+				struct videobuf2_msm_map *map)
+{
+	list_del(&map->list);
+	cache->count--;
+	ion_unmap_iommu(client, map->ion_handle, CAMERA_DOMAIN, GEN_POOL);
+	ion_free(client, map->ion_handle);
+	dma_buf_put(map->dbuf);
+	kfree(map);
+}
+
+/*
+ * An idle mapping whose dma-buf is referenced by the cache alone is
+ * likely dead: user space closed every fd of the export we hold. A
+ * later export of the same buffer is simply mapped again.
+ */
+static bool msm_mem_map_orphaned(struct videobuf2_msm_map *map)
+{
+	return !map->users && file_count(map->dbuf->file) == 1;
+}
+
+/*
+ * Drop orphaned mappings, then the least recently used idle ones over
+ * the limit, cache->lock held
+ */
+static void msm_mem_map_trim(struct videobuf2_msm_map_cache *cache,
+				struct ion_client *client)
+{
+	struct videobuf2_msm_map *map, *tmp;
+
+	list_for_each_entry_safe_reverse(map, tmp, &cache->maps, list) {
+		if (msm_mem_map_orphaned(map) ||
+		    (!map->users &&
+		     cache->count > VIDEOBUF2_MSM_MAP_CACHE_MAX))
+			msm_mem_map_release(cache, client, map);
+	}
+}
+
+/*
+ * Look the buffer behind @fd up by its ION handle rather than by fd or
+ * dma-buf: every export of an ION buffer is a new dma-buf, but @client
+ * gets the same handle back for each import of it. So a buffer shared
+ * with another driver or re-registered by user space reuses its
+ * existing IOMMU mapping.
+ */
+static int msm_mem_map_get(struct videobuf2_msm_map_cache *cache,
+			struct ion_client *client, int fd,
+			struct videobuf2_contig_pmem *mem)
+{
+	struct videobuf2_msm_map *map;
+	struct ion_handle *handle;
+	struct dma_buf *dbuf;
+	int rc = 0;
+
+	dbuf = dma_buf_get(fd);
+	if (IS_ERR_OR_NULL(dbuf)) {
+		pr_err("%s invalid dma-buf fd %d\n", __func__, fd);
+		return -EINVAL;
+	}
+	handle = ion_import_dma_buf(client, fd);
+	if (IS_ERR_OR_NULL(handle)) {
+		pr_err("%s ION import failed\n", __func__);
+		dma_buf_put(dbuf);
+		return handle ? PTR_ERR(handle) : -EINVAL;
+	}
+
+	mutex_lock(&cache->lock);
+	list_for_each_entry(map, &cache->maps, list) {
+		if (map->ion_handle == handle) {
+			/* the cache holds its own import */
+			ion_free(client, handle);
+			/* keep the newest export for the orphan check */
+			if (map->dbuf != dbuf) {
+				dma_buf_put(map->dbuf);
+				map->dbuf = dbuf;
+			} else {
+				dma_buf_put(dbuf);
+			}
+			list_move(&map->list, &cache->maps);
+			cache->hits++;
+			mem->map_cached = 1;
+			goto out;
+		}
+	}
+
+	map = kzalloc(sizeof(*map), GFP_KERNEL);
+	if (!map) {
+		rc = -ENOMEM;
+		goto alloc_failed;
+	}
+	map->ion_handle = handle;
+	rc = ion_map_iommu(client, map->ion_handle, CAMERA_DOMAIN, GEN_POOL,
+		SZ_4K, 0, &map->phyaddr, &map->len, UNCACHED, 0);
+	if (rc < 0) {
+		pr_err("%s Could not map buffer %d\n", __func__, rc);
+		goto map_failed;
+	}
+	map->dbuf = dbuf;
+	list_add(&map->list, &cache->maps);
+	cache->count++;
+	cache->misses++;
+	mem->map_cached = 0;
+	msm_mem_map_trim(cache, client);
+out:
+	map->users++;
+	mem->map = map;
+	mem->ion_handle = map->ion_handle;
+	mem->phyaddr = map->phyaddr;
+	mutex_unlock(&cache->lock);
+	return 0;
+
+map_failed:
+	kfree(map);
+alloc_failed:
+	mutex_unlock(&cache->lock);
+	ion_free(client, handle);
+	dma_buf_put(dbuf);
+	return rc;
+}
+
+static void msm_mem_map_put(struct videobuf2_msm_map_cache *cache,
+			struct ion_client *client,
+			struct videobuf2_contig_pmem *mem)
+{
+	mutex_lock(&cache->lock);
+	mem->map->users--;
+	msm_mem_map_trim(cache, client);
+	mutex_unlock(&cache->lock);
+	mem->map = NULL;
+}
+#endif
+
+/**
+ * videobuf2_msm_map_cache_flush() - release all cached IOMMU mappings
+ * @cache: cache to empty
+ * @client: ION client the buffers were imported with
+ *
+ * Must be called before @client is destroyed. Mappings still marked in
+ * use are reported and released as well, since their handles go away
+ * with the client.
+ */
+void videobuf2_msm_map_cache_flush(struct videobuf2_msm_map_cache *cache,
+					struct ion_client *client)
+{
+#ifdef CONFIG_MSM_MULTIMEDIA_USE_ION
+	struct videobuf2_msm_map *map, *tmp;
+
+	mutex_lock(&cache->lock);
+	list_for_each_entry_safe(map, tmp, &cache->maps, list) {
+		if (map->users)
+			pr_err("%s mapping 0x%lx still has %u users\n",
+				__func__, map->phyaddr, map->users);
+		msm_mem_map_release(cache, client, map);
+	}
+	D("%s map cache hits %u misses %u\n", __func__,
+		cache->hits, cache->misses);
+	mutex_unlock(&cache->lock);
+#endif
+}
+EXPORT_SYMBOL_GPL(videobuf2_msm_map_cache_flush);
+
 /**
  * videobuf_pmem_contig_user_get() - setup user space memory pointer
  * @mem: per-buffer private videobuf-contig-pmem data
  * @vb: video buffer to map
  *
  * This function validates and sets up a pointer to user space memory.
- * Only physically contiguous pfn-mapped memory is accepted.
+ * Only physically contiguous pfn-mapped memory is accepted. With ION
+ * the buffer is an imported dma-buf fd whose IOMMU mapping is kept in
+ * @cache.
  *
  * Returns 0 if successful.
  */
@@ -174,26 +351,21 @@ int videobuf2_pmem_contig_user_get(struct videobuf2_contig_pmem *mem,
 					struct videobuf2_msm_offset *offset,
 					enum videobuf2_buffer_type buffer_type,
 					uint32_t addr_offset, int path,
-					struct ion_client *client)
+					struct ion_client *client,
+					struct videobuf2_msm_map_cache *cache)
 {
-	unsigned long len;
 	int rc = 0;
 #ifndef CONFIG_MSM_MULTIMEDIA_USE_ION
 	unsigned long kvstart;
+	unsigned long len;
 #endif
 	unsigned long paddr = 0;
 	if (mem->phyaddr != 0)
 		return 0;
 #ifdef CONFIG_MSM_MULTIMEDIA_USE_ION
-	mem->ion_handle = ion_import_dma_buf(client, (int)mem->vaddr);
-	if (IS_ERR_OR_NULL(mem->ion_handle)) {
-		pr_err("%s ION import failed\n", __func__);
-		return PTR_ERR(mem->ion_handle);
-	}
-	rc = ion_map_iommu(client, mem->ion_handle, CAMERA_DOMAIN, GEN_POOL,
-		SZ_4K, 0, (unsigned long *)&mem->phyaddr, &len, UNCACHED, 0);
+	rc = msm_mem_map_get(cache, client, (int)mem->vaddr, mem);
 	if (rc < 0)
-		ion_free(client, mem->ion_handle);
+		return rc;
 #elif CONFIG_ANDROID_PMEM
 	rc = get_pmem_file((int)mem->vaddr, (unsigned long *)&mem->phyaddr,
 					&kvstart, &len, &mem->file);
@@ -220,13 +392,14 @@ int videobuf2_pmem_contig_user_get(struct videobuf2_contig_pmem *mem,
 EXPORT_SYMBOL_GPL(videobuf2_pmem_contig_user_get);
 
 void videobuf2_pmem_contig_user_put(struct videobuf2_contig_pmem *mem,
-					struct ion_client *client)
+					struct ion_client *client,
+					struct videobuf2_msm_map_cache *cache)
 {
 	if (mem->is_userptr) {
 #ifdef CONFIG_MSM_MULTIMEDIA_USE_ION
-		ion_unmap_iommu(client, mem->ion_handle,
-				CAMERA_DOMAIN, GEN_POOL);
-		ion_free(client, mem->ion_handle);
+		if (mem->map)
+			msm_mem_map_put(cache, client, mem);
+		mem->ion_handle = NULL;
 #elif CONFIG_ANDROID_PMEM
 		put_pmem_file(mem->file);
 #endif
@@ -349,6 +349,9 @@ static ssize_t sps_set_bam_addr(struct file *file, const char __user *buf,
 		print_bam_pipe_selected_reg(vir_addr, 5);
 		print_bam_pipe_desc_fifo(vir_addr, 5);
 		break;
+	case 10: /* output transfer statistics of all active pipes */
+		sps_bam_print_pipe_stats(bam);
+		break;
 	default:
 		pr_info("sps:no dump option is chosen yet.");
 	}
@@ -1014,6 +1014,12 @@ int sps_bam_pipe_set_params(struct sps_bam *dev, u32 pipe_index, u32 options)
 		mask |= opt_event_table[n].pipe_irq;
 	}
 
+	/* Keep the inactivity interrupt used for moderation */
+	if (pipe->sys.irq_mod_count) {
+		pipe->sys.irq_mod_inactive = ((mask & BAM_PIPE_IRQ_TIMER) == 0);
+		mask |= BAM_PIPE_IRQ_TIMER;
+	}
+
 #ifdef SPS_BAM_STATISTICS
 	/* Is an illegal mode change specified? */
 	if (pipe->sys.desc_wr_count > 0 &&
@@ -1153,61 +1159,24 @@ int sps_bam_pipe_reg_event(struct sps_bam *dev,
 }
 
 /**
- * Submit a transfer of a single buffer to a BAM pipe
+ * Write a descriptor to a BAM pipe descriptor FIFO
+ *
+ * This function writes one descriptor to the hardware descriptor FIFO and
+ *    the software cache, without notifying the pipe. The caller must have
+ *    checked that the FIFO has room for it.
  *
  */
-int sps_bam_pipe_transfer_one(struct sps_bam *dev,
-				    u32 pipe_index, u32 addr, u32 size,
-				    void *user, u32 flags)
+static inline void pipe_write_desc(struct sps_pipe *pipe, u32 addr, u32 size,
+				   void *user, u32 flags)
 {
-	struct sps_pipe *pipe = dev->pipes[pipe_index];
 	struct sps_iovec *desc;
 	struct sps_iovec iovec;
 	u32 next_write;
 
-	/* Is this a BAM-to-BAM or satellite connection? */
-	if ((pipe->state & (BAM_STATE_BAM2BAM | BAM_STATE_REMOTE))) {
-		SPS_ERR("sps:Transfer on BAM-to-BAM: BAM 0x%x pipe %d",
-			BAM_ID(dev), pipe_index);
-		return SPS_ERROR;
-	}
-
-	/*
-	 * Client identifier (user pointer) is not supported for
-	 * SPS_O_NO_Q option.
-	 */
-	if (pipe->sys.no_queue && user != NULL) {
-		SPS_ERR("sps:User pointer arg non-NULL: BAM 0x%x pipe %d",
-			BAM_ID(dev), pipe_index);
-		return SPS_ERROR;
-	}
-
-	/* Determine if descriptor can be queued */
 	next_write = pipe->sys.desc_offset + sizeof(struct sps_iovec);
 	if (next_write >= pipe->desc_size)
 		next_write = 0;
 
-	if (next_write == pipe->sys.acked_offset) {
-		/*
-		 * If pipe is polled and client is not ACK'ing descriptors,
-		 * perform polling operation so that any outstanding ACKs
-		 * can occur.
-		 */
-		if (!pipe->sys.ack_xfers && pipe->polled) {
-			pipe_handler_eot(dev, pipe);
-			if (next_write == pipe->sys.acked_offset) {
-				SPS_DBG2("sps:Descriptor FIFO is full for BAM "
-					"0x%x pipe %d after pipe_handler_eot",
-					BAM_ID(dev), pipe_index);
-				return SPS_ERROR;
-			}
-		} else {
-			SPS_DBG2("sps:Descriptor FIFO is full for "
-				"BAM 0x%x pipe %d", BAM_ID(dev), pipe_index);
-			return SPS_ERROR;
-		}
-	}
-
 	/* Create descriptor */
 	if (!pipe->sys.no_queue)
 		desc = (struct sps_iovec *) (pipe->sys.desc_cache +
@@ -1236,6 +1205,20 @@ int sps_bam_pipe_transfer_one(struct sps_bam *dev,
 	*((struct sps_iovec *) (pipe->sys.desc_buf + pipe->sys.desc_offset))
 	= *desc;
 
+	/*
+	 * With interrupt moderation only every irq_mod_count'th descriptor
+	 * keeps its INT flag in the hardware FIFO. The cached copy keeps
+	 * the client's flags so that events are still generated for it.
+	 */
+	if (pipe->sys.irq_mod_count && (desc->flags & SPS_IOVEC_FLAG_INT)) {
+		if (++pipe->sys.irq_mod_pending < pipe->sys.irq_mod_count)
+			((struct sps_iovec *) (pipe->sys.desc_buf +
+			  pipe->sys.desc_offset))->flags &=
+				~SPS_IOVEC_FLAG_INT;
+		else
+			pipe->sys.irq_mod_pending = 0;
+	}
+
 	/* Record user pointer value */
 	if (!pipe->sys.no_queue) {
 		u32 index = pipe->sys.desc_offset / sizeof(struct sps_iovec);
@@ -1248,19 +1231,96 @@ int sps_bam_pipe_transfer_one(struct sps_bam *dev,
 
 	/* Update descriptor ACK offset */
 	pipe->sys.desc_offset = next_write;
+	pipe->sys.desc_pending++;
 
 #ifdef SPS_BAM_STATISTICS
 	/* Update statistics */
 	pipe->sys.desc_wr_count++;
 #endif /* SPS_BAM_STATISTICS */
+}
 
-	/* Notify pipe */
-	if ((flags & SPS_IOVEC_FLAG_NO_SUBMIT) == 0) {
-		wmb(); /* Memory Barrier */
-		bam_pipe_set_desc_write_offset(dev->base, pipe_index,
-					       next_write);
+/**
+ * Notify a BAM pipe of new descriptors
+ *
+ * This function updates the pipe's descriptor FIFO write offset so that all
+ *    descriptors written since the last notification are processed.
+ *
+ */
+static inline void pipe_submit(struct sps_bam *dev, struct sps_pipe *pipe)
+{
+	wmb(); /* Memory Barrier */
+	bam_pipe_set_desc_write_offset(dev->base, pipe->pipe_index,
+				       pipe->sys.desc_offset);
+
+	pipe->sys.doorbells++;
+	pipe->sys.doorbell_descs += pipe->sys.desc_pending;
+	pipe->sys.desc_pending = 0;
+
+	/* Restart the inactivity timer for descriptors without INT */
+	if (pipe->sys.irq_mod_pending)
+		bam_pipe_timer_reset(dev->base, pipe->pipe_index);
+}
+
+/**
+ * Submit a transfer of a single buffer to a BAM pipe
+ *
+ */
+int sps_bam_pipe_transfer_one(struct sps_bam *dev,
+				    u32 pipe_index, u32 addr, u32 size,
+				    void *user, u32 flags)
+{
+	struct sps_pipe *pipe = dev->pipes[pipe_index];
+	u32 next_write;
+
+	/* Is this a BAM-to-BAM or satellite connection? */
+	if ((pipe->state & (BAM_STATE_BAM2BAM | BAM_STATE_REMOTE))) {
+		SPS_ERR("sps:Transfer on BAM-to-BAM: BAM 0x%x pipe %d",
+			BAM_ID(dev), pipe_index);
+		return SPS_ERROR;
+	}
+
+	/*
+	 * Client identifier (user pointer) is not supported for
+	 * SPS_O_NO_Q option.
+	 */
+	if (pipe->sys.no_queue && user != NULL) {
+		SPS_ERR("sps:User pointer arg non-NULL: BAM 0x%x pipe %d",
+			BAM_ID(dev), pipe_index);
+		return SPS_ERROR;
+	}
+
+	/* Determine if descriptor can be queued */
+	next_write = pipe->sys.desc_offset + sizeof(struct sps_iovec);
+	if (next_write >= pipe->desc_size)
+		next_write = 0;
+
+	if (next_write == pipe->sys.acked_offset) {
+		/*
+		 * If pipe is polled and client is not ACK'ing descriptors,
+		 * perform polling operation so that any outstanding ACKs
+		 * can occur.
+		 */
+		if (!pipe->sys.ack_xfers && pipe->polled) {
+			pipe_handler_eot(dev, pipe);
+			if (next_write == pipe->sys.acked_offset) {
+				SPS_DBG2("sps:Descriptor FIFO is full for BAM "
+					"0x%x pipe %d after pipe_handler_eot",
+					BAM_ID(dev), pipe_index);
+				return SPS_ERROR;
+			}
+		} else {
+			SPS_DBG2("sps:Descriptor FIFO is full for "
+				"BAM 0x%x pipe %d", BAM_ID(dev), pipe_index);
+			return SPS_ERROR;
+		}
 	}
 
+	pipe_write_desc(pipe, addr, size, user, flags);
+
+	/* Notify pipe */
+	if ((flags & SPS_IOVEC_FLAG_NO_SUBMIT) == 0)
+		pipe_submit(dev, pipe);
+
 	return 0;
 }
 
@@ -1271,12 +1331,10 @@ int sps_bam_pipe_transfer_one(struct sps_bam *dev,
 int sps_bam_pipe_transfer(struct sps_bam *dev,
 			 u32 pipe_index, struct sps_transfer *transfer)
 {
+	struct sps_pipe *pipe = dev->pipes[pipe_index];
 	struct sps_iovec *iovec;
 	u32 count;
-	u32 flags;
-	void *user;
 	int n;
-	int result;
 
 	if (transfer->iovec_count == 0) {
 		SPS_ERR("sps:iovec count zero: BAM 0x%x pipe %d",
@@ -1284,31 +1342,38 @@ int sps_bam_pipe_transfer(struct sps_bam *dev,
 		return SPS_ERROR;
 	}
 
-	sps_bam_get_free_count(dev, pipe_index, &count);
+	if (pipe->sys.no_queue && transfer->user != NULL) {
+		SPS_ERR("sps:User pointer arg non-NULL: BAM 0x%x pipe %d",
+			BAM_ID(dev), pipe_index);
+		return SPS_ERROR;
+	}
+
+	/* Also rejects BAM-to-BAM and satellite connections */
+	if (sps_bam_get_free_count(dev, pipe_index, &count))
+		return SPS_ERROR;
+
 	if (count < transfer->iovec_count) {
 		SPS_ERR("sps:Insufficient free desc: BAM 0x%x pipe %d: %d",
 			BAM_ID(dev), pipe_index, count);
 		return SPS_ERROR;
 	}
 
-	user = NULL;		/* NULL for all except last descriptor */
+	/*
+	 * Room for all descriptors was checked above, so write them
+	 * back to back and notify the pipe once for the whole transfer.
+	 */
 	for (n = (int)transfer->iovec_count - 1, iovec = transfer->iovec;
-	    n >= 0; n--, iovec++) {
-		if (n > 0) {
-			/* This is *not* the last descriptor */
-			flags = iovec->flags | SPS_IOVEC_FLAG_NO_SUBMIT;
-		} else {
-			/* This *is* the last descriptor */
-			flags = iovec->flags;
-			user = transfer->user;
-		}
-		result = sps_bam_pipe_transfer_one(dev, pipe_index,
-						 iovec->addr,
-						 iovec->size, user,
-						 flags);
-		if (result)
-			return SPS_ERROR;
-	}
+	    n > 0; n--, iovec++)
+		/* User pointer is NULL for all except last descriptor */
+		pipe_write_desc(pipe, iovec->addr, iovec->size, NULL,
+				iovec->flags);
+
+	/* This *is* the last descriptor */
+	pipe_write_desc(pipe, iovec->addr, iovec->size, transfer->user,
+			iovec->flags);
+
+	if ((iovec->flags & SPS_IOVEC_FLAG_NO_SUBMIT) == 0)
+		pipe_submit(dev, pipe);
 
 	return 0;
 }
@@ -1442,6 +1507,35 @@ static void pipe_handler_wakeup(struct sps_bam *dev, struct sps_pipe *pipe)
 	}
 }
 
+/**
+ * Copy completed producer descriptors to the descriptor cache
+ *
+ * Copies are done in a tight loop to increase chance of multi-descriptor
+ *    burst accesses on the bus. With interrupt moderation, the INT flag
+ *    stripped from the hardware descriptor is restored from the cache.
+ *
+ */
+static inline void pipe_fetch_desc(struct sps_pipe *pipe,
+				   struct sps_iovec *cache,
+				   struct sps_iovec *desc,
+				   struct sps_iovec *desc_end)
+{
+	u32 flags;
+
+	if (!pipe->sys.irq_mod_count) {
+		while (desc < desc_end)
+			*cache++ = *desc++;
+		return;
+	}
+
+	while (desc < desc_end) {
+		flags = cache->flags & SPS_IOVEC_FLAG_INT;
+		*cache = *desc++;
+		cache->flags |= flags;
+		cache++;
+	}
+}
+
 /**
  * Handle a BAM pipe's EOT/INT interrupt sources
  *
@@ -1538,8 +1632,7 @@ static void pipe_handler_eot(struct sps_bam *dev, struct sps_pipe *pipe)
 		if (end_offset < offset) {
 			desc_end = (struct sps_iovec *)
 				   (pipe->sys.desc_buf + pipe->desc_size);
-			while (desc < desc_end)
-				*cache++ = *desc++;
+			pipe_fetch_desc(pipe, cache, desc, desc_end);
 
 			desc = (void *)pipe->sys.desc_buf;
 			cache = (void *)pipe->sys.desc_cache;
@@ -1548,8 +1641,7 @@ static void pipe_handler_eot(struct sps_bam *dev, struct sps_pipe *pipe)
 		/* Fetch all remaining completed descriptors (no wrap) */
 		desc_end = (struct sps_iovec *)	(pipe->sys.desc_buf +
 						 end_offset);
-		while (desc < desc_end)
-			*cache++ = *desc++;
+		pipe_fetch_desc(pipe, cache, desc, desc_end);
 	}
 
 	/* Process all completed descriptors */
@@ -1566,6 +1658,7 @@ static void pipe_handler_eot(struct sps_bam *dev, struct sps_pipe *pipe)
 			offset = 0;
 
 		*update_offset = offset;
+		pipe->sys.desc_retired++;
 #ifdef SPS_BAM_STATISTICS
 		pipe->sys.desc_rd_count++;
 #endif /* SPS_BAM_STATISTICS */
@@ -1634,6 +1727,7 @@ static void pipe_handler(struct sps_bam *dev, struct sps_pipe *pipe)
 {
 	u32 pipe_index;
 	u32 status;
+	u32 retired;
 	enum sps_event event_id;
 
 	/* Get interrupt sources and ack all */
@@ -1654,9 +1748,22 @@ static void pipe_handler(struct sps_bam *dev, struct sps_pipe *pipe)
 	 * Check for early exit opportunities.
 	 */
 
+	if (pipe->sys.irq_mod_count && (status & SPS_O_INACTIVE)) {
+		/*
+		 * Inactivity timer of a moderated pipe: retire the
+		 * descriptors submitted without INT flag.
+		 */
+		status |= SPS_O_DESC_DONE;
+		if (pipe->sys.irq_mod_inactive)
+			status &= ~SPS_O_INACTIVE;
+	}
+
 	if ((status & (SPS_O_EOT | SPS_O_DESC_DONE)) &&
 	    (pipe->state & BAM_STATE_BAM2BAM) == 0) {
+		retired = pipe->sys.desc_retired;
 		pipe_handler_eot(dev, pipe);
+		pipe->sys.xfer_irqs++;
+		pipe->sys.xfer_irq_descs += pipe->sys.desc_retired - retired;
 		if (pipe->sys.no_queue) {
 			/*
 			 * EOT handler will not generate any event if there
@@ -1933,6 +2040,60 @@ int sps_bam_set_satellite(struct sps_bam *dev, u32 pipe_index)
 	return 0;
 }
 
+/**
+ * Configure BAM pipe interrupt moderation
+ *
+ * This function makes only every count'th descriptor submitted to the pipe
+ *    request an interrupt. Descriptors submitted without one are retired
+ *    when the pipe inactivity timer expires.
+ *
+ */
+static int pipe_set_moderation(struct sps_bam *dev, u32 pipe_index,
+			       u32 count, u32 timeout_msec)
+{
+	struct sps_pipe *pipe = dev->pipes[pipe_index];
+
+	if ((pipe->state & (BAM_STATE_BAM2BAM | BAM_STATE_REMOTE))) {
+		SPS_ERR("sps:Moderation on BAM-to-BAM: BAM 0x%x pipe %d",
+			BAM_ID(dev), pipe_index);
+		return SPS_ERROR;
+	}
+
+	if (count <= 1)
+		count = 0;
+
+	if (count && timeout_msec == 0) {
+		SPS_ERR("sps:Moderation needs a timeout: BAM 0x%x pipe %d",
+			BAM_ID(dev), pipe_index);
+		return SPS_ERROR;
+	}
+
+	pipe->sys.irq_mod_count = count;
+	pipe->sys.irq_mod_pending = 0;
+
+	if (count) {
+		bam_pipe_timer_config(dev->base, pipe_index,
+				      BAM_PIPE_TIMER_ONESHOT,
+				      timeout_msec * 10);
+		if ((pipe->irq_mask & BAM_PIPE_IRQ_TIMER) == 0) {
+			pipe->irq_mask |= BAM_PIPE_IRQ_TIMER;
+			pipe->sys.irq_mod_inactive = true;
+			pipe_set_irq(dev, pipe_index,
+				     (pipe->connect.options & SPS_O_POLL));
+		}
+	} else if (pipe->sys.irq_mod_inactive) {
+		pipe->irq_mask &= ~BAM_PIPE_IRQ_TIMER;
+		pipe->sys.irq_mod_inactive = false;
+		pipe_set_irq(dev, pipe_index,
+			     (pipe->connect.options & SPS_O_POLL));
+	}
+
+	SPS_DBG("sps:BAM 0x%x pipe %d irq moderation %d desc %d msec",
+		BAM_ID(dev), pipe_index, count, timeout_msec);
+
+	return 0;
+}
+
 /**
  * Perform BAM pipe timer control
  *
@@ -1966,6 +2127,11 @@ int sps_bam_pipe_timer_ctrl(struct sps_bam *dev,
 		break;
 	case SPS_TIMER_OP_READ:
 		break;
+	case SPS_TIMER_OP_MODERATE:
+		result = pipe_set_moderation(dev, pipe_index,
+					     timer_ctrl->desc_count,
+					     timer_ctrl->timeout_msec);
+		break;
 	default:
 		result = SPS_ERROR;
 		break;
@@ -2005,3 +2171,27 @@ int sps_bam_pipe_get_unused_desc_num(struct sps_bam *dev, u32 pipe_index,
 
 	return 0;
 }
+
+/**
+ * Print BAM pipe transfer statistics
+ *
+ */
+void sps_bam_print_pipe_stats(struct sps_bam *dev)
+{
+	struct sps_pipe *pipe;
+
+	/* pipes join and leave pipes_q under the BAM lock */
+	mutex_lock(&dev->lock);
+	list_for_each_entry(pipe, &dev->pipes_q, list) {
+		if ((pipe->state & (BAM_STATE_BAM2BAM | BAM_STATE_REMOTE)))
+			continue;
+
+		pr_info("sps:BAM 0x%x pipe %d: moderation %d; "
+			"doorbells %u (%u desc); irqs %u (%u desc)\n",
+			BAM_ID(dev), pipe->pipe_index,
+			pipe->sys.irq_mod_count,
+			pipe->sys.doorbells, pipe->sys.doorbell_descs,
+			pipe->sys.xfer_irqs, pipe->sys.xfer_irq_descs);
+	}
+	mutex_unlock(&dev->lock);
+}
@@ -138,6 +138,19 @@ struct sps_bam_sys_mode {
 	int ack_xfers;	/* Whether client must ACK all descriptors */
 	int handler_eot; /* Whether EOT handling is in progress (debug) */
 
+	/* Interrupt moderation (see SPS_TIMER_OP_MODERATE) */
+	u32 irq_mod_count; /* Descriptors per interrupt, 0 if disabled */
+	u32 irq_mod_pending; /* Descriptors submitted since last INT */
+	int irq_mod_inactive; /* INACTIVE irq enabled for moderation only */
+
+	/* Batching statistics */
+	u32 desc_pending; /* Descriptors written since last doorbell */
+	u32 desc_retired; /* Descriptors retired by EOT handler */
+	u32 doorbells; /* Descriptor FIFO write offset updates */
+	u32 doorbell_descs; /* Descriptors submitted by those updates */
+	u32 xfer_irqs; /* EOT/DESC_DONE/moderation interrupts */
+	u32 xfer_irq_descs; /* Descriptors retired by those interrupts */
+
 	/* Statistics */
 #ifdef SPS_BAM_STATISTICS
 	u32 desc_wr_count;
@@ -426,7 +439,9 @@ int sps_bam_pipe_transfer_one(struct sps_bam *dev, u32 pipe_index, u32 addr,
 /**
  * Submit a transfer to a BAM pipe
  *
- * This function submits a transfer to a BAM pipe.
+ * This function submits a transfer to a BAM pipe. All descriptors of the
+ *    transfer are written to the descriptor FIFO first and the pipe is
+ *    notified once, unless the last descriptor has SPS_IOVEC_FLAG_NO_SUBMIT.
  *
  * @dev - pointer to BAM device descriptor
  *
@@ -561,4 +576,15 @@ int sps_bam_pipe_timer_ctrl(struct sps_bam *dev, u32 pipe_index,
 int sps_bam_pipe_get_unused_desc_num(struct sps_bam *dev, u32 pipe_index,
 					u32 *desc_num);
 
+/**
+ * Print BAM pipe transfer statistics
+ *
+ * This function prints the descriptor batching and interrupt
+ *    moderation statistics of all active pipes of a BAM device.
+ *
+ * @dev - pointer to BAM device descriptor
+ *
+ */
+void sps_bam_print_pipe_stats(struct sps_bam *dev);
+
 #endif	/* _SPSBAM_H_ */
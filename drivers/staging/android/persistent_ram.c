@@ -12,6 +12,7 @@
  *
  */
 
+#include <linux/debugfs.h>
 #include <linux/device.h>
 #include <linux/err.h>
 #include <linux/errno.h>
@@ -20,8 +21,12 @@
 #include <linux/io.h>
 #include <linux/list.h>
 #include <linux/memblock.h>
+#include <linux/moduleparam.h>
+#include <linux/notifier.h>
 #include <linux/persistent_ram.h>
+#include <linux/reboot.h>
 #include <linux/rslib.h>
+#include <linux/sched.h>
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
 
@@ -36,6 +41,26 @@ struct persistent_ram_buffer {
 
 static __devinitdata LIST_HEAD(persistent_ram_list);
 
+/*
+ * Leave the Reed-Solomon encoding of written blocks to a periodic worker,
+ * so that a write is a plain memcpy.  The header is still encoded by the
+ * write itself.  A write encodes the dirty blocks itself once
+ * PERSISTENT_RAM_ECC_DIRTY_MAX / 2 bytes have gone unencoded, so after an
+ * unclean reset that bypasses the panic and reboot notifiers only the
+ * newest PERSISTENT_RAM_ECC_DIRTY_MAX bytes can have stale parity.  Those
+ * are checked but not corrected on the next boot.
+ */
+static bool deferred_ecc;
+module_param(deferred_ecc, bool, S_IRUGO);
+
+#define PERSISTENT_RAM_ECC_DELAY	(HZ / 10)
+#define PERSISTENT_RAM_ECC_DIRTY_MAX	2048
+
+/* Zones with deferred ECC, flushed on panic and reboot */
+static LIST_HEAD(persistent_ram_deferred_list);
+
+static struct dentry *persistent_ram_debugfs;
+
 static inline size_t buffer_size(struct persistent_ram_zone *prz)
 {
 	return atomic_read(&prz->buffer->size);
@@ -141,15 +166,164 @@ static void persistent_ram_update_header_ecc(struct persistent_ram_zone *prz)
 				  prz->par_header);
 }
 
+/* Marks the blocks of a write for ecc_work */
+static void notrace persistent_ram_mark_ecc(struct persistent_ram_zone *prz,
+	unsigned int start, unsigned int count)
+{
+	unsigned int block, last;
+
+	if (!count)
+		return;
+
+	/* Data before the dirty bits, see persistent_ram_flush_ecc() */
+	smp_wmb();
+	last = (start + count - 1) / prz->ecc_block_size;
+	for (block = start / prz->ecc_block_size; block <= last; block++)
+		set_bit(block, prz->ecc_dirty);
+}
+
+static void notrace persistent_ram_flush_ecc(struct persistent_ram_zone *prz)
+{
+	int block;
+
+	atomic_set(&prz->ecc_pending, 0);
+	for_each_set_bit(block, prz->ecc_dirty, prz->ecc_blocks)
+		if (test_and_clear_bit(block, prz->ecc_dirty))
+			persistent_ram_update_ecc(prz,
+				block * prz->ecc_block_size, 1);
+}
+
+/*
+ * Accounts the bytes of a write that are left unencoded.  Past half of
+ * PERSISTENT_RAM_ECC_DIRTY_MAX they are encoded right away, which keeps
+ * the stale parity an unclean reset can leave behind within the window
+ * persistent_ram_ecc_old() does not correct.
+ */
+static void notrace persistent_ram_account_ecc(struct persistent_ram_zone *prz,
+	unsigned int count)
+{
+	if (atomic_add_return(count, &prz->ecc_pending) >
+	    PERSISTENT_RAM_ECC_DIRTY_MAX / 2)
+		persistent_ram_flush_ecc(prz);
+}
+
+/*
+ * Runs every PERSISTENT_RAM_ECC_DELAY rather than being queued by the
+ * writes: those come from printk and must not take the timer base lock.
+ */
+static void persistent_ram_ecc_work(struct work_struct *work)
+{
+	struct persistent_ram_zone *prz =
+		container_of(work, struct persistent_ram_zone, ecc_work.work);
+
+	persistent_ram_flush_ecc(prz);
+	if (prz->ecc_deferred)
+		queue_delayed_work(system_unbound_wq, &prz->ecc_work,
+				   PERSISTENT_RAM_ECC_DELAY);
+}
+
+/*
+ * Bring the parity up to date before the system goes down, and encode
+ * whatever is still written from then on right away.
+ */
+static int persistent_ram_sync_ecc(struct notifier_block *nb,
+	unsigned long event, void *unused)
+{
+	struct persistent_ram_zone *prz;
+
+	list_for_each_entry(prz, &persistent_ram_deferred_list, node) {
+		prz->ecc_deferred = false;
+		smp_mb();
+		persistent_ram_flush_ecc(prz);
+	}
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block persistent_ram_panic_nb = {
+	.notifier_call	= persistent_ram_sync_ecc,
+};
+
+static struct notifier_block persistent_ram_reboot_nb = {
+	.notifier_call	= persistent_ram_sync_ecc,
+};
+
+static int __devinit persistent_ram_init_deferred_ecc(
+	struct persistent_ram_zone *prz)
+{
+	prz->ecc_dirty = kcalloc(BITS_TO_LONGS(prz->ecc_blocks),
+				 sizeof(unsigned long), GFP_KERNEL);
+	if (!prz->ecc_dirty)
+		return -ENOMEM;
+
+	atomic_set(&prz->ecc_pending, 0);
+	INIT_DELAYED_WORK_DEFERRABLE(&prz->ecc_work, persistent_ram_ecc_work);
+
+	if (list_empty(&persistent_ram_deferred_list)) {
+		atomic_notifier_chain_register(&panic_notifier_list,
+					       &persistent_ram_panic_nb);
+		register_reboot_notifier(&persistent_ram_reboot_nb);
+	}
+	list_add_tail(&prz->node, &persistent_ram_deferred_list);
+	prz->ecc_deferred = true;
+	queue_delayed_work(system_unbound_wq, &prz->ecc_work,
+			   PERSISTENT_RAM_ECC_DELAY);
+
+	return 0;
+}
+
+static void __devinit persistent_ram_debugfs_init(
+	struct persistent_ram_zone *prz, const char *name)
+{
+	struct dentry *dir;
+
+	if (!persistent_ram_debugfs) {
+		persistent_ram_debugfs = debugfs_create_dir("persistent_ram",
+							    NULL);
+		if (IS_ERR_OR_NULL(persistent_ram_debugfs)) {
+			persistent_ram_debugfs = NULL;
+			return;
+		}
+	}
+
+	dir = debugfs_create_dir(name, persistent_ram_debugfs);
+	if (IS_ERR_OR_NULL(dir))
+		return;
+
+	debugfs_create_u64("writes", S_IRUGO, dir, &prz->write_count);
+	debugfs_create_u64("write_ns", S_IRUGO, dir, &prz->write_ns);
+	debugfs_create_u64("write_max_ns", S_IRUGO, dir, &prz->write_max_ns);
+}
+
+/*
+ * With deferred ECC the parity of the blocks written last before an
+ * unclean reset may predate their data, so they are only decoded from a
+ * copy.  A mismatch there is reported but the data is left as written.
+ */
+static bool persistent_ram_ecc_recent(struct persistent_ram_zone *prz,
+	uint8_t *block)
+{
+	size_t offset = block - prz->buffer->data;
+	size_t start = buffer_start(prz);
+
+	if (!deferred_ecc)
+		return false;
+
+	return (start + prz->buffer_size - offset) % prz->buffer_size <
+		PERSISTENT_RAM_ECC_DIRTY_MAX + prz->ecc_block_size;
+}
+
 static void persistent_ram_ecc_old(struct persistent_ram_zone *prz)
 {
 	struct persistent_ram_buffer *buffer = prz->buffer;
 	uint8_t *block;
 	uint8_t *par;
+	uint8_t *copy;
 
 	if (!prz->ecc)
 		return;
 
+	copy = kmalloc(prz->ecc_block_size, GFP_KERNEL);
+
 	block = buffer->data;
 	par = prz->par_buffer;
 	while (block < buffer->data + buffer_size(prz)) {
@@ -157,6 +331,17 @@ static void persistent_ram_ecc_old(struct persistent_ram_zone *prz)
 		int size = prz->ecc_block_size;
 		if (block + size > buffer->data + prz->buffer_size)
 			size = buffer->data + prz->buffer_size - block;
+		if (persistent_ram_ecc_recent(prz, block)) {
+			if (copy) {
+				memcpy(copy, block, size);
+				if (persistent_ram_decode_rs8(prz, copy, size,
+							      par))
+					prz->stale_blocks++;
+			}
+			block += prz->ecc_block_size;
+			par += prz->ecc_size;
+			continue;
+		}
 		numerr = persistent_ram_decode_rs8(prz, block, size, par);
 		if (numerr > 0) {
 			pr_devel("persistent_ram: error in block %p, %d\n",
@@ -170,6 +355,8 @@ static void persistent_ram_ecc_old(struct persistent_ram_zone *prz)
 		block += prz->ecc_block_size;
 		par += prz->ecc_size;
 	}
+
+	kfree(copy);
 }
 
 static int persistent_ram_init_ecc(struct persistent_ram_zone *prz,
@@ -197,6 +384,7 @@ static int persistent_ram_init_ecc(struct persistent_ram_zone *prz,
 		return -EINVAL;
 	}
 
+	prz->ecc_blocks = ecc_blocks;
 	prz->par_buffer = buffer->data + prz->buffer_size;
 	prz->par_header = prz->par_buffer + ecc_blocks * prz->ecc_size;
 
@@ -213,6 +401,7 @@ static int persistent_ram_init_ecc(struct persistent_ram_zone *prz,
 
 	prz->corrected_bytes = 0;
 	prz->bad_blocks = 0;
+	prz->stale_blocks = 0;
 
 	numerr = persistent_ram_decode_rs8(prz, buffer, sizeof(*buffer),
 					   prz->par_header);
@@ -239,6 +428,10 @@ ssize_t persistent_ram_ecc_string(struct persistent_ram_zone *prz,
 	else
 		ret = snprintf(str, len, "\nNo errors detected\n");
 
+	if (prz->stale_blocks && ret < len)
+		ret += snprintf(str + ret, len - ret,
+			"%d recent blocks not corrected\n", prz->stale_blocks);
+
 	return ret;
 }
 
@@ -247,7 +440,10 @@ static void notrace persistent_ram_update(struct persistent_ram_zone *prz,
 {
 	struct persistent_ram_buffer *buffer = prz->buffer;
 	memcpy(buffer->data + start, s, count);
-	persistent_ram_update_ecc(prz, start, count);
+	if (prz->ecc_deferred)
+		persistent_ram_mark_ecc(prz, start, count);
+	else
+		persistent_ram_update_ecc(prz, start, count);
 }
 
 static void __devinit
@@ -278,6 +474,10 @@ int notrace persistent_ram_write(struct persistent_ram_zone *prz,
 	int rem;
 	int c = count;
 	size_t start;
+	u64 t = 0;
+
+	if (prz->ecc)
+		t = sched_clock();
 
 	if (unlikely(c > prz->buffer_size)) {
 		s += c - prz->buffer_size;
@@ -298,6 +498,16 @@ int notrace persistent_ram_write(struct persistent_ram_zone *prz,
 	persistent_ram_update(prz, s, start, c);
 
 	persistent_ram_update_header_ecc(prz);
+	if (prz->ecc_deferred)
+		persistent_ram_account_ecc(prz, count);
+
+	if (prz->ecc) {
+		t = sched_clock() - t;
+		prz->write_count++;
+		prz->write_ns += t;
+		if (t > prz->write_max_ns)
+			prz->write_max_ns = t;
+	}
 
 	return count;
 }
@@ -407,6 +617,15 @@ struct persistent_ram_zone *__persistent_ram_init(struct device *dev, bool ecc)
 	if (ret)
 		goto err;
 
+	if (prz->ecc) {
+		if (deferred_ecc) {
+			ret = persistent_ram_init_deferred_ecc(prz);
+			if (ret)
+				goto err;
+		}
+		persistent_ram_debugfs_init(prz, dev_name(dev));
+	}
+
 	if (prz->buffer->sig == PERSISTENT_RAM_SIG) {
 		if (buffer_size(prz) > prz->buffer_size ||
 		    buffer_start(prz) > buffer_size(prz))
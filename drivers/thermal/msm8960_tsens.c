@@ -165,6 +165,20 @@ struct tsens_tm_device {
 
 struct tsens_tm_device *tmdev;
 
+/*
+ * One in-kernel client may borrow the upper threshold to be woken when
+ * the temperature rises instead of polling. The thermal zone's own
+ * upper trip is saved while it is borrowed and put back afterwards;
+ * meanwhile the register holds the lower of the two, and the zone's
+ * trip ops work on the saved copy.
+ */
+static DEFINE_SPINLOCK(tsens_client_lock);
+static tsens_threshold_fn tsens_client_fn;
+static void *tsens_client_data;
+static unsigned int tsens_client_code;
+static unsigned int tsens_saved_upper_code;
+static bool tsens_saved_upper_disabled;
+
 /* Temperature on y axis and ADC-code on x-axis */
 static int tsens_tz_code_to_degC(int adc_code, int sensor_num)
 {
@@ -237,12 +251,161 @@ int tsens_get_temp(struct tsens_device *device, unsigned long *temp)
 	if (!tmdev)
 		return -ENODEV;
 
+	if (device->sensor_num >= tmdev->tsens_num_sensor ||
+		tmdev->sensor[device->sensor_num].mode !=
+					THERMAL_DEVICE_ENABLED)
+		return -EINVAL;
+
 	tsens8960_get_temp(device->sensor_num, temp);
 
 	return 0;
 }
 EXPORT_SYMBOL(tsens_get_temp);
 
+int tsens_get_max_sensor_num(uint32_t *tsens_num_sensors)
+{
+	if (!tmdev)
+		return -ENODEV;
+
+	*tsens_num_sensors = tmdev->tsens_num_sensor;
+
+	return 0;
+}
+EXPORT_SYMBOL(tsens_get_max_sensor_num);
+
+static void __iomem *tsens_status_cntl_addr(void)
+{
+	if (tmdev->hw_type == APQ_8064)
+		return TSENS_8064_STATUS_CNTL;
+	return TSENS_CNTL_ADDR;
+}
+
+/*
+ * tsens_client_lock held: the thermal zone's view of the threshold and
+ * status control registers, with its own upper trip in place of a
+ * borrowed one.
+ */
+static void tsens_zone_view(unsigned int *reg_th, unsigned int *reg_cntl)
+{
+	if (!tsens_client_fn)
+		return;
+
+	*reg_th &= ~TSENS_THRESHOLD_UPPER_LIMIT_MASK;
+	*reg_th |= tsens_saved_upper_code << TSENS_THRESHOLD_UPPER_LIMIT_SHIFT;
+	if (tsens_saved_upper_disabled)
+		*reg_cntl |= TSENS_UPPER_STATUS_CLR;
+	else
+		*reg_cntl &= ~TSENS_UPPER_STATUS_CLR;
+}
+
+/*
+ * tsens_client_lock held, threshold borrowed: arm the upper threshold
+ * at the client's code or the zone's enabled trip, whichever is lower,
+ * and below the critical threshold.
+ */
+static void tsens_arm_upper_threshold(void)
+{
+	unsigned int reg_th, reg_cntl, code, max_code;
+
+	code = tsens_client_code;
+	if (!tsens_saved_upper_disabled && tsens_saved_upper_code < code)
+		code = tsens_saved_upper_code;
+
+	reg_th = readl_relaxed(TSENS_THRESHOLD_ADDR);
+	max_code = (reg_th & TSENS_THRESHOLD_MAX_LIMIT_MASK) >>
+			TSENS_THRESHOLD_MAX_LIMIT_SHIFT;
+	if (code >= max_code && max_code > 0)
+		code = max_code - 1;
+
+	reg_th &= ~TSENS_THRESHOLD_UPPER_LIMIT_MASK;
+	writel_relaxed(reg_th | (code << TSENS_THRESHOLD_UPPER_LIMIT_SHIFT),
+			TSENS_THRESHOLD_ADDR);
+	reg_cntl = readl_relaxed(tsens_status_cntl_addr());
+	writel_relaxed(reg_cntl & ~TSENS_UPPER_STATUS_CLR,
+			tsens_status_cntl_addr());
+	mb();
+}
+
+/* tsens_client_lock held */
+static void tsens_restore_upper_threshold(void)
+{
+	unsigned int reg_th, reg_cntl;
+
+	reg_th = readl_relaxed(TSENS_THRESHOLD_ADDR);
+	reg_th &= ~TSENS_THRESHOLD_UPPER_LIMIT_MASK;
+	writel_relaxed(reg_th | (tsens_saved_upper_code <<
+			TSENS_THRESHOLD_UPPER_LIMIT_SHIFT),
+			TSENS_THRESHOLD_ADDR);
+	reg_cntl = readl_relaxed(tsens_status_cntl_addr());
+	if (tsens_saved_upper_disabled)
+		reg_cntl |= TSENS_UPPER_STATUS_CLR;
+	else
+		reg_cntl &= ~TSENS_UPPER_STATUS_CLR;
+	writel_relaxed(reg_cntl, tsens_status_cntl_addr());
+	mb();
+	tsens_client_fn = NULL;
+	tsens_client_data = NULL;
+}
+
+/*
+ * Call @fn once, from process context, when any enabled sensor reaches
+ * @degC. The threshold register is shared by all sensors but calibrated
+ * per sensor, so the lowest code among them is used and a sensor may
+ * fire slightly early, never late.
+ */
+int tsens_set_upper_threshold(long degC, tsens_threshold_fn fn, void *data)
+{
+	unsigned int reg_th, reg_cntl, code = TSENS_THRESHOLD_MAX_CODE;
+	unsigned long flags;
+	int i, c;
+
+	if (!tmdev)
+		return -ENODEV;
+	if (!fn)
+		return -EINVAL;
+
+	for (i = 0; i < tmdev->tsens_num_sensor; i++) {
+		if (tmdev->sensor[i].mode != THERMAL_DEVICE_ENABLED)
+			continue;
+		c = tsens_tz_degC_to_code(degC, i);
+		if (c < code)
+			code = c;
+	}
+
+	spin_lock_irqsave(&tsens_client_lock, flags);
+	if (!tsens_client_fn) {
+		reg_th = readl_relaxed(TSENS_THRESHOLD_ADDR);
+		reg_cntl = readl_relaxed(tsens_status_cntl_addr());
+		tsens_saved_upper_code = (reg_th &
+			TSENS_THRESHOLD_UPPER_LIMIT_MASK) >>
+			TSENS_THRESHOLD_UPPER_LIMIT_SHIFT;
+		tsens_saved_upper_disabled =
+			!!(reg_cntl & TSENS_UPPER_STATUS_CLR);
+	}
+	tsens_client_fn = fn;
+	tsens_client_data = data;
+	tsens_client_code = code;
+	tsens_arm_upper_threshold();
+	spin_unlock_irqrestore(&tsens_client_lock, flags);
+
+	return 0;
+}
+EXPORT_SYMBOL(tsens_set_upper_threshold);
+
+void tsens_clear_upper_threshold(void *data)
+{
+	unsigned long flags;
+
+	if (!tmdev)
+		return;
+
+	spin_lock_irqsave(&tsens_client_lock, flags);
+	if (tsens_client_fn && tsens_client_data == data)
+		tsens_restore_upper_threshold();
+	spin_unlock_irqrestore(&tsens_client_lock, flags);
+}
+EXPORT_SYMBOL(tsens_clear_upper_threshold);
+
 static int tsens_tz_get_mode(struct thermal_zone_device *thermal,
 			      enum thermal_device_mode *mode)
 {
@@ -352,6 +515,9 @@ static int tsens_tz_activate_trip_type(struct thermal_zone_device *thermal,
 {
 	struct tsens_tm_device_sensor *tm_sensor = thermal->devdata;
 	unsigned int reg_cntl, reg_th, code, hi_code, lo_code, mask;
+	unsigned int hw_cntl;
+	unsigned long flags;
+	int ret = 0;
 
 	if (!tm_sensor || trip < 0)
 		return -EINVAL;
@@ -359,12 +525,15 @@ static int tsens_tz_activate_trip_type(struct thermal_zone_device *thermal,
 	lo_code = TSENS_THRESHOLD_MIN_CODE;
 	hi_code = TSENS_THRESHOLD_MAX_CODE;
 
+	spin_lock_irqsave(&tsens_client_lock, flags);
 	if (tmdev->hw_type == APQ_8064)
-		reg_cntl = readl_relaxed(TSENS_8064_STATUS_CNTL);
+		hw_cntl = readl_relaxed(TSENS_8064_STATUS_CNTL);
 	else
-		reg_cntl = readl_relaxed(TSENS_CNTL_ADDR);
+		hw_cntl = readl_relaxed(TSENS_CNTL_ADDR);
 
+	reg_cntl = hw_cntl;
 	reg_th = readl_relaxed(TSENS_THRESHOLD_ADDR);
+	tsens_zone_view(&reg_th, &reg_cntl);
 	switch (trip) {
 	case TSENS_TRIP_STAGE3:
 		code = (reg_th & TSENS_THRESHOLD_MAX_LIMIT_MASK)
@@ -427,39 +596,57 @@ static int tsens_tz_activate_trip_type(struct thermal_zone_device *thermal,
 					>> TSENS_THRESHOLD_MAX_LIMIT_SHIFT;
 		break;
 	default:
-		return -EINVAL;
+		ret = -EINVAL;
+		goto out;
+	}
+
+	if (mode != THERMAL_TRIP_ACTIVATION_DISABLED &&
+	    (code < lo_code || code > hi_code)) {
+		pr_info("%s with invalid code %x\n", __func__, code);
+		ret = -EINVAL;
+		goto out;
+	}
+
+	/* a borrowed upper threshold stays armed for the client */
+	if (tsens_client_fn && trip == TSENS_TRIP_STAGE2) {
+		tsens_saved_upper_disabled =
+			mode == THERMAL_TRIP_ACTIVATION_DISABLED;
+		tsens_arm_upper_threshold();
+		goto out;
 	}
 
 	if (mode == THERMAL_TRIP_ACTIVATION_DISABLED) {
 		if (tmdev->hw_type == APQ_8064)
-			writel_relaxed(reg_cntl | mask, TSENS_8064_STATUS_CNTL);
+			writel_relaxed(hw_cntl | mask, TSENS_8064_STATUS_CNTL);
 		else
-			writel_relaxed(reg_cntl | mask, TSENS_CNTL_ADDR);
+			writel_relaxed(hw_cntl | mask, TSENS_CNTL_ADDR);
 	} else {
-		if (code < lo_code || code > hi_code) {
-			pr_info("%s with invalid code %x\n", __func__, code);
-			return -EINVAL;
-		}
 		if (tmdev->hw_type == APQ_8064)
-			writel_relaxed(reg_cntl & ~mask,
+			writel_relaxed(hw_cntl & ~mask,
 					TSENS_8064_STATUS_CNTL);
 		else
-			writel_relaxed(reg_cntl & ~mask, TSENS_CNTL_ADDR);
+			writel_relaxed(hw_cntl & ~mask, TSENS_CNTL_ADDR);
 	}
 	mb();
-	return 0;
+out:
+	spin_unlock_irqrestore(&tsens_client_lock, flags);
+	return ret;
 }
 
 static int tsens_tz_get_trip_temp(struct thermal_zone_device *thermal,
 				   int trip, unsigned long *temp)
 {
 	struct tsens_tm_device_sensor *tm_sensor = thermal->devdata;
-	unsigned int reg;
+	unsigned int reg, reg_cntl = 0;
+	unsigned long flags;
 
 	if (!tm_sensor || trip < 0 || !temp)
 		return -EINVAL;
 
+	spin_lock_irqsave(&tsens_client_lock, flags);
 	reg = readl_relaxed(TSENS_THRESHOLD_ADDR);
+	tsens_zone_view(&reg, &reg_cntl);
+	spin_unlock_irqrestore(&tsens_client_lock, flags);
 	switch (trip) {
 	case TSENS_TRIP_STAGE3:
 		reg = (reg & TSENS_THRESHOLD_MAX_LIMIT_MASK)
@@ -507,6 +694,8 @@ static int tsens_tz_set_trip_temp(struct thermal_zone_device *thermal,
 	struct tsens_tm_device_sensor *tm_sensor = thermal->devdata;
 	unsigned int reg_th, reg_cntl;
 	int code, hi_code, lo_code, code_err_chk;
+	unsigned long flags;
+	int ret = 0;
 
 	code_err_chk = code = tsens_tz_degC_to_code(temp,
 					tm_sensor->sensor_num);
@@ -516,11 +705,13 @@ static int tsens_tz_set_trip_temp(struct thermal_zone_device *thermal,
 	lo_code = TSENS_THRESHOLD_MIN_CODE;
 	hi_code = TSENS_THRESHOLD_MAX_CODE;
 
+	spin_lock_irqsave(&tsens_client_lock, flags);
 	if (tmdev->hw_type == APQ_8064)
 		reg_cntl = readl_relaxed(TSENS_8064_STATUS_CNTL);
 	else
 		reg_cntl = readl_relaxed(TSENS_CNTL_ADDR);
 	reg_th = readl_relaxed(TSENS_THRESHOLD_ADDR);
+	tsens_zone_view(&reg_th, &reg_cntl);
 	switch (trip) {
 	case TSENS_TRIP_STAGE3:
 		code <<= TSENS_THRESHOLD_MAX_LIMIT_SHIFT;
@@ -579,15 +770,32 @@ static int tsens_tz_set_trip_temp(struct thermal_zone_device *thermal,
 					>> TSENS_THRESHOLD_MAX_LIMIT_SHIFT;
 		break;
 	default:
-		return -EINVAL;
+		ret = -EINVAL;
+		goto out;
 	}
 
-	if (code_err_chk < lo_code || code_err_chk > hi_code)
-		return -EINVAL;
-
-	writel_relaxed(reg_th | code, TSENS_THRESHOLD_ADDR);
+	if (code_err_chk < lo_code || code_err_chk > hi_code) {
+		ret = -EINVAL;
+		goto out;
+	}
 
-	return 0;
+	reg_th |= code;
+	if (tsens_client_fn) {
+		/* the zone's upper trip is the saved one while borrowed */
+		tsens_saved_upper_code = (reg_th &
+			TSENS_THRESHOLD_UPPER_LIMIT_MASK) >>
+			TSENS_THRESHOLD_UPPER_LIMIT_SHIFT;
+		reg_th &= ~TSENS_THRESHOLD_UPPER_LIMIT_MASK;
+		reg_th |= readl_relaxed(TSENS_THRESHOLD_ADDR) &
+			TSENS_THRESHOLD_UPPER_LIMIT_MASK;
+		writel_relaxed(reg_th, TSENS_THRESHOLD_ADDR);
+		tsens_arm_upper_threshold();
+	} else {
+		writel_relaxed(reg_th, TSENS_THRESHOLD_ADDR);
+	}
+out:
+	spin_unlock_irqrestore(&tsens_client_lock, flags);
+	return ret;
 }
 
 static struct thermal_zone_device_ops tsens_thermal_zone_ops = {
@@ -617,9 +825,13 @@ static void tsens_scheduler_fn(struct work_struct *work)
 					tsens_work);
 	unsigned int threshold, threshold_low, i, code, reg, sensor, mask;
 	unsigned int sensor_addr;
-	bool upper_th_x, lower_th_x;
+	bool upper_th_x, lower_th_x, zone_x, client_x = false;
+	tsens_threshold_fn client_fn = NULL;
+	void *client_data = NULL;
+	unsigned long flags;
 	int adc_code;
 
+	spin_lock_irqsave(&tsens_client_lock, flags);
 	if (tmdev->hw_type == APQ_8064) {
 		reg = readl_relaxed(TSENS_8064_STATUS_CNTL);
 		writel_relaxed(reg | TSENS_LOWER_STATUS_CLR |
@@ -653,11 +865,25 @@ static void tsens_scheduler_fn(struct work_struct *work)
 			code = readl_relaxed(sensor_addr);
 			upper_th_x = code >= threshold;
 			lower_th_x = code <= threshold_low;
-			if (upper_th_x)
+			zone_x = upper_th_x;
+			if (upper_th_x) {
 				mask |= TSENS_UPPER_STATUS_CLR;
+				client_x = true;
+			}
+			/*
+			 * While the threshold is borrowed only a crossing of
+			 * the zone's own trip is news to user space; it then
+			 * stays disabled as it would without the client.
+			 */
+			if (upper_th_x && tsens_client_fn) {
+				zone_x = !tsens_saved_upper_disabled &&
+					code >= tsens_saved_upper_code;
+				if (zone_x)
+					tsens_saved_upper_disabled = true;
+			}
 			if (lower_th_x)
 				mask |= TSENS_LOWER_STATUS_CLR;
-			if (upper_th_x || lower_th_x) {
+			if (zone_x || lower_th_x) {
 				/* Notify user space */
 				schedule_work(&tm->sensor[i].work);
 				adc_code = readl_relaxed(sensor_addr);
@@ -673,6 +899,17 @@ static void tsens_scheduler_fn(struct work_struct *work)
 	else
 	writel_relaxed(reg & mask, TSENS_CNTL_ADDR);
 	mb();
+
+	if (client_x) {
+		client_fn = tsens_client_fn;
+		client_data = tsens_client_data;
+		if (client_fn)
+			tsens_restore_upper_threshold();
+	}
+	spin_unlock_irqrestore(&tsens_client_lock, flags);
+
+	if (client_fn)
+		client_fn(client_data);
 }
 
 static irqreturn_t tsens_isr(int irq, void *data)
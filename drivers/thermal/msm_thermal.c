@@ -19,14 +19,74 @@
 #include <linux/workqueue.h>
 #include <linux/cpu.h>
 #include <linux/cpufreq.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 #include <linux/msm_tsens.h>
 #include <linux/msm_thermal.h>
 #include <mach/cpufreq.h>
 
+/* budgets are kept in thousandths of a percent of full performance */
+#define BUDGET_FULL		100000
+
 static int enabled;
 static struct msm_thermal_data msm_thermal_info;
 static uint32_t limited_max_freq = MSM_CPUFREQ_NO_LIMIT;
 static struct delayed_work check_temp_work;
+static DEFINE_MUTEX(budget_mutex);
+
+static msm_thermal_gpu_limit_fn gpu_limit_fn;
+static void *gpu_limit_data;
+
+/*
+ * Controller gains, in thousandths of a percent of budget: pid_kp per
+ * degC of predicted overshoot, pid_ki per degC*s and pid_kd per degC/s
+ * of temperature rise.
+ */
+static int pid_kp = 5000;
+module_param(pid_kp, int, 0644);
+static int pid_ki = 500;
+module_param(pid_ki, int, 0644);
+static int pid_kd = 10000;
+module_param(pid_kd, int, 0644);
+/* how far ahead the temperature trend is extrapolated */
+static int predict_ms = 1000;
+module_param(predict_ms, int, 0644);
+/* relative share of a budget cut taken by the CPUs and the GPU */
+static int cpu_weight = 60;
+module_param(cpu_weight, int, 0644);
+static int gpu_weight = 40;
+module_param(gpu_weight, int, 0644);
+
+/* controller state, read-only in sysfs */
+static int budget = 100;
+module_param(budget, int, 0444);
+static int cpu_budget = 100;
+module_param(cpu_budget, int, 0444);
+static int gpu_budget = 100;
+module_param(gpu_budget, int, 0444);
+static int max_temp;
+module_param(max_temp, int, 0444);
+static unsigned long throttled_ms;
+module_param(throttled_ms, ulong, 0444);
+
+/*
+ * While well below the mitigation band the poll is replaced by a TSENS
+ * threshold interrupt irq_step degC above the last reading (capped at
+ * the band), so each wakeup still yields a sample of the trend.
+ */
+static int irq_step = 3;
+module_param(irq_step, int, 0644);
+static unsigned long polls_avoided;
+module_param(polls_avoided, ulong, 0444);
+static unsigned long threshold_wakeups;
+module_param(threshold_wakeups, ulong, 0444);
+static ktime_t armed_at;
+
+static uint32_t num_sensors = 1;
+static long temp_prev_mdeg;
+static long slope_mdeg_s;
+static long long integral;
+static ktime_t last_sample;
 
 static int update_cpu_max_freq(int cpu, uint32_t max_freq)
 {
@@ -50,59 +110,237 @@ static int update_cpu_max_freq(int cpu, uint32_t max_freq)
 	return ret;
 }
 
-static void check_temp(struct work_struct *work)
+/*
+ * Highest table frequency within @pct of the fastest one, but never
+ * below the platform's mitigation frequency.
+ */
+static uint32_t cpu_freq_for_budget(unsigned int pct)
+{
+	struct cpufreq_frequency_table *table;
+	uint32_t fmax = 0, target, best = 0;
+	int i;
+
+	if (pct >= 100)
+		return MSM_CPUFREQ_NO_LIMIT;
+
+	table = cpufreq_frequency_get_table(0);
+	if (!table)
+		return msm_thermal_info.limit_freq;
+
+	for (i = 0; table[i].frequency != CPUFREQ_TABLE_END; i++)
+		if (table[i].frequency != CPUFREQ_ENTRY_INVALID &&
+				table[i].frequency > fmax)
+			fmax = table[i].frequency;
+
+	target = fmax / 100 * pct;
+	for (i = 0; table[i].frequency != CPUFREQ_TABLE_END; i++)
+		if (table[i].frequency != CPUFREQ_ENTRY_INVALID &&
+				table[i].frequency <= target &&
+				table[i].frequency > best)
+			best = table[i].frequency;
+
+	if (best < msm_thermal_info.limit_freq)
+		best = msm_thermal_info.limit_freq;
+	if (best >= fmax)
+		return MSM_CPUFREQ_NO_LIMIT;
+	return best;
+}
+
+/* budget_mutex held */
+static void apply_budget(int new_budget)
+{
+	int deficit = 100 - new_budget;
+	int cw = max(cpu_weight, 0), gw = max(gpu_weight, 0);
+	int cpu_cut;
+	uint32_t max_freq;
+	int cpu, ret;
+
+	/* split the cut cw:gw, so the two shares add up to the deficit */
+	if (cw + gw)
+		cpu_cut = deficit * cw / (cw + gw);
+	else
+		cpu_cut = deficit / 2;
+	cpu_budget = 100 - cpu_cut;
+	gpu_budget = 100 - (deficit - cpu_cut);
+	budget = new_budget;
+
+	max_freq = cpu_freq_for_budget(cpu_budget);
+	if (max_freq != limited_max_freq) {
+		for_each_possible_cpu(cpu) {
+			ret = update_cpu_max_freq(cpu, max_freq);
+			if (ret)
+				pr_debug("Unable to limit cpu%d max freq to %d\n",
+						cpu, max_freq);
+		}
+	}
+
+	if (gpu_limit_fn)
+		gpu_limit_fn(gpu_budget, gpu_limit_data);
+}
+
+/* Hottest of all sensors, in degC */
+static int read_max_temp(unsigned long *temp)
 {
 	struct tsens_device tsens_dev;
+	unsigned long t;
+	uint32_t i;
+	int ret = -ENODEV;
+
+	*temp = 0;
+	for (i = 0; i < num_sensors; i++) {
+		tsens_dev.sensor_num = num_sensors > 1 ? i :
+					msm_thermal_info.sensor_id;
+		if (tsens_get_temp(&tsens_dev, &t))
+			continue;
+		if (t > *temp)
+			*temp = t;
+		ret = 0;
+	}
+	return ret;
+}
+
+static void threshold_notify(void *data)
+{
+	s64 idle_ms = ktime_to_ms(ktime_sub(ktime_get(), armed_at));
+
+	threshold_wakeups++;
+	if (msm_thermal_info.poll_ms)
+		polls_avoided += div_s64(idle_ms, msm_thermal_info.poll_ms);
+	if (enabled)
+		schedule_delayed_work(&check_temp_work, 0);
+}
+
+static int arm_threshold(unsigned long temp)
+{
+	long arm_temp = (long)msm_thermal_info.limit_temp -
+			msm_thermal_info.temp_hysteresis;
+	long hi = min_t(long, temp + max(irq_step, 1), arm_temp);
+
+	armed_at = ktime_get();
+	return tsens_set_upper_threshold(hi, threshold_notify,
+			&check_temp_work);
+}
+
+/*
+ * PID on the predicted distance to limit_temp. The output is the share
+ * of full performance the system may use; it is split between the CPUs
+ * and the GPU by weight, so mitigation ramps in and out in small steps
+ * instead of toggling one clamp on and off.
+ */
+static void check_temp(struct work_struct *work)
+{
 	unsigned long temp = 0;
-	uint32_t max_freq = limited_max_freq;
-	int cpu = 0;
+	long temp_mdeg, pred_mdeg, err_mdeg, sample, arm_mdeg;
+	long long out;
+	ktime_t now;
+	int dt_ms;
+	bool idle = false;
 	int ret = 0;
 
-	tsens_dev.sensor_num = msm_thermal_info.sensor_id;
-	ret = tsens_get_temp(&tsens_dev, &temp);
+	ret = read_max_temp(&temp);
 	if (ret) {
-		pr_debug("msm_thermal: Unable to read TSENS sensor %d\n",
-				tsens_dev.sensor_num);
+		pr_debug("msm_thermal: Unable to read TSENS sensors\n");
 		goto reschedule;
 	}
 
-	if (temp >= msm_thermal_info.limit_temp)
-		max_freq = msm_thermal_info.limit_freq;
-	else if (temp <
-		msm_thermal_info.limit_temp - msm_thermal_info.temp_hysteresis)
-		max_freq = MSM_CPUFREQ_NO_LIMIT;
+	now = ktime_get();
+	dt_ms = ktime_to_ms(ktime_sub(now, last_sample));
+	temp_mdeg = temp * 1000;
+	if (!ktime_to_ns(last_sample) || dt_ms <= 0) {
+		dt_ms = 0;
+		slope_mdeg_s = 0;
+	} else {
+		sample = (temp_mdeg - temp_prev_mdeg) * 1000 / dt_ms;
+		slope_mdeg_s = (3 * slope_mdeg_s + sample) / 4;
+	}
+	last_sample = now;
+	temp_prev_mdeg = temp_mdeg;
+	max_temp = temp;
 
-	if (max_freq == limited_max_freq)
-		goto reschedule;
+	pred_mdeg = temp_mdeg + slope_mdeg_s * predict_ms / 1000;
+	err_mdeg = (long)msm_thermal_info.limit_temp * 1000 - pred_mdeg;
 
-	/* Update new limits */
-	for_each_possible_cpu(cpu) {
-		ret = update_cpu_max_freq(cpu, max_freq);
-		if (ret)
-			pr_debug("Unable to limit cpu%d max freq to %d\n",
-					cpu, max_freq);
+	mutex_lock(&budget_mutex);
+	if (!enabled) {
+		mutex_unlock(&budget_mutex);
+		return;
 	}
 
+	integral += div_s64((s64)err_mdeg * dt_ms, 1000);
+	out = BUDGET_FULL + div_s64((s64)pid_kp * err_mdeg, 1000) +
+		div_s64(pid_ki * integral, 1000) -
+		div_s64((s64)pid_kd * slope_mdeg_s, 1000);
+
+	/* headroom earns no credit, and a saturated cut does not wind up */
+	if (integral > 0 || out >= BUDGET_FULL)
+		integral = min_t(long long, integral, 0);
+	if (out <= 0 && pid_ki > 0)
+		integral = max_t(long long, integral,
+				div_s64(-(s64)BUDGET_FULL * 1000, pid_ki));
+	out = clamp_t(long long, out, 0, BUDGET_FULL);
+
+	/* fully release only once back under the hysteresis band */
+	if (out == BUDGET_FULL && budget < 100 && temp >=
+		msm_thermal_info.limit_temp - msm_thermal_info.temp_hysteresis)
+		out = BUDGET_FULL - 1000;
+
+	if (budget < 100)
+		throttled_ms += dt_ms;
+	if ((int)out / 1000 != budget)
+		apply_budget((int)out / 1000);
+
+	/* unthrottled and not heading into the band any time soon */
+	arm_mdeg = ((long)msm_thermal_info.limit_temp -
+			msm_thermal_info.temp_hysteresis) * 1000;
+	idle = budget == 100 && temp_mdeg < arm_mdeg && pred_mdeg < arm_mdeg;
+	mutex_unlock(&budget_mutex);
+
 reschedule:
-	if (enabled)
-		schedule_delayed_work(&check_temp_work,
-				msecs_to_jiffies(msm_thermal_info.poll_ms));
+	if (!enabled)
+		return;
+	if (idle && !arm_threshold(temp))
+		return;
+	schedule_delayed_work(&check_temp_work,
+			msecs_to_jiffies(msm_thermal_info.poll_ms));
 }
 
-static void disable_msm_thermal(void)
+int msm_thermal_register_gpu_limit(msm_thermal_gpu_limit_fn fn, void *data)
 {
-	int cpu = 0;
+	mutex_lock(&budget_mutex);
+	gpu_limit_fn = fn;
+	gpu_limit_data = data;
+	if (budget < 100)
+		fn(gpu_budget, data);
+	mutex_unlock(&budget_mutex);
+	return 0;
+}
+EXPORT_SYMBOL(msm_thermal_register_gpu_limit);
 
+void msm_thermal_unregister_gpu_limit(void *data)
+{
+	mutex_lock(&budget_mutex);
+	if (gpu_limit_data == data) {
+		gpu_limit_fn = NULL;
+		gpu_limit_data = NULL;
+	}
+	mutex_unlock(&budget_mutex);
+}
+EXPORT_SYMBOL(msm_thermal_unregister_gpu_limit);
+
+static void disable_msm_thermal(void)
+{
 	/* make sure check_temp is no longer running */
+	tsens_clear_upper_threshold(&check_temp_work);
 	cancel_delayed_work(&check_temp_work);
 	flush_scheduled_work();
+	tsens_clear_upper_threshold(&check_temp_work);
 
-	if (limited_max_freq == MSM_CPUFREQ_NO_LIMIT)
-		return;
-
-	for_each_possible_cpu(cpu) {
-		update_cpu_max_freq(cpu, MSM_CPUFREQ_NO_LIMIT);
-	}
+	mutex_lock(&budget_mutex);
+	integral = 0;
+	last_sample = ktime_set(0, 0);
+	if (budget < 100 || limited_max_freq != MSM_CPUFREQ_NO_LIMIT)
+		apply_budget(100);
+	mutex_unlock(&budget_mutex);
 }
 
 static int set_enabled(const char *val, const struct kernel_param *kp)
@@ -136,6 +374,10 @@ int __init msm_thermal_init(struct msm_thermal_data *pdata)
 	BUG_ON(pdata->sensor_id >= TSENS_MAX_SENSORS);
 	memcpy(&msm_thermal_info, pdata, sizeof(struct msm_thermal_data));
 
+	if (tsens_get_max_sensor_num(&num_sensors) || !num_sensors ||
+			num_sensors > TSENS_MAX_SENSORS)
+		num_sensors = 1;
+
 	enabled = 1;
 	INIT_DELAYED_WORK(&check_temp_work, check_temp);
 	schedule_delayed_work(&check_temp_work, 0);
@@ -247,6 +247,7 @@ struct mdp4_iommu_pipe_info {
 	struct ion_handle *ihdl[MDP4_MAX_PLANE];
 	struct ion_handle *prev_ihdl[MDP4_MAX_PLANE];
 	u8 mark_unmap;
+	u8 mapped;	/* planes mapped since mdp4_overlay_iommu_save() */
 };
 
 #define IOMMU_FREE_LIST_MAX 32
@@ -257,6 +258,22 @@ struct iommu_free_list {
 	struct ion_handle *ihdl[IOMMU_FREE_LIST_MAX];
 };
 
+#define IOMMU_CACHE_MAX 16
+
+/*
+ * A cached entry owns one ion handle reference, one iommu mapping
+ * reference and one dma_buf reference. busy counts the pipe planes
+ * which have the buffer queued or on screen.
+ */
+struct iommu_cache_entry {
+	struct dma_buf *dmabuf;
+	struct ion_handle *ihdl;
+	unsigned long start;
+	unsigned long len;
+	unsigned long last_use;
+	int busy;
+};
+
 struct blend_cfg {
 	u32 op;
 	u32 bg_alpha;
@@ -391,6 +408,8 @@ struct mdp4_statistic {
 	ulong blt_lcdc;	/* blt */
 	ulong blt_dtv;	/* blt */
 	ulong blt_mddi;	/* blt */
+	ulong dsi_cmd_full;	/* full frame update */
+	ulong dsi_cmd_partial;	/* dirty region update */
 	ulong overlay_set[MDP4_MIXER_MAX];
 	ulong overlay_unset[MDP4_MIXER_MAX];
 	ulong overlay_play[MDP4_MIXER_MAX];
@@ -401,6 +420,9 @@ struct mdp4_statistic {
 	ulong iommu_map;
 	ulong iommu_unmap;
 	ulong iommu_drop;
+	ulong iommu_cache_hit;
+	ulong iommu_cache_miss;
+	ulong iommu_cache_evict;
 	ulong dsi_clkoff;
 	ulong err_mixer;
 	ulong err_zorder;
@@ -576,6 +598,8 @@ int mdp4_overlay_unset_mixer(int mixer);
 int mdp4_overlay_play_wait(struct fb_info *info,
 	struct msmfb_overlay_data *req);
 int mdp4_overlay_play(struct fb_info *info, struct msmfb_overlay_data *req);
+int mdp4_overlay_commit(struct fb_info *info,
+	struct mdp_overlay_commit_layer *layers, int cnt);
 struct mdp4_overlay_pipe *mdp4_overlay_pipe_alloc(int ptype, int mixer);
 void mdp4_overlay_dma_commit(int mixer);
 void mdp4_overlay_vsync_commit(struct mdp4_overlay_pipe *pipe);
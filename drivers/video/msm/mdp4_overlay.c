@@ -29,6 +29,7 @@
 #include <linux/fb.h>
 #include <linux/msm_mdp.h>
 #include <linux/file.h>
+#include <linux/dma-buf.h>
 #include <linux/android_pmem.h>
 #include <linux/major.h>
 #include <asm/system.h>
@@ -51,6 +52,7 @@ struct mdp4_overlay_ctrl {
 	uint32 mixer_cfg[MDP4_MIXER_MAX];
 	uint32 flush[MDP4_MIXER_MAX];
 	struct iommu_free_list iommu_free[MDP4_MIXER_MAX];
+	struct iommu_cache_entry iommu_cache[MDP4_MIXER_MAX][IOMMU_CACHE_MAX];
 	uint32 cs_controller;
 	uint32 hw_version;
 	uint32 panel_3d;
@@ -120,8 +122,165 @@ struct mdp4_overlay_perf perf_current = {
 };
 
 static struct ion_client *display_iclient;
+static unsigned long iommu_cache_seq;
 
 
+/*
+ * iommu mapping cache
+ *
+ * gralloc buffers cycle through the same few overlay pipes every frame,
+ * so instead of importing, mapping and later unmapping them per overlay
+ * set, keep the ion handle and its iommu mapping around for as long as
+ * the buffer lives. A buffer is looked up by its ion handle, which
+ * display_iclient gets back for every import of the same ion buffer
+ * however often it was exported, and appears in at most one mixer's
+ * cache. Entries that are not on screen (busy == 0) are evicted once
+ * every other user dropped the dma_buf, when a mixer needs the slot or
+ * under memory pressure.
+ * All of the below is protected by iommu_mutex.
+ */
+static struct iommu_cache_entry *mdp4_iommu_cache_find(
+						struct ion_handle *ihdl)
+{
+	struct iommu_cache_entry *ent;
+	int mixer, i;
+
+	for (mixer = 0; mixer < MDP4_MIXER_MAX; mixer++) {
+		for (i = 0; i < IOMMU_CACHE_MAX; i++) {
+			ent = &ctrl->iommu_cache[mixer][i];
+			if (ent->ihdl && ent->ihdl == ihdl)
+				return ent;
+		}
+	}
+	return NULL;
+}
+
+static void mdp4_iommu_cache_evict(struct iommu_cache_entry *ent)
+{
+	pr_debug("%s: ihdl=0x%p start=0x%lx\n", __func__,
+				ent->ihdl, ent->start);
+	ion_unmap_iommu(display_iclient, ent->ihdl, DISPLAY_READ_DOMAIN,
+							GEN_POOL);
+	ion_free(display_iclient, ent->ihdl);
+	dma_buf_put(ent->dmabuf);
+	memset(ent, 0, sizeof(*ent));
+	mdp4_stat.iommu_unmap++;
+	mdp4_stat.iommu_cache_evict++;
+}
+
+static int mdp4_iommu_handle_queued(struct ion_handle *ihdl)
+{
+	struct mdp4_iommu_pipe_info *iom;
+	int i, plane;
+
+	for (i = 0; i < OVERLAY_PIPE_MAX; i++) {
+		iom = &ctrl->plist[i].iommu;
+		for (plane = 0; plane < MDP4_MAX_PLANE; plane++) {
+			if (iom->ihdl[plane] == ihdl ||
+			    iom->prev_ihdl[plane] == ihdl)
+				return 1;
+		}
+	}
+	for (i = 0; i < MDP4_MIXER_MAX; i++) {
+		for (plane = 0; plane < IOMMU_FREE_LIST_MAX; plane++) {
+			if (ctrl->iommu_free[i].ihdl[plane] == ihdl)
+				return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * hand the references of a fresh mapping over to the cache,
+ * returns 0 if there is no room for it
+ */
+static int mdp4_iommu_cache_insert(int mixer, struct dma_buf *dmabuf,
+		struct ion_handle *ihdl, unsigned long start, unsigned long len)
+{
+	struct iommu_cache_entry *ent, *slot = NULL;
+	int i;
+
+	/*
+	 * the freelist tells cached from uncached handles by looking them
+	 * up here, so a handle still queued uncached can not be adopted
+	 */
+	if (mdp4_iommu_handle_queued(ihdl))
+		return 0;
+
+	for (i = 0; i < IOMMU_CACHE_MAX; i++) {
+		ent = &ctrl->iommu_cache[mixer][i];
+		if (ent->ihdl == NULL) {
+			slot = ent;
+			break;
+		}
+		if (ent->busy)
+			continue;
+		if (slot == NULL || ent->last_use < slot->last_use)
+			slot = ent;
+	}
+
+	if (slot == NULL)
+		return 0;
+
+	if (slot->ihdl)
+		mdp4_iommu_cache_evict(slot);
+
+	slot->dmabuf = dmabuf;
+	slot->ihdl = ihdl;
+	slot->start = start;
+	slot->len = len;
+	slot->last_use = ++iommu_cache_seq;
+	slot->busy = 1;
+	return 1;
+}
+
+/* drop idle entries nobody but us holds a reference to anymore */
+static void mdp4_iommu_cache_reap(int mixer)
+{
+	struct iommu_cache_entry *ent;
+	int i;
+
+	for (i = 0; i < IOMMU_CACHE_MAX; i++) {
+		ent = &ctrl->iommu_cache[mixer][i];
+		if (ent->ihdl == NULL || ent->busy)
+			continue;
+		if (file_count(ent->dmabuf->file) == 1)
+			mdp4_iommu_cache_evict(ent);
+	}
+}
+
+static int mdp4_iommu_cache_shrink(struct shrinker *shrinker,
+					struct shrink_control *sc)
+{
+	struct iommu_cache_entry *ent;
+	int mixer, i, idle = 0;
+
+	if (!mutex_trylock(&iommu_mutex))
+		return -1;
+
+	for (mixer = 0; mixer < MDP4_MIXER_MAX; mixer++) {
+		for (i = 0; i < IOMMU_CACHE_MAX; i++) {
+			ent = &ctrl->iommu_cache[mixer][i];
+			if (ent->ihdl == NULL || ent->busy)
+				continue;
+			if (sc->nr_to_scan > 0) {
+				mdp4_iommu_cache_evict(ent);
+				sc->nr_to_scan--;
+			} else {
+				idle++;
+			}
+		}
+	}
+	mutex_unlock(&iommu_mutex);
+
+	return idle;
+}
+
+static struct shrinker mdp4_iommu_cache_shrinker = {
+	.shrink = mdp4_iommu_cache_shrink,
+	.seeks = DEFAULT_SEEKS,
+};
+
 /*
  * mdp4_overlay_iommu_unmap_freelist()
  * mdp4_overlay_iommu_2freelist()
@@ -134,10 +293,12 @@ void mdp4_overlay_iommu_unmap_freelist(int mixer)
 	int i;
 	struct ion_handle *ihdl;
 	struct iommu_free_list *flist;
+	struct iommu_cache_entry *ent;
 
 	mutex_lock(&iommu_mutex);
 	flist = &ctrl->iommu_free[mixer];
 	if (flist->total == 0) {
+		mdp4_iommu_cache_reap(mixer);
 		mutex_unlock(&iommu_mutex);
 		return;
 	}
@@ -147,6 +308,13 @@ void mdp4_overlay_iommu_unmap_freelist(int mixer)
 			continue;
 		pr_debug("%s: mixer=%d i=%d ihdl=0x%p\n", __func__,
 					mixer, i, ihdl);
+		flist->ihdl[i] = NULL;
+		ent = mdp4_iommu_cache_find(ihdl);
+		if (ent) {
+			/* off screen now, the cache keeps the mapping */
+			ent->busy--;
+			continue;
+		}
 		ion_unmap_iommu(display_iclient, ihdl, DISPLAY_READ_DOMAIN,
 							GEN_POOL);
 		mdp4_stat.iommu_unmap++;
@@ -154,11 +322,11 @@ void mdp4_overlay_iommu_unmap_freelist(int mixer)
 			(int)mdp4_stat.iommu_map, (int)mdp4_stat.iommu_unmap,
 				(int)mdp4_stat.iommu_drop);
 		ion_free(display_iclient, ihdl);
-		flist->ihdl[i] = NULL;
 	}
 
 	flist->fndx = 0;
 	flist->total = 0;
+	mdp4_iommu_cache_reap(mixer);
 	mutex_unlock(&iommu_mutex);
 }
 
@@ -216,15 +384,34 @@ int mdp4_overlay_iommu_map_buf(int mem_id,
 	struct ion_handle **srcp_ihdl)
 {
 	struct mdp4_iommu_pipe_info *iom;
+	struct iommu_cache_entry *ent;
+	struct dma_buf *dmabuf;
 
 	if (!display_iclient)
 		return -EINVAL;
 
+	dmabuf = dma_buf_get(mem_id);
+	if (IS_ERR_OR_NULL(dmabuf)) {
+		pr_err("dma_buf_get() failed\n");
+		return -EINVAL;
+	}
+
 	*srcp_ihdl = ion_import_dma_buf(display_iclient, mem_id);
 	if (IS_ERR_OR_NULL(*srcp_ihdl)) {
 		pr_err("ion_import_dma_buf() failed\n");
+		dma_buf_put(dmabuf);
 		return PTR_ERR(*srcp_ihdl);
 	}
+
+	mutex_lock(&iommu_mutex);
+	ent = mdp4_iommu_cache_find(*srcp_ihdl);
+	if (ent) {
+		/* the cache holds its own import and dma_buf references */
+		ion_free(display_iclient, *srcp_ihdl);
+		dma_buf_put(dmabuf);
+		goto cached;
+	}
+	mutex_unlock(&iommu_mutex);
 	pr_debug("%s(): ion_hdl %p, ion_buf %d\n", __func__, *srcp_ihdl,
 		ion_share_dma_buf(display_iclient, *srcp_ihdl));
 	pr_debug("mixer %u, pipe %u, plane %u\n", pipe->mixer_num,
@@ -233,11 +420,38 @@ int mdp4_overlay_iommu_map_buf(int mem_id,
 		DISPLAY_READ_DOMAIN, GEN_POOL, SZ_4K, 0, start,
 		len, 0, ION_IOMMU_UNMAP_DELAYED)) {
 		ion_free(display_iclient, *srcp_ihdl);
+		dma_buf_put(dmabuf);
 		pr_err("ion_map_iommu() failed\n");
 		return -EINVAL;
 	}
 
 	mutex_lock(&iommu_mutex);
+	mdp4_stat.iommu_map++;
+	mdp4_stat.iommu_cache_miss++;
+	ent = mdp4_iommu_cache_find(*srcp_ihdl);
+	if (ent) {
+		/* lost a race against another mapping of the same buffer */
+		ion_unmap_iommu(display_iclient, *srcp_ihdl,
+				DISPLAY_READ_DOMAIN, GEN_POOL);
+		ion_free(display_iclient, *srcp_ihdl);
+		mdp4_stat.iommu_unmap++;
+		dma_buf_put(dmabuf);
+		goto cached;
+	}
+	if (!mdp4_iommu_cache_insert(pipe->mixer_num, dmabuf, *srcp_ihdl,
+							*start, *len))
+		dma_buf_put(dmabuf);
+	goto track;
+
+cached:
+	ent->busy++;
+	ent->last_use = ++iommu_cache_seq;
+	*srcp_ihdl = ent->ihdl;
+	*start = ent->start;
+	*len = ent->len;
+	mdp4_stat.iommu_cache_hit++;
+
+track:
 	iom = &pipe->iommu;
 	if (iom->prev_ihdl[plane]) {
 		mdp4_overlay_iommu_2freelist(pipe->mixer_num,
@@ -248,7 +462,7 @@ int mdp4_overlay_iommu_map_buf(int mem_id,
 	}
 	iom->prev_ihdl[plane] = iom->ihdl[plane];
 	iom->ihdl[plane] = *srcp_ihdl;
-	mdp4_stat.iommu_map++;
+	iom->mapped |= BIT(plane);
 
 	pr_debug("%s: ndx=%d plane=%d prev=0x%p cur=0x%p start=0x%lx len=%lx\n",
 		 __func__, pipe->pipe_ndx, plane, iom->prev_ihdl[plane],
@@ -257,6 +471,54 @@ int mdp4_overlay_iommu_map_buf(int mem_id,
 	return 0;
 }
 
+/*
+ * mdp4_overlay_iommu_save: remember the pipe's buffers before a commit
+ * maps new ones, for mdp4_overlay_iommu_restore() to go back to
+ */
+static void mdp4_overlay_iommu_save(struct mdp4_overlay_pipe *pipe,
+		struct mdp4_iommu_pipe_info *iom)
+{
+	mutex_lock(&iommu_mutex);
+	pipe->iommu.mapped = 0;
+	*iom = pipe->iommu;
+	mutex_unlock(&iommu_mutex);
+}
+
+/*
+ * mdp4_overlay_iommu_restore: undo the mappings made since
+ * mdp4_overlay_iommu_save(). They never reached the screen, so they
+ * are released right away instead of through the free list.
+ */
+static void mdp4_overlay_iommu_restore(struct mdp4_overlay_pipe *pipe,
+		struct mdp4_iommu_pipe_info *saved)
+{
+	struct mdp4_iommu_pipe_info *iom = &pipe->iommu;
+	struct iommu_cache_entry *ent;
+	struct ion_handle *ihdl;
+	int plane;
+
+	mutex_lock(&iommu_mutex);
+	for (plane = 0; plane < MDP4_MAX_PLANE; plane++) {
+		if (!(iom->mapped & BIT(plane)))
+			continue;
+		ihdl = iom->ihdl[plane];
+		ent = mdp4_iommu_cache_find(ihdl);
+		if (ent) {
+			ent->busy--;
+		} else {
+			ion_unmap_iommu(display_iclient, ihdl,
+					DISPLAY_READ_DOMAIN, GEN_POOL);
+			ion_free(display_iclient, ihdl);
+			mdp4_stat.iommu_unmap++;
+		}
+		iom->ihdl[plane] = saved->ihdl[plane];
+		/* a previous buffer still held was passed to the free list */
+		iom->prev_ihdl[plane] = NULL;
+	}
+	iom->mapped = 0;
+	mutex_unlock(&iommu_mutex);
+}
+
 static struct mdp4_iommu_pipe_info mdp_iommu[MDP4_MIXER_MAX][OVERLAY_PIPE_MAX];
 
 void mdp4_iommu_unmap(struct mdp4_overlay_pipe *pipe)
@@ -2362,6 +2624,7 @@ static int mdp4_overlay_req2pipe(struct mdp_overlay *req, int mixer,
 
 	if (!display_iclient && !IS_ERR_OR_NULL(mfd->iclient)) {
 		display_iclient = mfd->iclient;
+		register_shrinker(&mdp4_iommu_cache_shrinker);
 		pr_debug("%s(): display_iclient %p\n", __func__,
 			display_iclient);
 	}
@@ -3002,35 +3265,24 @@ int mdp4_overlay_get(struct fb_info *info, struct mdp_overlay *req)
 	return 0;
 }
 
-int mdp4_overlay_set(struct fb_info *info, struct mdp_overlay *req)
+/*
+ * mdp4_overlay_set_sub: allocate/configure the pipe for req
+ * called with ov_mutex held
+ */
+static int mdp4_overlay_set_sub(struct msm_fb_data_type *mfd,
+				struct mdp_overlay *req)
 {
-	struct msm_fb_data_type *mfd = (struct msm_fb_data_type *)info->par;
 	int ret, mixer;
 	struct mdp4_overlay_pipe *pipe;
 
-	if (mfd == NULL) {
-		pr_err("%s: mfd == NULL, -ENODEV\n", __func__);
-		return -ENODEV;
-	}
-
-	if (info->node != 0 || mfd->cont_splash_done)	/* primary */
-		if (!mfd->panel_power_on)		/* suspended */
-			return -EPERM;
-
 	if (req->src.format == MDP_FB_FORMAT)
 		req->src.format = mfd->fb_imgType;
 
-	if (mutex_lock_interruptible(&mfd->dma->ov_mutex)) {
-		pr_err("%s: mutex_lock_interruptible, -EINTR\n", __func__);
-		return -EINTR;
-	}
-
 	mixer = mfd->panel_info.pdest;	/* DISPLAY_1 or DISPLAY_2 */
 
 	ret = mdp4_overlay_req2pipe(req, mixer, &pipe, mfd);
 
 	if (ret < 0) {
-		mutex_unlock(&mfd->dma->ov_mutex);
 		pr_err("%s: mdp4_overlay_req2pipe, ret=%d\n", __func__, ret);
 		return ret;
 	}
@@ -3063,9 +3315,33 @@ int mdp4_overlay_set(struct fb_info *info, struct mdp_overlay *req)
 
 	mdp4_overlay_mdp_pipe_req(pipe, mfd);
 
+	return 0;
+}
+
+int mdp4_overlay_set(struct fb_info *info, struct mdp_overlay *req)
+{
+	struct msm_fb_data_type *mfd = (struct msm_fb_data_type *)info->par;
+	int ret;
+
+	if (mfd == NULL) {
+		pr_err("%s: mfd == NULL, -ENODEV\n", __func__);
+		return -ENODEV;
+	}
+
+	if (info->node != 0 || mfd->cont_splash_done)	/* primary */
+		if (!mfd->panel_power_on)		/* suspended */
+			return -EPERM;
+
+	if (mutex_lock_interruptible(&mfd->dma->ov_mutex)) {
+		pr_err("%s: mutex_lock_interruptible, -EINTR\n", __func__);
+		return -EINTR;
+	}
+
+	ret = mdp4_overlay_set_sub(mfd, req);
+
 	mutex_unlock(&mfd->dma->ov_mutex);
 
-	return 0;
+	return ret;
 }
 
 int mdp4_overlay_unset_mixer(int mixer)
@@ -3273,11 +3549,14 @@ void mdp4_overlay_vsync_commit(struct mdp4_overlay_pipe *pipe)
 	mdp4_mixer_stage_up(pipe, 0);
 }
 
-int mdp4_overlay_play(struct fb_info *info, struct msmfb_overlay_data *req)
+/*
+ * mdp4_overlay_play_map: point the pipe at the new buffers, called
+ * with ov_mutex held. Nothing is queued to the display yet.
+ */
+static int mdp4_overlay_play_map(struct fb_info *info,
+		struct mdp4_overlay_pipe *pipe, struct msmfb_overlay_data *req)
 {
-	struct msm_fb_data_type *mfd = (struct msm_fb_data_type *)info->par;
 	struct msmfb_data *img;
-	struct mdp4_overlay_pipe *pipe;
 	ulong start, addr;
 	ulong len = 0;
 	struct file *srcp0_file = NULL;
@@ -3288,26 +3567,6 @@ int mdp4_overlay_play(struct fb_info *info, struct msmfb_overlay_data *req)
 	uint32_t overlay_version = 0;
 	int ret = 0;
 
-	if (mfd == NULL)
-		return -ENODEV;
-
-	if (!mfd->panel_power_on) /* suspended */
-		return -EPERM;
-
-	pipe = mdp4_overlay_ndx2pipe(req->id);
-	if (pipe == NULL) {
-		mdp4_stat.err_play++;
-		return -ENODEV;
-	}
-
-	if (pipe->pipe_type == OVERLAY_TYPE_BF) {
-		mdp4_overlay_borderfill_stage_up(pipe);
-		mdp4_mixer_stage_commit(pipe->mixer_num);
-		return 0;
-	}
-
-	mutex_lock(&mfd->dma->ov_mutex);
-
 	img = &req->data;
 	get_img(img, info, pipe, 0, &start, &len, &srcp0_file,
 		&ps0_need, &srcp0_ihdl);
@@ -3413,6 +3672,30 @@ int mdp4_overlay_play(struct fb_info *info, struct msmfb_overlay_data *req)
 		}
 	}
 
+end:
+#ifdef CONFIG_ANDROID_PMEM
+	if (srcp0_file)
+		put_pmem_file(srcp0_file);
+	if (srcp1_file)
+		put_pmem_file(srcp1_file);
+	if (srcp2_file)
+		put_pmem_file(srcp2_file);
+#endif
+	/* only source may use frame buffer */
+	if (img->flags & MDP_MEMORY_ID_TYPE_FB)
+		fput_light(srcp0_file, ps0_need);
+	return ret;
+}
+
+/*
+ * mdp4_overlay_play_queue: queue a pipe set up by mdp4_overlay_play_map()
+ * to its display, called with ov_mutex held
+ */
+static void mdp4_overlay_play_queue(struct fb_info *info,
+		struct mdp4_overlay_pipe *pipe)
+{
+	struct msm_fb_data_type *mfd = (struct msm_fb_data_type *)info->par;
+
 	mdp4_overlay_mdp_perf_req(mfd, ctrl->plist);
 
 	if (pipe->mixer_num == MDP4_MIXER2 || ctrl->panel_mode & MDP4_PANEL_MDDI)
@@ -3435,8 +3718,7 @@ int mdp4_overlay_play(struct fb_info *info, struct msmfb_overlay_data *req)
 			mdp4_dtv_pipe_queue(0, pipe);/* cndx = 0 */
 	}
 
-	mutex_unlock(&mfd->dma->ov_mutex);
-	return ret;
+	return;
 
 mddi:
 	if (pipe->pipe_type == OVERLAY_TYPE_VIDEO) {
@@ -3458,8 +3740,7 @@ mddi:
 	} else if (ctrl->panel_mode & MDP4_PANEL_MDDI) {
 		if (pipe->flags & MDP_OV_PLAY_NOWAIT) {
 			mdp4_stat.overlay_play[pipe->mixer_num]++;
-			mutex_unlock(&mfd->dma->ov_mutex);
-			goto end;
+			return;
 		}
 		mdp4_mixer_stage_commit(pipe->mixer_num);
 		mdp4_mddi_dma_busy_wait(mfd);
@@ -3472,21 +3753,206 @@ mddi:
 	if (!(pipe->flags & MDP_OV_PLAY_NOWAIT))
 		mdp4_iommu_unmap(pipe);
 	mdp4_stat.overlay_play[pipe->mixer_num]++;
+}
 
-end:
+/*
+ * mdp4_overlay_play_sub: point the pipe at the new buffers and queue it
+ * to its display, called with ov_mutex held
+ */
+static int mdp4_overlay_play_sub(struct fb_info *info,
+		struct mdp4_overlay_pipe *pipe, struct msmfb_overlay_data *req)
+{
+	int ret;
+
+	ret = mdp4_overlay_play_map(info, pipe, req);
+	if (ret)
+		return ret;
+
+	mdp4_overlay_play_queue(info, pipe);
+	return 0;
+}
+
+int mdp4_overlay_play(struct fb_info *info, struct msmfb_overlay_data *req)
+{
+	struct msm_fb_data_type *mfd = (struct msm_fb_data_type *)info->par;
+	struct mdp4_overlay_pipe *pipe;
+	int ret;
+
+	if (mfd == NULL)
+		return -ENODEV;
+
+	if (!mfd->panel_power_on) /* suspended */
+		return -EPERM;
+
+	pipe = mdp4_overlay_ndx2pipe(req->id);
+	if (pipe == NULL) {
+		mdp4_stat.err_play++;
+		return -ENODEV;
+	}
+
+	if (pipe->pipe_type == OVERLAY_TYPE_BF) {
+		mdp4_overlay_borderfill_stage_up(pipe);
+		mdp4_mixer_stage_commit(pipe->mixer_num);
+		return 0;
+	}
+
+	mutex_lock(&mfd->dma->ov_mutex);
+	ret = mdp4_overlay_play_sub(info, pipe, req);
 	mutex_unlock(&mfd->dma->ov_mutex);
 
-#ifdef CONFIG_ANDROID_PMEM
-	if (srcp0_file)
-		put_pmem_file(srcp0_file);
-	if (srcp1_file)
-		put_pmem_file(srcp1_file);
-	if (srcp2_file)
-		put_pmem_file(srcp2_file);
-#endif
-	/* only source may use frame buffer */
-	if (img->flags & MDP_MEMORY_ID_TYPE_FB)
-		fput_light(srcp0_file, ps0_need);
+	return ret;
+}
+
+/*
+ * the pipe fields from src_format up to the blt state are configuration
+ * written by set and play; the blt state, counters and completions
+ * after them are live and must not be rolled back
+ */
+#define MDP4_PIPE_CFG_START	offsetof(struct mdp4_overlay_pipe, src_format)
+#define MDP4_PIPE_CFG_SIZE	(offsetof(struct mdp4_overlay_pipe, \
+					ov_blt_addr) - MDP4_PIPE_CFG_START)
+
+/* what mdp4_overlay_commit() changes in a pipe and has to undo */
+struct mdp4_overlay_undo {
+	uint32 mixer_stage;
+	uint32 req_clk;
+	uint32 req_bw;
+	struct mdp_overlay req_data;
+	struct mdp4_iommu_pipe_info iommu;
+	u8 cfg[MDP4_PIPE_CFG_SIZE];
+};
+
+static void mdp4_overlay_undo_save(struct mdp4_overlay_pipe *pipe,
+		struct mdp4_overlay_undo *undo)
+{
+	undo->mixer_stage = pipe->mixer_stage;
+	undo->req_clk = pipe->req_clk;
+	undo->req_bw = pipe->req_bw;
+	undo->req_data = pipe->req_data;
+	memcpy(undo->cfg, (u8 *)pipe + MDP4_PIPE_CFG_START,
+					MDP4_PIPE_CFG_SIZE);
+}
+
+static void mdp4_overlay_undo_restore(struct mdp4_overlay_pipe *pipe,
+		struct mdp4_overlay_undo *undo)
+{
+	pipe->mixer_stage = undo->mixer_stage;
+	pipe->req_clk = undo->req_clk;
+	pipe->req_bw = undo->req_bw;
+	pipe->req_data = undo->req_data;
+	memcpy((u8 *)pipe + MDP4_PIPE_CFG_START, undo->cfg,
+					MDP4_PIPE_CFG_SIZE);
+}
+
+/*
+ * mdp4_overlay_commit: set and play a whole frame's worth of layers
+ * under one ov_mutex hold. Every layer is configured and has its
+ * buffers mapped before any of them is queued, and a failure puts the
+ * pipes back the way they were, so a bad layer fails the frame as a
+ * whole; the caller then kicks off the display once.
+ */
+int mdp4_overlay_commit(struct fb_info *info,
+	struct mdp_overlay_commit_layer *layers, int cnt)
+{
+	struct msm_fb_data_type *mfd = (struct msm_fb_data_type *)info->par;
+	struct mdp4_overlay_pipe *pipe;
+	struct mdp4_overlay_undo *undo;
+	struct mdp4_overlay_perf perf_req;
+	u32 mem_hid;
+	u32 new_pipes = 0;
+	int i, set = 0, mapped = 0, ret = 0;
+
+	if (mfd == NULL)
+		return -ENODEV;
+
+	if (!mfd->panel_power_on) /* suspended */
+		return -EPERM;
+
+	undo = kmalloc(cnt * sizeof(*undo), GFP_KERNEL);
+	if (undo == NULL)
+		return -ENOMEM;
+
+	if (mutex_lock_interruptible(&mfd->dma->ov_mutex)) {
+		kfree(undo);
+		return -EINTR;
+	}
+
+	mem_hid = mfd->mem_hid;
+	perf_req = perf_request;
+
+	/* validate and configure */
+	for (set = 0; set < cnt; set++) {
+		if (layers[set].req.id == MSMFB_NEW_REQUEST) {
+			new_pipes |= BIT(set);
+		} else {
+			pipe = mdp4_overlay_ndx2pipe(layers[set].req.id);
+			if (pipe == NULL) {
+				mdp4_stat.err_play++;
+				ret = -ENODEV;
+				goto undo;
+			}
+			mdp4_overlay_undo_save(pipe, &undo[set]);
+		}
+		ret = mdp4_overlay_set_sub(mfd, &layers[set].req);
+		if (ret) {
+			/* a new pipe is only allocated on success */
+			new_pipes &= ~BIT(set);
+			if (layers[set].req.id != MSMFB_NEW_REQUEST)
+				set++;
+			goto undo;
+		}
+		layers[set].data.id = layers[set].req.id;
+	}
+
+	/* map the buffers */
+	for (mapped = 0; mapped < cnt; mapped++) {
+		pipe = mdp4_overlay_ndx2pipe(layers[mapped].data.id);
+		if (pipe->pipe_type == OVERLAY_TYPE_BF)
+			continue;
+		mdp4_overlay_iommu_save(pipe, &undo[mapped].iommu);
+		ret = mdp4_overlay_play_map(info, pipe, &layers[mapped].data);
+		if (ret) {
+			mapped++;
+			goto undo;
+		}
+	}
+
+	/* nothing can fail from here on */
+	for (i = 0; i < cnt; i++) {
+		pipe = mdp4_overlay_ndx2pipe(layers[i].data.id);
+		if (pipe->pipe_type == OVERLAY_TYPE_BF)
+			mdp4_overlay_borderfill_stage_up(pipe);
+		else
+			mdp4_overlay_play_queue(info, pipe);
+	}
+
+	mutex_unlock(&mfd->dma->ov_mutex);
+	kfree(undo);
+	return 0;
+
+undo:
+	/* drop the mappings made for this commit, newest first */
+	while (--mapped >= 0) {
+		pipe = mdp4_overlay_ndx2pipe(layers[mapped].data.id);
+		if (pipe->pipe_type != OVERLAY_TYPE_BF)
+			mdp4_overlay_iommu_restore(pipe, &undo[mapped].iommu);
+	}
+	/* release the pipes this commit allocated and restore the others */
+	while (--set >= 0) {
+		pipe = mdp4_overlay_ndx2pipe(layers[set].req.id);
+		if (pipe == NULL)
+			continue;
+		if (new_pipes & BIT(set)) {
+			mdp4_overlay_pipe_free(pipe);
+			layers[set].req.id = MSMFB_NEW_REQUEST;
+			continue;
+		}
+		mdp4_overlay_undo_restore(pipe, &undo[set]);
+	}
+	mfd->mem_hid = mem_hid;
+	perf_request = perf_req;
+	mutex_unlock(&mfd->dma->ov_mutex);
+	kfree(undo);
 	return ret;
 }
 
@@ -72,6 +72,9 @@ static struct vsycn_ctrl {
 	int clk_enabled;
 	int clk_control;
 	int new_update;
+	struct mdp_rect roi;	/* panel window of last update */
+	int roi_changed;
+	int roi_partial;	/* roi is smaller than the panel */
 	ktime_t vsync_time;
 	struct work_struct clk_work;
 } vsync_ctrl_db[MAX_CONTROLLER];
@@ -249,6 +252,51 @@ void mdp4_dsi_cmd_pipe_queue(int cndx, struct mdp4_overlay_pipe *pipe)
 }
 
 static void mdp4_dsi_cmd_blt_ov_update(struct mdp4_overlay_pipe *pipe);
+static void mdp4_overlay_setup_pipe_addr(struct msm_fb_data_type *mfd,
+			struct mdp4_overlay_pipe *pipe);
+
+/*
+ * update_lock held: is anything above the base layer in the frame
+ * being staged, either already on the mixer or queued with it
+ */
+static int mdp4_dsi_cmd_staged_above_base(struct vsync_update *vp,
+			int mixer)
+{
+	struct mdp4_overlay_pipe *pp;
+	int i;
+
+	for (i = MDP4_MIXER_STAGE0; i < MDP4_MIXER_STAGE_MAX; i++) {
+		if (mdp4_overlay_stage_pipe(mixer, i))
+			return 1;
+	}
+
+	pp = vp->plist;
+	for (i = 0; i < OVERLAY_PIPE_MAX; i++, pp++) {
+		if (pp->pipe_used && pp->mixer_num == mixer &&
+		    pp->mixer_stage > MDP4_MIXER_STAGE_BASE)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * update_lock held: an overlay was staged after the base layer was
+ * shrunk to the dirty region, queue the whole frame instead
+ */
+static void mdp4_dsi_cmd_roi_full(struct vsycn_ctrl *vctrl,
+			struct vsync_update *vp,
+			struct mdp4_overlay_pipe *pipe)
+{
+	mdp4_overlay_setup_pipe_addr(vctrl->mfd, pipe);
+	vp->plist[pipe->pipe_ndx - 1] = *pipe;
+
+	vctrl->roi.x = 0;
+	vctrl->roi.y = 0;
+	vctrl->roi.w = pipe->src_width;
+	vctrl->roi.h = pipe->src_height;
+	vctrl->roi_partial = 0;
+	vctrl->roi_changed = 1;
+}
 
 int mdp4_dsi_cmd_pipe_commit(void)
 {
@@ -261,6 +309,8 @@ int mdp4_dsi_cmd_pipe_commit(void)
 	unsigned long flags;
 	int need_dmap_wait = 0;
 	int need_ov_wait = 0;
+	int roi_changed;
+	struct mdp_rect roi;
 	int cnt = 0;
 
 	vctrl = &vsync_ctrl_db[0];
@@ -276,9 +326,19 @@ int mdp4_dsi_cmd_pipe_commit(void)
 		return cnt;
 	}
 
+	if (vctrl->roi_partial && mdp4_dsi_cmd_staged_above_base(vp, mixer))
+		mdp4_dsi_cmd_roi_full(vctrl, vp, pipe);
+	if (vctrl->roi_partial)
+		mdp4_stat.dsi_cmd_partial++;
+	else
+		mdp4_stat.dsi_cmd_full++;
+
 	vctrl->update_ndx++;
 	vctrl->update_ndx &= 0x01;
 	vp->update_cnt = 0;     /* reset */
+	roi_changed = vctrl->roi_changed;
+	vctrl->roi_changed = 0;
+	roi = vctrl->roi;
 	if (vctrl->blt_free) {
 		vctrl->blt_free--;
 		if (vctrl->blt_free == 0)
@@ -334,6 +394,14 @@ int mdp4_dsi_cmd_pipe_commit(void)
 		vctrl->blt_change = 0;
 	}
 
+	if (roi_changed) {
+		/* resize mixer and dma_p output, then the panel window */
+		mdp4_overlayproc_cfg(pipe);
+		mdp4_overlay_dmap_xy(pipe);
+		mipi_dsi_cmd_roi(&vctrl->mfd->panel_info.mipi,
+					roi.x, roi.y, roi.w, roi.h);
+	}
+
 	pipe = vp->plist;
 	for (i = 0; i < OVERLAY_PIPE_MAX; i++, pipe++) {
 		if (pipe->pipe_used) {
@@ -799,6 +867,77 @@ static void mdp4_overlay_setup_pipe_addr(struct msm_fb_data_type *mfd,
 	pipe->srcp0_addr = (uint32)src;
 }
 
+/*
+ * mdp4_dsi_cmd_roi_setup: shrink the base layer to the dirty region
+ * of the pan update so that only that part of the frame is sent to
+ * the panel. Only done for panels with partial_update and when
+ * nothing is staged above the base layer, otherwise the whole mixer
+ * output is transferred. mdp4_dsi_cmd_pipe_commit() checks the
+ * staged pipes again, overlays may be queued in between.
+ */
+static void mdp4_dsi_cmd_roi_setup(struct vsycn_ctrl *vctrl,
+			struct msm_fb_data_type *mfd,
+			struct mdp4_overlay_pipe *pipe)
+{
+	MDPIBUF *iBuf = &mfd->ibuf;
+	struct fb_info *fbi = mfd->fbi;
+	struct mdp_rect roi;
+	int partial = 1;
+
+	if (!mfd->panel_info.mipi.partial_update)
+		return;
+
+	mutex_lock(&vctrl->update_lock);
+	if (pipe->is_3d || pipe->ov_blt_addr ||
+	    mdp4_dsi_cmd_staged_above_base(&vctrl->vlist[vctrl->update_ndx],
+					   pipe->mixer_num))
+		partial = 0;
+
+	roi.x = iBuf->dma_x;
+	roi.y = iBuf->dma_y;
+	roi.w = iBuf->dma_w;
+	roi.h = iBuf->dma_h;
+
+	if (roi.w == 0 || roi.h == 0 ||
+	    roi.x + roi.w > fbi->var.xres || roi.y + roi.h > fbi->var.yres)
+		partial = 0;
+
+	if (partial) {
+		/* panels take column address in pixel pairs */
+		roi.w += roi.x & 0x01;
+		roi.x &= ~0x01;
+		roi.w = ALIGN(roi.w, 2);
+		if (roi.x + roi.w > fbi->var.xres)
+			roi.w = fbi->var.xres - roi.x;
+
+		if (roi.w == fbi->var.xres && roi.h == fbi->var.yres)
+			partial = 0;
+	}
+
+	if (partial) {
+		pipe->srcp0_addr += roi.y * pipe->srcp0_ystride +
+					roi.x * iBuf->bpp;
+		pipe->src_height = roi.h;
+		pipe->src_width = roi.w;
+		pipe->src_h = roi.h;
+		pipe->src_w = roi.w;
+		pipe->dst_h = roi.h;
+		pipe->dst_w = roi.w;
+	} else {
+		roi.x = 0;
+		roi.y = 0;
+		roi.w = pipe->src_width;
+		roi.h = pipe->src_height;
+	}
+
+	if (memcmp(&roi, &vctrl->roi, sizeof(roi))) {
+		vctrl->roi = roi;
+		vctrl->roi_changed = 1;
+	}
+	vctrl->roi_partial = partial;
+	mutex_unlock(&vctrl->update_lock);
+}
+
 static void mdp4_overlay_update_dsi_cmd(struct msm_fb_data_type *mfd)
 {
 	int ptype;
@@ -1039,6 +1178,11 @@ int mdp4_dsi_cmd_off(struct platform_device *pdev)
 	mdp4_overlay_pipe_free(pipe);
 	vctrl->base_pipe = NULL;
 
+	/* panel window is back to full screen after power on */
+	memset(&vctrl->roi, 0, sizeof(vctrl->roi));
+	vctrl->roi_changed = 0;
+	vctrl->roi_partial = 0;
+
 	if (vctrl->clk_enabled) {
 		/*
 		 * in case of suspend, vsycn_ctrl off is not
@@ -1133,6 +1277,7 @@ void mdp4_dsi_cmd_overlay(struct msm_fb_data_type *mfd)
 	if (pipe->mixer_stage == MDP4_MIXER_STAGE_BASE) {
 		mdp4_mipi_vsync_enable(mfd, pipe, 0);
 		mdp4_overlay_setup_pipe_addr(mfd, pipe);
+		mdp4_dsi_cmd_roi_setup(vctrl, mfd, pipe);
 		mdp4_dsi_cmd_pipe_queue(0, pipe);
 	}
 
@@ -368,9 +368,19 @@ static ssize_t mdp_stat_read(
 
 	bp += len;
 	dlen -= len;
-	len = snprintf(bp, dlen, "clk_off: %08lu\n\n",
+	len = snprintf(bp, dlen, "clk_off: %08lu\n",
 					mdp4_stat.dsi_clk_off);
 
+	bp += len;
+	dlen -= len;
+	len = snprintf(bp, dlen, "update_full: %08lu\t",
+					mdp4_stat.dsi_cmd_full);
+
+	bp += len;
+	dlen -= len;
+	len = snprintf(bp, dlen, "update_partial: %08lu\n\n",
+					mdp4_stat.dsi_cmd_partial);
+
 	bp += len;
 	dlen -= len;
 	len = snprintf(bp, dlen, "kickoff:\n");
@@ -481,7 +491,20 @@ static ssize_t mdp_stat_read(
 	len = snprintf(bp, dlen, "unmap: %08lu\t", mdp4_stat.iommu_unmap);
 	bp += len;
 	dlen -= len;
-	len = snprintf(bp, dlen, "drop: %08lu\n\n", mdp4_stat.iommu_drop);
+	len = snprintf(bp, dlen, "drop: %08lu\n", mdp4_stat.iommu_drop);
+	bp += len;
+	dlen -= len;
+	len = snprintf(bp, dlen, "iommu_cache: ");
+	bp += len;
+	dlen -= len;
+	len = snprintf(bp, dlen, "hit : %08lu\t", mdp4_stat.iommu_cache_hit);
+	bp += len;
+	dlen -= len;
+	len = snprintf(bp, dlen, "miss : %08lu\t", mdp4_stat.iommu_cache_miss);
+	bp += len;
+	dlen -= len;
+	len = snprintf(bp, dlen, "evict: %08lu\n\n",
+					mdp4_stat.iommu_cache_evict);
 	bp += len;
 	dlen -= len;
 	len = snprintf(bp, dlen, "err_mixer : %08lu\t", mdp4_stat.err_mixer);
@@ -259,7 +259,6 @@ static int mipi_dsi_on(struct platform_device *pdev)
 	struct msm_panel_info *pinfo;
 	struct mipi_panel_info *mipi;
 	u32 hbp, hfp, vbp, vfp, hspw, vspw, width, height;
-	u32 ystride, bpp, data;
 	u32 dummy_xres, dummy_yres;
 	int target_type = 0;
 #ifdef CONFIG_FB_MSM_MIPI_HX8369B_WVGA_PT_PANEL
@@ -347,26 +346,7 @@ RETRY_MIPI_DSI_ON:
 		MIPI_OUTP(MIPI_DSI_BASE + 0x34, (vspw << 16));
 
 	} else {		/* command mode */
-		if (mipi->dst_format == DSI_CMD_DST_FORMAT_RGB888)
-			bpp = 3;
-		else if (mipi->dst_format == DSI_CMD_DST_FORMAT_RGB666)
-			bpp = 3;
-		else if (mipi->dst_format == DSI_CMD_DST_FORMAT_RGB565)
-			bpp = 2;
-		else
-			bpp = 3;	/* Default format set to RGB888 */
-
-		ystride = width * bpp + 1;
-
-		/* DSI_COMMAND_MODE_MDP_STREAM_CTRL */
-		data = (ystride << 16) | (mipi->vc << 8) | DTYPE_DCS_LWRITE;
-		MIPI_OUTP(MIPI_DSI_BASE + 0x5c, data);
-		MIPI_OUTP(MIPI_DSI_BASE + 0x54, data);
-
-		/* DSI_COMMAND_MODE_MDP_STREAM_TOTAL */
-		data = height << 16 | width;
-		MIPI_OUTP(MIPI_DSI_BASE + 0x60, data);
-		MIPI_OUTP(MIPI_DSI_BASE + 0x58, data);
+		mipi_dsi_cmd_stream_cfg(mipi, width, height);
 	}
 
 	mipi_dsi_host_init(mipi);
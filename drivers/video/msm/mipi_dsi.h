@@ -355,6 +355,10 @@ int mipi_dsi_cmdlist_put(struct dcs_cmd_req *cmdreq);
 struct dcs_cmd_req *mipi_dsi_cmdlist_get(void);
 void mipi_dsi_cmdlist_commit(int from_mdp);
 void mipi_dsi_cmd_mdp_busy(void);
+void mipi_dsi_cmd_stream_cfg(struct mipi_panel_info *mipi,
+				u32 width, u32 height);
+void mipi_dsi_cmd_roi(struct mipi_panel_info *mipi,
+			u32 x, u32 y, u32 w, u32 h);
 
 #ifdef CONFIG_FB_MSM_MDP303
 void update_lane_config(struct msm_panel_info *pinfo);
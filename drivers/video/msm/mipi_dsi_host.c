@@ -1575,6 +1575,80 @@ void mipi_dsi_cmd_mdp_busy(void)
 		wait_for_completion(&dsi_mdp_comp);
 }
 
+/*
+ * mipi_dsi_cmd_stream_cfg: size the mdp command mode stream
+ * to width x height pixels
+ */
+void mipi_dsi_cmd_stream_cfg(struct mipi_panel_info *mipi,
+				u32 width, u32 height)
+{
+	u32 ystride, bpp, data;
+
+	if (mipi->dst_format == DSI_CMD_DST_FORMAT_RGB888)
+		bpp = 3;
+	else if (mipi->dst_format == DSI_CMD_DST_FORMAT_RGB666)
+		bpp = 3;
+	else if (mipi->dst_format == DSI_CMD_DST_FORMAT_RGB565)
+		bpp = 2;
+	else
+		bpp = 3;	/* Default format set to RGB888 */
+
+	ystride = width * bpp + 1;
+
+	/* DSI_COMMAND_MODE_MDP_STREAM_CTRL */
+	data = (ystride << 16) | (mipi->vc << 8) | DTYPE_DCS_LWRITE;
+	MIPI_OUTP(MIPI_DSI_BASE + 0x5c, data);
+	MIPI_OUTP(MIPI_DSI_BASE + 0x54, data);
+
+	/* DSI_COMMAND_MODE_MDP_STREAM_TOTAL */
+	data = height << 16 | width;
+	MIPI_OUTP(MIPI_DSI_BASE + 0x60, data);
+	MIPI_OUTP(MIPI_DSI_BASE + 0x58, data);
+}
+
+static char set_col_addr[5] = {0x2a, 0x00, 0x00, 0x00, 0x00};
+static char set_page_addr[5] = {0x2b, 0x00, 0x00, 0x00, 0x00};
+
+static struct dsi_cmd_desc dsi_roi_cmds[] = {
+	{DTYPE_DCS_LWRITE, 1, 0, 0, 0, sizeof(set_col_addr), set_col_addr},
+	{DTYPE_DCS_LWRITE, 1, 0, 0, 0, sizeof(set_page_addr), set_page_addr},
+};
+
+/*
+ * mipi_dsi_cmd_roi: set panel column/page address window and
+ * resize the mdp stream so that the next frame only transfers
+ * the (x, y, w, h) region. dsi_cmd_mdp has to be idle.
+ * Panels without partial_update are left alone.
+ */
+void mipi_dsi_cmd_roi(struct mipi_panel_info *mipi,
+			u32 x, u32 y, u32 w, u32 h)
+{
+	u32 end;
+
+	if (!mipi->partial_update)
+		return;
+
+	end = x + w - 1;
+	set_col_addr[1] = (x >> 8) & 0xff;
+	set_col_addr[2] = x & 0xff;
+	set_col_addr[3] = (end >> 8) & 0xff;
+	set_col_addr[4] = end & 0xff;
+
+	end = y + h - 1;
+	set_page_addr[1] = (y >> 8) & 0xff;
+	set_page_addr[2] = y & 0xff;
+	set_page_addr[3] = (end >> 8) & 0xff;
+	set_page_addr[4] = end & 0xff;
+
+	mipi_dsi_cmd_mdp_busy();
+
+	mutex_lock(&cmd_mutex);
+	mipi_dsi_buf_init(&dsi_tx_buf);
+	mipi_dsi_cmds_tx(&dsi_tx_buf, dsi_roi_cmds, ARRAY_SIZE(dsi_roi_cmds));
+	mipi_dsi_cmd_stream_cfg(mipi, w, h);
+	mutex_unlock(&cmd_mutex);
+}
+
 /*
  * mipi_dsi_cmd_get: cmd_mutex acquired by caller
  */
@@ -41,6 +41,8 @@
 #include <linux/android_pmem.h>
 #include <linux/leds.h>
 #include <linux/pm_runtime.h>
+#include <linux/file.h>
+#include <linux/sync.h>
 
 #define MSM_FB_C
 #include "msm_fb.h"
@@ -949,6 +951,24 @@ void msm_fb_set_backlight(struct msm_fb_data_type *mfd, __u32 bkl_lvl)
 	}
 }
 
+/*
+ * signal every release fence handed out so far, nothing will be
+ * displayed anymore to retire the buffers in the usual way
+ */
+static void msm_fb_release_timeline(struct msm_fb_data_type *mfd)
+{
+#ifdef CONFIG_SW_SYNC
+	if (!mfd->timeline)
+		return;
+
+	mutex_lock(&mfd->sync_mutex);
+	if (mfd->timeline_value > mfd->timeline->value)
+		sw_sync_timeline_inc(mfd->timeline,
+			mfd->timeline_value - mfd->timeline->value);
+	mutex_unlock(&mfd->sync_mutex);
+#endif
+}
+
 static int msm_fb_blank_sub(int blank_mode, struct fb_info *info,
 			    boolean op_enable)
 {
@@ -1016,6 +1036,7 @@ static int msm_fb_blank_sub(int blank_mode, struct fb_info *info,
 			curr_pwr_state = mfd->panel_power_on;
 			mfd->panel_power_on = FALSE;
 			bl_updated = 0;
+			msm_fb_release_timeline(mfd);
 
 			// let screen light off smoothly, because backlight is turning off in another thread now
 			// if need delay more, please set it in the pdata->off()
@@ -1504,6 +1525,12 @@ static int msm_fb_register(struct msm_fb_data_type *mfd)
 	init_completion(&mfd->msmfb_update_notify);
 	init_completion(&mfd->msmfb_no_update_notify);
 
+#ifdef CONFIG_SW_SYNC
+	mutex_init(&mfd->sync_mutex);
+	mfd->timeline = sw_sync_timeline_create("mdp-release");
+	mfd->timeline_value = 0;
+#endif
+
 	fbram_offset = PAGE_ALIGN((int)fbram)-(int)fbram;
 	fbram += fbram_offset;
 	fbram_phys += fbram_offset;
@@ -3123,6 +3150,143 @@ static int msmfb_overlay_play(struct fb_info *info, unsigned long *argp)
 	return ret;
 }
 
+#define MSMFB_ACQ_FENCE_TIMEOUT	1000	/* msec */
+
+static int msmfb_overlay_commit_fences(struct mdp_overlay_commit_layer *layers,
+				       int cnt)
+{
+#ifdef CONFIG_SYNC
+	struct sync_fence *fence;
+	int i, ret;
+
+	for (i = 0; i < cnt; i++) {
+		if (layers[i].acq_fen_fd < 0)
+			continue;
+		fence = sync_fence_fdget(layers[i].acq_fen_fd);
+		if (fence == NULL) {
+			pr_err("%s: invalid fence fd %d\n", __func__,
+					layers[i].acq_fen_fd);
+			return -EINVAL;
+		}
+		ret = sync_fence_wait(fence, MSMFB_ACQ_FENCE_TIMEOUT);
+		sync_fence_put(fence);
+		if (ret < 0) {
+			pr_err("%s: fence wait failed %d\n", __func__, ret);
+			return ret;
+		}
+	}
+#endif
+	return 0;
+}
+
+/*
+ * the buffers of commit N stop being scanned out once commit N + 1
+ * reached the panel, so commit N + 1 signals the fence of commit N.
+ * The fence comes back with a reserved *fd that the caller installs
+ * once user space has been told about it.
+ */
+static struct sync_fence *msmfb_overlay_commit_release_fence(
+	struct msm_fb_data_type *mfd, int *fd)
+{
+	struct sync_fence *fence = NULL;
+#ifdef CONFIG_SW_SYNC
+	struct sync_pt *pt;
+#endif
+
+	*fd = -1;
+#ifdef CONFIG_SW_SYNC
+	if (!mfd->timeline)
+		return NULL;
+
+	mutex_lock(&mfd->sync_mutex);
+	if (mfd->timeline_value > mfd->timeline->value)
+		sw_sync_timeline_inc(mfd->timeline, 1);
+	mfd->timeline_value++;
+
+	*fd = get_unused_fd_flags(O_CLOEXEC);
+	if (*fd < 0)
+		goto err;
+
+	pt = sw_sync_pt_create(mfd->timeline, mfd->timeline_value);
+	if (pt == NULL) {
+		put_unused_fd(*fd);
+		goto err;
+	}
+
+	fence = sync_fence_create("mdp-release", pt);
+	if (fence == NULL) {
+		sync_pt_free(pt);
+		put_unused_fd(*fd);
+		goto err;
+	}
+	mutex_unlock(&mfd->sync_mutex);
+
+	return fence;
+err:
+	*fd = -1;
+	mutex_unlock(&mfd->sync_mutex);
+#endif
+	return fence;
+}
+
+static int msmfb_overlay_commit(struct fb_info *info, void __user *argp)
+{
+	struct msm_fb_data_type *mfd = (struct msm_fb_data_type *)info->par;
+	struct mdp_overlay_commit commit;
+	struct mdp_overlay_commit_layer *layers;
+	struct sync_fence *fence;
+	size_t size;
+	int ret, fd;
+
+	if (copy_from_user(&commit, argp, sizeof(commit)))
+		return -EFAULT;
+
+	if (commit.num_layers > MDP_OVERLAY_COMMIT_MAX_LAYERS)
+		return -EINVAL;
+
+	size = commit.num_layers * sizeof(*layers);
+	layers = kmalloc(size, GFP_KERNEL);
+	if (!layers)
+		return -ENOMEM;
+
+	if (copy_from_user(layers, commit.layers, size)) {
+		ret = -EFAULT;
+		goto out;
+	}
+
+	ret = msmfb_overlay_commit_fences(layers, commit.num_layers);
+	if (ret)
+		goto out;
+
+	ret = mdp4_overlay_commit(info, layers, commit.num_layers);
+
+	/* hand back the pipe ids, also those left from a failed commit */
+	if (copy_to_user(commit.layers, layers, size))
+		ret = -EFAULT;
+	if (ret)
+		goto out;
+
+	ret = msm_fb_pan_display(&info->var, info);
+	if (ret)
+		goto out;
+
+	fence = msmfb_overlay_commit_release_fence(mfd, &fd);
+	commit.release_fen_fd = fd;
+	if (copy_to_user(argp, &commit, sizeof(commit))) {
+		if (fence) {
+			sync_fence_put(fence);
+			put_unused_fd(fd);
+		}
+		ret = -EFAULT;
+		goto out;
+	}
+	if (fence)
+		sync_fence_install(fence, fd);
+out:
+	kfree(layers);
+	return ret;
+}
+
 static int msmfb_overlay_play_enable(struct fb_info *info, unsigned long *argp)
 {
 	int	ret, enable;
@@ -3482,6 +3646,9 @@ static int msm_fb_ioctl(struct fb_info *info, unsigned int cmd,
 	case MSMFB_OVERLAY_PLAY_ENABLE:
 		ret = msmfb_overlay_play_enable(info, argp);
 		break;
+	case MSMFB_OVERLAY_COMMIT:
+		ret = msmfb_overlay_commit(info, argp);
+		break;
 	case MSMFB_OVERLAY_PLAY_WAIT:
 		ret = msmfb_overlay_play_wait(info, argp);
 		break;
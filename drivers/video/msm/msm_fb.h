@@ -39,6 +39,9 @@
 #include <linux/types.h>
 
 #include <linux/msm_mdp.h>
+#ifdef CONFIG_SW_SYNC
+#include <linux/sw_sync.h>
+#endif
 #ifdef CONFIG_HAS_EARLYSUSPEND
 #include <linux/earlysuspend.h>
 #endif
@@ -187,6 +190,12 @@ struct msm_fb_data_type {
 	u32 writeback_state;
 	bool writeback_active_cnt;
 	int cont_splash_done;
+#ifdef CONFIG_SW_SYNC
+	/* release fences handed out by MSMFB_OVERLAY_COMMIT */
+	struct mutex sync_mutex;
+	struct sw_sync_timeline *timeline;
+	u32 timeline_value;
+#endif
 };
 
 struct dentry *msm_fb_get_debugfs_root(void);
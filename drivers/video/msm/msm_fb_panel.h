@@ -136,6 +136,8 @@ struct mipi_panel_info {
 	char no_max_pkt_size;
 	/* Clock required during LP commands */
 	char force_clk_lane_hs;
+	/* command mode panel takes column/page address windows */
+	char partial_update;
 };
 
 enum lvds_mode {
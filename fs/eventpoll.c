@@ -47,11 +47,14 @@
  * 3) ep->lock (spinlock)
  *
  * The acquire order is the one listed above, from 1 to 3.
- * We need a spinlock (ep->lock) because we manipulate objects
- * from inside the poll callback, that might be triggered from
- * a wake_up() that in turn might be called from IRQ context.
- * So we can't sleep inside the poll callback and hence we need
- * a spinlock. During the event transfer loop (from kernel to
+ * We need a spinlock (ep->lock) because the ready list is also
+ * manipulated with interrupts disabled, by the event transfer code and
+ * epoll_ctl().  The poll callback, that might be triggered from a
+ * wake_up() that in turn might be called from IRQ context, takes no
+ * lock at all: it chains the item on ep->wakelist with cmpxchg(), and
+ * the list is moved to the ready list in one go by whoever takes
+ * ep->lock next.  Tasks sleeping in epoll_wait() are protected by the
+ * lock of ep->wq itself. During the event transfer loop (from kernel to
  * user space) we could end up sleeping due a copy_to_user(), so
  * we need a lock that will allow us to sleep. This lock is a
  * mutex (ep->mtx). It is acquired during the event transfer loop,
@@ -87,7 +90,10 @@
  */
 
 /* Epoll private bits inside the event mask */
-#define EP_PRIVATE_BITS (EPOLLONESHOT | EPOLLET)
+#define EP_PRIVATE_BITS (EPOLLNOREPOLL | EPOLLONESHOT | EPOLLET)
+
+/* epi->revents: a wakeup came without a key, f_op->poll() must be asked */
+#define EP_REVENTS_UNKNOWN (1U << 31)
 
 /* Maximum number of nesting allowed inside epoll sets */
 #define EP_MAX_NESTS 4
@@ -134,11 +140,14 @@ struct epitem {
 	struct list_head rdllink;
 
 	/*
-	 * Works together "struct eventpoll"->ovflist in keeping the
-	 * single linked chain of items.
+	 * Works together "struct eventpoll"->wakelist in keeping the
+	 * single linked chain of items, EP_UNACTIVE_PTR when not chained.
 	 */
 	struct epitem *next;
 
+	/* Wakeup keys seen since the last delivery, for EPOLLNOREPOLL */
+	unsigned int revents;
+
 	/* The file descriptor information this item refers to */
 	struct epoll_filefd ffd;
 
@@ -188,11 +197,11 @@ struct eventpoll {
 	struct rb_root rbr;
 
 	/*
-	 * This is a single linked list that chains all the "struct epitem" that
-	 * happened while transferring ready events to userspace w/out
-	 * holding ->lock.
+	 * This is a single linked list that chains all the "struct epitem"
+	 * woken by the poll callback and not moved to the ready list yet.
+	 * Pushed to locklessly, emptied under ->lock.
 	 */
-	struct epitem *ovflist;
+	struct epitem *wakelist;
 
 	/* The user that created the eventpoll descriptor */
 	struct user_struct *user;
@@ -359,7 +368,62 @@ static void ep_nested_calls_init(struct nested_calls *ncalls)
  */
 static inline int ep_events_available(struct eventpoll *ep)
 {
-	return !list_empty(&ep->rdllist) || ep->ovflist != EP_UNACTIVE_PTR;
+	return !list_empty(&ep->rdllist) || ACCESS_ONCE(ep->wakelist) != NULL;
+}
+
+/*
+ * Chains @epi on ep->wakelist unless it is already there.  Returns true
+ * if the list was empty, that is if nobody has been told about it yet.
+ */
+static bool ep_wakelist_add(struct eventpoll *ep, struct epitem *epi)
+{
+	struct epitem *head;
+
+	if (cmpxchg(&epi->next, EP_UNACTIVE_PTR, NULL) != EP_UNACTIVE_PTR)
+		return false;
+
+	do {
+		head = ACCESS_ONCE(ep->wakelist);
+		epi->next = head;
+	} while (cmpxchg(&ep->wakelist, head, epi) != head);
+
+	return head == NULL;
+}
+
+/*
+ * Moves the items chained by the poll callback to the ready list, oldest
+ * first. Must be called with "ep->lock" held.
+ */
+static void ep_wakelist_splice(struct eventpoll *ep)
+{
+	struct epitem *epi, *nepi;
+	LIST_HEAD(batch);
+
+	for (nepi = xchg(&ep->wakelist, NULL); (epi = nepi) != NULL;) {
+		nepi = epi->next;
+		/* From here on the callback may chain the item again */
+		epi->next = EP_UNACTIVE_PTR;
+
+		/*
+		 * The item may still be on the ready list, or on the "txlist"
+		 * of ep_scan_ready_list(), which puts it back by itself.
+		 */
+		if (!ep_is_linked(&epi->rdllink))
+			list_add(&epi->rdllink, &batch);
+	}
+	list_splice_tail(&batch, &ep->rdllist);
+}
+
+/* Accumulates wakeup keys for items that skip the re-poll */
+static void ep_revents_add(struct epitem *epi, unsigned int bits)
+{
+	unsigned int old;
+
+	do {
+		old = ACCESS_ONCE(epi->revents);
+		if ((old & bits) == bits)
+			return;
+	} while (cmpxchg(&epi->revents, old, old | bits) != old);
 }
 
 /**
@@ -547,7 +611,6 @@ static int ep_scan_ready_list(struct eventpoll *ep,
 {
 	int error, pwake = 0;
 	unsigned long flags;
-	struct epitem *epi, *nepi;
 	LIST_HEAD(txlist);
 
 	/*
@@ -557,16 +620,15 @@ static int ep_scan_ready_list(struct eventpoll *ep,
 	mutex_lock_nested(&ep->mtx, depth);
 
 	/*
-	 * Steal the ready list, and re-init the original one to the
-	 * empty list. Also, set ep->ovflist to NULL so that events
-	 * happening while looping w/out locks, are not lost. We cannot
-	 * have the poll callback to queue directly on ep->rdllist,
-	 * because we want the "sproc" callback to be able to do it
-	 * in a lockless way.
+	 * Collect everything the poll callback chained so far, then steal
+	 * the ready list, and re-init the original one to the empty list.
+	 * Events happening while looping w/out locks stay on ep->wakelist,
+	 * the poll callback never touches ep->rdllist, so the "sproc"
+	 * callback is able to do it in a lockless way.
 	 */
 	spin_lock_irqsave(&ep->lock, flags);
+	ep_wakelist_splice(ep);
 	list_splice_init(&ep->rdllist, &txlist);
-	ep->ovflist = NULL;
 	spin_unlock_irqrestore(&ep->lock, flags);
 
 	/*
@@ -580,23 +642,7 @@ static int ep_scan_ready_list(struct eventpoll *ep,
 	 * other events might have been queued by the poll callback.
 	 * We re-insert them inside the main ready-list here.
 	 */
-	for (nepi = ep->ovflist; (epi = nepi) != NULL;
-	     nepi = epi->next, epi->next = EP_UNACTIVE_PTR) {
-		/*
-		 * We need to check if the item is already in the list.
-		 * During the "sproc" callback execution time, items are
-		 * queued into ->ovflist but the "txlist" might already
-		 * contain them, and the list_splice() below takes care of them.
-		 */
-		if (!ep_is_linked(&epi->rdllink))
-			list_add_tail(&epi->rdllink, &ep->rdllist);
-	}
-	/*
-	 * We need to set back ep->ovflist to EP_UNACTIVE_PTR, so that after
-	 * releasing the lock, events will be queued in the normal way inside
-	 * ep->rdllist.
-	 */
-	ep->ovflist = EP_UNACTIVE_PTR;
+	ep_wakelist_splice(ep);
 
 	/*
 	 * Quickly re-inject items left on "txlist".
@@ -608,8 +654,7 @@ static int ep_scan_ready_list(struct eventpoll *ep,
 		 * Wake up (if active) both the eventpoll wait list and
 		 * the ->poll() wait list (delayed after we release the lock).
 		 */
-		if (waitqueue_active(&ep->wq))
-			wake_up_locked(&ep->wq);
+		wake_up(&ep->wq);
 		if (waitqueue_active(&ep->poll_wait))
 			pwake++;
 	}
@@ -634,12 +679,9 @@ static int ep_remove(struct eventpoll *ep, struct epitem *epi)
 	struct file *file = epi->ffd.file;
 
 	/*
-	 * Removes poll wait queue hooks. We _have_ to do this without holding
-	 * the "ep->lock" otherwise a deadlock might occur. This because of the
-	 * sequence of the lock acquisition. Here we do "ep->lock" then the wait
-	 * queue head lock when unregistering the wait queue. The wakeup callback
-	 * will run by holding the wait queue head lock and will call our callback
-	 * that will try to get "ep->lock".
+	 * Removes poll wait queue hooks. The wakeup callback runs holding the
+	 * wait queue head lock, so once this returns no callback is running
+	 * on the item or can chain it on ep->wakelist again.
 	 */
 	ep_unregister_pollwait(ep, epi);
 
@@ -651,7 +693,12 @@ static int ep_remove(struct eventpoll *ep, struct epitem *epi)
 
 	rb_erase(&epi->rbn, &ep->rbr);
 
+	/*
+	 * No callback can chain the item any more, but it may still be on
+	 * ep->wakelist: flush that before unlinking it.
+	 */
 	spin_lock_irqsave(&ep->lock, flags);
+	ep_wakelist_splice(ep);
 	if (ep_is_linked(&epi->rdllink))
 		list_del_init(&epi->rdllink);
 	spin_unlock_irqrestore(&ep->lock, flags);
@@ -833,7 +880,7 @@ static int ep_alloc(struct eventpoll **pep)
 	init_waitqueue_head(&ep->poll_wait);
 	INIT_LIST_HEAD(&ep->rdllist);
 	ep->rbr = RB_ROOT;
-	ep->ovflist = EP_UNACTIVE_PTR;
+	ep->wakelist = NULL;
 	ep->user = user;
 
 	*pep = ep;
@@ -881,8 +928,6 @@ static struct epitem *ep_find(struct eventpoll *ep, struct file *file, int fd)
  */
 static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *key)
 {
-	int pwake = 0;
-	unsigned long flags;
 	struct epitem *epi = ep_item_from_wait(wait);
 	struct eventpoll *ep = epi->ep;
 
@@ -897,8 +942,6 @@ static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *k
 		list_del_init(&wait->task_list);
 	}
 
-	spin_lock_irqsave(&ep->lock, flags);
-
 	/*
 	 * If the event mask does not contain any poll(2) event, we consider the
 	 * descriptor to be disabled. This condition is likely the effect of the
@@ -906,7 +949,7 @@ static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *k
 	 * until the next EPOLL_CTL_MOD will be issued.
 	 */
 	if (!(epi->event.events & ~EP_PRIVATE_BITS))
-		goto out_unlock;
+		return 1;
 
 	/*
 	 * Check the events coming with the callback. At this stage, not
@@ -915,40 +958,30 @@ static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *k
 	 * test for "key" != NULL before the event match test.
 	 */
 	if (key && !((unsigned long) key & epi->event.events))
-		goto out_unlock;
+		return 1;
+
+	if (epi->event.events & EPOLLNOREPOLL)
+		ep_revents_add(epi, key ? (unsigned long) key & ~EP_PRIVATE_BITS :
+				     EP_REVENTS_UNKNOWN);
 
 	/*
-	 * If we are transferring events to userspace, we can hold no locks
-	 * (because we're accessing user memory, and because of linux f_op->poll()
-	 * semantics). All the events that happen during that period of time are
-	 * chained in ep->ovflist and requeued later on.
+	 * Chain the item for the next ep_scan_ready_list(), which moves it
+	 * to the ready list. Only the first item chained needs to wake
+	 * anybody: the task collecting it takes all the others with it,
+	 * and ep_scan_ready_list() passes on what it leaves behind.
+	 * The cmpxchg() in ep_wakelist_add() orders the chaining before
+	 * the waitqueue_active() tests.
 	 */
-	if (unlikely(ep->ovflist != EP_UNACTIVE_PTR)) {
-		if (epi->next == EP_UNACTIVE_PTR) {
-			epi->next = ep->ovflist;
-			ep->ovflist = epi;
-		}
-		goto out_unlock;
-	}
-
-	/* If this file is already in the ready list we exit soon */
-	if (!ep_is_linked(&epi->rdllink))
-		list_add_tail(&epi->rdllink, &ep->rdllist);
+	if (!ep_wakelist_add(ep, epi))
+		return 1;
 
 	/*
 	 * Wake up ( if active ) both the eventpoll wait list and the ->poll()
 	 * wait list.
 	 */
 	if (waitqueue_active(&ep->wq))
-		wake_up_locked(&ep->wq);
+		wake_up(&ep->wq);
 	if (waitqueue_active(&ep->poll_wait))
-		pwake++;
-
-out_unlock:
-	spin_unlock_irqrestore(&ep->lock, flags);
-
-	/* We have to call this outside the lock */
-	if (pwake)
 		ep_poll_safewake(&ep->poll_wait);
 
 	return 1;
@@ -1118,6 +1151,7 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 	epi->event = *event;
 	epi->nwait = 0;
 	epi->next = EP_UNACTIVE_PTR;
+	epi->revents = 0;
 
 	/* Initialize the poll table using the queue callback */
 	epq.epi = epi;
@@ -1163,11 +1197,11 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 
 	/* If the file is already "ready" we drop it inside the ready list */
 	if ((revents & event->events) && !ep_is_linked(&epi->rdllink)) {
+		ep_revents_add(epi, revents & ~EP_PRIVATE_BITS);
 		list_add_tail(&epi->rdllink, &ep->rdllist);
 
 		/* Notify waiting tasks that events are available */
-		if (waitqueue_active(&ep->wq))
-			wake_up_locked(&ep->wq);
+		wake_up(&ep->wq);
 		if (waitqueue_active(&ep->poll_wait))
 			pwake++;
 	}
@@ -1195,11 +1229,10 @@ error_unregister:
 
 	/*
 	 * We need to do this because an event could have been arrived on some
-	 * allocated wait queue. Note that we don't care about the ep->ovflist
-	 * list, since that is used/cleaned only inside a section bound by "mtx".
-	 * And ep_insert() is called with "mtx" held.
+	 * allocated wait queue, and chained the item on ep->wakelist.
 	 */
 	spin_lock_irqsave(&ep->lock, flags);
+	ep_wakelist_splice(ep);
 	if (ep_is_linked(&epi->rdllink))
 		list_del_init(&epi->rdllink);
 	spin_unlock_irqrestore(&ep->lock, flags);
@@ -1236,9 +1269,9 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi, struct epoll_even
 	 * 1) Flush epi changes above to other CPUs.  This ensures
 	 *    we do not miss events from ep_poll_callback if an
 	 *    event occurs immediately after we call f_op->poll().
-	 *    We need this because we did not take ep->lock while
-	 *    changing epi above (but ep_poll_callback does take
-	 *    ep->lock).
+	 *    We need this because we did not take any lock while
+	 *    changing epi above, and ep_poll_callback takes none
+	 *    either.
 	 *
 	 * 2) We also need to ensure we do not miss _past_ events
 	 *    when calling f_op->poll().  This barrier also
@@ -1261,13 +1294,13 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi, struct epoll_even
 	 * list, push it inside.
 	 */
 	if (revents & event->events) {
+		ep_revents_add(epi, revents & ~EP_PRIVATE_BITS);
 		spin_lock_irq(&ep->lock);
 		if (!ep_is_linked(&epi->rdllink)) {
 			list_add_tail(&epi->rdllink, &ep->rdllist);
 
 			/* Notify waiting tasks that events are available */
-			if (waitqueue_active(&ep->wq))
-				wake_up_locked(&ep->wq);
+			wake_up(&ep->wq);
 			if (waitqueue_active(&ep->poll_wait))
 				pwake++;
 		}
@@ -1304,9 +1337,20 @@ static int ep_send_events_proc(struct eventpoll *ep, struct list_head *head,
 
 		list_del_init(&epi->rdllink);
 
-		pt._key = epi->event.events;
-		revents = epi->ffd.file->f_op->poll(epi->ffd.file, &pt) &
-			epi->event.events;
+		/*
+		 * Edge triggered items may ask to be reported from the keys
+		 * of the wakeups that queued them, saving a f_op->poll() per
+		 * event. Wakeups without a key still need the poll.
+		 */
+		revents = 0;
+		if ((epi->event.events & (EPOLLET | EPOLLNOREPOLL)) ==
+		    (EPOLLET | EPOLLNOREPOLL))
+			revents = xchg(&epi->revents, 0);
+		if (!revents || (revents & EP_REVENTS_UNKNOWN)) {
+			pt._key = epi->event.events;
+			revents = epi->ffd.file->f_op->poll(epi->ffd.file, &pt);
+		}
+		revents &= epi->event.events;
 
 		/*
 		 * If the event mask intersect the caller-requested one,
@@ -1334,7 +1378,7 @@ static int ep_send_events_proc(struct eventpoll *ep, struct list_head *head,
 				 * into ep->rdllist besides us. The epoll_ctl()
 				 * callers are locked out by
 				 * ep_scan_ready_list() holding "mtx" and the
-				 * poll callback will queue them in ep->ovflist.
+				 * poll callback will queue them in ep->wakelist.
 				 */
 				list_add_tail(&epi->rdllink, &ep->rdllist);
 			}
@@ -1404,12 +1448,17 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 		 * caller specified a non blocking operation.
 		 */
 		timed_out = 1;
-		spin_lock_irqsave(&ep->lock, flags);
+		spin_lock_irqsave(&ep->wq.lock, flags);
 		goto check_events;
 	}
 
 fetch_events:
-	spin_lock_irqsave(&ep->lock, flags);
+	/*
+	 * Sleepers are protected by the wait queue lock, which is also what
+	 * the wake_up() of the poll callback takes; ep->lock stays out of
+	 * the wakeup path.
+	 */
+	spin_lock_irqsave(&ep->wq.lock, flags);
 
 	if (!ep_events_available(ep)) {
 		/*
@@ -1434,11 +1483,11 @@ fetch_events:
 				break;
 			}
 
-			spin_unlock_irqrestore(&ep->lock, flags);
+			spin_unlock_irqrestore(&ep->wq.lock, flags);
 			if (!schedule_hrtimeout_range(to, slack, HRTIMER_MODE_ABS))
 				timed_out = 1;
 
-			spin_lock_irqsave(&ep->lock, flags);
+			spin_lock_irqsave(&ep->wq.lock, flags);
 		}
 		__remove_wait_queue(&ep->wq, &wait);
 
@@ -1448,7 +1497,7 @@ check_events:
 	/* Is it worth to try to dig for events ? */
 	eavail = ep_events_available(ep);
 
-	spin_unlock_irqrestore(&ep->lock, flags);
+	spin_unlock_irqrestore(&ep->wq.lock, flags);
 
 	/*
 	 * Try to transfer events to user space. In case we get 0 events and
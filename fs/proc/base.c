@@ -352,6 +352,18 @@ static int proc_pid_schedstat(struct task_struct *task, char *buffer)
 			(unsigned long long)task->sched_info.run_delay,
 			task->sched_info.pcount);
 }
+
+#ifdef CONFIG_SCHED_LATENCY_HIST
+/*
+ * Provides /proc/PID/schedstat_hist
+ */
+static int proc_pid_schedstat_hist(struct seq_file *m, struct pid_namespace *ns,
+				   struct pid *pid, struct task_struct *task)
+{
+	sched_lat_hist_show(m, &task->se.statistics.lat_hist);
+	return 0;
+}
+#endif
 #endif
 
 #ifdef CONFIG_LATENCYTOP
@@ -1377,6 +1389,78 @@ static const struct file_operations proc_pid_sched_autogroup_operations = {
 
 #endif /* CONFIG_SCHED_AUTOGROUP */
 
+/*
+ * Print/write the latency sensitive attribute of a task
+ */
+static int sched_latency_sensitive_show(struct seq_file *m, void *v)
+{
+	struct inode *inode = m->private;
+	struct task_struct *p;
+
+	p = get_proc_task(inode);
+	if (!p)
+		return -ESRCH;
+	seq_printf(m, "%u\n", p->sched_latency_sensitive);
+
+	put_task_struct(p);
+
+	return 0;
+}
+
+static ssize_t
+sched_latency_sensitive_write(struct file *file, const char __user *buf,
+	    size_t count, loff_t *offset)
+{
+	struct inode *inode = file->f_path.dentry->d_inode;
+	struct task_struct *p;
+	char buffer[PROC_NUMBUF];
+	int val;
+	int err;
+
+	memset(buffer, 0, sizeof(buffer));
+	if (count > sizeof(buffer) - 1)
+		count = sizeof(buffer) - 1;
+	if (copy_from_user(buffer, buf, count))
+		return -EFAULT;
+
+	err = kstrtoint(strstrip(buffer), 0, &val);
+	if (err < 0)
+		return err;
+
+	p = get_proc_task(inode);
+	if (!p)
+		return -ESRCH;
+
+	err = sched_set_latency_sensitive(p, val);
+	if (err)
+		count = err;
+
+	put_task_struct(p);
+
+	return count;
+}
+
+static int sched_latency_sensitive_open(struct inode *inode, struct file *filp)
+{
+	int ret;
+
+	ret = single_open(filp, sched_latency_sensitive_show, NULL);
+	if (!ret) {
+		struct seq_file *m = filp->private_data;
+
+		m->private = inode;
+	}
+	return ret;
+}
+
+static const struct file_operations proc_pid_sched_latency_sensitive_operations = {
+	.open		= sched_latency_sensitive_open,
+	.read		= seq_read,
+	.write		= sched_latency_sensitive_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static ssize_t comm_write(struct file *file, const char __user *buf,
 				size_t count, loff_t *offset)
 {
@@ -3002,6 +3086,8 @@ static const struct pid_entry tgid_base_stuff[] = {
 #ifdef CONFIG_SCHED_AUTOGROUP
 	REG("autogroup",  S_IRUGO|S_IWUSR, proc_pid_sched_autogroup_operations),
 #endif
+	REG("sched_latency_sensitive", S_IRUGO|S_IWUSR,
+	    proc_pid_sched_latency_sensitive_operations),
 	REG("comm",      S_IRUGO|S_IWUSR, proc_pid_set_comm_operations),
 #ifdef CONFIG_HAVE_ARCH_TRACEHOOK
 	INF("syscall",    S_IRUGO, proc_pid_syscall),
@@ -3036,6 +3122,9 @@ static const struct pid_entry tgid_base_stuff[] = {
 #endif
 #ifdef CONFIG_SCHEDSTATS
 	INF("schedstat",  S_IRUGO, proc_pid_schedstat),
+#ifdef CONFIG_SCHED_LATENCY_HIST
+	ONE("schedstat_hist", S_IRUGO, proc_pid_schedstat_hist),
+#endif
 #endif
 #ifdef CONFIG_LATENCYTOP
 	REG("latency",  S_IRUGO, proc_lstats_operations),
@@ -3361,6 +3450,8 @@ static const struct pid_entry tid_base_stuff[] = {
 #ifdef CONFIG_SCHED_DEBUG
 	REG("sched",     S_IRUGO|S_IWUSR, proc_pid_sched_operations),
 #endif
+	REG("sched_latency_sensitive", S_IRUGO|S_IWUSR,
+	    proc_pid_sched_latency_sensitive_operations),
 	REG("comm",      S_IRUGO|S_IWUSR, proc_pid_set_comm_operations),
 #ifdef CONFIG_HAVE_ARCH_TRACEHOOK
 	INF("syscall",   S_IRUGO, proc_pid_syscall),
@@ -3394,6 +3485,9 @@ static const struct pid_entry tid_base_stuff[] = {
 #endif
 #ifdef CONFIG_SCHEDSTATS
 	INF("schedstat", S_IRUGO, proc_pid_schedstat),
+#ifdef CONFIG_SCHED_LATENCY_HIST
+	ONE("schedstat_hist", S_IRUGO, proc_pid_schedstat_hist),
+#endif
 #endif
 #ifdef CONFIG_LATENCYTOP
 	REG("latency",  S_IRUGO, proc_lstats_operations),
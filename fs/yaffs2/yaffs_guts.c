@@ -41,6 +41,8 @@
 
 #include "yaffs_ecc.h"
 
+#include <linux/ktime.h>
+
 /* Forward declarations */
 
 static int yaffs_wr_data_obj(struct yaffs_obj *in, int inode_chunk,
@@ -4764,6 +4766,8 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 	int init_failed = 0;
 	unsigned x;
 	int bits;
+	ktime_t mount_start = ktime_get();
+	ktime_t checkpt_start;
 
 	yaffs_trace(YAFFS_TRACE_TRACING, "yaffs: yaffs_guts_initialise()" );
 
@@ -4916,6 +4920,11 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 	dev->passive_gc_count = 0;
 	dev->oldest_dirty_gc_count = 0;
 	dev->bg_gcs = 0;
+	dev->bg_checkpoints = 0;
+	dev->mount_checkpt_us = 0;
+	dev->mount_query_us = 0;
+	dev->mount_scan_us = 0;
+	dev->mount_scan_threads = 0;
 	dev->gc_block_finder = 0;
 	dev->buffered_block = -1;
 	dev->doing_buffered_block_rewrite = 0;
@@ -4994,7 +5003,14 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 	if (!init_failed) {
 		/* Now scan the flash. */
 		if (dev->param.is_yaffs2) {
-			if (yaffs2_checkpt_restore(dev)) {
+			int restored;
+
+			checkpt_start = ktime_get();
+			restored = yaffs2_checkpt_restore(dev);
+			dev->mount_checkpt_us =
+			    (u32) ktime_us_delta(ktime_get(), checkpt_start);
+
+			if (restored) {
 				yaffs_check_obj_details_loaded(dev->root_dir);
 				yaffs_trace(YAFFS_TRACE_CHECKPOINT | YAFFS_TRACE_MOUNT,
 					"yaffs: restored from checkpoint"
@@ -5063,6 +5079,12 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 	if (!dev->is_checkpointed && dev->blocks_in_checkpt > 0)
 		yaffs2_checkpt_invalidate(dev);
 
+	dev->mount_us = (u32) ktime_us_delta(ktime_get(), mount_start);
+	yaffs_trace(YAFFS_TRACE_MOUNT,
+		"yaffs: mounted in %u us: checkpoint %u, query %u, scan %u (%u readers)",
+		dev->mount_us, dev->mount_checkpt_us, dev->mount_query_us,
+		dev->mount_scan_us, dev->mount_scan_threads);
+
 	yaffs_trace(YAFFS_TRACE_TRACING,
 	  "yaffs: yaffs_guts_initialise() done.");
 	return YAFFS_OK;
@@ -547,6 +547,16 @@ struct yaffs_param {
 	int (*query_block_fn) (struct yaffs_dev * dev, int block_no,
 			       enum yaffs_block_state * state,
 			       u32 * seq_number);
+
+	/* Optional tags-only read that is safe to call from several threads
+	 * at once. spare is a per-caller buffer of at least
+	 * sizeof(struct yaffs_packed_tags2) bytes. The driver's own ECC
+	 * verdict goes to mtd_ecc, device statistics are left alone.
+	 */
+	int (*read_tags_fn) (struct yaffs_dev * dev, int nand_chunk,
+			     struct yaffs_ext_tags * tags, u8 * spare,
+			     enum yaffs_ecc_result * mtd_ecc);
+	int scan_threads;	/* Readers for the mount scan, needs read_tags_fn */
 #endif
 
 	/* The remove_obj_fn function must be supplied by OS flavours that
@@ -734,6 +744,14 @@ struct yaffs_dev {
 	u32 n_unmarked_deletions;
 	u32 refresh_count;
 	u32 cache_hits;
+	u32 bg_checkpoints;
+
+	/* Mount time breakdown in microseconds */
+	u32 mount_us;
+	u32 mount_checkpt_us;	/* Checkpoint restore, successful or not */
+	u32 mount_query_us;	/* Block state pass of the backwards scan */
+	u32 mount_scan_us;	/* Tag pass and object tree building */
+	u32 mount_scan_threads;	/* Tag readers used, 0 for a serial scan */
 
 };
 
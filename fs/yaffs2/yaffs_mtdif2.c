@@ -165,6 +165,57 @@ int nandmtd2_read_chunk_tags(struct yaffs_dev *dev, int nand_chunk,
 		return YAFFS_FAIL;
 }
 
+/*
+ * Tags-only read for the parallel mount scan. Unlike
+ * nandmtd2_read_chunk_tags() it reads the OOB into the caller's spare
+ * buffer and does not touch the statistics, so readers can run
+ * concurrently. Inband tags need a full chunk read and are not handled.
+ */
+int nandmtd2_read_tags(struct yaffs_dev *dev, int nand_chunk,
+		       struct yaffs_ext_tags *tags, u8 * spare,
+		       enum yaffs_ecc_result *mtd_ecc)
+{
+	struct mtd_info *mtd = yaffs_dev_to_mtd(dev);
+	struct mtd_oob_ops ops;
+	int retval;
+
+	loff_t addr = ((loff_t) nand_chunk) * dev->param.total_bytes_per_chunk;
+
+	struct yaffs_packed_tags2 pt;
+
+	int packed_tags_size =
+	    dev->param.no_tags_ecc ? sizeof(pt.t) : sizeof(pt);
+	void *packed_tags_ptr =
+	    dev->param.no_tags_ecc ? (void *)&pt.t : (void *)&pt;
+
+	ops.mode = MTD_OPS_AUTO_OOB;
+	ops.ooblen = packed_tags_size;
+	ops.len = packed_tags_size;
+	ops.ooboffs = 0;
+	ops.datbuf = NULL;
+	ops.oobbuf = spare;
+	retval = mtd_read_oob(mtd, addr, &ops);
+
+	memcpy(packed_tags_ptr, spare, packed_tags_size);
+	yaffs_unpack_tags2(tags, &pt, !dev->param.no_tags_ecc);
+
+	*mtd_ecc = YAFFS_ECC_RESULT_NO_ERROR;
+	if (retval == -EBADMSG
+	    && tags->ecc_result == YAFFS_ECC_RESULT_NO_ERROR) {
+		tags->ecc_result = YAFFS_ECC_RESULT_UNFIXED;
+		*mtd_ecc = YAFFS_ECC_RESULT_UNFIXED;
+	}
+	if (retval == -EUCLEAN
+	    && tags->ecc_result == YAFFS_ECC_RESULT_NO_ERROR) {
+		tags->ecc_result = YAFFS_ECC_RESULT_FIXED;
+		*mtd_ecc = YAFFS_ECC_RESULT_FIXED;
+	}
+	if (retval == 0)
+		return YAFFS_OK;
+	else
+		return YAFFS_FAIL;
+}
+
 int nandmtd2_mark_block_bad(struct yaffs_dev *dev, int block_no)
 {
 	struct mtd_info *mtd = yaffs_dev_to_mtd(dev);
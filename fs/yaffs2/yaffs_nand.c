@@ -50,6 +50,31 @@ int yaffs_rd_chunk_tags_nand(struct yaffs_dev *dev, int nand_chunk,
 	return result;
 }
 
+/*
+ * Account for tags that a scan reader fetched with read_tags_fn, the same
+ * way yaffs_rd_chunk_tags_nand() would have. Called on the mount thread.
+ */
+void yaffs_rd_chunk_tags_done(struct yaffs_dev *dev, int nand_chunk,
+			      struct yaffs_ext_tags *tags,
+			      enum yaffs_ecc_result mtd_ecc)
+{
+	dev->n_page_reads++;
+
+	if (mtd_ecc == YAFFS_ECC_RESULT_UNFIXED)
+		dev->n_ecc_unfixed++;
+	else if (mtd_ecc == YAFFS_ECC_RESULT_FIXED)
+		dev->n_ecc_fixed++;
+
+	if (tags->ecc_result > YAFFS_ECC_RESULT_NO_ERROR) {
+
+		struct yaffs_block_info *bi;
+		bi = yaffs_get_block_info(dev,
+					  nand_chunk /
+					  dev->param.chunks_per_block);
+		yaffs_handle_chunk_error(dev, bi);
+	}
+}
+
 int yaffs_wr_chunk_tags_nand(struct yaffs_dev *dev,
 			     int nand_chunk,
 			     const u8 * buffer, struct yaffs_ext_tags *tags)
@@ -20,6 +20,10 @@
 int yaffs_rd_chunk_tags_nand(struct yaffs_dev *dev, int nand_chunk,
 			     u8 * buffer, struct yaffs_ext_tags *tags);
 
+void yaffs_rd_chunk_tags_done(struct yaffs_dev *dev, int nand_chunk,
+			      struct yaffs_ext_tags *tags,
+			      enum yaffs_ecc_result mtd_ecc);
+
 int yaffs_wr_chunk_tags_nand(struct yaffs_dev *dev,
 			     int nand_chunk,
 			     const u8 * buffer, struct yaffs_ext_tags *tags);
@@ -97,6 +97,8 @@ unsigned int yaffs_wr_attempts = YAFFS_WR_ATTEMPTS;
 unsigned int yaffs_auto_checkpoint = 1;
 unsigned int yaffs_gc_control = 1;
 unsigned int yaffs_bg_enable = 1;
+unsigned int yaffs_bg_checkpoint_idle = 30;	/* seconds, 0 = off */
+unsigned int yaffs_scan_threads;
 
 /* Module Parameters */
 module_param(yaffs_trace_mask, uint, 0644);
@@ -104,6 +106,8 @@ module_param(yaffs_wr_attempts, uint, 0644);
 module_param(yaffs_auto_checkpoint, uint, 0644);
 module_param(yaffs_gc_control, uint, 0644);
 module_param(yaffs_bg_enable, uint, 0644);
+module_param(yaffs_bg_checkpoint_idle, uint, 0644);
+module_param(yaffs_scan_threads, uint, 0644);
 
 
 #define yaffs_inode_to_obj_lv(iptr) ((iptr)->i_private)
@@ -1628,6 +1632,8 @@ static int yaffs_bg_thread_fn(void *data)
 	unsigned long now = jiffies;
 	unsigned long next_dir_update = now;
 	unsigned long next_gc = now;
+	unsigned long idle_since = now;
+	u32 last_writes = dev->n_page_writes;
 	unsigned long expires;
 	unsigned int urgency;
 
@@ -1674,6 +1680,29 @@ static int yaffs_bg_thread_fn(void *data)
 				next_gc = next_dir_update;
                         }
 		}
+
+		/*
+		 * Write a checkpoint once the device has been quiet for a
+		 * while so the next mount can skip the scan. Writes since
+		 * the last look restart the idle period.
+		 */
+		if (dev->n_page_writes != last_writes) {
+			last_writes = dev->n_page_writes;
+			idle_since = now;
+		} else if (yaffs_bg_checkpoint_idle && yaffs_bg_enable &&
+			   !dev->is_checkpointed && !dev->read_only &&
+			   !dev->param.skip_checkpt_wr &&
+			   time_after(now, idle_since +
+				      yaffs_bg_checkpoint_idle * HZ) &&
+			   !yaffs_bg_gc_urgency(dev)) {
+			yaffs_flush_super(context->super, 1);
+			context->super->s_dirt = 0;
+			if (dev->is_checkpointed)
+				dev->bg_checkpoints++;
+			/* The checkpoint itself wrote pages */
+			last_writes = dev->n_page_writes;
+			idle_since = now;
+		}
 		yaffs_gross_unlock(dev);
 		expires = next_dir_update;
 		if (time_before(next_gc, expires))
@@ -2264,6 +2293,8 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 	if (yaffs_version == 2) {
 		param->write_chunk_tags_fn = nandmtd2_write_chunk_tags;
 		param->read_chunk_tags_fn = nandmtd2_read_chunk_tags;
+		param->read_tags_fn = nandmtd2_read_tags;
+		param->scan_threads = yaffs_scan_threads;
 		param->bad_block_fn = nandmtd2_mark_block_bad;
 		param->query_block_fn = nandmtd2_query_block;
 		yaffs_dev_to_lc(dev)->spare_buffer = 
@@ -2494,6 +2525,16 @@ static char *yaffs_dump_dev_part1(char *buf, struct yaffs_dev *dev)
 	    sprintf(buf, "n_unlinked_files...... %u\n", dev->n_unlinked_files);
 	buf += sprintf(buf, "refresh_count......... %u\n", dev->refresh_count);
 	buf += sprintf(buf, "n_bg_deletions........ %u\n", dev->n_bg_deletions);
+	buf += sprintf(buf, "bg_checkpoints........ %u\n", dev->bg_checkpoints);
+	buf += sprintf(buf, "\n");
+	buf += sprintf(buf, "mount_us.............. %u\n", dev->mount_us);
+	buf +=
+	    sprintf(buf, "mount_checkpt_us...... %u\n", dev->mount_checkpt_us);
+	buf += sprintf(buf, "mount_query_us........ %u\n", dev->mount_query_us);
+	buf += sprintf(buf, "mount_scan_us......... %u\n", dev->mount_scan_us);
+	buf +=
+	    sprintf(buf, "mount_scan_threads.... %u\n",
+		    dev->mount_scan_threads);
 
 	return buf;
 }
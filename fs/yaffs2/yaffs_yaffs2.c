@@ -20,6 +20,12 @@
 #include "yaffs_getblockinfo.h"
 #include "yaffs_verify.h"
 #include "yaffs_attribs.h"
+#include "yaffs_packedtags2.h"
+
+#include <linux/workqueue.h>
+#include <linux/semaphore.h>
+#include <linux/wait.h>
+#include <linux/ktime.h>
 
 /*
  * Checkpoints are really no benefit on very small partitions.
@@ -954,6 +960,206 @@ static int yaffs2_ybicmp(const void *a, const void *b)
 		return aseq - bseq;
 }
 
+/*
+ * Parallel tag prefetch for the backwards scan.
+ *
+ * Reader work items walk block_index in the same (descending) order as the
+ * scan and read every chunk's tags of a block into one of a window of
+ * slots, so several MTD requests are in flight while the mount thread
+ * builds the object tree from blocks that have already arrived. The tree
+ * itself is still built serially: it depends on the backwards order.
+ *
+ * Block iter always lands in slot iter % window. At most window blocks
+ * are claimed and not yet consumed, and both sides go in order, so a
+ * claimed slot is never still in use.
+ */
+#define YAFFS_SCAN_MAX_THREADS	8
+#define YAFFS_SCAN_SLOTS_PER_THREAD	2
+
+struct yaffs_scan_slot {
+	int ready;
+	struct yaffs_ext_tags *tags;
+	int *result;
+	enum yaffs_ecc_result *mtd_ecc;
+};
+
+struct yaffs_scan_reader {
+	struct work_struct work;
+	struct yaffs_scan_prefetch *pf;
+	u8 *spare;
+};
+
+struct yaffs_scan_prefetch {
+	struct yaffs_dev *dev;
+	struct yaffs_block_index *block_index;
+	atomic_t next;
+	int stop;
+	int window;
+	struct semaphore free_slots;
+	wait_queue_head_t wq;
+	struct workqueue_struct *wq_readers;
+	int n_readers;
+	struct yaffs_scan_reader *readers;
+	struct yaffs_scan_slot *slots;
+};
+
+static void yaffs2_scan_reader_fn(struct work_struct *work)
+{
+	struct yaffs_scan_reader *r =
+	    container_of(work, struct yaffs_scan_reader, work);
+	struct yaffs_scan_prefetch *pf = r->pf;
+	struct yaffs_dev *dev = pf->dev;
+	struct yaffs_scan_slot *slot;
+	int iter;
+	int chunk;
+	int c;
+
+	while (1) {
+		down(&pf->free_slots);
+		iter = atomic_dec_return(&pf->next);
+		if (pf->stop || iter < 0) {
+			up(&pf->free_slots);
+			break;
+		}
+
+		slot = &pf->slots[iter % pf->window];
+		chunk = pf->block_index[iter].block *
+		    dev->param.chunks_per_block - dev->chunk_offset;
+		for (c = dev->param.chunks_per_block - 1; c >= 0; c--)
+			slot->result[c] =
+			    dev->param.read_tags_fn(dev, chunk + c,
+						    &slot->tags[c], r->spare,
+						    &slot->mtd_ecc[c]);
+
+		smp_wmb();
+		slot->ready = 1;
+		wake_up(&pf->wq);
+	}
+}
+
+static void yaffs2_scan_prefetch_free(struct yaffs_scan_prefetch *pf)
+{
+	int i;
+
+	if (pf->wq_readers)
+		destroy_workqueue(pf->wq_readers);
+
+	if (pf->readers)
+		for (i = 0; i < pf->n_readers; i++)
+			kfree(pf->readers[i].spare);
+	kfree(pf->readers);
+
+	if (pf->slots)
+		for (i = 0; i < pf->window; i++) {
+			kfree(pf->slots[i].tags);
+			kfree(pf->slots[i].result);
+			kfree(pf->slots[i].mtd_ecc);
+		}
+	kfree(pf->slots);
+	kfree(pf);
+}
+
+static struct yaffs_scan_prefetch *yaffs2_scan_prefetch_start(
+				struct yaffs_dev *dev,
+				struct yaffs_block_index *block_index,
+				int n_to_scan)
+{
+	struct yaffs_scan_prefetch *pf;
+	int n_chunks = dev->param.chunks_per_block;
+	int n = dev->param.scan_threads;
+	int i;
+
+	if (n <= 0 || !dev->param.read_tags_fn || dev->param.inband_tags ||
+	    n_to_scan < 2)
+		return NULL;
+	if (n > YAFFS_SCAN_MAX_THREADS)
+		n = YAFFS_SCAN_MAX_THREADS;
+
+	pf = kzalloc(sizeof(*pf), GFP_NOFS);
+	if (!pf)
+		return NULL;
+
+	pf->dev = dev;
+	pf->block_index = block_index;
+	atomic_set(&pf->next, n_to_scan);
+	pf->n_readers = n;
+	pf->window = n * YAFFS_SCAN_SLOTS_PER_THREAD;
+	sema_init(&pf->free_slots, pf->window);
+	init_waitqueue_head(&pf->wq);
+
+	pf->slots = kcalloc(pf->window, sizeof(*pf->slots), GFP_NOFS);
+	pf->readers = kcalloc(n, sizeof(*pf->readers), GFP_NOFS);
+	if (!pf->slots || !pf->readers)
+		goto fail;
+
+	for (i = 0; i < pf->window; i++) {
+		struct yaffs_scan_slot *slot = &pf->slots[i];
+
+		slot->tags = kmalloc(n_chunks * sizeof(*slot->tags), GFP_NOFS);
+		slot->result = kmalloc(n_chunks * sizeof(*slot->result),
+				       GFP_NOFS);
+		slot->mtd_ecc = kmalloc(n_chunks * sizeof(*slot->mtd_ecc),
+					GFP_NOFS);
+		if (!slot->tags || !slot->result || !slot->mtd_ecc)
+			goto fail;
+	}
+
+	for (i = 0; i < n; i++) {
+		/* kmalloc()ed, the MTD driver may DMA into it */
+		pf->readers[i].spare =
+		    kmalloc(sizeof(struct yaffs_packed_tags2), GFP_NOFS);
+		if (!pf->readers[i].spare)
+			goto fail;
+		pf->readers[i].pf = pf;
+		INIT_WORK(&pf->readers[i].work, yaffs2_scan_reader_fn);
+	}
+
+	pf->wq_readers = alloc_workqueue("yaffs-scan", WQ_UNBOUND, n);
+	if (!pf->wq_readers)
+		goto fail;
+
+	for (i = 0; i < n; i++)
+		queue_work(pf->wq_readers, &pf->readers[i].work);
+
+	return pf;
+
+fail:
+	yaffs_trace(YAFFS_TRACE_SCAN,
+		"yaffs2_scan_backwards() no memory for %d readers, scanning serially",
+		n);
+	yaffs2_scan_prefetch_free(pf);
+	return NULL;
+}
+
+/* Wait for the readers to deliver block iter */
+static struct yaffs_scan_slot *yaffs2_scan_prefetch_get(
+				struct yaffs_scan_prefetch *pf, int iter)
+{
+	struct yaffs_scan_slot *slot = &pf->slots[iter % pf->window];
+
+	wait_event(pf->wq, slot->ready);
+	smp_rmb();
+	return slot;
+}
+
+static void yaffs2_scan_prefetch_put(struct yaffs_scan_prefetch *pf,
+				     struct yaffs_scan_slot *slot)
+{
+	slot->ready = 0;
+	up(&pf->free_slots);
+}
+
+static void yaffs2_scan_prefetch_stop(struct yaffs_scan_prefetch *pf)
+{
+	int i;
+
+	/* Readers still waiting for a slot see stop and leave */
+	pf->stop = 1;
+	for (i = 0; i < pf->n_readers; i++)
+		up(&pf->free_slots);
+	yaffs2_scan_prefetch_free(pf);
+}
+
 int yaffs2_scan_backwards(struct yaffs_dev *dev)
 {
 	struct yaffs_ext_tags tags;
@@ -986,6 +1192,9 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 
 	struct yaffs_block_index *block_index = NULL;
 	int alt_block_index = 0;
+	struct yaffs_scan_prefetch *pf = NULL;
+	struct yaffs_scan_slot *slot = NULL;
+	ktime_t start = ktime_get();
 
 	yaffs_trace(YAFFS_TRACE_SCAN,
 		"yaffs2_scan_backwards starts  intstartblk %d intendblk %d...",
@@ -1069,6 +1278,9 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 		bi++;
 	}
 
+	dev->mount_query_us = (u32) ktime_us_delta(ktime_get(), start);
+	start = ktime_get();
+
 	yaffs_trace(YAFFS_TRACE_SCAN, "%d blocks to be sorted...", n_to_scan);
 
 	cond_resched();
@@ -1086,6 +1298,9 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 	end_iter = n_to_scan - 1;
 	yaffs_trace(YAFFS_TRACE_SCAN_DEBUG, "%d blocks to scan", n_to_scan);
 
+	pf = yaffs2_scan_prefetch_start(dev, block_index, n_to_scan);
+	dev->mount_scan_threads = pf ? pf->n_readers : 0;
+
 	/* For each block.... backwards */
 	for (block_iter = end_iter; !alloc_failed && block_iter >= start_iter;
 	     block_iter--) {
@@ -1102,6 +1317,9 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 
 		deleted = 0;
 
+		if (pf)
+			slot = yaffs2_scan_prefetch_get(pf, block_iter);
+
 		/* For each chunk in each block that needs scanning.... */
 		found_chunks = 0;
 		for (c = dev->param.chunks_per_block - 1;
@@ -1114,8 +1332,15 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 
 			chunk = blk * dev->param.chunks_per_block + c;
 
-			result = yaffs_rd_chunk_tags_nand(dev, chunk, NULL,
-							  &tags);
+			if (slot) {
+				tags = slot->tags[c];
+				result = slot->result[c];
+				yaffs_rd_chunk_tags_done(dev, chunk, &tags,
+							 slot->mtd_ecc[c]);
+			} else {
+				result = yaffs_rd_chunk_tags_nand(dev, chunk,
+								  NULL, &tags);
+			}
 
 			/* Let's have a good look at this chunk... */
 
@@ -1571,8 +1796,16 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 			yaffs_block_became_dirty(dev, blk);
 		}
 
+		if (slot) {
+			yaffs2_scan_prefetch_put(pf, slot);
+			slot = NULL;
+		}
 	}
 
+	/* The readers use block_index */
+	if (pf)
+		yaffs2_scan_prefetch_stop(pf);
+
 	yaffs_skip_rest_of_block(dev);
 
 	if (alt_block_index)
@@ -1589,6 +1822,8 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 
 	yaffs_release_temp_buffer(dev, chunk_data, __LINE__);
 
+	dev->mount_scan_us = (u32) ktime_us_delta(ktime_get(), start);
+
 	if (alloc_failed)
 		return YAFFS_FAIL;
 
@@ -26,6 +26,13 @@
 #define EPOLL_CTL_DEL 2
 #define EPOLL_CTL_MOD 3
 
+/*
+ * Report edge triggered events from the wakeups seen since the last
+ * epoll_wait() instead of polling the file again.  The reported mask may
+ * then include conditions that no longer hold.  Ignored without EPOLLET.
+ */
+#define EPOLLNOREPOLL (1 << 27)
+
 /* Set the One Shot behaviour for the target file descriptor */
 #define EPOLLONESHOT (1 << 30)
 
@@ -70,6 +70,8 @@
 #define MSMFB_MDP_PP _IOWR(MSMFB_IOCTL_MAGIC, 156, struct msmfb_mdp_pp)
 #define MSMFB_OVERLAY_VSYNC_CTRL _IOW(MSMFB_IOCTL_MAGIC, 160, unsigned int)
 #define MSMFB_VSYNC_CTRL  _IOW(MSMFB_IOCTL_MAGIC, 161, unsigned int)
+#define MSMFB_OVERLAY_COMMIT _IOWR(MSMFB_IOCTL_MAGIC, 162, \
+						struct mdp_overlay_commit)
 #define FB_TYPE_3D_PANEL 0x10101010
 #define MDP_IMGTYPE2_START 0x10000
 #define MSMFB_DRIVER_VERSION	0xF9E8D701
@@ -295,6 +297,27 @@ struct mdp_overlay {
 	struct dpp_ctrl dpp;
 };
 
+#define MDP_OVERLAY_COMMIT_MAX_LAYERS	8
+
+/*
+ * one layer of an atomic overlay commit: the pipe configuration as for
+ * MSMFB_OVERLAY_SET, the buffers as for MSMFB_OVERLAY_PLAY and an
+ * optional sync fence (-1 for none) to wait on before the buffers are
+ * read. req.id is returned like MSMFB_OVERLAY_SET does.
+ */
+struct mdp_overlay_commit_layer {
+	struct mdp_overlay req;
+	struct msmfb_overlay_data data;
+	int acq_fen_fd;
+};
+
+struct mdp_overlay_commit {
+	uint32_t flags;
+	uint32_t num_layers;
+	struct mdp_overlay_commit_layer *layers;
+	int release_fen_fd;	/* out, signaled when the buffers are free */
+};
+
 struct msmfb_overlay_3d {
 	uint32_t is_3d;
 	uint32_t width;
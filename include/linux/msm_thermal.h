@@ -22,13 +22,27 @@ struct msm_thermal_data {
 	uint32_t limit_freq;
 };
 
+/* Applies a GPU limit, in percent of full performance */
+typedef void (*msm_thermal_gpu_limit_fn)(unsigned int pct, void *data);
+
 #ifdef CONFIG_THERMAL_MONITOR
 extern int msm_thermal_init(struct msm_thermal_data *pdata);
+extern int msm_thermal_register_gpu_limit(msm_thermal_gpu_limit_fn fn,
+		void *data);
+extern void msm_thermal_unregister_gpu_limit(void *data);
 #else
 static inline int msm_thermal_init(struct msm_thermal_data *pdata)
 {
 	return -ENOSYS;
 }
+static inline int msm_thermal_register_gpu_limit(msm_thermal_gpu_limit_fn fn,
+		void *data)
+{
+	return -ENOSYS;
+}
+static inline void msm_thermal_unregister_gpu_limit(void *data)
+{
+}
 #endif
 
 #endif /*__MSM_THERMAL_H*/
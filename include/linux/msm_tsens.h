@@ -39,7 +39,12 @@ struct tsens_device {
 	uint32_t			sensor_num;
 };
 
+typedef void (*tsens_threshold_fn)(void *data);
+
 int32_t tsens_get_temp(struct tsens_device *dev, unsigned long *temp);
+int tsens_get_max_sensor_num(uint32_t *tsens_num_sensors);
+int tsens_set_upper_threshold(long degC, tsens_threshold_fn fn, void *data);
+void tsens_clear_upper_threshold(void *data);
 int msm_tsens_early_init(struct tsens_platform_data *pdata);
 
 #endif /*MSM_TSENS_H */
@@ -19,6 +19,7 @@
 #include <linux/kernel.h>
 #include <linux/list.h>
 #include <linux/types.h>
+#include <linux/workqueue.h>
 
 struct persistent_ram_buffer;
 
@@ -55,10 +56,23 @@ struct persistent_ram_zone {
 	struct rs_control *rs_decoder;
 	int corrected_bytes;
 	int bad_blocks;
+	int stale_blocks;
 	int ecc_block_size;
 	int ecc_size;
 	int ecc_symsize;
 	int ecc_poly;
+	int ecc_blocks;
+
+	/* ECC computed later from ecc_work, for the blocks marked here */
+	bool ecc_deferred;
+	unsigned long *ecc_dirty;
+	atomic_t ecc_pending;
+	struct delayed_work ecc_work;
+
+	/* Cost of persistent_ram_write(), for zones with ECC */
+	u64 write_count;
+	u64 write_ns;
+	u64 write_max_ns;
 
 	char *old_log;
 	size_t old_log_size;
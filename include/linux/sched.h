@@ -1174,6 +1174,23 @@ struct load_weight {
 	unsigned long weight, inv_weight;
 };
 
+#ifdef CONFIG_SCHED_LATENCY_HIST
+/*
+ * log2 histogram of runqueue wait times.  Bucket 0 counts waits below
+ * 1us, bucket n counts waits in [2^(n-1), 2^n) us and the last bucket
+ * collects everything longer.
+ */
+#define SCHED_LAT_HIST_BUCKETS	20
+
+struct sched_lat_hist {
+	u32			wakeup[SCHED_LAT_HIST_BUCKETS];
+	u32			preempt[SCHED_LAT_HIST_BUCKETS];
+};
+
+extern void sched_lat_hist_show(struct seq_file *m,
+				const struct sched_lat_hist *hist);
+#endif
+
 #ifdef CONFIG_SCHEDSTATS
 struct sched_statistics {
 	u64			wait_start;
@@ -1207,6 +1224,11 @@ struct sched_statistics {
 	u64			nr_wakeups_affine_attempts;
 	u64			nr_wakeups_passive;
 	u64			nr_wakeups_idle;
+
+#ifdef CONFIG_SCHED_LATENCY_HIST
+	unsigned int		wait_wakeup;
+	struct sched_lat_hist	lat_hist;
+#endif
 };
 #endif
 
@@ -1309,6 +1331,8 @@ struct task_struct {
 #endif
 
 	unsigned int policy;
+	/* see sched_set_latency_sensitive() */
+	unsigned int sched_latency_sensitive;
 	cpumask_t cpus_allowed;
 
 #ifdef CONFIG_PREEMPT_RCU
@@ -2070,6 +2094,9 @@ extern unsigned int sysctl_sched_latency;
 extern unsigned int sysctl_sched_min_granularity;
 extern unsigned int sysctl_sched_wakeup_granularity;
 extern unsigned int sysctl_sched_child_runs_first;
+extern unsigned int sysctl_sched_latency_sensitive_slice;
+
+extern int sched_set_latency_sensitive(struct task_struct *p, int val);
 
 enum sched_tunable_scaling {
 	SCHED_TUNABLESCALING_NONE,
@@ -75,6 +75,11 @@
 #else
 # define SLAB_FAILSLAB		0x00000000UL
 #endif
+#ifdef CONFIG_SLUB_MAGAZINE
+# define SLAB_MAGAZINE		0x04000000UL	/* Per cpu object magazines */
+#else
+# define SLAB_MAGAZINE		0x00000000UL
+#endif
 
 /* The following flags affect the page allocator grouping pages by mobility */
 #define SLAB_RECLAIM_ACCOUNT	0x00020000UL		/* Objects are reclaimable */
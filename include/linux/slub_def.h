@@ -54,6 +54,27 @@ struct kmem_cache_cpu {
 #endif
 };
 
+#ifdef CONFIG_SLUB_MAGAZINE
+enum magazine_stat_item {
+	MAG_ALLOC_HIT,		/* Allocation from the magazine */
+	MAG_ALLOC_MISS,		/* Magazine empty, allocation from cpu slab */
+	MAG_FREE,		/* Slow path free kept in the magazine */
+	MAG_FREE_REMOTE,	/* ... of an object in a slab frozen by a cpu */
+	MAG_DRAIN,		/* Magazine full, oldest half freed to slabs */
+	NR_MAG_STAT_ITEMS };
+
+/*
+ * Per cpu stack of free objects that did not belong to the cpu slab when
+ * they were freed. Only touched with interrupts disabled.
+ */
+struct kmem_cache_magazine {
+	unsigned int count;
+	unsigned int size;
+	unsigned stat[NR_MAG_STAT_ITEMS];
+	void *objects[];
+};
+#endif
+
 struct kmem_cache_node {
 	spinlock_t list_lock;	/* Protect partial list and nr_partial */
 	unsigned long nr_partial;
@@ -86,6 +107,9 @@ struct kmem_cache {
 	int objsize;		/* The size of an object without meta data */
 	int offset;		/* Free pointer offset. */
 	int cpu_partial;	/* Number of per cpu partial objects to keep around */
+#ifdef CONFIG_SLUB_MAGAZINE
+	struct kmem_cache_magazine __percpu *mag;	/* NULL if disabled */
+#endif
 	struct kmem_cache_order_objects oo;
 
 	/* Allocation and freeing of slabs */
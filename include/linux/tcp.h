@@ -106,6 +106,7 @@ enum {
 #define TCP_THIN_LINEAR_TIMEOUTS 16      /* Use linear timeouts for thin streams*/
 #define TCP_THIN_DUPACK         17      /* Fast retrans. after 1 dupack */
 #define TCP_USER_TIMEOUT	18	/* How long for loss retry before timeout */
+#define TCP_FASTOPEN		23	/* Enable FastOpen on listeners */
 
 /* for TCP_INFO socket option */
 #define TCPI_OPT_TIMESTAMPS	1
@@ -168,6 +169,10 @@ struct tcp_info {
 	__u32	tcpi_rcv_space;
 
 	__u32	tcpi_total_retrans;
+
+	__u64	tcpi_pacing_rate;	/* bytes per second, ~0 if unpaced */
+	__u32	tcpi_tsq_throttled;
+	__u32	tcpi_pacing_throttled;
 };
 
 /* for TCP_MD5SIG socket option */
@@ -209,6 +214,7 @@ struct tcp_cookie_transactions {
 
 #include <linux/skbuff.h>
 #include <linux/dmaengine.h>
+#include <linux/hrtimer.h>
 #include <net/sock.h>
 #include <net/inet_connection_sock.h>
 #include <net/inet_timewait_sock.h>
@@ -281,6 +287,26 @@ static inline void tcp_clear_options(struct tcp_options_received *rx_opt)
 struct tcp_cookie_values;
 struct tcp_request_sock_ops;
 
+#define TCP_FASTOPEN_COOKIE_MIN	4	/* Min Fast Open Cookie size in bytes */
+#define TCP_FASTOPEN_COOKIE_MAX	16	/* Max Fast Open Cookie size in bytes */
+#define TCP_FASTOPEN_COOKIE_SIZE 8	/* the size employed by this impl. */
+
+/* TCP Fast Open Cookie as stored in memory.
+ * len is -1 for no option, 0 for a cookie request.
+ */
+struct tcp_fastopen_cookie {
+	s8	len;
+	u8	val[TCP_FASTOPEN_COOKIE_MAX];
+};
+
+/* Active side of a Fast Open connect(), see tcp_sendmsg_fastopen() */
+struct tcp_fastopen_request {
+	/* Fast Open cookie. Size 0 means a cookie request */
+	struct tcp_fastopen_cookie	cookie;
+	struct msghdr			*data;  /* data in MSG_FASTOPEN */
+	int				copied;	/* queued in tcp_connect() */
+};
+
 struct tcp_request_sock {
 	struct inet_request_sock 	req;
 #ifdef CONFIG_TCP_MD5SIG
@@ -290,6 +316,7 @@ struct tcp_request_sock {
 	u32				rcv_isn;
 	u32				snt_isn;
 	u32				snt_synack; /* synack sent time */
+	u32				syn_data_len; /* Fast Open data acked */
 };
 
 static inline struct tcp_request_sock *tcp_rsk(const struct request_sock *req)
@@ -354,7 +381,8 @@ struct tcp_sock {
 	u8	nonagle     : 4,/* Disable Nagle algorithm?             */
 		thin_lto    : 1,/* Use linear timeouts for thin streams */
 		thin_dupack : 1,/* Fast retransmit on first dupack      */
-		unused      : 2;
+		syn_fastopen : 1, /* SYN includes Fast Open option */
+		syn_data    : 1;/* SYN includes data */
 
 /* RTT measurement */
 	u32	srtt;		/* smoothed round trip time << 3	*/
@@ -473,6 +501,31 @@ struct tcp_sock {
 	 * contains related tcp_cookie_transactions fields.
 	 */
 	struct tcp_cookie_values  *cookie_values;
+
+/* TCP Fast Open information */
+	struct tcp_fastopen_request *fastopen_req;
+	/* Passive child until the handshake completes: the request it was
+	 * created from, for SYN-ACK retransmits, and a ref on its listener.
+	 */
+	struct request_sock	*fastopen_rsk;
+	struct sock		*fastopen_listener;
+	/* Listener: max and current number of such children */
+	int			fastopen_max_qlen;
+	atomic_t		fastopen_qlen;
+
+/* TCP small queues and pacing, see tcp_write_xmit() */
+	unsigned long		tsq_flags;
+	struct list_head	tsq_node; /* anchor in tsq_tasklet.head list */
+	struct hrtimer		pacing_timer;
+	u32			pacing_rate;	/* bytes per second, ~0U if unpaced */
+	u32			tsq_throttled;	/* sends held back below the qdisc */
+	u32			pacing_throttled; /* sends held back by pacing */
+};
+
+enum tsq_flags {
+	TSQ_THROTTLED,
+	TSQ_QUEUED,
+	TCP_TSQ_DEFERRED,	   /* tcp_tasklet_func() found socket was owned */
 };
 
 static inline struct tcp_sock *tcp_sk(const struct sock *sk)
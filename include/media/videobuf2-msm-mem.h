@@ -18,6 +18,13 @@
 #include <media/videobuf2-core.h>
 #include <mach/iommu_domains.h>
 #include <linux/ion.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+
+/* idle imported mappings kept per cache before the oldest are dropped */
+#define VIDEOBUF2_MSM_MAP_CACHE_MAX 32
+
+struct dma_buf;
 
 struct videobuf2_mapping {
 	unsigned int count;
@@ -40,6 +47,28 @@ struct videobuf2_msm_offset {
 	};
 };
 
+/*
+ * IOMMU mapping of an imported dma-buf. Kept after the last user goes
+ * away so that a buffer re-registered later, possibly under another fd
+ * number, does not have to be imported and mapped again.
+ */
+struct videobuf2_msm_map {
+	struct list_head list;
+	struct dma_buf *dbuf;
+	struct ion_handle *ion_handle;
+	unsigned long phyaddr;
+	unsigned long len;
+	unsigned int users;
+};
+
+struct videobuf2_msm_map_cache {
+	struct mutex lock;
+	struct list_head maps; /* most recently used first */
+	unsigned int count;
+	unsigned int hits;
+	unsigned int misses;
+};
+
 struct videobuf2_contig_pmem {
 	u32 magic;
 	void *vaddr;
@@ -59,6 +88,9 @@ struct videobuf2_contig_pmem {
 	unsigned long mapped_phyaddr;
 	struct ion_handle *ion_handle;
 	struct ion_client *client;
+	/* imported mapping, and whether it came from the cache */
+	struct videobuf2_msm_map *map;
+	int map_cached;
 };
 void videobuf2_queue_pmem_contig_init(struct vb2_queue *q,
 					enum v4l2_buf_type type,
@@ -72,8 +104,13 @@ int videobuf2_pmem_contig_user_get(struct videobuf2_contig_pmem *mem,
 					struct videobuf2_msm_offset *offset,
 					enum videobuf2_buffer_type,
 					uint32_t addr_offset, int path,
-					struct ion_client *client);
+					struct ion_client *client,
+					struct videobuf2_msm_map_cache *cache);
 void videobuf2_pmem_contig_user_put(struct videobuf2_contig_pmem *mem,
+					struct ion_client *client,
+					struct videobuf2_msm_map_cache *cache);
+void videobuf2_msm_map_cache_init(struct videobuf2_msm_map_cache *cache);
+void videobuf2_msm_map_cache_flush(struct videobuf2_msm_map_cache *cache,
 					struct ion_client *client);
 unsigned long videobuf2_to_pmem_contig(struct vb2_buffer *buf,
 					unsigned int plane_no);
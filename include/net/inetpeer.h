@@ -27,6 +27,15 @@ struct inetpeer_addr {
 	__u16				family;
 };
 
+/* TCP Fast Open client state, see net/ipv4/tcp_fastopen.c */
+struct inetpeer_fastopen {
+	u16			mss;	/* MSS from the last SYN-ACK */
+	u16			syn_loss; /* Recurring Fast Open SYN losses */
+	s8			cookie_len;
+	u8			cookie[16];
+	unsigned long		last_syn_loss; /* Last Fast Open SYN loss */
+};
+
 struct inet_peer {
 	/* group together avl_left,avl_right,v4daddr to speedup lookups */
 	struct inet_peer __rcu	*avl_left, *avl_right;
@@ -40,6 +49,7 @@ struct inet_peer {
 	u32			pmtu_orig;
 	u32			pmtu_learned;
 	struct inetpeer_addr_base redirect_learned;
+	struct inetpeer_fastopen fastopen;
 	union {
 		struct list_head	gc_list;
 		struct rcu_head     gc_rcu;
@@ -61,6 +61,7 @@
 
 #include <linux/filter.h>
 #include <linux/rculist_nulls.h>
+#include <linux/seqlock.h>
 #include <linux/poll.h>
 
 #include <linux/atomic.h>
@@ -253,6 +254,9 @@ struct cg_proto;
   *	@sk_mark: generic packet mark
   *	@sk_classid: this socket's cgroup classid
   *	@sk_cgrp: this socket's cgroup-specific proto data
+  *	@sk_qtaguid_seq: protects @sk_qtaguid_tag against lockless readers
+  *	@sk_qtaguid_tagged: socket has a qtaguid tag, cached from its sock_tag
+  *	@sk_qtaguid_tag: the cached qtaguid tag
   *	@sk_write_pending: a write to stream socket waits to start
   *	@sk_state_change: callback to indicate change in the state of the sock
   *	@sk_data_ready: callback to indicate there is data to be processed
@@ -370,6 +374,11 @@ struct sock {
 	__u32			sk_mark;
 	u32			sk_classid;
 	struct cg_proto		*sk_cgrp;
+#ifdef CONFIG_NETFILTER_XT_MATCH_QTAGUID
+	seqcount_t		sk_qtaguid_seq;
+	bool			sk_qtaguid_tagged;
+	u64			sk_qtaguid_tag;
+#endif
 	void			(*sk_state_change)(struct sock *sk);
 	void			(*sk_data_ready)(struct sock *sk, int bytes);
 	void			(*sk_write_space)(struct sock *sk);
@@ -856,6 +865,8 @@ struct proto {
 	int			(*backlog_rcv) (struct sock *sk, 
 						struct sk_buff *skb);
 
+	void			(*release_cb)(struct sock *sk);
+
 	/* Keeping track of sk's, looking them up, and port selection methods. */
 	void			(*hash)(struct sock *sk);
 	void			(*unhash)(struct sock *sk);
@@ -197,6 +197,9 @@ int q6asm_write(struct audio_client *ac, uint32_t len, uint32_t msw_ts,
 				uint32_t lsw_ts, uint32_t flags);
 int q6asm_write_nolock(struct audio_client *ac, uint32_t len, uint32_t msw_ts,
 				uint32_t lsw_ts, uint32_t flags);
+int q6asm_write_bufs_nolock(struct audio_client *ac, uint32_t bufs,
+			uint32_t len, uint32_t msw_ts, uint32_t lsw_ts,
+			uint32_t flags);
 
 int q6asm_async_write(struct audio_client *ac,
 					  struct audio_aio_write_param *param);
@@ -0,0 +1,114 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM msm_cam
+
+#if !defined(_TRACE_MSM_CAM_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_MSM_CAM_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(msm_cam_launch_step,
+
+	TP_PROTO(const char *step, int begin),
+
+	TP_ARGS(step, begin),
+
+	TP_STRUCT__entry(
+		__string(step, step)
+		__field(int, begin)
+	),
+
+	TP_fast_assign(
+		__assign_str(step, step);
+		__entry->begin = begin;
+	),
+
+	TP_printk("%s %s", __get_str(step),
+		__entry->begin ? "begin" : "end")
+);
+
+DECLARE_EVENT_CLASS(msm_cam_buf_map_class,
+
+	TP_PROTO(int inst, int idx, int plane, unsigned long iova,
+		unsigned long size, int cached),
+
+	TP_ARGS(inst, idx, plane, iova, size, cached),
+
+	TP_STRUCT__entry(
+		__field(int, inst)
+		__field(int, idx)
+		__field(int, plane)
+		__field(unsigned long, iova)
+		__field(unsigned long, size)
+		__field(int, cached)
+	),
+
+	TP_fast_assign(
+		__entry->inst = inst;
+		__entry->idx = idx;
+		__entry->plane = plane;
+		__entry->iova = iova;
+		__entry->size = size;
+		__entry->cached = cached;
+	),
+
+	TP_printk("inst=%d idx=%d plane=%d iova=0x%lx size=%lu cached=%d",
+		__entry->inst, __entry->idx, __entry->plane, __entry->iova,
+		__entry->size, __entry->cached)
+);
+
+DEFINE_EVENT(msm_cam_buf_map_class, msm_cam_buf_map,
+
+	TP_PROTO(int inst, int idx, int plane, unsigned long iova,
+		unsigned long size, int cached),
+
+	TP_ARGS(inst, idx, plane, iova, size, cached)
+);
+
+DEFINE_EVENT(msm_cam_buf_map_class, msm_cam_buf_unmap,
+
+	TP_PROTO(int inst, int idx, int plane, unsigned long iova,
+		unsigned long size, int cached),
+
+	TP_ARGS(inst, idx, plane, iova, size, cached)
+);
+
+DECLARE_EVENT_CLASS(msm_cam_buf_class,
+
+	TP_PROTO(int inst, int idx, unsigned long iova),
+
+	TP_ARGS(inst, idx, iova),
+
+	TP_STRUCT__entry(
+		__field(int, inst)
+		__field(int, idx)
+		__field(unsigned long, iova)
+	),
+
+	TP_fast_assign(
+		__entry->inst = inst;
+		__entry->idx = idx;
+		__entry->iova = iova;
+	),
+
+	TP_printk("inst=%d idx=%d iova=0x%lx",
+		__entry->inst, __entry->idx, __entry->iova)
+);
+
+DEFINE_EVENT(msm_cam_buf_class, msm_cam_buf_queue,
+
+	TP_PROTO(int inst, int idx, unsigned long iova),
+
+	TP_ARGS(inst, idx, iova)
+);
+
+DEFINE_EVENT(msm_cam_buf_class, msm_cam_buf_done,
+
+	TP_PROTO(int inst, int idx, unsigned long iova),
+
+	TP_ARGS(inst, idx, iova)
+);
+
+#endif /* _TRACE_MSM_CAM_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -0,0 +1,73 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM msm_vidc
+
+#if !defined(_TRACE_MSM_VIDC_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_MSM_VIDC_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(msm_vidc_buf_register,
+
+	TP_PROTO(int fd, u32 offset, unsigned long device_addr, u32 size,
+		int reused),
+
+	TP_ARGS(fd, offset, device_addr, size, reused),
+
+	TP_STRUCT__entry(
+		__field(int, fd)
+		__field(u32, offset)
+		__field(unsigned long, device_addr)
+		__field(u32, size)
+		__field(int, reused)
+	),
+
+	TP_fast_assign(
+		__entry->fd = fd;
+		__entry->offset = offset;
+		__entry->device_addr = device_addr;
+		__entry->size = size;
+		__entry->reused = reused;
+	),
+
+	TP_printk("fd=%d off=%u addr=0x%lx size=%u reused=%d",
+		__entry->fd, __entry->offset, __entry->device_addr,
+		__entry->size, __entry->reused)
+);
+
+DECLARE_EVENT_CLASS(msm_vidc_buf_class,
+
+	TP_PROTO(int fd, unsigned long device_addr),
+
+	TP_ARGS(fd, device_addr),
+
+	TP_STRUCT__entry(
+		__field(int, fd)
+		__field(unsigned long, device_addr)
+	),
+
+	TP_fast_assign(
+		__entry->fd = fd;
+		__entry->device_addr = device_addr;
+	),
+
+	TP_printk("fd=%d addr=0x%lx", __entry->fd, __entry->device_addr)
+);
+
+DEFINE_EVENT(msm_vidc_buf_class, msm_vidc_buf_unregister,
+
+	TP_PROTO(int fd, unsigned long device_addr),
+
+	TP_ARGS(fd, device_addr)
+);
+
+DEFINE_EVENT(msm_vidc_buf_class, msm_vidc_buf_queue,
+
+	TP_PROTO(int fd, unsigned long device_addr),
+
+	TP_ARGS(fd, device_addr)
+);
+
+#endif /* _TRACE_MSM_VIDC_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
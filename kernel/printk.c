@@ -41,6 +41,7 @@
 #include <linux/cpu.h>
 #include <linux/notifier.h>
 #include <linux/rculist.h>
+#include <linux/kthread.h>
 
 #include <asm/uaccess.h>
 
@@ -99,6 +100,22 @@ EXPORT_SYMBOL_GPL(console_drivers);
  */
 static int console_locked, console_suspended;
 
+/*
+ * With printk.offload set, printk() only appends to log_buf and this
+ * thread feeds the consoles, see printk_offload_output().
+ */
+static struct task_struct *printk_kthread;
+#if defined(CONFIG_PRINTK_OFFLOAD)
+static bool printk_offload = 1;
+#else
+static bool printk_offload;
+#endif
+module_param_named(offload, printk_offload, bool, S_IRUGO | S_IWUSR);
+
+/* Console output time printk_kthread took off printk() callers, usecs */
+static unsigned long printk_offload_us;
+module_param_named(offload_us, printk_offload_us, ulong, S_IRUGO);
+
 /*
  * logbuf_lock protects log_buf, log_start, log_end, con_start and logged_chars
  * It is also used in interesting ways to provide interlocking in
@@ -929,6 +946,8 @@ static int console_trylock_for_printk(unsigned int cpu)
 		up(&console_sem);
 	return retval;
 }
+static bool printk_offload_output(int level);
+
 static const char recursion_bug_msg [] =
 		KERN_CRIT "BUG: recent printk recursion!\n";
 static int recursion_bug;
@@ -1101,8 +1120,13 @@ asmlinkage int vprintk(const char *fmt, va_list args)
 	 * The console_trylock_for_printk() function
 	 * will release 'logbuf_lock' regardless of whether it
 	 * actually gets the semaphore or not.
+	 *
+	 * Unless printk_kthread takes care of the consoles.
 	 */
-	if (console_trylock_for_printk(this_cpu))
+	if (printk_offload_output(current_log_level)) {
+		printk_cpu = UINT_MAX;
+		raw_spin_unlock(&logbuf_lock);
+	} else if (console_trylock_for_printk(this_cpu))
 		console_unlock();
 
 	lockdep_on();
@@ -1377,6 +1401,7 @@ int is_console_locked(void)
 
 #define PRINTK_PENDING_WAKEUP	0x01
 #define PRINTK_PENDING_SCHED	0x02
+#define PRINTK_PENDING_OUTPUT	0x04
 
 static DEFINE_PER_CPU(int, printk_pending);
 static DEFINE_PER_CPU(char [PRINTK_BUF_SIZE], printk_sched_buf);
@@ -1391,6 +1416,8 @@ void printk_tick(void)
 		}
 		if (pending & PRINTK_PENDING_WAKEUP)
 			wake_up_interruptible(&log_wait);
+		if (pending & PRINTK_PENDING_OUTPUT)
+			wake_up_process(printk_kthread);
 	}
 }
 
@@ -1407,6 +1434,42 @@ void wake_up_klogd(void)
 		this_cpu_or(printk_pending, PRINTK_PENDING_WAKEUP);
 }
 
+#ifdef CONFIG_PRINTK
+/*
+ * Leave the console output of a printk() to printk_kthread?  Not while
+ * it cannot run or cannot be trusted to: before it is started, during
+ * shutdown, oopses and panics, and not for KERN_EMERG messages.
+ *
+ * printk() may be called with runqueue locks held, so the kthread is
+ * woken from the next tick, like klogd.  Called with logbuf_lock held.
+ */
+static bool printk_offload_output(int level)
+{
+	if (!printk_offload || !printk_kthread)
+		return false;
+	if (oops_in_progress || system_state != SYSTEM_RUNNING || level == 0)
+		return false;
+
+	this_cpu_or(printk_pending, PRINTK_PENDING_OUTPUT);
+	return true;
+}
+
+static int printk_kthread_func(void *unused)
+{
+	while (!kthread_should_stop()) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (ACCESS_ONCE(con_start) == ACCESS_ONCE(log_end) ||
+		    console_suspended)
+			schedule();
+		__set_current_state(TASK_RUNNING);
+
+		console_lock();
+		console_unlock();
+	}
+	return 0;
+}
+#endif
+
 /**
  * console_unlock - unlock the console system
  *
@@ -1426,6 +1489,8 @@ void console_unlock(void)
 	unsigned long flags;
 	unsigned _con_start, _log_end;
 	unsigned wake_klogd = 0, retry = 0;
+	bool offloaded = current == printk_kthread;
+	u64 t = 0;
 
 	if (console_suspended) {
 		up(&console_sem);
@@ -1445,7 +1510,14 @@ again:
 		con_start = log_end;		/* Flush */
 		raw_spin_unlock(&logbuf_lock);
 		stop_critical_timings();	/* don't trace print latency */
+		if (offloaded)
+			t = local_clock();
 		call_console_drivers(_con_start, _log_end);
+		if (offloaded) {
+			t = local_clock() - t;
+			do_div(t, NSEC_PER_USEC);
+			printk_offload_us += t;
+		}
 		start_critical_timings();
 		local_irq_restore(flags);
 	}
@@ -1791,6 +1863,13 @@ static int __init printk_late_init(void)
 		}
 	}
 	hotcpu_notifier(console_cpu_notify, 0);
+#ifdef CONFIG_PRINTK
+	printk_kthread = kthread_run(printk_kthread_func, NULL, "printk");
+	if (IS_ERR(printk_kthread)) {
+		pr_err("printk: cannot start console thread\n");
+		printk_kthread = NULL;
+	}
+#endif
 	return 0;
 }
 late_initcall(printk_late_init);
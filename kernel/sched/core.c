@@ -1771,6 +1771,7 @@ void sched_fork(struct task_struct *p)
 		 * fulfilled its duty:
 		 */
 		p->sched_reset_on_fork = 0;
+		p->sched_latency_sensitive = 0;
 	}
 
 	if (!rt_prio(p->prio))
@@ -4483,6 +4484,35 @@ do_sched_setscheduler(pid_t pid, int policy, struct sched_param __user *param)
 	return retval;
 }
 
+/**
+ * sched_set_latency_sensitive - mark a task as latency sensitive
+ * @p: the task in question.
+ * @val: 1 to mark the task latency sensitive, 0 to clear it.
+ *
+ * Latency sensitive fair tasks preempt regular ones on wakeup, skip the
+ * START_DEBIT penalty and prefer idle cpus, but are limited to
+ * sysctl_sched_latency_sensitive_slice when others are waiting.
+ * Marking a task requires CAP_SYS_NICE, like raising its priority.
+ */
+int sched_set_latency_sensitive(struct task_struct *p, int val)
+{
+	unsigned long flags;
+	struct rq *rq;
+
+	if (val != 0 && val != 1)
+		return -EINVAL;
+	if (val && !capable(CAP_SYS_NICE))
+		return -EPERM;
+	if (!check_same_owner(p) && !capable(CAP_SYS_NICE))
+		return -EPERM;
+
+	rq = task_rq_lock(p, &flags);
+	p->sched_latency_sensitive = val;
+	task_rq_unlock(rq, p, &flags);
+
+	return 0;
+}
+
 /**
  * sys_sched_setscheduler - set/change the scheduler policy and RT priority
  * @pid: the pid in question.
@@ -7976,6 +8006,25 @@ static int cpu_shares_write_u64(struct cgroup *cgrp, struct cftype *cftype,
 	return sched_group_set_shares(cgroup_tg(cgrp), scale_load(shareval));
 }
 
+static int cpu_latency_sensitive_write_u64(struct cgroup *cgrp,
+					   struct cftype *cftype, u64 val)
+{
+	struct task_group *tg = cgroup_tg(cgrp);
+
+	/* the root group is everybody, marking it would be meaningless */
+	if (tg == &root_task_group || val > 1)
+		return -EINVAL;
+
+	tg->latency_sensitive = val;
+	return 0;
+}
+
+static u64 cpu_latency_sensitive_read_u64(struct cgroup *cgrp,
+					  struct cftype *cft)
+{
+	return cgroup_tg(cgrp)->latency_sensitive;
+}
+
 static u64 cpu_shares_read_u64(struct cgroup *cgrp, struct cftype *cft)
 {
 	struct task_group *tg = cgroup_tg(cgrp);
@@ -8220,6 +8269,29 @@ static int cpu_stats_show(struct cgroup *cgrp, struct cftype *cft,
 	return 0;
 }
 #endif /* CONFIG_CFS_BANDWIDTH */
+
+#ifdef CONFIG_SCHED_LATENCY_HIST
+static int cpu_latency_hist_show(struct cgroup *cgrp, struct cftype *cft,
+				 struct seq_file *m)
+{
+	struct task_group *tg = cgroup_tg(cgrp);
+	struct sched_lat_hist hist;
+	int cpu, i;
+
+	memset(&hist, 0, sizeof(hist));
+	for_each_possible_cpu(cpu) {
+		struct sched_lat_hist *h = &tg->cfs_rq[cpu]->lat_hist;
+
+		for (i = 0; i < SCHED_LAT_HIST_BUCKETS; i++) {
+			hist.wakeup[i] += h->wakeup[i];
+			hist.preempt[i] += h->preempt[i];
+		}
+	}
+	sched_lat_hist_show(m, &hist);
+
+	return 0;
+}
+#endif /* CONFIG_SCHED_LATENCY_HIST */
 #endif /* CONFIG_FAIR_GROUP_SCHED */
 
 #ifdef CONFIG_RT_GROUP_SCHED
@@ -8253,6 +8325,11 @@ static struct cftype cpu_files[] = {
 		.read_u64 = cpu_shares_read_u64,
 		.write_u64 = cpu_shares_write_u64,
 	},
+	{
+		.name = "latency_sensitive",
+		.read_u64 = cpu_latency_sensitive_read_u64,
+		.write_u64 = cpu_latency_sensitive_write_u64,
+	},
 #endif
 #ifdef CONFIG_CFS_BANDWIDTH
 	{
@@ -8270,6 +8347,12 @@ static struct cftype cpu_files[] = {
 		.read_map = cpu_stats_show,
 	},
 #endif
+#if defined(CONFIG_FAIR_GROUP_SCHED) && defined(CONFIG_SCHED_LATENCY_HIST)
+	{
+		.name = "latency_hist",
+		.read_seq_string = cpu_latency_hist_show,
+	},
+#endif
 #ifdef CONFIG_RT_GROUP_SCHED
 	{
 		.name = "rt_runtime_us",
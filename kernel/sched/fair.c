@@ -87,6 +87,13 @@ unsigned int sysctl_sched_child_runs_first __read_mostly;
 unsigned int sysctl_sched_wakeup_granularity = 1000000UL;
 unsigned int normalized_sysctl_sched_wakeup_granularity = 1000000UL;
 
+/*
+ * Longest stretch a latency sensitive task may run while others are
+ * waiting before the tick preempts it.
+ * (default: 3 msec, units: nanoseconds)
+ */
+unsigned int sysctl_sched_latency_sensitive_slice = 3000000UL;
+
 const_debug unsigned int sysctl_sched_migration_cost = 500000UL;
 
 /*
@@ -416,6 +423,35 @@ find_matching_se(struct sched_entity **se, struct sched_entity **pse)
 
 #endif	/* CONFIG_FAIR_GROUP_SCHED */
 
+#ifdef CONFIG_FAIR_GROUP_SCHED
+/* A group is latency sensitive if it or any group above it was marked */
+static inline int tg_latency_sensitive(struct task_group *tg)
+{
+	for (; tg; tg = tg->parent) {
+		if (tg->latency_sensitive)
+			return 1;
+	}
+	return 0;
+}
+#endif
+
+/*
+ * A task is latency sensitive if it was marked so itself or if the
+ * group it runs in is; a group entity if its group is.
+ */
+static inline int entity_latency_sensitive(struct sched_entity *se)
+{
+	if (!sched_feat(LATENCY_SENSITIVE))
+		return 0;
+#ifdef CONFIG_FAIR_GROUP_SCHED
+	if (!entity_is_task(se))
+		return tg_latency_sensitive(group_cfs_rq(se)->tg);
+	if (tg_latency_sensitive(cfs_rq_of(se)->tg))
+		return 1;
+#endif
+	return task_of(se)->sched_latency_sensitive;
+}
+
 static __always_inline
 void account_cfs_rq_runtime(struct cfs_rq *cfs_rq, unsigned long delta_exec);
 
@@ -749,6 +785,43 @@ update_stats_wait_end(struct cfs_rq *cfs_rq, struct sched_entity *se)
 	schedstat_set(se->statistics.wait_start, 0);
 }
 
+#ifdef CONFIG_SCHED_LATENCY_HIST
+static inline int sched_lat_hist_bucket(u64 delta)
+{
+	/* ~1us granularity is plenty and avoids a 64-bit division */
+	return min_t(int, fls64(delta >> 10), SCHED_LAT_HIST_BUCKETS - 1);
+}
+
+/*
+ * Account the wait that ends with @se being picked to run, both to the
+ * entity and to the cfs_rq (i.e. the cpu cgroup on this cpu) it ran on.
+ */
+static void
+update_stats_lat_hist(struct cfs_rq *cfs_rq, struct sched_entity *se)
+{
+	int bucket;
+
+	if (!se->statistics.wait_start)
+		return;
+
+	bucket = sched_lat_hist_bucket(rq_of(cfs_rq)->clock -
+				       se->statistics.wait_start);
+	if (se->statistics.wait_wakeup) {
+		se->statistics.lat_hist.wakeup[bucket]++;
+		cfs_rq->lat_hist.wakeup[bucket]++;
+	} else {
+		se->statistics.lat_hist.preempt[bucket]++;
+		cfs_rq->lat_hist.preempt[bucket]++;
+	}
+	se->statistics.wait_wakeup = 0;
+}
+#else
+static inline void
+update_stats_lat_hist(struct cfs_rq *cfs_rq, struct sched_entity *se)
+{
+}
+#endif
+
 static inline void
 update_stats_dequeue(struct cfs_rq *cfs_rq, struct sched_entity *se)
 {
@@ -1057,7 +1130,7 @@ place_entity(struct cfs_rq *cfs_rq, struct sched_entity *se, int initial)
 	 * little, place the new task so that it fits in the slot that
 	 * stays open at the end.
 	 */
-	if (initial && sched_feat(START_DEBIT))
+	if (initial && sched_feat(START_DEBIT) && !entity_latency_sensitive(se))
 		vruntime += sched_vslice(cfs_rq, se);
 
 	/* sleeps up to a single latency don't count. */
@@ -1066,9 +1139,11 @@ place_entity(struct cfs_rq *cfs_rq, struct sched_entity *se, int initial)
 
 		/*
 		 * Halve their sleep time's effect, to allow
-		 * for a gentler effect of sleepers:
+		 * for a gentler effect of sleepers.  Latency sensitive
+		 * entities get the full credit so they land leftmost.
 		 */
-		if (sched_feat(GENTLE_FAIR_SLEEPERS))
+		if (sched_feat(GENTLE_FAIR_SLEEPERS) &&
+		    !entity_latency_sensitive(se))
 			thresh >>= 1;
 
 		vruntime -= thresh;
@@ -1103,6 +1178,9 @@ enqueue_entity(struct cfs_rq *cfs_rq, struct sched_entity *se, int flags)
 	if (flags & ENQUEUE_WAKEUP) {
 		place_entity(cfs_rq, se, 0);
 		enqueue_sleeper(cfs_rq, se);
+#ifdef CONFIG_SCHED_LATENCY_HIST
+		se->statistics.wait_wakeup = 1;
+#endif
 	}
 
 	update_stats_enqueue(cfs_rq, se);
@@ -1220,6 +1298,13 @@ check_preempt_tick(struct cfs_rq *cfs_rq, struct sched_entity *curr)
 	s64 delta;
 
 	ideal_runtime = sched_slice(cfs_rq, curr);
+	/*
+	 * Latency sensitive entities get to preempt on wakeup, bound how
+	 * long they may then keep the cpu from everybody else.
+	 */
+	if (entity_latency_sensitive(curr))
+		ideal_runtime = min_t(unsigned long, ideal_runtime,
+				      sysctl_sched_latency_sensitive_slice);
 	delta_exec = curr->sum_exec_runtime - curr->prev_sum_exec_runtime;
 	if (delta_exec > ideal_runtime) {
 		resched_task(rq_of(cfs_rq)->curr);
@@ -1259,6 +1344,7 @@ set_next_entity(struct cfs_rq *cfs_rq, struct sched_entity *se)
 		 * a CPU. So account for the time it spent waiting on the
 		 * runqueue.
 		 */
+		update_stats_lat_hist(cfs_rq, se);
 		update_stats_wait_end(cfs_rq, se);
 		__dequeue_entity(cfs_rq, se);
 	}
@@ -2785,6 +2871,22 @@ select_task_rq_fair(struct task_struct *p, int sd_flag, int wake_flags)
 			prev_cpu = cpu;
 
 		new_cpu = select_idle_sibling(p, prev_cpu);
+
+		/*
+		 * Latency sensitive tasks would rather run right away on
+		 * any idle cpu of the domain than queue behind others.
+		 */
+		if (!idle_cpu(new_cpu) && entity_latency_sensitive(&p->se)) {
+			int i;
+
+			for_each_cpu_and(i, sched_domain_span(affine_sd),
+					 tsk_cpus_allowed(p)) {
+				if (idle_cpu(i)) {
+					new_cpu = i;
+					break;
+				}
+			}
+		}
 		goto unlock;
 	}
 
@@ -2963,6 +3065,18 @@ static void check_preempt_wakeup(struct rq *rq, struct task_struct *p, int wake_
 	find_matching_se(&se, &pse);
 	update_curr(cfs_rq_of(se));
 	BUG_ON(!pse);
+	/*
+	 * A latency sensitive entity preempts a regular one as soon as it
+	 * is entitled to run first, without waiting out the wakeup
+	 * granularity; check_preempt_tick() bounds the slice it gets.
+	 */
+	if (entity_latency_sensitive(pse) && !entity_latency_sensitive(se) &&
+	    wakeup_preempt_entity(se, pse) == 0) {
+		if (!next_buddy_marked)
+			set_next_buddy(pse);
+		goto preempt;
+	}
+
 	if (wakeup_preempt_entity(se, pse) == 1) {
 		/*
 		 * Bias pick_next to pick the sched entity that is
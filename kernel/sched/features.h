@@ -11,6 +11,14 @@ SCHED_FEAT(GENTLE_FAIR_SLEEPERS, true)
  */
 SCHED_FEAT(START_DEBIT, true)
 
+/*
+ * Let latency sensitive tasks (and groups) preempt on wakeup without
+ * waiting out the wakeup granularity, skip the START_DEBIT penalty and
+ * prefer idle cpus, in exchange for a slice bounded by
+ * sysctl_sched_latency_sensitive_slice.
+ */
+SCHED_FEAT(LATENCY_SENSITIVE, true)
+
 /*
  * Based on load and program behaviour, see if it makes sense to place
  * a newly woken task on the same cpu as the task that woke it --
@@ -110,6 +110,7 @@ struct task_group {
 	/* runqueue "owned" by this group on each cpu */
 	struct cfs_rq **cfs_rq;
 	unsigned long shares;
+	unsigned int latency_sensitive;
 
 	atomic_t load_weight;
 #endif
@@ -222,6 +223,11 @@ struct cfs_rq {
 	unsigned int nr_spread_over;
 #endif
 
+#ifdef CONFIG_SCHED_LATENCY_HIST
+	/* wait times of entities queued on this cfs_rq */
+	struct sched_lat_hist lat_hist;
+#endif
+
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	struct rq *rq;	/* cpu runqueue to which this cfs_rq is attached */
 
@@ -103,6 +103,26 @@ static const struct file_operations proc_schedstat_operations = {
 	.release = single_release,
 };
 
+#ifdef CONFIG_SCHED_LATENCY_HIST
+/*
+ * One line per bucket: upper bound in usecs (0 for the open-ended last
+ * bucket), wakeup latency count and preemption delay count.
+ */
+void sched_lat_hist_show(struct seq_file *m, const struct sched_lat_hist *hist)
+{
+	int i;
+
+	for (i = 0; i < SCHED_LAT_HIST_BUCKETS; i++) {
+		unsigned long bound = 0;
+
+		if (i < SCHED_LAT_HIST_BUCKETS - 1)
+			bound = 1UL << i;
+		seq_printf(m, "%lu %u %u\n", bound,
+			   hist->wakeup[i], hist->preempt[i]);
+	}
+}
+#endif
+
 static int __init proc_schedstat_init(void)
 {
 	proc_create("schedstat", 0, NULL, &proc_schedstat_operations);
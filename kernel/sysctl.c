@@ -255,6 +255,8 @@ static int max_wakeup_granularity_ns = NSEC_PER_SEC;	/* 1 second */
 static int min_sched_tunable_scaling = SCHED_TUNABLESCALING_NONE;
 static int max_sched_tunable_scaling = SCHED_TUNABLESCALING_END-1;
 #endif
+static int min_latency_sensitive_slice_ns = 100000;	/* 100 usecs */
+static int max_latency_sensitive_slice_ns = NSEC_PER_SEC;	/* 1 second */
 
 #ifdef CONFIG_COMPACTION
 static int min_extfrag_threshold;
@@ -269,6 +271,15 @@ static struct ctl_table kern_table[] = {
 		.mode		= 0644,
 		.proc_handler	= proc_dointvec,
 	},
+	{
+		.procname	= "sched_latency_sensitive_slice_ns",
+		.data		= &sysctl_sched_latency_sensitive_slice,
+		.maxlen		= sizeof(unsigned int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= &min_latency_sensitive_slice_ns,
+		.extra2		= &max_latency_sensitive_slice_ns,
+	},
 #ifdef CONFIG_SCHED_DEBUG
 	{
 		.procname	= "sched_min_granularity_ns",
@@ -850,4 +850,18 @@ int perf_ftrace_event_register(struct ftrace_event_call *call,
 #define perf_ftrace_event_register NULL
 #endif
 
+enum {
+	CRIT_HIST_IRQSOFF,
+	CRIT_HIST_PREEMPTOFF,
+	CRIT_HIST_TYPES,
+};
+
+#ifdef CONFIG_CRITICAL_SECTION_HIST
+void crit_hist_start(int type, unsigned long ip);
+void crit_hist_stop(int type);
+#else
+static inline void crit_hist_start(int type, unsigned long ip) { }
+static inline void crit_hist_stop(int type) { }
+#endif
+
 #endif /* _LINUX_KERNEL_TRACE_H */
@@ -0,0 +1,201 @@
+/*
+ * Always-on histograms of irqs-off and preempt-off section lengths
+ *
+ * Unlike the irqsoff/preemptoff tracers this records nothing into the
+ * ring buffer: each section costs two clock reads and a couple of
+ * per-cpu counter updates, so it can stay enabled on production builds.
+ * Sections longer than threshold_us are also attributed to the call
+ * site that started them, keeping the worst few sites per cpu.
+ */
+#include <linux/kallsyms.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/percpu.h>
+#include <linux/trace_clock.h>
+#include <linux/hardirq.h>
+
+#include "trace.h"
+
+#define CRIT_HIST_BUCKETS	24	/* log2(usecs), last one open ended */
+#define CRIT_HIST_TOP		8
+
+struct crit_hist_site {
+	unsigned long	ip;
+	u32		count;
+	u32		max_us;
+	bool		used;
+};
+
+struct crit_hist_cpu {
+	u64			start[CRIT_HIST_TYPES];
+	unsigned long		start_ip[CRIT_HIST_TYPES];
+	u32			hist[CRIT_HIST_TYPES][CRIT_HIST_BUCKETS];
+	struct crit_hist_site	top[CRIT_HIST_TYPES][CRIT_HIST_TOP];
+};
+
+static DEFINE_PER_CPU(struct crit_hist_cpu, crit_hist);
+
+static u32 crit_hist_enabled __read_mostly = 1;
+static u32 crit_hist_threshold_us __read_mostly = 100;
+
+void notrace crit_hist_start(int type, unsigned long ip)
+{
+	struct crit_hist_cpu *ch;
+
+	if (!crit_hist_enabled)
+		return;
+
+	ch = &__get_cpu_var(crit_hist);
+	/* nested disables keep the outermost start */
+	if (ch->start[type])
+		return;
+	ch->start_ip[type] = ip;
+	ch->start[type] = trace_clock_local();
+}
+
+static void notrace crit_hist_add_site(struct crit_hist_site *top,
+				       unsigned long ip, u32 us)
+{
+	struct crit_hist_site *min = NULL;
+	int i;
+
+	for (i = 0; i < CRIT_HIST_TOP; i++) {
+		if (!top[i].used) {
+			if (!min || min->used)
+				min = &top[i];
+			continue;
+		}
+		if (top[i].ip == ip) {
+			top[i].count++;
+			if (us > top[i].max_us)
+				top[i].max_us = us;
+			return;
+		}
+		if (!min || (min->used && top[i].max_us < min->max_us))
+			min = &top[i];
+	}
+	/* take a free slot, or evict the mildest site */
+	if (!min->used || us > min->max_us) {
+		min->ip = ip;
+		min->count = 1;
+		min->max_us = us;
+		min->used = true;
+	}
+}
+
+void notrace crit_hist_stop(int type)
+{
+	struct crit_hist_cpu *ch;
+	unsigned long flags;
+	u64 delta;
+	u32 us;
+	int b;
+
+	ch = &__get_cpu_var(crit_hist);
+	if (!ch->start[type])
+		return;
+
+	delta = trace_clock_local() - ch->start[type];
+	ch->start[type] = 0;
+	us = delta > (u64)U32_MAX ? U32_MAX / 1000 : (u32)delta / 1000;
+	b = us ? min(fls(us), CRIT_HIST_BUCKETS - 1) : 0;
+
+	/* preempt-off sections end with irqs on; keep irq paths out */
+	raw_local_irq_save(flags);
+	ch->hist[type][b]++;
+	if (us >= crit_hist_threshold_us)
+		crit_hist_add_site(ch->top[type], ch->start_ip[type], us);
+	raw_local_irq_restore(flags);
+}
+
+static int crit_hist_show(struct seq_file *m, void *v)
+{
+	int type = (long)m->private;
+	struct crit_hist_cpu *ch;
+	struct crit_hist_site *s;
+	int cpu, i;
+
+	for_each_online_cpu(cpu) {
+		ch = &per_cpu(crit_hist, cpu);
+		seq_printf(m, "cpu%d\n", cpu);
+		/* upper bound in usecs, 0 for the open-ended last bucket */
+		for (i = 0; i < CRIT_HIST_BUCKETS; i++) {
+			if (!ch->hist[type][i])
+				continue;
+			seq_printf(m, "  %lu %u\n",
+				   i < CRIT_HIST_BUCKETS - 1 ? 1UL << i : 0,
+				   ch->hist[type][i]);
+		}
+		for (i = 0; i < CRIT_HIST_TOP; i++) {
+			s = &ch->top[type][i];
+			if (!s->used)
+				continue;
+			seq_printf(m, "  top %pS count %u max_us %u\n",
+				   (void *)s->ip, s->count, s->max_us);
+		}
+	}
+	return 0;
+}
+
+static int crit_hist_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, crit_hist_show, inode->i_private);
+}
+
+static const struct file_operations crit_hist_fops = {
+	.open		= crit_hist_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static ssize_t crit_hist_reset_write(struct file *filp,
+				     const char __user *ubuf,
+				     size_t cnt, loff_t *ppos)
+{
+	struct crit_hist_cpu *ch;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		ch = &per_cpu(crit_hist, cpu);
+		memset(ch->hist, 0, sizeof(ch->hist));
+		memset(ch->top, 0, sizeof(ch->top));
+	}
+	return cnt;
+}
+
+static const struct file_operations crit_hist_reset_fops = {
+	.open		= tracing_open_generic,
+	.write		= crit_hist_reset_write,
+	.llseek		= noop_llseek,
+};
+
+static __init int crit_hist_init(void)
+{
+	struct dentry *d_tracer, *dir;
+
+	d_tracer = tracing_init_dentry();
+	if (!d_tracer)
+		return 0;
+
+	dir = debugfs_create_dir("critical_hist", d_tracer);
+	if (!dir)
+		return 0;
+
+#ifdef CONFIG_IRQSOFF_TRACER
+	debugfs_create_file("irqsoff", 0444, dir,
+			    (void *)CRIT_HIST_IRQSOFF, &crit_hist_fops);
+#endif
+#ifdef CONFIG_PREEMPT_TRACER
+	debugfs_create_file("preemptoff", 0444, dir,
+			    (void *)CRIT_HIST_PREEMPTOFF, &crit_hist_fops);
+#endif
+	debugfs_create_u32("enable", 0644, dir, &crit_hist_enabled);
+	debugfs_create_u32("threshold_us", 0644, dir,
+			   &crit_hist_threshold_us);
+	debugfs_create_file("reset", 0200, dir, NULL, &crit_hist_reset_fops);
+
+	return 0;
+}
+device_initcall(crit_hist_init);
@@ -435,6 +435,10 @@ stop_critical_timing(unsigned long ip, unsigned long parent_ip)
 /* start and stop critical timings used to for stoppage (in idle) */
 void start_critical_timings(void)
 {
+	if (irqs_disabled())
+		crit_hist_start(CRIT_HIST_IRQSOFF, CALLER_ADDR0);
+	if (preempt_count())
+		crit_hist_start(CRIT_HIST_PREEMPTOFF, CALLER_ADDR0);
 	if (preempt_trace() || irq_trace())
 		start_critical_timing(CALLER_ADDR0, CALLER_ADDR1);
 }
@@ -442,6 +446,8 @@ EXPORT_SYMBOL_GPL(start_critical_timings);
 
 void stop_critical_timings(void)
 {
+	crit_hist_stop(CRIT_HIST_IRQSOFF);
+	crit_hist_stop(CRIT_HIST_PREEMPTOFF);
 	if (preempt_trace() || irq_trace())
 		stop_critical_timing(CALLER_ADDR0, CALLER_ADDR1);
 }
@@ -451,12 +457,14 @@ EXPORT_SYMBOL_GPL(stop_critical_timings);
 #ifdef CONFIG_PROVE_LOCKING
 void time_hardirqs_on(unsigned long a0, unsigned long a1)
 {
+	crit_hist_stop(CRIT_HIST_IRQSOFF);
 	if (!preempt_trace() && irq_trace())
 		stop_critical_timing(a0, a1);
 }
 
 void time_hardirqs_off(unsigned long a0, unsigned long a1)
 {
+	crit_hist_start(CRIT_HIST_IRQSOFF, a0);
 	if (!preempt_trace() && irq_trace())
 		start_critical_timing(a0, a1);
 }
@@ -484,6 +492,7 @@ inline void print_irqtrace_events(struct task_struct *curr)
  */
 void trace_hardirqs_on(void)
 {
+	crit_hist_stop(CRIT_HIST_IRQSOFF);
 	if (!preempt_trace() && irq_trace())
 		stop_critical_timing(CALLER_ADDR0, CALLER_ADDR1);
 }
@@ -491,6 +500,7 @@ EXPORT_SYMBOL(trace_hardirqs_on);
 
 void trace_hardirqs_off(void)
 {
+	crit_hist_start(CRIT_HIST_IRQSOFF, CALLER_ADDR0);
 	if (!preempt_trace() && irq_trace())
 		start_critical_timing(CALLER_ADDR0, CALLER_ADDR1);
 }
@@ -498,6 +508,7 @@ EXPORT_SYMBOL(trace_hardirqs_off);
 
 void trace_hardirqs_on_caller(unsigned long caller_addr)
 {
+	crit_hist_stop(CRIT_HIST_IRQSOFF);
 	if (!preempt_trace() && irq_trace())
 		stop_critical_timing(CALLER_ADDR0, caller_addr);
 }
@@ -505,6 +516,7 @@ EXPORT_SYMBOL(trace_hardirqs_on_caller);
 
 void trace_hardirqs_off_caller(unsigned long caller_addr)
 {
+	crit_hist_start(CRIT_HIST_IRQSOFF, caller_addr);
 	if (!preempt_trace() && irq_trace())
 		start_critical_timing(CALLER_ADDR0, caller_addr);
 }
@@ -516,12 +528,14 @@ EXPORT_SYMBOL(trace_hardirqs_off_caller);
 #ifdef CONFIG_PREEMPT_TRACER
 void trace_preempt_on(unsigned long a0, unsigned long a1)
 {
+	crit_hist_stop(CRIT_HIST_PREEMPTOFF);
 	if (preempt_trace() && !irq_trace())
 		stop_critical_timing(a0, a1);
 }
 
 void trace_preempt_off(unsigned long a0, unsigned long a1)
 {
+	crit_hist_start(CRIT_HIST_PREEMPTOFF, a0);
 	if (preempt_trace() && !irq_trace())
 		start_critical_timing(a0, a1);
 }
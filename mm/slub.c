@@ -2019,6 +2019,252 @@ static inline void flush_slab(struct kmem_cache *s, struct kmem_cache_cpu *c)
 	deactivate_slab(s, c);
 }
 
+#ifdef CONFIG_SLUB_MAGAZINE
+/*
+ * Per cpu object magazines.
+ *
+ * Frees that miss the cpu slab, typically objects allocated on another
+ * cpu, are pushed onto a per cpu stack instead of going through
+ * __slab_free() and its cmpxchg retries and list_lock. Allocations pop
+ * from the stack first so those objects are reused while still cache hot.
+ * A full magazine writes back its oldest half in one go, outside of the
+ * irq disabled section.
+ *
+ * s->mag is only dereferenced with interrupts disabled, so replacing it
+ * and draining the old magazines from an IPI on each cpu is enough to
+ * know nobody uses them anymore.
+ */
+#define SLUB_MAGAZINE_MAX	64
+
+static int slub_magazine_size = 32;
+static DEFINE_MUTEX(slub_magazine_mutex);
+
+static void __slab_free(struct kmem_cache *s, struct page *page,
+			void *x, unsigned long addr);
+
+static void *__slab_magazine_alloc(struct kmem_cache *s)
+{
+	struct kmem_cache_magazine __percpu *mag;
+	struct kmem_cache_magazine *m;
+	unsigned long flags;
+	void *object = NULL;
+
+	local_irq_save(flags);
+	mag = ACCESS_ONCE(s->mag);
+	if (likely(mag)) {
+		m = this_cpu_ptr(mag);
+		if (m->count) {
+			object = m->objects[--m->count];
+			m->stat[MAG_ALLOC_HIT]++;
+		} else
+			m->stat[MAG_ALLOC_MISS]++;
+	}
+	local_irq_restore(flags);
+
+	return object;
+}
+
+static __always_inline void *slab_magazine_alloc(struct kmem_cache *s,
+						 int node)
+{
+	if (!s->mag || node != NUMA_NO_NODE)
+		return NULL;
+	return __slab_magazine_alloc(s);
+}
+
+static int __slab_magazine_free(struct kmem_cache *s, struct page *page,
+				void *x, unsigned long addr)
+{
+	struct kmem_cache_magazine __percpu *mag;
+	struct kmem_cache_magazine *m;
+	void *batch[SLUB_MAGAZINE_MAX / 2];
+	unsigned long flags;
+	int n = 0;
+
+	local_irq_save(flags);
+	mag = ACCESS_ONCE(s->mag);
+	if (unlikely(!mag)) {
+		local_irq_restore(flags);
+		return 0;
+	}
+
+	m = this_cpu_ptr(mag);
+	if (unlikely(m->count == m->size)) {
+		/* The bottom of the stack is the coldest */
+		n = m->size / 2;
+		memcpy(batch, m->objects, n * sizeof(void *));
+		m->count -= n;
+		memmove(m->objects, m->objects + n, m->count * sizeof(void *));
+		m->stat[MAG_DRAIN]++;
+	}
+	m->objects[m->count++] = x;
+	m->stat[MAG_FREE]++;
+	if (page->frozen)
+		m->stat[MAG_FREE_REMOTE]++;
+	local_irq_restore(flags);
+
+	while (n--)
+		__slab_free(s, virt_to_head_page(batch[n]), batch[n], addr);
+
+	return 1;
+}
+
+static __always_inline int slab_magazine_free(struct kmem_cache *s,
+				struct page *page, void *x, unsigned long addr)
+{
+	if (!s->mag)
+		return 0;
+	return __slab_magazine_free(s, page, x, addr);
+}
+
+/* Interrupts disabled, m not in use by its cpu */
+static void drain_magazine(struct kmem_cache *s, struct kmem_cache_magazine *m)
+{
+	void *object;
+
+	while (m->count) {
+		object = m->objects[--m->count];
+		__slab_free(s, virt_to_head_page(object), object, _RET_IP_);
+	}
+}
+
+static void drain_cpu_magazine(struct kmem_cache *s, int cpu)
+{
+	if (s->mag)
+		drain_magazine(s, per_cpu_ptr(s->mag, cpu));
+}
+
+static bool has_cpu_magazine(struct kmem_cache *s, int cpu)
+{
+	return s->mag && per_cpu_ptr(s->mag, cpu)->count;
+}
+
+struct magazine_swap {
+	struct kmem_cache *s;
+	struct kmem_cache_magazine __percpu *old;
+};
+
+static void drain_old_magazine(void *d)
+{
+	struct magazine_swap *swap = d;
+
+	drain_magazine(swap->s, this_cpu_ptr(swap->old));
+}
+
+static struct kmem_cache_magazine __percpu *
+alloc_kmem_cache_magazine(unsigned long size)
+{
+	struct kmem_cache_magazine __percpu *mag;
+	int cpu;
+
+	mag = __alloc_percpu(sizeof(struct kmem_cache_magazine) +
+			     size * sizeof(void *), sizeof(void *));
+	if (mag)
+		for_each_possible_cpu(cpu)
+			per_cpu_ptr(mag, cpu)->size = size;
+	return mag;
+}
+
+/*
+ * Replace the magazines of a cache with ones of the given size, 0 turns
+ * them off. Debug caches need every free to go through the slow path.
+ */
+static int kmem_cache_set_magazine(struct kmem_cache *s, unsigned long size)
+{
+	struct magazine_swap swap = { .s = s };
+	struct kmem_cache_magazine __percpu *mag = NULL;
+
+	if (size == 1 || size > SLUB_MAGAZINE_MAX)
+		return -EINVAL;
+	if (size && kmem_cache_debug(s))
+		return -EINVAL;
+
+	if (size) {
+		mag = alloc_kmem_cache_magazine(size);
+		if (!mag)
+			return -ENOMEM;
+	}
+
+	/*
+	 * Dead cpus drain s->mag, keep them from missing the old one.  The
+	 * hotplug lock nests outside slub_magazine_mutex, as it does
+	 * outside slub_lock in slab_cpuup_callback().
+	 */
+	get_online_cpus();
+	mutex_lock(&slub_magazine_mutex);
+	swap.old = s->mag;
+	smp_wmb();
+	s->mag = mag;
+	if (swap.old) {
+		on_each_cpu(drain_old_magazine, &swap, 1);
+		free_percpu(swap.old);
+	}
+	mutex_unlock(&slub_magazine_mutex);
+	put_online_cpus();
+
+	return 0;
+}
+
+/*
+ * Give a cache created, or merged into, with SLAB_MAGAZINE its magazines.
+ * There is nothing to drain, so this does not need the hotplug lock and
+ * is fine under slub_lock.
+ */
+static void init_kmem_cache_magazine(struct kmem_cache *s,
+				     unsigned long flags)
+{
+	struct kmem_cache_magazine __percpu *mag;
+
+	if (!(flags & SLAB_MAGAZINE) || !slub_magazine_size ||
+	    kmem_cache_debug(s) || s->mag)
+		return;
+
+	mag = alloc_kmem_cache_magazine(slub_magazine_size);
+	if (!mag)
+		return;
+
+	mutex_lock(&slub_magazine_mutex);
+	if (!s->mag) {
+		smp_wmb();
+		s->mag = mag;
+		mag = NULL;
+	}
+	mutex_unlock(&slub_magazine_mutex);
+	free_percpu(mag);
+}
+
+static void free_kmem_cache_magazine(struct kmem_cache *s)
+{
+	free_percpu(s->mag);
+	s->mag = NULL;
+}
+
+static int __init setup_slub_magazine(char *str)
+{
+	get_option(&str, &slub_magazine_size);
+	slub_magazine_size = clamp(slub_magazine_size, 0, SLUB_MAGAZINE_MAX);
+	if (slub_magazine_size == 1)
+		slub_magazine_size = 2;
+
+	return 1;
+}
+
+__setup("slub_magazine=", setup_slub_magazine);
+#else
+static inline void *slab_magazine_alloc(struct kmem_cache *s, int node)
+							{ return NULL; }
+static inline int slab_magazine_free(struct kmem_cache *s,
+		struct page *page, void *x, unsigned long addr) { return 0; }
+static inline void drain_cpu_magazine(struct kmem_cache *s, int cpu) {}
+static inline bool has_cpu_magazine(struct kmem_cache *s, int cpu)
+							{ return false; }
+static inline int kmem_cache_set_magazine(struct kmem_cache *s,
+					  unsigned long size) { return 0; }
+static inline void init_kmem_cache_magazine(struct kmem_cache *s,
+					    unsigned long flags) {}
+static inline void free_kmem_cache_magazine(struct kmem_cache *s) {}
+#endif
+
 /*
  * Flush cpu slab.
  *
@@ -2028,6 +2274,9 @@ static inline void __flush_cpu_slab(struct kmem_cache *s, int cpu)
 {
 	struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
 
+	/* First, its objects may go back to the cpu slab or partials */
+	drain_cpu_magazine(s, cpu);
+
 	if (likely(c)) {
 		if (c->page)
 			flush_slab(s, c);
@@ -2048,7 +2297,7 @@ static bool has_cpu_slab(int cpu, void *info)
 	struct kmem_cache *s = info;
 	struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
 
-	return c->page || c->partial;
+	return c->page || c->partial || has_cpu_magazine(s, cpu);
 }
 
 static void flush_all(struct kmem_cache *s)
@@ -2317,6 +2566,10 @@ static __always_inline void *slab_alloc(struct kmem_cache *s,
 	if (slab_pre_alloc_hook(s, gfpflags))
 		return NULL;
 
+	object = slab_magazine_alloc(s, node);
+	if (object)
+		goto out;
+
 redo:
 
 	/*
@@ -2368,6 +2621,7 @@ redo:
 		stat(s, ALLOC_FASTPATH);
 	}
 
+out:
 	if (unlikely(gfpflags & __GFP_ZERO) && object)
 		memset(object, 0, s->objsize);
 
@@ -2597,7 +2851,7 @@ redo:
 			goto redo;
 		}
 		stat(s, FREE_FASTPATH);
-	} else
+	} else if (!slab_magazine_free(s, page, x, addr))
 		__slab_free(s, page, x, addr);
 
 }
@@ -3101,8 +3355,10 @@ static int kmem_cache_open(struct kmem_cache *s,
 	if (!init_kmem_cache_nodes(s))
 		goto error;
 
-	if (alloc_kmem_cache_cpus(s))
+	if (alloc_kmem_cache_cpus(s)) {
+		init_kmem_cache_magazine(s, s->flags);
 		return 1;
+	}
 
 	free_kmem_cache_nodes(s);
 error:
@@ -3178,6 +3434,7 @@ static inline int kmem_cache_close(struct kmem_cache *s)
 	int node;
 
 	flush_all(s);
+	free_kmem_cache_magazine(s);
 	free_percpu(s->cpu_slab);
 	/* Attempt to free all objects */
 	for_each_node_state(node, N_NORMAL_MEMORY) {
@@ -3821,7 +4078,11 @@ void __init kmem_cache_init(void)
 	}
 
 	for (i = KMALLOC_SHIFT_LOW; i < SLUB_PAGE_SHIFT; i++) {
-		kmalloc_caches[i] = create_kmalloc_cache("kmalloc", 1 << i, 0);
+		/* Small skb heads, binder and friends are freed cross cpu */
+		unsigned int flags = (i >= 6 && i <= 8) ? SLAB_MAGAZINE : 0;
+
+		kmalloc_caches[i] = create_kmalloc_cache("kmalloc", 1 << i,
+							 flags);
 		caches++;
 	}
 
@@ -3956,6 +4217,8 @@ struct kmem_cache *kmem_cache_create(const char *name, size_t size,
 		s->objsize = max(s->objsize, (int)size);
 		s->inuse = max_t(int, s->inuse, ALIGN(size, sizeof(void *)));
 
+		init_kmem_cache_magazine(s, flags);
+
 		if (sysfs_slab_alias(s, name)) {
 			s->refcount--;
 			goto err;
@@ -4717,6 +4980,101 @@ static ssize_t cpu_partial_store(struct kmem_cache *s, const char *buf,
 }
 SLAB_ATTR(cpu_partial);
 
+#ifdef CONFIG_SLUB_MAGAZINE
+static ssize_t magazine_size_show(struct kmem_cache *s, char *buf)
+{
+	unsigned int size = 0;
+
+	mutex_lock(&slub_magazine_mutex);
+	if (s->mag)
+		size = per_cpu_ptr(s->mag, 0)->size;
+	mutex_unlock(&slub_magazine_mutex);
+
+	return sprintf(buf, "%u\n", size);
+}
+
+static ssize_t magazine_size_store(struct kmem_cache *s, const char *buf,
+				   size_t length)
+{
+	unsigned long objects;
+	int err;
+
+	err = strict_strtoul(buf, 10, &objects);
+	if (err)
+		return err;
+
+	err = kmem_cache_set_magazine(s, objects);
+	if (err)
+		return err;
+	return length;
+}
+SLAB_ATTR(magazine_size);
+
+/* Always collected, the magazine is cpu local and irqs are off anyway */
+static int show_magazine_stat(struct kmem_cache *s, char *buf,
+			      enum magazine_stat_item si)
+{
+	unsigned long sum  = 0;
+	int cpu;
+	int len;
+	int *data = kmalloc(nr_cpu_ids * sizeof(int), GFP_KERNEL);
+
+	if (!data)
+		return -ENOMEM;
+
+	mutex_lock(&slub_magazine_mutex);
+	for_each_online_cpu(cpu) {
+		unsigned x = s->mag ? per_cpu_ptr(s->mag, cpu)->stat[si] : 0;
+
+		data[cpu] = x;
+		sum += x;
+	}
+	mutex_unlock(&slub_magazine_mutex);
+
+	len = sprintf(buf, "%lu", sum);
+
+	for_each_online_cpu(cpu) {
+		if (data[cpu] && len < PAGE_SIZE - 20)
+			len += sprintf(buf + len, " C%d=%u", cpu, data[cpu]);
+	}
+	kfree(data);
+	return len + sprintf(buf + len, "\n");
+}
+
+static void clear_magazine_stat(struct kmem_cache *s,
+				enum magazine_stat_item si)
+{
+	int cpu;
+
+	mutex_lock(&slub_magazine_mutex);
+	if (s->mag)
+		for_each_online_cpu(cpu)
+			per_cpu_ptr(s->mag, cpu)->stat[si] = 0;
+	mutex_unlock(&slub_magazine_mutex);
+}
+
+#define MAG_STAT_ATTR(si, text)					\
+static ssize_t text##_show(struct kmem_cache *s, char *buf)	\
+{								\
+	return show_magazine_stat(s, buf, si);			\
+}								\
+static ssize_t text##_store(struct kmem_cache *s,		\
+				const char *buf, size_t length)	\
+{								\
+	if (buf[0] != '0')					\
+		return -EINVAL;					\
+	clear_magazine_stat(s, si);				\
+	return length;						\
+}								\
+SLAB_ATTR(text);						\
+
+MAG_STAT_ATTR(MAG_ALLOC_HIT, magazine_alloc_hit);
+MAG_STAT_ATTR(MAG_ALLOC_MISS, magazine_alloc_miss);
+MAG_STAT_ATTR(MAG_FREE, magazine_free);
+MAG_STAT_ATTR(MAG_FREE_REMOTE, magazine_free_remote);
+MAG_STAT_ATTR(MAG_DRAIN, magazine_drain);
+#endif
+
 static ssize_t ctor_show(struct kmem_cache *s, char *buf)
 {
 	if (!s->ctor)
@@ -4850,6 +5208,7 @@ static ssize_t sanity_checks_store(struct kmem_cache *s,
 {
 	s->flags &= ~SLAB_DEBUG_FREE;
 	if (buf[0] == '1') {
+		kmem_cache_set_magazine(s, 0);
 		s->flags &= ~__CMPXCHG_DOUBLE;
 		s->flags |= SLAB_DEBUG_FREE;
 	}
@@ -4867,6 +5226,7 @@ static ssize_t trace_store(struct kmem_cache *s, const char *buf,
 {
 	s->flags &= ~SLAB_TRACE;
 	if (buf[0] == '1') {
+		kmem_cache_set_magazine(s, 0);
 		s->flags &= ~__CMPXCHG_DOUBLE;
 		s->flags |= SLAB_TRACE;
 	}
@@ -4887,6 +5247,7 @@ static ssize_t red_zone_store(struct kmem_cache *s,
 
 	s->flags &= ~SLAB_RED_ZONE;
 	if (buf[0] == '1') {
+		kmem_cache_set_magazine(s, 0);
 		s->flags &= ~__CMPXCHG_DOUBLE;
 		s->flags |= SLAB_RED_ZONE;
 	}
@@ -4908,6 +5269,7 @@ static ssize_t poison_store(struct kmem_cache *s,
 
 	s->flags &= ~SLAB_POISON;
 	if (buf[0] == '1') {
+		kmem_cache_set_magazine(s, 0);
 		s->flags &= ~__CMPXCHG_DOUBLE;
 		s->flags |= SLAB_POISON;
 	}
@@ -4929,6 +5291,7 @@ static ssize_t store_user_store(struct kmem_cache *s,
 
 	s->flags &= ~SLAB_STORE_USER;
 	if (buf[0] == '1') {
+		kmem_cache_set_magazine(s, 0);
 		s->flags &= ~__CMPXCHG_DOUBLE;
 		s->flags |= SLAB_STORE_USER;
 	}
@@ -5121,6 +5484,14 @@ static struct attribute *slab_attrs[] = {
 	&order_attr.attr,
 	&min_partial_attr.attr,
 	&cpu_partial_attr.attr,
+#ifdef CONFIG_SLUB_MAGAZINE
+	&magazine_size_attr.attr,
+	&magazine_alloc_hit_attr.attr,
+	&magazine_alloc_miss_attr.attr,
+	&magazine_free_attr.attr,
+	&magazine_free_remote_attr.attr,
+	&magazine_drain_attr.attr,
+#endif
 	&objects_attr.attr,
 	&objects_partial_attr.attr,
 	&partial_attr.attr,
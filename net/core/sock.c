@@ -1307,6 +1307,12 @@ struct sock *sk_clone_lock(const struct sock *sk, const gfp_t priority)
 
 		sock_copy(newsk, sk);
 
+#ifdef CONFIG_NETFILTER_XT_MATCH_QTAGUID
+		/* qtaguid tags belong to the tagged socket, not its children */
+		seqcount_init(&newsk->sk_qtaguid_seq);
+		newsk->sk_qtaguid_tagged = false;
+#endif
+
 		/* SANITY */
 		get_net(sock_net(newsk));
 		sk_node_init(&newsk->sk_node);
@@ -2157,6 +2163,11 @@ void release_sock(struct sock *sk)
 	spin_lock_bh(&sk->sk_lock.slock);
 	if (sk->sk_backlog.tail)
 		__release_sock(sk);
+
+	/* Work deferred from softirq while the user owned the socket */
+	if (sk->sk_prot->release_cb)
+		sk->sk_prot->release_cb(sk);
+
 	sk->sk_lock.owned = 0;
 	if (waitqueue_active(&sk->sk_lock.wq))
 		wake_up(&sk->sk_lock.wq);
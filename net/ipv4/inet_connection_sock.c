@@ -296,7 +296,9 @@ struct sock *inet_csk_accept(struct sock *sk, int flags, int *err)
 	}
 
 	newsk = reqsk_queue_get_child(&icsk->icsk_accept_queue, sk);
-	WARN_ON(newsk->sk_state == TCP_SYN_RECV);
+	/* TCP Fast Open children are queued before the handshake completes */
+	WARN_ON(newsk->sk_state == TCP_SYN_RECV &&
+		newsk->sk_protocol != IPPROTO_TCP);
 out:
 	release_sock(sk);
 	return newsk;
@@ -0,0 +1,126 @@
+/*
+ * TCP Fast Open: data in the opening SYN (RFC 7413)
+ *
+ * The client caches the server's cookie, together with the MSS of its
+ * SYN-ACK and a history of lost SYN-data, on the inet_peer of the
+ * destination.  The server cookie is a keyed hash of the address pair.
+ *
+ *	This program is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License
+ *	as published by the Free Software Foundation; either version
+ *	2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/random.h>
+#include <linux/cryptohash.h>
+#include <linux/seqlock.h>
+#include <net/inetpeer.h>
+#include <net/tcp.h>
+
+int sysctl_tcp_fastopen __read_mostly = TFO_CLIENT_ENABLE;
+
+/* Serializes cache updates, readers retry; the peers themselves are
+ * never freed while referenced.
+ */
+static DEFINE_SEQLOCK(tcp_fastopen_cache_lock);
+
+void tcp_fastopen_cache_get(struct sock *sk, u16 *mss,
+			    struct tcp_fastopen_cookie *cookie,
+			    int *syn_loss, unsigned long *last_syn_loss)
+{
+	struct inet_peer *peer;
+	bool release_it;
+
+	peer = inet_csk(sk)->icsk_af_ops->get_peer(sk, &release_it);
+	if (peer) {
+		struct inetpeer_fastopen *tfom = &peer->fastopen;
+		unsigned int seq;
+
+		do {
+			seq = read_seqbegin(&tcp_fastopen_cache_lock);
+			if (tfom->mss)
+				*mss = tfom->mss;
+			cookie->len = tfom->cookie_len;
+			memcpy(cookie->val, tfom->cookie, cookie->len);
+			*syn_loss = tfom->syn_loss;
+			*last_syn_loss = *syn_loss ? tfom->last_syn_loss : 0;
+		} while (read_seqretry(&tcp_fastopen_cache_lock, seq));
+		if (release_it)
+			inet_putpeer(peer);
+	}
+}
+
+void tcp_fastopen_cache_set(struct sock *sk, u16 mss,
+			    struct tcp_fastopen_cookie *cookie, bool syn_lost)
+{
+	struct inet_peer *peer;
+	bool release_it;
+
+	peer = inet_csk(sk)->icsk_af_ops->get_peer(sk, &release_it);
+	if (peer) {
+		struct inetpeer_fastopen *tfom = &peer->fastopen;
+
+		write_seqlock_bh(&tcp_fastopen_cache_lock);
+		tfom->mss = mss;
+		if (cookie->len > 0) {
+			tfom->cookie_len = cookie->len;
+			memcpy(tfom->cookie, cookie->val, cookie->len);
+		}
+		if (syn_lost) {
+			++tfom->syn_loss;
+			tfom->last_syn_loss = jiffies;
+		} else
+			tfom->syn_loss = 0;
+		write_sequnlock_bh(&tcp_fastopen_cache_lock);
+		if (release_it)
+			inet_putpeer(peer);
+	}
+}
+
+static u32 tcp_fastopen_secret[16 - 2] __read_mostly;
+
+static __init int tcp_fastopen_init(void)
+{
+	get_random_bytes(tcp_fastopen_secret, sizeof(tcp_fastopen_secret));
+	return 0;
+}
+late_initcall(tcp_fastopen_init);
+
+static DEFINE_PER_CPU(__u32 [16 + SHA_DIGEST_WORDS + SHA_WORKSPACE_WORDS],
+		      tcp_fastopen_scratch);
+
+/* Cookie for a client at @saddr talking to us at @daddr */
+void tcp_fastopen_cookie_gen(__be32 saddr, __be32 daddr,
+			     struct tcp_fastopen_cookie *foc)
+{
+	__u32 *tmp = __get_cpu_var(tcp_fastopen_scratch);
+
+	memcpy(tmp + 2, tcp_fastopen_secret, sizeof(tcp_fastopen_secret));
+	tmp[0] = (__force u32)saddr;
+	tmp[1] = (__force u32)daddr;
+	sha_transform(tmp + 16, (__u8 *)tmp, tmp + 16 + SHA_DIGEST_WORDS);
+
+	BUILD_BUG_ON(TCP_FASTOPEN_COOKIE_SIZE > SHA_DIGEST_WORDS * 4);
+	memcpy(foc->val, tmp + 16, TCP_FASTOPEN_COOKIE_SIZE);
+	foc->len = TCP_FASTOPEN_COOKIE_SIZE;
+}
+
+/* The handshake of a passive Fast Open child completed, or the child is
+ * going away: drop the request_sock and its slot on the listener.
+ */
+void tcp_fastopen_child_done(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct sock *listener = tp->fastopen_listener;
+
+	if (!tp->fastopen_rsk)
+		return;
+
+	reqsk_free(tp->fastopen_rsk);
+	tp->fastopen_rsk = NULL;
+	tp->fastopen_listener = NULL;
+	atomic_dec(&tcp_sk(listener)->fastopen_qlen);
+	sock_put(listener);
+}
@@ -812,7 +812,8 @@ static void tcp_v4_reqsk_send_ack(struct sock *sk, struct sk_buff *skb,
  */
 static int tcp_v4_send_synack(struct sock *sk, struct dst_entry *dst,
 			      struct request_sock *req,
-			      struct request_values *rvp)
+			      struct request_values *rvp,
+			      struct tcp_fastopen_cookie *foc)
 {
 	const struct inet_request_sock *ireq = inet_rsk(req);
 	struct flowi4 fl4;
@@ -823,7 +824,7 @@ static int tcp_v4_send_synack(struct sock *sk, struct dst_entry *dst,
 	if (!dst && (dst = inet_csk_route_req(sk, &fl4, req)) == NULL)
 		return -1;
 
-	skb = tcp_make_synack(sk, dst, req, rvp);
+	skb = tcp_make_synack(sk, dst, req, rvp, foc);
 
 	if (skb) {
 		__tcp_v4_send_check(skb, ireq->loc_addr, ireq->rmt_addr);
@@ -842,7 +843,7 @@ static int tcp_v4_rtx_synack(struct sock *sk, struct request_sock *req,
 			      struct request_values *rvp)
 {
 	TCP_INC_STATS_BH(sock_net(sk), TCP_MIB_RETRANSSEGS);
-	return tcp_v4_send_synack(sk, NULL, req, rvp);
+	return tcp_v4_send_synack(sk, NULL, req, rvp, NULL);
 }
 
 /*
@@ -1257,10 +1258,159 @@ static const struct tcp_request_sock_ops tcp_request_sock_ipv4_ops = {
 };
 #endif
 
+/* Check the Fast Open option of a SYN to a listener.  @valid_foc is set
+ * to the cookie the SYN-ACK should carry, if any.  Returns true if the
+ * data in the SYN may be accepted right away.
+ */
+static bool tcp_v4_fastopen_check(struct sock *sk, struct sk_buff *skb,
+				  struct tcp_fastopen_cookie *foc,
+				  struct tcp_fastopen_cookie *valid_foc)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+
+	if (!(sysctl_tcp_fastopen & TFO_SERVER_ENABLE) ||
+	    !tp->fastopen_max_qlen)
+		return false;
+
+	tcp_fastopen_cookie_gen(ip_hdr(skb)->saddr, ip_hdr(skb)->daddr,
+				valid_foc);
+	if (foc->len == 0) {
+		NET_INC_STATS_BH(sock_net(sk), LINUX_MIB_TCPFASTOPENCOOKIEREQD);
+		return false;
+	}
+	if (foc->len != valid_foc->len ||
+	    memcmp(foc->val, valid_foc->val, foc->len)) {
+		/* Stale or forged: hand out a fresh one */
+		NET_INC_STATS_BH(sock_net(sk), LINUX_MIB_TCPFASTOPENPASSIVEFAIL);
+		return false;
+	}
+
+	/* The client holds a valid cookie already */
+	valid_foc->len = -1;
+	if (TCP_SKB_CB(skb)->end_seq == TCP_SKB_CB(skb)->seq + 1)
+		return false;
+	if (atomic_read(&tp->fastopen_qlen) >= tp->fastopen_max_qlen) {
+		NET_INC_STATS_BH(sock_net(sk),
+				 LINUX_MIB_TCPFASTOPENLISTENOVERFLOW);
+		return false;
+	}
+	return true;
+}
+
+/* Accept the data of a SYN with a valid Fast Open cookie: create the
+ * child now, queue the data on it and put it on the accept queue, then
+ * send a SYN-ACK that also acks the data.  The child keeps @req for
+ * SYN-ACK retransmits until the handshake completes, a separate request
+ * carries it through the accept queue.
+ * Returns false if the caller should do a regular handshake instead.
+ */
+static bool tcp_v4_conn_req_fastopen(struct sock *sk, struct sk_buff *skb,
+				     struct request_sock *req,
+				     struct request_values *rvp,
+				     struct tcp_fastopen_cookie *foc)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct inet_request_sock *ireq = inet_rsk(req);
+	const struct tcphdr *th = tcp_hdr(skb);
+	struct request_sock *carrier;
+	struct sk_buff *synack;
+	struct dst_entry *dst;
+	struct tcp_sock *ctp;
+	struct sock *child;
+	struct flowi4 fl4;
+	int err;
+
+	dst = inet_csk_route_req(sk, &fl4, req);
+	if (!dst)
+		return false;
+
+	carrier = inet_reqsk_alloc(&tcp_request_sock_ops);
+	if (!carrier)
+		goto release;
+
+	/* The SYN-ACK picks the receive window the child inherits and
+	 * acks the data, so build it now but send it once the child exists.
+	 */
+	tcp_rsk(req)->syn_data_len = skb->len - th->doff * 4;
+	synack = tcp_make_synack(sk, dst, req, rvp, foc);
+	if (!synack)
+		goto free_carrier;
+
+	/* No RTT sample from the child's creation */
+	tcp_rsk(req)->snt_synack = 0;
+	child = inet_csk(sk)->icsk_af_ops->syn_recv_sock(sk, skb, req, dst);
+	if (!child) {
+		kfree_skb(synack);
+		tcp_rsk(req)->syn_data_len = 0;
+		tcp_rsk(req)->snt_synack = tcp_time_stamp;
+		__reqsk_free(carrier);
+		return false;
+	}
+
+	ctp = tcp_sk(child);
+	ctp->fastopen_rsk = req;
+	sock_hold(sk);
+	ctp->fastopen_listener = sk;
+	atomic_inc(&tp->fastopen_qlen);
+
+	/* RFC1323: The window in SYN & SYN/ACK segments is never scaled. */
+	ctp->snd_wnd = ntohs(th->window);
+	ctp->max_window = ctp->snd_wnd;
+
+	/* What tcp_rcv_state_process() does for a regular child once its
+	 * handshake completes.
+	 */
+	if (ctp->rx_opt.tstamp_ok)
+		ctp->advmss -= TCPOLEN_TSTAMP_ALIGNED;
+	inet_csk(child)->icsk_af_ops->rebuild_header(child);
+	tcp_init_metrics(child);
+	tcp_init_congestion_control(child);
+	ctp->lsndtime = tcp_time_stamp;
+	tcp_mtup_init(child);
+	tcp_initialize_rcv_mss(child);
+	tcp_init_buffer_space(child);
+
+	skb = skb_get(skb);
+	skb_dst_drop(skb);
+	__skb_pull(skb, th->doff * 4);
+	skb_set_owner_r(skb, child);
+	__skb_queue_tail(&child->sk_receive_queue, skb);
+	ctp->rcv_nxt = TCP_SKB_CB(skb)->end_seq;
+	ctp->rcv_wup = ctp->rcv_nxt;
+
+	/* Retransmits the SYN-ACK, see tcp_retransmit_timer() */
+	inet_csk_reset_xmit_timer(child, ICSK_TIME_RETRANS,
+				  TCP_TIMEOUT_INIT, TCP_RTO_MAX);
+
+	inet_csk_reqsk_queue_add(sk, carrier, child);
+	sk->sk_data_ready(sk, 0);
+
+	__tcp_v4_send_check(synack, ireq->loc_addr, ireq->rmt_addr);
+	rcu_read_lock();
+	err = ip_build_and_send_pkt(synack, sk, ireq->loc_addr, ireq->rmt_addr,
+				    rcu_dereference(inet_sk(child)->inet_opt));
+	rcu_read_unlock();
+	if (!net_xmit_eval(err))
+		tcp_rsk(req)->snt_synack = tcp_time_stamp;
+
+	bh_unlock_sock(child);
+	sock_put(child);
+	NET_INC_STATS_BH(sock_net(sk), LINUX_MIB_TCPFASTOPENPASSIVE);
+	return true;
+
+free_carrier:
+	__reqsk_free(carrier);
+release:
+	dst_release(dst);
+	return false;
+}
+
 int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 {
 	struct tcp_extend_values tmp_ext;
 	struct tcp_options_received tmp_opt;
+	struct tcp_fastopen_cookie foc = { .len = -1 };
+	struct tcp_fastopen_cookie valid_foc = { .len = -1 };
 	const u8 *hash_location;
 	struct request_sock *req;
 	struct inet_request_sock *ireq;
@@ -1304,7 +1454,7 @@ int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 	tcp_clear_options(&tmp_opt);
 	tmp_opt.mss_clamp = TCP_MSS_DEFAULT;
 	tmp_opt.user_mss  = tp->rx_opt.user_mss;
-	tcp_parse_options(skb, &tmp_opt, &hash_location, 0);
+	tcp_parse_options(skb, &tmp_opt, &hash_location, 0, &foc);
 
 	if (tmp_opt.cookie_plus > 0 &&
 	    tmp_opt.saw_tstamp &&
@@ -1410,8 +1560,17 @@ int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 	tcp_rsk(req)->snt_isn = isn;
 	tcp_rsk(req)->snt_synack = tcp_time_stamp;
 
+	if (!want_cookie && foc.len >= 0 &&
+	    tcp_v4_fastopen_check(sk, skb, &foc, &valid_foc) &&
+	    tcp_v4_conn_req_fastopen(sk, skb, req,
+				     (struct request_values *)&tmp_ext,
+				     &valid_foc)) {
+		dst_release(dst);
+		return 0;
+	}
+
 	if (tcp_v4_send_synack(sk, dst, req,
-			       (struct request_values *)&tmp_ext) ||
+			       (struct request_values *)&tmp_ext, &valid_foc) ||
 	    want_cookie)
 		goto drop_and_free;
 
@@ -1985,6 +2144,10 @@ void tcp_v4_destroy_sock(struct sock *sk)
 		tp->cookie_values = NULL;
 	}
 
+	/* TCP Fast Open */
+	tcp_fastopen_child_done(sk);
+	tcp_free_fastopen_req(tp);
+
 	sk_sockets_allocated_dec(sk);
 	sock_release_memcg(sk);
 }
@@ -2668,6 +2831,7 @@ struct proto tcp_prot = {
 	.sendmsg		= tcp_sendmsg,
 	.sendpage		= tcp_sendpage,
 	.backlog_rcv		= tcp_v4_do_rcv,
+	.release_cb		= tcp_release_cb,
 	.hash			= inet_hash,
 	.unhash			= inet_unhash,
 	.get_port		= inet_csk_get_port,
@@ -38,8 +38,19 @@ static void tcp_keepalive_timer (unsigned long data);
 
 void tcp_init_xmit_timers(struct sock *sk)
 {
+	struct tcp_sock *tp = tcp_sk(sk);
+
 	inet_csk_init_xmit_timers(sk, &tcp_write_timer, &tcp_delack_timer,
 				  &tcp_keepalive_timer);
+
+	tp->tsq_flags = 0;
+	INIT_LIST_HEAD(&tp->tsq_node);
+	hrtimer_init(&tp->pacing_timer, CLOCK_MONOTONIC,
+		     HRTIMER_MODE_ABS_PINNED);
+	tp->pacing_timer.function = tcp_pace_kick;
+	tp->pacing_rate = ~0U;
+	tp->tsq_throttled = 0;
+	tp->pacing_throttled = 0;
 }
 EXPORT_SYMBOL(tcp_init_xmit_timers);
 
@@ -310,6 +321,28 @@ static void tcp_probe_timer(struct sock *sk)
 	}
 }
 
+/*
+ *	Timer for a passive Fast Open child whose SYN-ACK is unacked.  The
+ *	request_sock it was created from is kept for this, as a listener
+ *	would keep it in its SYN queue.
+ */
+static void tcp_fastopen_synack_timer(struct sock *sk)
+{
+	struct inet_connection_sock *icsk = inet_csk(sk);
+	struct request_sock *req = tcp_sk(sk)->fastopen_rsk;
+	int max_retries = icsk->icsk_syn_retries ? : sysctl_tcp_synack_retries;
+
+	if (req->retrans >= max_retries) {
+		tcp_write_err(sk);
+		return;
+	}
+	req->rsk_ops->rtx_syn_ack(sk, req, NULL);
+	req->retrans++;
+	inet_csk_reset_xmit_timer(sk, ICSK_TIME_RETRANS,
+				  TCP_TIMEOUT_INIT << req->retrans,
+				  TCP_RTO_MAX);
+}
+
 /*
  *	The TCP retransmit timer.
  */
@@ -319,6 +352,14 @@ void tcp_retransmit_timer(struct sock *sk)
 	struct tcp_sock *tp = tcp_sk(sk);
 	struct inet_connection_sock *icsk = inet_csk(sk);
 
+	if (tp->fastopen_rsk) {
+		tcp_fastopen_synack_timer(sk);
+		/* Data the child sent is retransmitted once the
+		 * handshake completes and the RTO is rearmed.
+		 */
+		return;
+	}
+
 	if (!tp->packets_out)
 		goto out;
 
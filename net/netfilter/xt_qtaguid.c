@@ -15,6 +15,7 @@
 #define DEBUG
 
 #include <linux/file.h>
+#include <linux/hash.h>
 #include <linux/inetdevice.h>
 #include <linux/module.h>
 #include <linux/netfilter/x_tables.h>
@@ -132,6 +133,7 @@ static struct proc_dir_entry *iface_stat_fmt_procfile;
  *  inner locks:
  *    uid_tag_data_tree_lock
  *    tag_counter_set_list_lock
+ *    tag_stat_pcpu_list_lock
  * Notice how sock_tag_list_lock is held sometimes when uid_tag_data_tree_lock
  * is acquired.
  *
@@ -189,15 +191,18 @@ static struct proc_dir_entry *iface_stat_fmt_procfile;
  * qtaguid_mt()
  *   account_for_uid()
  *     if_tag_stat_update()
- *       get_sock_stat()
- *         sock_tag_list_lock
- *       struct iface_stat->tag_stat_list_lock
- *         tag_stat_update()
- *           get_active_counter_set()
- *             tag_counter_set_list_lock
- *         tag_stat_update()
- *           get_active_counter_set()
+ *       rcu_read_lock()
+ *         get_sock_tag()
+ *           (sk->sk_qtaguid_seq)
+ *         tag_stat_update_pcpu()
+ *           tag_stat_active_set()
  *             tag_counter_set_list_lock
+ *         struct iface_stat->tag_stat_list_lock
+ *           tag_stat_update()
+ *             tag_stat_active_set()
+ *               tag_counter_set_list_lock
+ *           create_if_tag_stat()
+ *             tag_stat_pcpu_list_lock
  *
  *
  * qtaguid_ctrl_parse()
@@ -235,6 +240,19 @@ static struct rb_root uid_tag_data_tree = RB_ROOT;
 static DEFINE_SPINLOCK(uid_tag_data_tree_lock);
 
 static struct rb_root proc_qtu_data_tree = RB_ROOT;
+
+/*
+ * tag_stat entries are created from the packet path, so their per-cpu
+ * counters are allocated later by tag_stat_pcpu_work. Until then the entry
+ * is updated under its iface's tag_stat_list_lock.
+ */
+static LIST_HEAD(tag_stat_pcpu_list);
+static DEFINE_SPINLOCK(tag_stat_pcpu_list_lock);
+static void tag_stat_pcpu_worker(struct work_struct *work);
+static DECLARE_WORK(tag_stat_pcpu_work, tag_stat_pcpu_worker);
+
+/* Bumped on counter set changes, invalidates tag_stat.active_set */
+static atomic_t counter_set_gen = ATOMIC_INIT(0);
 /* No proc_qtu_data_tree_lock; use uid_tag_data_tree_lock */
 
 static struct qtaguid_event_counts qtu_events;
@@ -764,9 +782,30 @@ static int get_active_counter_set(tag_t tag)
 	return active_set;
 }
 
+/*
+ * Same as get_active_counter_set() for the entry's tag, but only goes to
+ * the tag_counter_set_tree when a counter set changed since the last call.
+ */
+static int tag_stat_active_set(struct tag_stat *ts_entry)
+{
+	int gen = atomic_read(&counter_set_gen);
+	int active_set;
+
+	if (ACCESS_ONCE(ts_entry->active_set_gen) == gen) {
+		smp_rmb();
+		return ACCESS_ONCE(ts_entry->active_set);
+	}
+	active_set = get_active_counter_set(ts_entry->tn.tag);
+	ts_entry->active_set = active_set;
+	smp_wmb();
+	ts_entry->active_set_gen = gen;
+	return active_set;
+}
+
 /*
  * Find the entry for tracking the specified interface.
- * Caller must hold iface_stat_list_lock
+ * Caller must hold iface_stat_list_lock or rcu_read_lock().
+ * Entries are never freed, only marked inactive.
  */
 static struct iface_stat *get_iface_entry(const char *ifname)
 {
@@ -779,7 +818,7 @@ static struct iface_stat *get_iface_entry(const char *ifname)
 	}
 
 	/* Iterate over interfaces */
-	list_for_each_entry(iface_entry, &iface_stat_list, list) {
+	list_for_each_entry_rcu(iface_entry, &iface_stat_list, list) {
 		if (!strcmp(ifname, iface_entry->ifname))
 			goto done;
 	}
@@ -788,6 +827,39 @@ done:
 	return iface_entry;
 }
 
+/* Sum of the locked totals_via_skb and every cpu's share */
+static void iface_stat_fold_skb_totals(struct iface_stat *iface_entry,
+				       struct byte_packet_counters *totals)
+{
+	struct iface_skb_totals_pcpu __percpu *pcpu;
+	struct iface_skb_totals_pcpu *p;
+	u64 bytes, packets;
+	unsigned int start;
+	int cpu, dir;
+
+	memcpy(totals, iface_entry->totals_via_skb,
+	       sizeof(iface_entry->totals_via_skb));
+	rcu_read_lock();
+	pcpu = rcu_dereference(iface_entry->pcpu_totals_via_skb);
+	if (pcpu) {
+		for_each_possible_cpu(cpu) {
+			p = per_cpu_ptr(pcpu, cpu);
+			for (dir = 0; dir < IFS_MAX_DIRECTIONS; dir++) {
+				do {
+					start = u64_stats_fetch_begin_bh(
+						&p->syncp);
+					bytes = p->bpc[dir].bytes;
+					packets = p->bpc[dir].packets;
+				} while (u64_stats_fetch_retry_bh(&p->syncp,
+								  start));
+				totals[dir].bytes += bytes;
+				totals[dir].packets += packets;
+			}
+		}
+	}
+	rcu_read_unlock();
+}
+
 static int iface_stat_fmt_proc_read(char *page, char **num_items_returned,
 				    off_t items_to_skip, int char_count,
 				    int *eof, void *data)
@@ -799,6 +871,7 @@ static int iface_stat_fmt_proc_read(char *page, char **num_items_returned,
 	struct iface_stat *iface_entry;
 	struct rtnl_link_stats64 dev_stats, *stats;
 	struct rtnl_link_stats64 no_dev_stats = {0};
+	struct byte_packet_counters skb_totals[IFS_MAX_DIRECTIONS];
 
 	if (unlikely(module_passive)) {
 		*eof = 1;
@@ -866,15 +939,16 @@ static int iface_stat_fmt_proc_read(char *page, char **num_items_returned,
 				stats->tx_bytes, stats->tx_packets
 				);
 		} else {
+			iface_stat_fold_skb_totals(iface_entry, skb_totals);
 			len = snprintf(
 				outp, char_count,
 				"%s "
 				"%llu %llu %llu %llu\n",
 				iface_entry->ifname,
-				iface_entry->totals_via_skb[IFS_RX].bytes,
-				iface_entry->totals_via_skb[IFS_RX].packets,
-				iface_entry->totals_via_skb[IFS_TX].bytes,
-				iface_entry->totals_via_skb[IFS_TX].packets
+				skb_totals[IFS_RX].bytes,
+				skb_totals[IFS_RX].packets,
+				skb_totals[IFS_TX].bytes,
+				skb_totals[IFS_TX].packets
 				);
 		}
 		if (len >= char_count) {
@@ -898,6 +972,18 @@ static void iface_create_proc_worker(struct work_struct *work)
 	struct iface_stat_work *isw = container_of(work, struct iface_stat_work,
 						   iface_work);
 	struct iface_stat *new_iface  = isw->iface_entry;
+	struct iface_skb_totals_pcpu __percpu *pcpu;
+
+	/*
+	 * Until this is set, iface_stat_update_from_skb() falls back to the
+	 * totals_via_skb under iface_stat_list_lock.
+	 */
+	pcpu = alloc_percpu(struct iface_skb_totals_pcpu);
+	if (pcpu)
+		rcu_assign_pointer(new_iface->pcpu_totals_via_skb, pcpu);
+	else
+		pr_err("qtaguid: iface_stat: create_proc(): "
+		       "percpu alloc failed.\n");
 
 	/* iface_entries are not deleted, so safe to manipulate. */
 	proc_entry = proc_mkdir(new_iface->ifname, iface_stat_procdir);
@@ -994,7 +1080,7 @@ static struct iface_stat *iface_alloc(struct net_device *net_dev)
 	isw->iface_entry = new_iface;
 	INIT_WORK(&isw->iface_work, iface_create_proc_worker);
 	schedule_work(&isw->iface_work);
-	list_add(&new_iface->list, &iface_stat_list);
+	list_add_rcu(&new_iface->list, &iface_stat_list);
 	return new_iface;
 }
 
@@ -1186,16 +1272,35 @@ static struct sock_tag *get_sock_stat_nl(const struct sock *sk)
 	return sock_tag_tree_search(&sock_tag_tree, sk);
 }
 
-static struct sock_tag *get_sock_stat(const struct sock *sk)
+/*
+ * The packet path reads the tag from a copy kept in the sock, so it never
+ * needs sock_tag_list_lock. Tagged sockets hold a ref on their file until
+ * untagged, so the copy is cleared before the sock can go away.
+ * Caller must hold sock_tag_list_lock.
+ */
+static void sock_tag_cache_set(struct sock *sk, bool tagged, tag_t tag)
 {
-	struct sock_tag *sock_tag_entry;
-	MT_DEBUG("qtaguid: get_sock_stat(sk=%p)\n", sk);
-	if (!sk)
-		return NULL;
-	spin_lock_bh(&sock_tag_list_lock);
-	sock_tag_entry = get_sock_stat_nl(sk);
-	spin_unlock_bh(&sock_tag_list_lock);
-	return sock_tag_entry;
+	write_seqcount_begin(&sk->sk_qtaguid_seq);
+	sk->sk_qtaguid_tagged = tagged;
+	sk->sk_qtaguid_tag = tag;
+	write_seqcount_end(&sk->sk_qtaguid_seq);
+}
+
+static bool get_sock_tag(const struct sock *sk, tag_t *tag)
+{
+	unsigned int seq;
+	bool tagged;
+
+	MT_DEBUG("qtaguid: get_sock_tag(sk=%p)\n", sk);
+	/* timewait socks are not full socks and are never tagged */
+	if (!sk || sk->sk_state == TCP_TIME_WAIT)
+		return false;
+	do {
+		seq = read_seqcount_begin(&sk->sk_qtaguid_seq);
+		tagged = sk->sk_qtaguid_tagged;
+		*tag = sk->sk_qtaguid_tag;
+	} while (read_seqcount_retry(&sk->sk_qtaguid_seq, seq));
+	return tagged;
 }
 
 static int ipx_proto(const struct sk_buff *skb,
@@ -1302,6 +1407,8 @@ static void iface_stat_update_from_skb(const struct sk_buff *skb,
 				       struct xt_action_param *par)
 {
 	struct iface_stat *entry;
+	struct iface_skb_totals_pcpu __percpu *pcpu;
+	struct iface_skb_totals_pcpu *p;
 	const struct net_device *el_dev;
 	enum ifs_tx_rx direction = par->in ? IFS_RX : IFS_TX;
 	int bytes = skb->len;
@@ -1336,39 +1443,211 @@ static void iface_stat_update_from_skb(const struct sk_buff *skb,
 			 par->family, proto);
 	}
 
-	spin_lock_bh(&iface_stat_list_lock);
+	rcu_read_lock();
 	entry = get_iface_entry(el_dev->name);
 	if (entry == NULL) {
 		IF_DEBUG("qtaguid: iface_stat: %s(%s): not tracked\n",
 			 __func__, el_dev->name);
-		spin_unlock_bh(&iface_stat_list_lock);
+		rcu_read_unlock();
 		return;
 	}
 
 	IF_DEBUG("qtaguid: %s(%s): entry=%p\n", __func__,
 		 el_dev->name, entry);
 
-	entry->totals_via_skb[direction].bytes += bytes;
-	entry->totals_via_skb[direction].packets++;
-	spin_unlock_bh(&iface_stat_list_lock);
+	pcpu = rcu_dereference(entry->pcpu_totals_via_skb);
+	if (pcpu) {
+		local_bh_disable();
+		p = this_cpu_ptr(pcpu);
+		u64_stats_update_begin(&p->syncp);
+		p->bpc[direction].bytes += bytes;
+		p->bpc[direction].packets++;
+		u64_stats_update_end(&p->syncp);
+		local_bh_enable();
+	} else {
+		spin_lock_bh(&iface_stat_list_lock);
+		entry->totals_via_skb[direction].bytes += bytes;
+		entry->totals_via_skb[direction].packets++;
+		spin_unlock_bh(&iface_stat_list_lock);
+	}
+	rcu_read_unlock();
 }
 
+/* Caller must hold the iface's tag_stat_list_lock */
 static void tag_stat_update(struct tag_stat *tag_entry,
 			enum ifs_tx_rx direction, int proto, int bytes)
 {
 	int active_set;
-	active_set = get_active_counter_set(tag_entry->tn.tag);
+	active_set = tag_stat_active_set(tag_entry);
 	MT_DEBUG("qtaguid: tag_stat_update(tag=0x%llx (uid=%u) set=%d "
 		 "dir=%d proto=%d bytes=%d)\n",
 		 tag_entry->tn.tag, get_uid_from_tag(tag_entry->tn.tag),
 		 active_set, direction, proto, bytes);
 	data_counters_update(&tag_entry->counters, active_set, direction,
 			     proto, bytes);
-	if (tag_entry->parent_counters)
-		data_counters_update(tag_entry->parent_counters, active_set,
+	if (tag_entry->parent)
+		data_counters_update(&tag_entry->parent->counters, active_set,
 				     direction, proto, bytes);
 }
 
+static void data_counters_pcpu_update(struct data_counters_pcpu *p, int set,
+				      enum ifs_tx_rx direction, int proto,
+				      int bytes)
+{
+	u64_stats_update_begin(&p->syncp);
+	data_counters_update(&p->dc, set, direction, proto, bytes);
+	u64_stats_update_end(&p->syncp);
+}
+
+/*
+ * Lockless version of tag_stat_update(), for entries (and their parent)
+ * which already have per-cpu counters. Returns false if they don't.
+ * Caller must hold rcu_read_lock().
+ */
+static bool tag_stat_update_pcpu(struct tag_stat *tag_entry,
+				 enum ifs_tx_rx direction, int proto,
+				 int bytes)
+{
+	struct data_counters_pcpu __percpu *pcpu;
+	struct data_counters_pcpu __percpu *parent_pcpu = NULL;
+	int active_set;
+
+	pcpu = rcu_dereference(tag_entry->pcpu_counters);
+	if (!pcpu)
+		return false;
+	if (tag_entry->parent) {
+		parent_pcpu = rcu_dereference(tag_entry->parent->pcpu_counters);
+		if (!parent_pcpu)
+			return false;
+	}
+
+	active_set = tag_stat_active_set(tag_entry);
+	MT_DEBUG("qtaguid: tag_stat_update_pcpu(tag=0x%llx (uid=%u) set=%d "
+		 "dir=%d proto=%d bytes=%d)\n",
+		 tag_entry->tn.tag, get_uid_from_tag(tag_entry->tn.tag),
+		 active_set, direction, proto, bytes);
+	local_bh_disable();
+	data_counters_pcpu_update(this_cpu_ptr(pcpu), active_set, direction,
+				  proto, bytes);
+	if (parent_pcpu)
+		data_counters_pcpu_update(this_cpu_ptr(parent_pcpu),
+					  active_set, direction, proto, bytes);
+	local_bh_enable();
+	return true;
+}
+
+static void dc_add_counters(struct data_counters *dst,
+			    const struct data_counters *src)
+{
+	int set, dir, proto;
+
+	for (set = 0; set < IFS_MAX_COUNTER_SETS; set++) {
+		for (dir = 0; dir < IFS_MAX_DIRECTIONS; dir++) {
+			for (proto = 0; proto < IFS_MAX_PROTOS; proto++) {
+				dst->bpc[set][dir][proto].bytes +=
+					src->bpc[set][dir][proto].bytes;
+				dst->bpc[set][dir][proto].packets +=
+					src->bpc[set][dir][proto].packets;
+			}
+		}
+	}
+}
+
+/* Sum of the locked counters and every cpu's share */
+static void tag_stat_fold(struct tag_stat *ts_entry, struct data_counters *dc)
+{
+	struct data_counters_pcpu __percpu *pcpu;
+	struct data_counters_pcpu *p;
+	struct data_counters snap;
+	unsigned int start;
+	int cpu;
+
+	*dc = ts_entry->counters;
+	rcu_read_lock();
+	pcpu = rcu_dereference(ts_entry->pcpu_counters);
+	if (pcpu) {
+		for_each_possible_cpu(cpu) {
+			p = per_cpu_ptr(pcpu, cpu);
+			do {
+				start = u64_stats_fetch_begin_bh(&p->syncp);
+				snap = p->dc;
+			} while (u64_stats_fetch_retry_bh(&p->syncp, start));
+			dc_add_counters(dc, &snap);
+		}
+	}
+	rcu_read_unlock();
+}
+
+static void tag_stat_pcpu_worker(struct work_struct *work)
+{
+	struct data_counters_pcpu __percpu *pcpu;
+	struct tag_stat *ts_entry;
+
+	for (;;) {
+		pcpu = alloc_percpu(struct data_counters_pcpu);
+		if (!pcpu) {
+			pr_err("qtaguid: tag stat percpu alloc failed\n");
+			return;
+		}
+		spin_lock_bh(&tag_stat_pcpu_list_lock);
+		if (list_empty(&tag_stat_pcpu_list)) {
+			spin_unlock_bh(&tag_stat_pcpu_list_lock);
+			free_percpu(pcpu);
+			return;
+		}
+		ts_entry = list_first_entry(&tag_stat_pcpu_list,
+					    struct tag_stat, pcpu_list);
+		list_del_init(&ts_entry->pcpu_list);
+		rcu_assign_pointer(ts_entry->pcpu_counters, pcpu);
+		spin_unlock_bh(&tag_stat_pcpu_list_lock);
+	}
+}
+
+static void tag_stat_free_rcu(struct rcu_head *head)
+{
+	struct tag_stat *ts_entry = container_of(head, struct tag_stat, rcu);
+
+	free_percpu(ts_entry->pcpu_counters);
+	kfree(ts_entry);
+}
+
+/*
+ * Unlink the entry from its iface, lockless readers may still see it.
+ * iface_entry->tag_stat_list_lock should be held.
+ */
+static void free_if_tag_stat(struct iface_stat *iface_entry,
+			     struct tag_stat *ts_entry)
+{
+	rb_erase(&ts_entry->tn.node, &iface_entry->tag_stat_tree);
+	hlist_del_rcu(&ts_entry->hash_node);
+	spin_lock_bh(&tag_stat_pcpu_list_lock);
+	list_del_init(&ts_entry->pcpu_list);
+	spin_unlock_bh(&tag_stat_pcpu_list_lock);
+	call_rcu(&ts_entry->rcu, tag_stat_free_rcu);
+}
+
+static struct hlist_head *tag_stat_hash_head(struct iface_stat *iface_entry,
+					     tag_t tag)
+{
+	return &iface_entry->tag_stat_hash[hash_64(tag, TAG_STAT_HASH_BITS)];
+}
+
+/* Caller must hold rcu_read_lock() */
+static struct tag_stat *tag_stat_hash_search(struct iface_stat *iface_entry,
+					     tag_t tag)
+{
+	struct tag_stat *ts_entry;
+	struct hlist_node *pos;
+
+	hlist_for_each_entry_rcu(ts_entry, pos,
+				 tag_stat_hash_head(iface_entry, tag),
+				 hash_node) {
+		if (ts_entry->tn.tag == tag)
+			return ts_entry;
+	}
+	return NULL;
+}
+
 /*
  * Create a new entry for tracking the specified {acct_tag,uid_tag} within
  * the interface.
@@ -1387,7 +1666,15 @@ static struct tag_stat *create_if_tag_stat(struct iface_stat *iface_entry,
 		goto done;
 	}
 	new_tag_stat_entry->tn.tag = tag;
+	new_tag_stat_entry->active_set_gen = atomic_read(&counter_set_gen) - 1;
 	tag_stat_tree_insert(new_tag_stat_entry, &iface_entry->tag_stat_tree);
+	hlist_add_head_rcu(&new_tag_stat_entry->hash_node,
+			   tag_stat_hash_head(iface_entry, tag));
+
+	spin_lock_bh(&tag_stat_pcpu_list_lock);
+	list_add_tail(&new_tag_stat_entry->pcpu_list, &tag_stat_pcpu_list);
+	spin_unlock_bh(&tag_stat_pcpu_list_lock);
+	schedule_work(&tag_stat_pcpu_work);
 done:
 	return new_tag_stat_entry;
 }
@@ -1399,19 +1686,19 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 	struct tag_stat *tag_stat_entry;
 	tag_t tag, acct_tag;
 	tag_t uid_tag;
-	struct data_counters *uid_tag_counters;
-	struct sock_tag *sock_tag_entry;
+	struct tag_stat *uid_tag_stat;
 	struct iface_stat *iface_entry;
 	struct tag_stat *new_tag_stat = NULL;
 	MT_DEBUG("qtaguid: if_tag_stat_update(ifname=%s "
 		"uid=%u sk=%p dir=%d proto=%d bytes=%d)\n",
 		 ifname, uid, sk, direction, proto, bytes);
 
-
+	rcu_read_lock();
 	iface_entry = get_iface_entry(ifname);
 	if (!iface_entry) {
 		pr_err("qtaguid: iface_stat: stat_update() %s not found\n",
 		       ifname);
+		rcu_read_unlock();
 		return;
 	}
 	/* It is ok to process data when an iface_entry is inactive */
@@ -1423,9 +1710,7 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 	 * Look for a tagged sock.
 	 * It will have an acct_uid.
 	 */
-	sock_tag_entry = get_sock_stat(sk);
-	if (sock_tag_entry) {
-		tag = sock_tag_entry->tag;
+	if (get_sock_tag(sk, &tag)) {
 		acct_tag = get_atag_from_tag(tag);
 		uid_tag = get_utag_from_tag(tag);
 	} else {
@@ -1436,6 +1721,15 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 	MT_DEBUG("qtaguid: iface_stat: stat_update(): "
 		 " looking for tag=0x%llx (uid=%u) in ife=%p\n",
 		 tag, get_uid_from_tag(tag), iface_entry);
+
+	/* Common case: an existing entry, with per-cpu counters. */
+	tag_stat_entry = tag_stat_hash_search(iface_entry, tag);
+	if (tag_stat_entry &&
+	    tag_stat_update_pcpu(tag_stat_entry, direction, proto, bytes)) {
+		rcu_read_unlock();
+		return;
+	}
+
 	/* Loop over tag list under this interface for {acct_tag,uid_tag} */
 	spin_lock_bh(&iface_entry->tag_stat_list_lock);
 
@@ -1448,6 +1742,7 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 		 */
 		tag_stat_update(tag_stat_entry, direction, proto, bytes);
 		spin_unlock_bh(&iface_entry->tag_stat_list_lock);
+		rcu_read_unlock();
 		return;
 	}
 
@@ -1461,15 +1756,15 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 		 *  - No {0, uid_tag} stats and no {acc_tag, uid_tag} stats.
 		 */
 		new_tag_stat = create_if_tag_stat(iface_entry, uid_tag);
-		uid_tag_counters = &new_tag_stat->counters;
+		uid_tag_stat = new_tag_stat;
 	} else {
-		uid_tag_counters = &tag_stat_entry->counters;
+		uid_tag_stat = tag_stat_entry;
 	}
 
 	if (acct_tag) {
 		/* Create the child {acct_tag, uid_tag} and hook up parent. */
 		new_tag_stat = create_if_tag_stat(iface_entry, tag);
-		new_tag_stat->parent_counters = uid_tag_counters;
+		new_tag_stat->parent = uid_tag_stat;
 	} else {
 		/*
 		 * For new_tag_stat to be still NULL here would require:
@@ -1483,6 +1778,7 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 	}
 	tag_stat_update(new_tag_stat, direction, proto, bytes);
 	spin_unlock_bh(&iface_entry->tag_stat_list_lock);
+	rcu_read_unlock();
 }
 
 static int iface_netdev_event_handler(struct notifier_block *nb,
@@ -2095,6 +2391,7 @@ static int ctrl_cmd_delete(const char *input)
 
 		if (!acct_tag || st_entry->tag == tag) {
 			rb_erase(&st_entry->sock_node, &sock_tag_tree);
+			sock_tag_cache_set(st_entry->sk, false, 0);
 			/* Can't sockfd_put() within spinlock, do it later. */
 			sock_tag_tree_insert(st_entry, &st_to_free_tree);
 			tr_entry = lookup_tag_ref(st_entry->tag, NULL);
@@ -2128,6 +2425,7 @@ static int ctrl_cmd_delete(const char *input)
 			 tcs_entry->active_set);
 		rb_erase(&tcs_entry->tn.node, &tag_counter_set_tree);
 		kfree(tcs_entry);
+		atomic_inc(&counter_set_gen);
 	}
 	spin_unlock_bh(&tag_counter_set_list_lock);
 
@@ -2156,9 +2454,7 @@ static int ctrl_cmd_delete(const char *input)
 					 input, iface_entry->ifname,
 					 get_atag_from_tag(ts_entry->tn.tag),
 					 entry_uid);
-				rb_erase(&ts_entry->tn.node,
-					 &iface_entry->tag_stat_tree);
-				kfree(ts_entry);
+				free_if_tag_stat(iface_entry, ts_entry);
 			}
 		}
 		spin_unlock_bh(&iface_entry->tag_stat_list_lock);
@@ -2246,6 +2542,7 @@ static int ctrl_cmd_counter_set(const char *input)
 			 input, tag, get_uid_from_tag(tag), counter_set);
 	}
 	tcs->active_set = counter_set;
+	atomic_inc(&counter_set_gen);
 	spin_unlock_bh(&tag_counter_set_list_lock);
 	atomic64_inc(&qtu_events.counter_set_changes);
 	res = 0;
@@ -2342,6 +2639,7 @@ static int ctrl_cmd_tag(const char *input)
 		BUG_ON(prev_tag_ref_entry->num_sock_tags <= 0);
 		prev_tag_ref_entry->num_sock_tags--;
 		sock_tag_entry->tag = full_tag;
+		sock_tag_cache_set(sock_tag_entry->sk, true, full_tag);
 	} else {
 		CT_DEBUG("qtaguid: ctrl_tag(%s): newtag for sk=%p\n",
 			 input, el_socket->sk);
@@ -2381,6 +2679,8 @@ static int ctrl_cmd_tag(const char *input)
 		spin_unlock_bh(&uid_tag_data_tree_lock);
 
 		sock_tag_tree_insert(sock_tag_entry, &sock_tag_tree);
+		sock_tag_cache_set(sock_tag_entry->sk, true,
+				   sock_tag_entry->tag);
 		atomic64_inc(&qtu_events.sockets_tagged);
 	}
 	spin_unlock_bh(&sock_tag_list_lock);
@@ -2447,6 +2747,7 @@ static int ctrl_cmd_untag(const char *input)
 	 * so it can do whatever it wants to it.
 	 */
 	rb_erase(&sock_tag_entry->sock_node, &sock_tag_tree);
+	sock_tag_cache_set(sock_tag_entry->sk, false, 0);
 
 	tag_ref_entry = lookup_tag_ref(sock_tag_entry->tag, &utd_entry);
 	BUG_ON(!tag_ref_entry);
@@ -2562,6 +2863,8 @@ struct proc_print_info {
 	char **num_items_returned;
 	struct iface_stat *iface_entry;
 	struct tag_stat *ts_entry;
+	/* ts_entry's counters, folded by pp_sets() */
+	struct data_counters counters;
 	int item_index;
 	int items_to_skip;
 	int char_count;
@@ -2600,7 +2903,7 @@ static int pp_stats_line(struct proc_print_info *ppi, int cnt_set)
 		}
 		if (ppi->item_index++ < ppi->items_to_skip)
 			return 0;
-		cnts = &ppi->ts_entry->counters;
+		cnts = &ppi->counters;
 		len = snprintf(
 			ppi->outp, ppi->char_count,
 			"%d %s 0x%llx %u %u "
@@ -2641,6 +2944,8 @@ static bool pp_sets(struct proc_print_info *ppi)
 {
 	int len;
 	int counter_set;
+
+	tag_stat_fold(ppi->ts_entry, &ppi->counters);
 	for (counter_set = 0; counter_set < IFS_MAX_COUNTER_SETS;
 	     counter_set++) {
 		len = pp_stats_line(ppi, counter_set);
@@ -2848,6 +3153,7 @@ static int qtudev_release(struct inode *inode, struct file *file)
 		free_tag_ref_from_utd_entry(tr, utd_entry);
 
 		rb_erase(&st_entry->sock_node, &sock_tag_tree);
+		sock_tag_cache_set(st_entry->sk, false, 0);
 		list_del(&st_entry->list);
 		/* Can't sockfd_put() within spinlock, do it later. */
 		sock_tag_tree_insert(st_entry, &st_to_free_tree);
@@ -12,7 +12,9 @@
 
 #include <linux/types.h>
 #include <linux/rbtree.h>
+#include <linux/rculist.h>
 #include <linux/spinlock_types.h>
+#include <linux/u64_stats_sync.h>
 #include <linux/workqueue.h>
 
 /* Iface handling */
@@ -179,6 +181,20 @@ struct data_counters {
 	struct byte_packet_counters bpc[IFS_MAX_COUNTER_SETS][IFS_MAX_DIRECTIONS][IFS_MAX_PROTOS];
 };
 
+/*
+ * Per-cpu share of the counters, updated without locks by the packet path
+ * and only summed up when the stats are read.
+ */
+struct data_counters_pcpu {
+	struct data_counters dc;
+	struct u64_stats_sync syncp;
+};
+
+struct iface_skb_totals_pcpu {
+	struct byte_packet_counters bpc[IFS_MAX_DIRECTIONS];
+	struct u64_stats_sync syncp;
+};
+
 /* Generic X based nodes used as a base for rb_tree ops */
 struct tag_node {
 	struct rb_node node;
@@ -187,14 +203,28 @@ struct tag_node {
 
 struct tag_stat {
 	struct tag_node tn;
+	/* Updated under tag_stat_list_lock until pcpu_counters is set */
 	struct data_counters counters;
 	/*
 	 * If this tag is acct_tag based, we need to count against the
 	 * matching parent uid_tag.
 	 */
-	struct data_counters *parent_counters;
+	struct tag_stat *parent;
+
+	/* RCU lookup by the packet path, in iface_stat.tag_stat_hash */
+	struct hlist_node hash_node;
+	struct data_counters_pcpu __percpu *pcpu_counters;
+	/* On tag_stat_pcpu_list until pcpu_counters is allocated */
+	struct list_head pcpu_list;
+	struct rcu_head rcu;
+
+	/* Cached counter set of the uid, valid for counter_set_gen */
+	int active_set;
+	int active_set_gen;
 };
 
+#define TAG_STAT_HASH_BITS 6
+
 struct iface_stat {
 	struct list_head list;  /* in iface_stat_list */
 	char *ifname;
@@ -220,6 +250,11 @@ struct iface_stat {
 
 	struct rb_root tag_stat_tree;
 	spinlock_t tag_stat_list_lock;
+	/* Same entries as tag_stat_tree, for lockless lookups */
+	struct hlist_head tag_stat_hash[1 << TAG_STAT_HASH_BITS];
+
+	/* Lockless share of totals_via_skb, set once allocated */
+	struct iface_skb_totals_pcpu __percpu *pcpu_totals_via_skb;
 };
 
 /* This is needed to create proc_dir_entries from atomic context. */
@@ -236,7 +271,8 @@ struct iface_stat_work {
  */
 struct sock_tag {
 	struct rb_node sock_node;
-	struct sock *sk;  /* Only used as a number, never dereferenced */
+	/* Only dereferenced to update its cached tag, while socket is held */
+	struct sock *sk;
 	/* The socket is needed for sockfd_put() */
 	struct socket *socket;
 	/* Used to associate with a given pid */
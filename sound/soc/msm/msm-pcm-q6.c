@@ -19,6 +19,9 @@
 #include <linux/wait.h>
 #include <linux/platform_device.h>
 #include <linux/slab.h>
+#include <linux/debugfs.h>
+#include <linux/uaccess.h>
+#include <linux/ktime.h>
 #include <sound/core.h>
 #include <sound/soc.h>
 #include <sound/soc-dapm.h>
@@ -42,7 +45,18 @@ struct snd_msm {
 #define PLAYBACK_NUM_PERIODS	8
 #define PLAYBACK_PERIOD_SIZE	2048
 #define CAPTURE_NUM_PERIODS	16
-#define CAPTURE_PERIOD_SIZE	320
+#define CAPTURE_MIN_PERIOD_SIZE	320
+#define CAPTURE_MAX_PERIOD_SIZE	4096
+/* low latency streams: 5 ms of 48 kHz stereo, double buffered */
+#define PLAYBACK_MIN_PERIOD_SIZE	960
+#define MIN_NUM_PERIODS		2
+/*
+ * ASM buffer addresses must be 32 byte aligned, and the periods of the
+ * ring sit back to back
+ */
+#define DSP_PERIOD_ALIGN	32
+/* writes kept queued on the DSP for mmap playback */
+#define MMAP_PLAYBACK_INFLIGHT	2
 
 static struct snd_pcm_hardware msm_pcm_hardware_capture = {
 	.info =                 (SNDRV_PCM_INFO_MMAP |
@@ -56,10 +70,10 @@ static struct snd_pcm_hardware msm_pcm_hardware_capture = {
 	.rate_max =             48000,
 	.channels_min =         1,
 	.channels_max =         4,
-	.buffer_bytes_max =     CAPTURE_NUM_PERIODS * CAPTURE_PERIOD_SIZE,
-	.period_bytes_min =	CAPTURE_PERIOD_SIZE,
-	.period_bytes_max =     CAPTURE_PERIOD_SIZE,
-	.periods_min =          CAPTURE_NUM_PERIODS,
+	.buffer_bytes_max =     CAPTURE_NUM_PERIODS * CAPTURE_MAX_PERIOD_SIZE,
+	.period_bytes_min =	CAPTURE_MIN_PERIOD_SIZE,
+	.period_bytes_max =     CAPTURE_MAX_PERIOD_SIZE,
+	.periods_min =          MIN_NUM_PERIODS,
 	.periods_max =          CAPTURE_NUM_PERIODS,
 	.fifo_size =            0,
 };
@@ -77,9 +91,9 @@ static struct snd_pcm_hardware msm_pcm_hardware_playback = {
 	.channels_min =         1,
 	.channels_max =         2,
 	.buffer_bytes_max =     PLAYBACK_NUM_PERIODS * PLAYBACK_PERIOD_SIZE,
-	.period_bytes_min =	PLAYBACK_PERIOD_SIZE,
+	.period_bytes_min =	PLAYBACK_MIN_PERIOD_SIZE,
 	.period_bytes_max =     PLAYBACK_PERIOD_SIZE,
-	.periods_min =          PLAYBACK_NUM_PERIODS,
+	.periods_min =          MIN_NUM_PERIODS,
 	.periods_max =          PLAYBACK_NUM_PERIODS,
 	.fifo_size =            0,
 };
@@ -97,6 +111,169 @@ static struct snd_pcm_hw_constraint_list constraints_sample_rates = {
 	.mask = 0,
 };
 
+/* q6asm walks its buffer ring with a power of two mask */
+static unsigned int supported_periods[] = {
+	2, 4, 8, 16
+};
+
+static struct snd_pcm_hw_constraint_list constraints_periods = {
+	.count = ARRAY_SIZE(supported_periods),
+	.list = supported_periods,
+	.mask = 0,
+};
+
+/*
+ * Round trip latency test. Once armed through debugfs, the next playback
+ * buffer handed to the DSP starts with a full scale impulse and capture
+ * buffers are scanned for it coming back, either through the AFE
+ * loopback or an external one. The delay is measured from handing the
+ * buffer to the DSP to the capture time of the detected sample, and
+ * kept with the playback stream that sent the impulse.
+ */
+#define LOOPBACK_IMPULSE_FRAMES	8
+#define LOOPBACK_THRESHOLD	0x2000
+#define LOOPBACK_TIMEOUT_US	(2 * USEC_PER_SEC)
+
+enum {
+	LOOPBACK_IDLE,
+	LOOPBACK_ARMED,
+	LOOPBACK_SENT,
+};
+
+static DEFINE_SPINLOCK(loopback_lock);
+static int loopback_armed;
+/* playback stream being measured, the one that took the last arm */
+static struct msm_audio *loopback_stream;
+
+static void msm_pcm_loopback_tx(struct msm_audio *prtd)
+{
+	struct audio_port_data *port = &prtd->audio_client->port[IN];
+	int16_t *data;
+	unsigned long flags;
+	int i, n;
+
+	if (likely(!ACCESS_ONCE(loopback_armed)))
+		return;
+
+	spin_lock_irqsave(&loopback_lock, flags);
+	if (loopback_armed && port->buf) {
+		data = port->buf[port->dsp_buf].data;
+		n = min_t(int, LOOPBACK_IMPULSE_FRAMES * prtd->channel_mode,
+			prtd->pcm_count / sizeof(int16_t));
+		for (i = 0; i < n; i++)
+			data[i] = 0x7fff;
+		prtd->loopback.tx_time = ktime_get();
+		prtd->loopback.state = LOOPBACK_SENT;
+		loopback_stream = prtd;
+		loopback_armed = 0;
+	}
+	spin_unlock_irqrestore(&loopback_lock, flags);
+}
+
+static void msm_pcm_loopback_rx(struct msm_audio *prtd, void *buf,
+				uint32_t len)
+{
+	struct msm_pcm_loopback *lb;
+	int16_t *data = buf;
+	uint32_t i, n = len / sizeof(int16_t);
+	unsigned long flags;
+	s64 us;
+
+	if (likely(!ACCESS_ONCE(loopback_stream)))
+		return;
+
+	spin_lock_irqsave(&loopback_lock, flags);
+	if (!loopback_stream)
+		goto unlock;
+	lb = &loopback_stream->loopback;
+	if (lb->state != LOOPBACK_SENT)
+		goto unlock;
+	us = ktime_us_delta(ktime_get(), lb->tx_time);
+	if (us > LOOPBACK_TIMEOUT_US) {
+		lb->timeouts++;
+		lb->state = LOOPBACK_IDLE;
+		goto unlock;
+	}
+	for (i = 0; i < n; i++)
+		if (abs(data[i]) >= LOOPBACK_THRESHOLD)
+			break;
+	if (i == n || !prtd->samp_rate || !prtd->channel_mode)
+		goto unlock;
+
+	/* the buffer was complete just now, the impulse is this far back */
+	us -= div_u64((u64)((n - i) / prtd->channel_mode) * USEC_PER_SEC,
+		prtd->samp_rate);
+	lb->last_us = us;
+	if (!lb->count || us < lb->min_us)
+		lb->min_us = us;
+	if (us > lb->max_us)
+		lb->max_us = us;
+	lb->total_us += us;
+	lb->count++;
+	lb->state = LOOPBACK_IDLE;
+unlock:
+	spin_unlock_irqrestore(&loopback_lock, flags);
+}
+
+static void msm_pcm_loopback_release(struct msm_audio *prtd)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&loopback_lock, flags);
+	if (loopback_stream == prtd)
+		loopback_stream = NULL;
+	spin_unlock_irqrestore(&loopback_lock, flags);
+}
+
+/*
+ * In mmap mode each DSP write covers prtd->burst periods, and the stream
+ * position between two WRITE_DONEs is estimated from the clock, so the
+ * pointer moves on without an APR message per period.
+ */
+static void msm_pcm_write_nolock(struct msm_audio *prtd)
+{
+	msm_pcm_loopback_tx(prtd);
+	if (q6asm_write_bufs_nolock(prtd->audio_client, prtd->burst,
+			prtd->pcm_count * prtd->burst, 0, 0, NO_TIMESTAMP) >= 0)
+		atomic_inc(&prtd->dsp_inflight);
+}
+
+static void msm_pcm_burst_started(struct msm_audio *prtd)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&prtd->pos_lock, flags);
+	prtd->burst_start = ktime_get();
+	spin_unlock_irqrestore(&prtd->pos_lock, flags);
+}
+
+/* bytes of the oldest queued write the DSP has played by now */
+static unsigned int msm_pcm_burst_played(struct snd_pcm_runtime *runtime,
+					 struct msm_audio *prtd)
+{
+	unsigned int bytes, limit;
+	unsigned long flags;
+	s64 us;
+
+	if (!prtd->mmap_flag || !atomic_read(&prtd->start) ||
+	    !atomic_read(&prtd->dsp_inflight) || !prtd->samp_rate)
+		return 0;
+
+	spin_lock_irqsave(&prtd->pos_lock, flags);
+	us = ktime_us_delta(ktime_get(), prtd->burst_start);
+	spin_unlock_irqrestore(&prtd->pos_lock, flags);
+	if (us <= 0)
+		return 0;
+
+	/* never report the write done ahead of its WRITE_DONE */
+	limit = prtd->pcm_count * prtd->burst - frames_to_bytes(runtime, 1);
+	if (us >= USEC_PER_SEC)
+		return limit;
+	bytes = frames_to_bytes(runtime,
+		div_u64((u64)us * prtd->samp_rate, USEC_PER_SEC));
+	return min(bytes, limit);
+}
+
 static void event_handler(uint32_t opcode,
 		uint32_t token, uint32_t *payload, void *priv)
 {
@@ -112,7 +289,10 @@ static void event_handler(uint32_t opcode,
 	case ASM_DATA_EVENT_WRITE_DONE: {
 		pr_debug("ASM_DATA_EVENT_WRITE_DONE\n");
 		pr_debug("Buffer Consumed = 0x%08x\n", *ptrmem);
-		prtd->pcm_irq_pos += prtd->pcm_count;
+		prtd->pcm_irq_pos += prtd->pcm_count * prtd->burst;
+		if (atomic_read(&prtd->dsp_inflight) > 0)
+			atomic_dec(&prtd->dsp_inflight);
+		msm_pcm_burst_started(prtd);
 		if (atomic_read(&prtd->start))
 			snd_pcm_period_elapsed(substream);
 		atomic_inc(&prtd->out_count);
@@ -121,14 +301,13 @@ static void event_handler(uint32_t opcode,
 			break;
 		if (!prtd->mmap_flag)
 			break;
-		if (q6asm_is_cpu_buf_avail_nolock(IN,
-				prtd->audio_client,
-				&size, &idx)) {
-			pr_debug("%s:writing %d bytes of buffer to dsp 2\n",
-					__func__, prtd->pcm_count);
-			q6asm_write_nolock(prtd->audio_client,
-				prtd->pcm_count, 0, 0, NO_TIMESTAMP);
-		}
+		/*
+		 * the mmap ring has no cpu side bookkeeping, the
+		 * application keeps ahead of the DSP on its own
+		 */
+		pr_debug("%s:writing %d bytes of buffer to dsp 2\n",
+				__func__, prtd->pcm_count * prtd->burst);
+		msm_pcm_write_nolock(prtd);
 		break;
 	}
 	case ASM_DATA_CMDRSP_EOS:
@@ -143,6 +322,10 @@ static void event_handler(uint32_t opcode,
 			pr_debug("cmd[%d]=0x%08x\n", i, *ptrmem);
 		in_frame_info[token][0] = payload[2];
 		in_frame_info[token][1] = payload[3];
+		if (prtd->audio_client->port[OUT].buf)
+			msm_pcm_loopback_rx(prtd,
+				prtd->audio_client->port[OUT].buf[token].data +
+				payload[3], payload[2]);
 		prtd->pcm_irq_pos += in_frame_info[token][0];
 		pr_debug("pcm_irq_pos=%d\n", prtd->pcm_irq_pos);
 		if (atomic_read(&prtd->start))
@@ -166,22 +349,29 @@ static void event_handler(uint32_t opcode,
 				break;
 			}
 			if (prtd->mmap_flag) {
-				pr_debug("%s:writing %d bytes"
-					" of buffer to dsp\n",
-					__func__,
-					prtd->pcm_count);
-				q6asm_write_nolock(prtd->audio_client,
-					prtd->pcm_count,
-					0, 0, NO_TIMESTAMP);
+				/*
+				 * Keep more than one write queued so the
+				 * DSP does not starve while the next one is
+				 * sent from the WRITE_DONE callback, but never
+				 * the period the application is filling.
+				 */
+				msm_pcm_burst_started(prtd);
+				for (i = 0; i < MMAP_PLAYBACK_INFLIGHT &&
+				     (i + 1) * prtd->burst < prtd->periods;
+				     i++) {
+					pr_debug("%s:writing %d bytes"
+						" of buffer to dsp\n",
+						__func__,
+						prtd->pcm_count * prtd->burst);
+					msm_pcm_write_nolock(prtd);
+				}
 			} else {
 				while (atomic_read(&prtd->out_needed)) {
 					pr_debug("%s:writing %d bytes"
 						 " of buffer to dsp\n",
 						__func__,
 						prtd->pcm_count);
-					q6asm_write_nolock(prtd->audio_client,
-						prtd->pcm_count,
-						0, 0, NO_TIMESTAMP);
+					msm_pcm_write_nolock(prtd);
 					atomic_dec(&prtd->out_needed);
 					wake_up(&the_locks.write_wait);
 				};
@@ -209,6 +399,14 @@ static int msm_pcm_playback_prepare(struct snd_pcm_substream *substream)
 	prtd->pcm_size = snd_pcm_lib_buffer_bytes(substream);
 	prtd->pcm_count = snd_pcm_lib_period_bytes(substream);
 	prtd->pcm_irq_pos = 0;
+	prtd->periods = runtime->periods;
+	/*
+	 * mmap playback hands the DSP a quarter of the ring per write;
+	 * periods and thus the burst are powers of two, so a write never
+	 * wraps around the ring
+	 */
+	prtd->burst = prtd->mmap_flag ? max_t(int, 1, runtime->periods / 4) : 1;
+	atomic_set(&prtd->dsp_inflight, 0);
 	/* rate and channels are sent to audio driver */
 	prtd->samp_rate = runtime->rate;
 	prtd->channel_mode = runtime->channels;
@@ -317,6 +515,8 @@ static int msm_pcm_open(struct snd_pcm_substream *substream)
 		return -ENOMEM;
 	}
 	prtd->substream = substream;
+	prtd->burst = 1;
+	spin_lock_init(&prtd->pos_lock);
 	prtd->audio_client = q6asm_audio_client_alloc(
 				(app_cb)event_handler, prtd);
 	if (!prtd->audio_client) {
@@ -357,6 +557,16 @@ static int msm_pcm_open(struct snd_pcm_substream *substream)
 					    SNDRV_PCM_HW_PARAM_PERIODS);
 	if (ret < 0)
 		pr_info("snd_pcm_hw_constraint_integer failed\n");
+	ret = snd_pcm_hw_constraint_list(runtime, 0,
+				SNDRV_PCM_HW_PARAM_PERIODS,
+				&constraints_periods);
+	if (ret < 0)
+		pr_info("snd_pcm_hw_constraint_list periods failed\n");
+	ret = snd_pcm_hw_constraint_step(runtime, 0,
+				SNDRV_PCM_HW_PARAM_PERIOD_BYTES,
+				DSP_PERIOD_ALIGN);
+	if (ret < 0)
+		pr_info("snd_pcm_hw_constraint_step failed\n");
 
 	prtd->dsp_cnt = 0;
 	runtime->private_data = prtd;
@@ -409,12 +619,14 @@ static int msm_pcm_playback_copy(struct snd_pcm_substream *substream, int a,
 		if (atomic_read(&prtd->start)) {
 			pr_debug("%s:writing %d bytes of buffer to dsp\n",
 					__func__, xfer);
+			msm_pcm_loopback_tx(prtd);
 			ret = q6asm_write(prtd->audio_client, xfer,
 						0, 0, NO_TIMESTAMP);
 			if (ret < 0) {
 				ret = -EFAULT;
 				goto fail;
 			}
+			atomic_inc(&prtd->dsp_inflight);
 		} else
 			atomic_inc(&prtd->out_needed);
 		atomic_dec(&prtd->out_count);
@@ -439,6 +651,7 @@ static int msm_pcm_playback_close(struct snd_pcm_substream *substream)
 	if (ret < 0)
 		pr_err("%s: CMD_EOS failed\n", __func__);
 	q6asm_cmd(prtd->audio_client, CMD_CLOSE);
+	msm_pcm_loopback_release(prtd);
 	q6asm_audio_client_buf_free_contiguous(dir,
 				prtd->audio_client);
 
@@ -583,12 +796,23 @@ static snd_pcm_uframes_t msm_pcm_pointer(struct snd_pcm_substream *substream)
 
 	struct snd_pcm_runtime *runtime = substream->runtime;
 	struct msm_audio *prtd = runtime->private_data;
+	unsigned int pos, played = 0;
 
 	if (prtd->pcm_irq_pos >= prtd->pcm_size)
 		prtd->pcm_irq_pos = 0;
+	pos = prtd->pcm_irq_pos;
+
+	/* data handed to the DSP but not yet consumed */
+	if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK) {
+		played = msm_pcm_burst_played(runtime, prtd);
+		pos = (pos + played) % prtd->pcm_size;
+		runtime->delay = bytes_to_frames(runtime,
+			atomic_read(&prtd->dsp_inflight) *
+			prtd->pcm_count * prtd->burst - played);
+	}
 
 	pr_debug("pcm_irq_pos = %d\n", prtd->pcm_irq_pos);
-	return bytes_to_frames(runtime, (prtd->pcm_irq_pos));
+	return bytes_to_frames(runtime, pos);
 }
 
 static int msm_pcm_mmap(struct snd_pcm_substream *substream,
@@ -654,8 +878,8 @@ static int msm_pcm_hw_params(struct snd_pcm_substream *substream,
 
 	ret = q6asm_audio_client_buf_alloc_contiguous(dir,
 			prtd->audio_client,
-			runtime->hw.period_bytes_min,
-			runtime->hw.periods_max);
+			params_period_bytes(params),
+			params_periods(params));
 	if (ret < 0) {
 		pr_err("Audio Start: Buffer Allocation failed \
 					rc = %d\n", ret);
@@ -671,7 +895,7 @@ static int msm_pcm_hw_params(struct snd_pcm_substream *substream,
 	dma_buf->private_data = NULL;
 	dma_buf->area = buf[0].data;
 	dma_buf->addr =  buf[0].phys;
-	dma_buf->bytes = runtime->hw.buffer_bytes_max;
+	dma_buf->bytes = params_buffer_bytes(params);
 	if (!dma_buf->area)
 		return -ENOMEM;
 
@@ -728,8 +952,82 @@ static struct platform_driver msm_pcm_driver = {
 	.remove = __devexit_p(msm_pcm_remove),
 };
 
+#ifdef CONFIG_DEBUG_FS
+static struct dentry *debugfs_loopback;
+
+static ssize_t msm_pcm_loopback_read(struct file *file, char __user *ubuf,
+				size_t count, loff_t *ppos)
+{
+	static const char * const states[] = { "idle", "armed", "sent" };
+	struct msm_pcm_loopback lb;
+	char buf[224];
+	unsigned long flags;
+	int session = -1;
+	int len;
+
+	memset(&lb, 0, sizeof(lb));
+	spin_lock_irqsave(&loopback_lock, flags);
+	if (loopback_stream) {
+		lb = loopback_stream->loopback;
+		session = loopback_stream->session_id;
+	}
+	if (loopback_armed)
+		lb.state = LOOPBACK_ARMED;
+	spin_unlock_irqrestore(&loopback_lock, flags);
+
+	len = snprintf(buf, sizeof(buf),
+		"session %d\nstate %s\ncount %u\ntimeouts %u\nlast_us %lld\n"
+		"min_us %lld\nmax_us %lld\navg_us %lld\n",
+		session, states[lb.state], lb.count, lb.timeouts,
+		lb.last_us, lb.min_us, lb.max_us,
+		lb.count ? div_s64(lb.total_us, lb.count) : 0);
+
+	return simple_read_from_buffer(ubuf, count, ppos, buf, len);
+}
+
+/*
+ * "1" arms one measurement on the next playback stream to hand the DSP
+ * a buffer, "0" disarms and clears the measured stream's statistics
+ */
+static ssize_t msm_pcm_loopback_write(struct file *file,
+		const char __user *ubuf, size_t count, loff_t *ppos)
+{
+	unsigned long flags;
+	char c;
+
+	if (!count || get_user(c, ubuf))
+		return -EFAULT;
+
+	spin_lock_irqsave(&loopback_lock, flags);
+	if (c == '1') {
+		loopback_armed = 1;
+	} else if (c == '0') {
+		loopback_armed = 0;
+		if (loopback_stream)
+			memset(&loopback_stream->loopback, 0,
+				sizeof(loopback_stream->loopback));
+	} else {
+		count = -EINVAL;
+	}
+	spin_unlock_irqrestore(&loopback_lock, flags);
+
+	return count;
+}
+
+static const struct file_operations msm_pcm_loopback_fops = {
+	.open = simple_open,
+	.read = msm_pcm_loopback_read,
+	.write = msm_pcm_loopback_write,
+};
+#endif
+
 static int __init msm_soc_platform_init(void)
 {
+#ifdef CONFIG_DEBUG_FS
+	debugfs_loopback = debugfs_create_file("msm_pcm_loopback_latency",
+		S_IFREG | S_IRUGO | S_IWUSR, NULL, NULL,
+		&msm_pcm_loopback_fops);
+#endif
 	init_waitqueue_head(&the_locks.enable_wait);
 	init_waitqueue_head(&the_locks.eos_wait);
 	init_waitqueue_head(&the_locks.write_wait);
@@ -741,6 +1039,9 @@ module_init(msm_soc_platform_init);
 
 static void __exit msm_soc_platform_exit(void)
 {
+#ifdef CONFIG_DEBUG_FS
+	debugfs_remove(debugfs_loopback);
+#endif
 	platform_driver_unregister(&msm_pcm_driver);
 }
 module_exit(msm_soc_platform_exit);
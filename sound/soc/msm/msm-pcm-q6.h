@@ -18,6 +18,7 @@
 
 #ifndef _MSM_PCM_H
 #define _MSM_PCM_H
+#include <linux/ktime.h>
 #include <sound/apr_audio.h>
 #include <sound/q6asm.h>
 
@@ -50,6 +51,18 @@ struct audio_locks {
 	wait_queue_head_t enable_wait;
 };
 
+/* round trip latency measurement of a playback stream */
+struct msm_pcm_loopback {
+	int state;
+	ktime_t tx_time;
+	s64 last_us;
+	s64 min_us;
+	s64 max_us;
+	s64 total_us;
+	u32 count;
+	u32 timeouts;
+};
+
 struct msm_audio {
 	struct snd_pcm_substream *substream;
 	unsigned int pcm_size;
@@ -79,6 +92,11 @@ struct msm_audio {
 	int periods;
 	int mmap_flag;
 	atomic_t pending_buffer;
+	atomic_t dsp_inflight; /* writes queued on the DSP */
+	int burst; /* periods per DSP write */
+	spinlock_t pos_lock;
+	ktime_t burst_start; /* DSP started on the oldest queued write */
+	struct msm_pcm_loopback loopback;
 };
 
 #endif /*_MSM_PCM_H*/
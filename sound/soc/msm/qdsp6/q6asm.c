@@ -3350,6 +3350,18 @@ fail_cmd:
 
 int q6asm_write_nolock(struct audio_client *ac, uint32_t len, uint32_t msw_ts,
 			uint32_t lsw_ts, uint32_t flags)
+{
+	return q6asm_write_bufs_nolock(ac, 1, len, msw_ts, lsw_ts, flags);
+}
+
+/*
+ * Queue @bufs consecutive buffers of a contiguous allocation, starting at
+ * the next DSP buffer, as a single write of @len bytes. The buffers must
+ * not wrap around the end of the ring.
+ */
+int q6asm_write_bufs_nolock(struct audio_client *ac, uint32_t bufs,
+			uint32_t len, uint32_t msw_ts, uint32_t lsw_ts,
+			uint32_t flags)
 {
 	int rc = 0;
 	struct asm_stream_cmd_write write;
@@ -3383,7 +3395,8 @@ int q6asm_write_nolock(struct audio_client *ac, uint32_t len, uint32_t msw_ts,
 			write.uflags = (0x00000000 | (flags & 0x800000FF));
 		else
 			write.uflags = (0x80000000 | flags);
-		port->dsp_buf = (port->dsp_buf + 1) & (port->max_buf_cnt - 1);
+		port->dsp_buf = (port->dsp_buf + bufs) &
+					(port->max_buf_cnt - 1);
 
 		pr_debug("%s:ab->phys[0x%x]bufadd[0x%x]token[0x%x]buf_id[0x%x]"
 							, __func__,
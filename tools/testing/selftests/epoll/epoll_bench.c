@@ -0,0 +1,237 @@
+/*
+ * epoll throughput and wakeup latency microbenchmark
+ *
+ * Throughput: writer threads make random pipes out of a set of -f pipes
+ * readable as fast as they can, the main thread collects the events with
+ * edge triggered epoll_wait() and drains the pipes.  Reports events per
+ * second and the average number of events per epoll_wait() call.
+ *
+ * Latency: a single writer timestamps a byte, sleeps, and the main thread
+ * measures how long the wakeup out of epoll_wait() took.
+ *
+ * -n registers the pipes with EPOLLNOREPOLL, to compare against the
+ * default of polling each ready file again in epoll_wait().
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+
+#ifndef EPOLLNOREPOLL
+#define EPOLLNOREPOLL (1 << 27)
+#endif
+
+#define MAX_EVENTS	256
+#define LAT_ITERS	2000
+
+static int nr_fds = 1024;
+static int nr_writers = 2;
+static int seconds = 5;
+static unsigned int ep_flags = EPOLLIN | EPOLLET;
+static int (*fds)[2];
+static volatile int stop;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static void *writer(void *arg)
+{
+	unsigned int seed = (unsigned long)arg;
+	char c = 0;
+
+	while (!stop) {
+		int i = rand_r(&seed) % nr_fds;
+
+		/* EAGAIN on a full pipe is fine, it is readable already */
+		if (write(fds[i][1], &c, 1) < 0 && errno != EAGAIN)
+			die("write");
+	}
+	return NULL;
+}
+
+static void drain(int fd)
+{
+	char buf[4096];
+
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+}
+
+static int setup(int n)
+{
+	struct epoll_event ev;
+	int epfd, i;
+
+	epfd = epoll_create1(0);
+	if (epfd < 0)
+		die("epoll_create1");
+
+	fds = calloc(n, sizeof(*fds));
+	if (!fds)
+		die("calloc");
+
+	for (i = 0; i < n; i++) {
+		if (pipe2(fds[i], O_NONBLOCK))
+			die("pipe2");
+		ev.events = ep_flags;
+		ev.data.u32 = i;
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, fds[i][0], &ev))
+			die("epoll_ctl");
+	}
+	return epfd;
+}
+
+static void throughput(void)
+{
+	struct epoll_event events[MAX_EVENTS];
+	unsigned long long start, end, nevents = 0, ncalls = 0;
+	pthread_t *threads;
+	int epfd, i, n;
+
+	epfd = setup(nr_fds);
+	threads = calloc(nr_writers, sizeof(*threads));
+	if (!threads)
+		die("calloc");
+
+	stop = 0;
+	for (i = 0; i < nr_writers; i++)
+		if (pthread_create(&threads[i], NULL, writer,
+				   (void *)(unsigned long)(i + 1)))
+			die("pthread_create");
+
+	start = now_ns();
+	end = start + seconds * 1000000000ULL;
+	while (now_ns() < end) {
+		n = epoll_wait(epfd, events, MAX_EVENTS, 100);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			die("epoll_wait");
+		}
+		for (i = 0; i < n; i++)
+			drain(fds[events[i].data.u32][0]);
+		nevents += n;
+		ncalls++;
+	}
+	end = now_ns();
+
+	stop = 1;
+	for (i = 0; i < nr_writers; i++)
+		pthread_join(threads[i], NULL);
+
+	printf("throughput: %d fds %d writers: %llu events/s, %.1f events/call\n",
+	       nr_fds, nr_writers, nevents * 1000000000ULL / (end - start),
+	       ncalls ? (double)nevents / ncalls : 0.0);
+
+	for (i = 0; i < nr_fds; i++) {
+		close(fds[i][0]);
+		close(fds[i][1]);
+	}
+	free(fds);
+	free(threads);
+	close(epfd);
+}
+
+static void *lat_writer(void *arg)
+{
+	unsigned long long t;
+	struct timespec gap = { 0, 200000 };
+	int i;
+
+	(void)arg;
+	for (i = 0; i < LAT_ITERS && !stop; i++) {
+		nanosleep(&gap, NULL);
+		t = now_ns();
+		if (write(fds[0][1], &t, sizeof(t)) != sizeof(t))
+			die("write");
+	}
+	return NULL;
+}
+
+static void latency(void)
+{
+	unsigned long long t, d, min = ~0ULL, max = 0, sum = 0;
+	struct epoll_event ev;
+	pthread_t thread;
+	int epfd, i;
+
+	epfd = setup(1);
+	stop = 0;
+	if (pthread_create(&thread, NULL, lat_writer, NULL))
+		die("pthread_create");
+
+	for (i = 0; i < LAT_ITERS; i++) {
+		if (epoll_wait(epfd, &ev, 1, 1000) != 1)
+			break;
+		if (read(fds[0][0], &t, sizeof(t)) != sizeof(t))
+			die("read");
+		d = now_ns() - t;
+		sum += d;
+		if (d < min)
+			min = d;
+		if (d > max)
+			max = d;
+	}
+	stop = 1;
+	pthread_join(thread, NULL);
+
+	if (i)
+		printf("wakeup latency: %d samples min %llu avg %llu max %llu ns\n",
+		       i, min, sum / i, max);
+
+	close(fds[0][0]);
+	close(fds[0][1]);
+	free(fds);
+	close(epfd);
+}
+
+int main(int argc, char **argv)
+{
+	int opt;
+
+	while ((opt = getopt(argc, argv, "f:w:t:n")) != -1) {
+		switch (opt) {
+		case 'f':
+			nr_fds = atoi(optarg);
+			break;
+		case 'w':
+			nr_writers = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 'n':
+			ep_flags |= EPOLLNOREPOLL;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-f fds] [-w writers] "
+				"[-t seconds] [-n]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (nr_fds < 1 || nr_writers < 1 || seconds < 1) {
+		fprintf(stderr, "bad arguments\n");
+		return 1;
+	}
+
+	throughput();
+	latency();
+	return 0;
+}
@@ -0,0 +1,187 @@
+/*
+ * Frame deadline benchmark for latency sensitive tasks
+ *
+ * A render thread wakes up every -p microseconds, burns -w microseconds
+ * of its own CPU time and must be done before the next period starts.
+ * Meanwhile -b background threads spin on the CPUs.  Reports the wakeup
+ * latency of the render thread and how many frames missed their deadline.
+ *
+ * -l marks the render thread latency sensitive through
+ * /proc/self/task/<tid>/sched_latency_sensitive, -g moves it into the
+ * given cpu cgroup directory instead, to check that a latency_sensitive
+ * flag set on that group or any group above it is honoured.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+static int period_us = 16667;
+static int work_us = 4000;
+static int nr_background;
+static int seconds = 10;
+static int latency_sensitive;
+static const char *cgroup;
+static volatile int stop;
+
+static unsigned long long clock_ns(clockid_t clk)
+{
+	struct timespec ts;
+
+	clock_gettime(clk, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static void write_file(const char *path, const char *val)
+{
+	int fd;
+
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		die(path);
+	if (write(fd, val, strlen(val)) < 0)
+		die(path);
+	close(fd);
+}
+
+static void *background(void *arg)
+{
+	(void)arg;
+	while (!stop)
+		;
+	return NULL;
+}
+
+/* Spin until this thread has run for @ns, however long that takes */
+static void burn(unsigned long long ns)
+{
+	unsigned long long end = clock_ns(CLOCK_THREAD_CPUTIME_ID) + ns;
+
+	while (clock_ns(CLOCK_THREAD_CPUTIME_ID) < end)
+		;
+}
+
+static void render(void)
+{
+	unsigned long long next, now, lat, min = ~0ULL, max = 0, sum = 0;
+	unsigned long long period = period_us * 1000ULL;
+	struct timespec ts;
+	char path[256], buf[16];
+	int frames, missed = 0, i;
+
+	snprintf(buf, sizeof(buf), "%ld", syscall(SYS_gettid));
+	if (latency_sensitive) {
+		snprintf(path, sizeof(path),
+			 "/proc/self/task/%s/sched_latency_sensitive", buf);
+		write_file(path, "1");
+	}
+	if (cgroup) {
+		snprintf(path, sizeof(path), "%s/tasks", cgroup);
+		write_file(path, buf);
+	}
+
+	frames = seconds * 1000000ULL / period_us;
+	next = clock_ns(CLOCK_MONOTONIC) + period;
+	for (i = 0; i < frames; i++) {
+		ts.tv_sec = next / 1000000000ULL;
+		ts.tv_nsec = next % 1000000000ULL;
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL))
+			;
+
+		now = clock_ns(CLOCK_MONOTONIC);
+		lat = now - next;
+		sum += lat;
+		if (lat < min)
+			min = lat;
+		if (lat > max)
+			max = lat;
+
+		burn(work_us * 1000ULL);
+
+		next += period;
+		now = clock_ns(CLOCK_MONOTONIC);
+		if (now > next) {
+			missed++;
+			/* skip the frames we are already late for */
+			while (next < now)
+				next += period;
+		}
+	}
+
+	printf("frames: %d missed %d (%.1f%%)\n",
+	       frames, missed, 100.0 * missed / frames);
+	printf("wakeup latency: min %llu avg %llu max %llu us\n",
+	       min / 1000, sum / frames / 1000, max / 1000);
+}
+
+int main(int argc, char **argv)
+{
+	pthread_t *threads;
+	int opt, i;
+
+	nr_background = sysconf(_SC_NPROCESSORS_ONLN) * 2;
+
+	while ((opt = getopt(argc, argv, "p:w:b:t:lg:")) != -1) {
+		switch (opt) {
+		case 'p':
+			period_us = atoi(optarg);
+			break;
+		case 'w':
+			work_us = atoi(optarg);
+			break;
+		case 'b':
+			nr_background = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 'l':
+			latency_sensitive = 1;
+			break;
+		case 'g':
+			cgroup = optarg;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-p period_us] [-w work_us] "
+				"[-b background] [-t seconds] [-l] "
+				"[-g cgroup]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (period_us < 1 || work_us < 1 || work_us >= period_us ||
+	    nr_background < 0 || seconds < 1) {
+		fprintf(stderr, "bad arguments\n");
+		return 1;
+	}
+
+	threads = calloc(nr_background + 1, sizeof(*threads));
+	if (!threads)
+		die("calloc");
+	for (i = 0; i < nr_background; i++)
+		if (pthread_create(&threads[i], NULL, background, NULL))
+			die("pthread_create");
+
+	printf("period %d us work %d us, %d background threads%s%s%s\n",
+	       period_us, work_us, nr_background,
+	       latency_sensitive ? ", latency sensitive" : "",
+	       cgroup ? ", cgroup " : "", cgroup ? cgroup : "");
+	render();
+
+	stop = 1;
+	for (i = 0; i < nr_background; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+	return 0;
+}
@@ -0,0 +1,252 @@
+/*
+ * TCP small queues / pacing RTT inflation benchmark
+ *
+ * Opens two connections to a local server: a bulk connection that a
+ * sender thread keeps full, and an interactive connection on which the
+ * main thread bounces a small message every -i milliseconds.  The
+ * interactive RTT is measured once with the link idle and once with the
+ * bulk flow running, and the ratio is reported as the RTT inflation the
+ * bulk flow causes by building a queue in front of the interactive one.
+ *
+ * Meant to be run over a delayed link, see run_tsq_tests which puts a
+ * netem qdisc on lo and toggles tcp_limit_output_bytes and tcp_pacing.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define MSG_SIZE	64
+#define BULK_CHUNK	65536
+
+static int port = 12866;
+static int seconds = 10;
+static int interval_ms = 10;
+static volatile int stop;
+static unsigned long long bulk_bytes;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static void set_nodelay(int fd)
+{
+	int one = 1;
+
+	if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)))
+		die("setsockopt TCP_NODELAY");
+}
+
+static void *bulk_sink(void *arg)
+{
+	int fd = (long)arg;
+	char buf[BULK_CHUNK];
+
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+	close(fd);
+	return NULL;
+}
+
+static void *echo(void *arg)
+{
+	int fd = (long)arg;
+	char buf[MSG_SIZE];
+	ssize_t n;
+
+	set_nodelay(fd);
+	while ((n = read(fd, buf, sizeof(buf))) > 0)
+		if (write(fd, buf, n) != n)
+			break;
+	close(fd);
+	return NULL;
+}
+
+static void *bulk_sender(void *arg)
+{
+	int fd = (long)arg;
+	static char buf[BULK_CHUNK];
+	ssize_t n;
+
+	while (!stop) {
+		n = write(fd, buf, sizeof(buf));
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (stop)
+				break;
+			die("write bulk");
+		}
+		bulk_bytes += n;
+	}
+	return NULL;
+}
+
+static int listen_on(void)
+{
+	struct sockaddr_in sin;
+	int fd, one = 1;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		die("socket");
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(port);
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(fd, (struct sockaddr *)&sin, sizeof(sin)))
+		die("bind");
+	if (listen(fd, 2))
+		die("listen");
+	return fd;
+}
+
+static int connect_to(void)
+{
+	struct sockaddr_in sin;
+	int fd;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		die("socket");
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(port);
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(fd, (struct sockaddr *)&sin, sizeof(sin)))
+		die("connect");
+	return fd;
+}
+
+/* Accept one connection and serve it from a detached thread */
+static void serve(int lfd, void *(*fn)(void *))
+{
+	pthread_t thread;
+	int fd;
+
+	fd = accept(lfd, NULL, NULL);
+	if (fd < 0)
+		die("accept");
+	if (pthread_create(&thread, NULL, fn, (void *)(long)fd))
+		die("pthread_create");
+	pthread_detach(thread);
+}
+
+/* Bounce messages for @secs seconds, returns the average RTT in ns */
+static unsigned long long ping(int fd, int secs, const char *what)
+{
+	struct timespec gap = { 0, interval_ms * 1000000L };
+	unsigned long long t, d, end, min = ~0ULL, max = 0, sum = 0;
+	char buf[MSG_SIZE];
+	int i, n;
+
+	memset(buf, 0, sizeof(buf));
+	end = now_ns() + secs * 1000000000ULL;
+	for (i = 0; now_ns() < end; i++) {
+		t = now_ns();
+		if (write(fd, buf, sizeof(buf)) != sizeof(buf))
+			die("write ping");
+		for (n = 0; n < MSG_SIZE; ) {
+			int r = read(fd, buf + n, sizeof(buf) - n);
+
+			if (r <= 0)
+				die("read ping");
+			n += r;
+		}
+		d = now_ns() - t;
+		sum += d;
+		if (d < min)
+			min = d;
+		if (d > max)
+			max = d;
+		nanosleep(&gap, NULL);
+	}
+
+	if (!i)
+		return 0;
+	printf("%s rtt: %d samples min %llu avg %llu max %llu us\n",
+	       what, i, min / 1000, sum / i / 1000, max / 1000);
+	return sum / i;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long idle, loaded, start, end;
+	pthread_t thread;
+	int opt, lfd, pfd, bfd;
+
+	while ((opt = getopt(argc, argv, "p:t:i:")) != -1) {
+		switch (opt) {
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 'i':
+			interval_ms = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-p port] [-t seconds] "
+				"[-i interval_ms]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (port < 1 || seconds < 2 || interval_ms < 1 || interval_ms > 999) {
+		fprintf(stderr, "bad arguments\n");
+		return 1;
+	}
+
+	/* the bulk sender sees EPIPE once it is shut down */
+	signal(SIGPIPE, SIG_IGN);
+	lfd = listen_on();
+	pfd = connect_to();
+	serve(lfd, echo);
+	bfd = connect_to();
+	serve(lfd, bulk_sink);
+	set_nodelay(pfd);
+
+	idle = ping(pfd, seconds / 2, "idle");
+
+	stop = 0;
+	if (pthread_create(&thread, NULL, bulk_sender, (void *)(long)bfd))
+		die("pthread_create");
+	start = now_ns();
+	loaded = ping(pfd, seconds, "loaded");
+	end = now_ns();
+	stop = 1;
+	shutdown(bfd, SHUT_RDWR);
+	pthread_join(thread, NULL);
+
+	printf("bulk: %llu kbit/s\n",
+	       bulk_bytes * 8 * 1000000ULL / (end - start));
+	if (idle)
+		printf("rtt inflation: %.2fx\n", (double)loaded / idle);
+
+	close(pfd);
+	close(bfd);
+	close(lfd);
+	return 0;
+}